@@ -0,0 +1,664 @@
+//
+//  main.cpp
+//  FramebufferDecoder
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Decodes gPlatformInformationList of Intel framebuffer kexts into a table or JSON, e.g.:
+//   FramebufferDecoder -json AppleIntelSKLGraphicsFramebuffer.kext builds/
+// Directories are searched for AppleIntel framebuffer binaries, which are processed in parallel.
+// This is a command-line counterpart of Manual/IntelFramebuffer.bt built on the kext structures.
+
+#include "../WhateverGreen/kern_fb.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define SYSLOG(str, ...) fprintf(stderr, "FramebufferDecoder: " str "\n", ## __VA_ARGS__)
+
+/**
+ *  Minimal Mach-O definitions, host systems may have no mach-o headers
+ */
+namespace MachO {
+	static constexpr uint32_t Magic64 {0xFEEDFACF};
+	static constexpr uint32_t FatMagic {0xCAFEBABE};
+	static constexpr uint32_t CpuTypeX8664 {0x01000007};
+	static constexpr uint32_t CmdSymtab {0x2};
+	static constexpr uint32_t CmdSegment64 {0x19};
+	static constexpr uint8_t TypeStab {0xE0};
+
+	struct Header64 {
+		uint32_t magic;
+		uint32_t cputype;
+		uint32_t cpusubtype;
+		uint32_t filetype;
+		uint32_t ncmds;
+		uint32_t sizeofcmds;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	struct LoadCommand {
+		uint32_t cmd;
+		uint32_t cmdsize;
+	};
+
+	struct Segment64 {
+		uint32_t cmd;
+		uint32_t cmdsize;
+		char segname[16];
+		uint64_t vmaddr;
+		uint64_t vmsize;
+		uint64_t fileoff;
+		uint64_t filesize;
+		uint32_t maxprot;
+		uint32_t initprot;
+		uint32_t nsects;
+		uint32_t flags;
+	};
+
+	struct Symtab {
+		uint32_t cmd;
+		uint32_t cmdsize;
+		uint32_t symoff;
+		uint32_t nsyms;
+		uint32_t stroff;
+		uint32_t strsize;
+	};
+
+	struct Nlist64 {
+		uint32_t strx;
+		uint8_t type;
+		uint8_t sect;
+		uint16_t desc;
+		uint64_t value;
+	};
+
+	/* Fat headers are big endian */
+	struct FatHeader {
+		uint32_t magic;
+		uint32_t nfatArch;
+	};
+
+	struct FatArch {
+		uint32_t cputype;
+		uint32_t cpusubtype;
+		uint32_t offset;
+		uint32_t size;
+		uint32_t align;
+	};
+}
+
+/**
+ *  Maximum amount of decoded platforms per kext
+ */
+static constexpr size_t MaxPlatforms {128};
+
+/**
+ *  Maximum model name length
+ */
+static constexpr size_t MaxModelName {128};
+
+/**
+ *  Framebuffer generations with distinct record layouts
+ */
+enum class Generation {
+	Unknown,
+	SandyBridge,
+	IvyBridge,
+	Haswell,
+	Broadwell,
+	Skylake,
+	CoffeeLake
+};
+
+static const char *generationName(Generation gen) {
+	switch (gen) {
+		case Generation::SandyBridge: return "SNB";
+		case Generation::IvyBridge:   return "IVB";
+		case Generation::Haswell:     return "HSW";
+		case Generation::Broadwell:   return "BDW";
+		case Generation::Skylake:     return "SKL";
+		case Generation::CoffeeLake:  return "CFL";
+		default:                      return "Unknown";
+	}
+}
+
+/**
+ *  Mapped Mach-O image
+ */
+class Image {
+	const uint8_t *data {nullptr};
+	size_t size {0};
+
+	template <typename T>
+	const T *read(uint64_t off) const {
+		if (off > size || sizeof(T) > size - off)
+			return nullptr;
+		return reinterpret_cast<const T *>(data + off);
+	}
+
+public:
+	/**
+	 *  Select x86_64 Mach-O image from the file
+	 *
+	 *  @param file      file contents
+	 *  @param fileSize  file size
+	 *
+	 *  @return true on success
+	 */
+	bool init(const uint8_t *file, size_t fileSize) {
+		data = file;
+		size = fileSize;
+
+		auto fat = read<MachO::FatHeader>(0);
+		if (fat && __builtin_bswap32(fat->magic) == MachO::FatMagic) {
+			uint32_t num = __builtin_bswap32(fat->nfatArch);
+			for (uint32_t i = 0; i < num; i++) {
+				auto arch = read<MachO::FatArch>(sizeof(MachO::FatHeader) + i * sizeof(MachO::FatArch));
+				if (!arch)
+					return false;
+				uint32_t off = __builtin_bswap32(arch->offset), len = __builtin_bswap32(arch->size);
+				if (__builtin_bswap32(arch->cputype) == MachO::CpuTypeX8664 && off <= fileSize && len <= fileSize - off) {
+					data = file + off;
+					size = len;
+					break;
+				}
+			}
+		}
+
+		auto header = read<MachO::Header64>(0);
+		return header && header->magic == MachO::Magic64;
+	}
+
+	/**
+	 *  Iterate load commands
+	 *
+	 *  @param callback  called with each load command offset, returns false to stop
+	 */
+	template <typename F>
+	void forEachCommand(F callback) const {
+		auto header = read<MachO::Header64>(0);
+		uint64_t off = sizeof(MachO::Header64);
+		for (uint32_t i = 0; header && i < header->ncmds; i++) {
+			auto cmd = read<MachO::LoadCommand>(off);
+			if (!cmd || cmd->cmdsize < sizeof(MachO::LoadCommand) || !callback(*cmd, off))
+				return;
+			off += cmd->cmdsize;
+		}
+	}
+
+	/**
+	 *  Translate virtual address to file data
+	 *
+	 *  @param address  virtual address
+	 *  @param length   amount of bytes needed
+	 *
+	 *  @return pointer to the data or nullptr
+	 */
+	const uint8_t *resolve(uint64_t address, size_t length) const {
+		const uint8_t *r = nullptr;
+		forEachCommand([&](const MachO::LoadCommand &cmd, uint64_t off) {
+			if (cmd.cmd != MachO::CmdSegment64)
+				return true;
+			auto seg = read<MachO::Segment64>(off);
+			if (!seg || address < seg->vmaddr || address - seg->vmaddr >= seg->filesize || length > seg->filesize - (address - seg->vmaddr))
+				return true;
+			uint64_t fileoff = seg->fileoff + (address - seg->vmaddr);
+			if (fileoff <= size && length <= size - fileoff)
+				r = data + fileoff;
+			return false;
+		});
+		return r;
+	}
+
+	/**
+	 *  Find symbol address in the symbol table
+	 *
+	 *  @param name     symbol name
+	 *  @param address  symbol address
+	 *
+	 *  @return true on success
+	 */
+	bool findSymbol(const char *name, uint64_t &address) const {
+		bool found = false;
+		size_t nameLen = strlen(name);
+		forEachCommand([&](const MachO::LoadCommand &cmd, uint64_t off) {
+			if (cmd.cmd != MachO::CmdSymtab)
+				return true;
+			auto symtab = read<MachO::Symtab>(off);
+			if (!symtab || symtab->stroff > size || symtab->strsize > size - symtab->stroff)
+				return false;
+			for (uint32_t i = 0; i < symtab->nsyms; i++) {
+				auto sym = read<MachO::Nlist64>(symtab->symoff + static_cast<uint64_t>(i) * sizeof(MachO::Nlist64));
+				if (!sym)
+					break;
+				if ((sym->type & MachO::TypeStab) || sym->strx >= symtab->strsize || symtab->strsize - sym->strx <= nameLen)
+					continue;
+				auto str = reinterpret_cast<const char *>(data + symtab->stroff + sym->strx);
+				if (!memcmp(str, name, nameLen + 1)) {
+					address = sym->value;
+					found = true;
+					break;
+				}
+			}
+			return false;
+		});
+		return found;
+	}
+};
+
+/**
+ *  Generation independent platform description
+ */
+struct Platform {
+	uint32_t framebufferId {0};
+	uint8_t mobile {0};
+	uint8_t pipeCount {0};
+	uint8_t portCount {0};
+	uint8_t fbMemoryCount {0};
+	uint32_t stolenMemorySize {0};
+	uint32_t framebufferMemorySize {0};
+	uint32_t unifiedMemorySize {0};
+	bool hasBacklight {false};
+	uint32_t backlightFrequency {0};
+	uint32_t backlightMax {0};
+	bool hasFlags {false};
+	uint32_t flags {0};
+	bool hasCamelia {false};
+	uint32_t cameliaVersion {0};
+	std::string modelName;
+	ConnectorInfo connectors[MaxFramebufferConnectorCount] {};
+};
+
+/**
+ *  Decoding result for a single kext binary
+ */
+struct Result {
+	std::string path;
+	std::string error;
+	Generation generation {Generation::Unknown};
+	std::vector<Platform> platforms;
+};
+
+template <typename T>
+static void decodeCommon(const T &fb, Platform &p) {
+	p.mobile = fb.fMobile;
+	p.pipeCount = fb.fPipeCount;
+	p.portCount = fb.fPortCount;
+	p.fbMemoryCount = fb.fFBMemoryCount;
+	memcpy(p.connectors, fb.connectors, sizeof(p.connectors));
+}
+
+template <typename T>
+static void decodeMemory(const T &fb, Platform &p) {
+	p.framebufferId = fb.framebufferId;
+	p.stolenMemorySize = fb.fStolenMemorySize;
+	p.framebufferMemorySize = fb.fFramebufferMemorySize;
+	p.unifiedMemorySize = fb.fUnifiedMemorySize;
+}
+
+template <typename T>
+static void decodeBacklight(const T &fb, Platform &p) {
+	p.hasBacklight = true;
+	p.backlightFrequency = fb.fBacklightFrequency;
+	p.backlightMax = fb.fBacklightMax;
+}
+
+template <typename T>
+static void decodeFlags(const T &fb, Platform &p) {
+	p.hasFlags = true;
+	p.flags = fb.flags.value;
+	p.hasCamelia = true;
+	p.cameliaVersion = fb.cameliaVersion;
+}
+
+static void decodeModelName(const Image &image, uint64_t address, Platform &p) {
+	for (size_t i = 0; address && i < MaxModelName; i++) {
+		auto c = image.resolve(address + i, 1);
+		if (!c || *c == '\0')
+			break;
+		p.modelName.push_back(static_cast<char>(*c));
+	}
+}
+
+static void decode(const Image &, const FramebufferSNB &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeBacklight(fb, p);
+}
+
+static void decode(const Image &, const FramebufferIVB &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeMemory(fb, p);
+	decodeBacklight(fb, p);
+}
+
+static void decode(const Image &, const FramebufferHSW &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeMemory(fb, p);
+	decodeBacklight(fb, p);
+	decodeFlags(fb, p);
+}
+
+static void decode(const Image &, const FramebufferBDW &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeMemory(fb, p);
+	decodeBacklight(fb, p);
+	decodeFlags(fb, p);
+}
+
+static void decode(const Image &image, const FramebufferSKL &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeMemory(fb, p);
+	decodeBacklight(fb, p);
+	decodeFlags(fb, p);
+	decodeModelName(image, fb.fModelNameAddr, p);
+}
+
+static void decode(const Image &image, const FramebufferCFL &fb, Platform &p) {
+	decodeCommon(fb, p);
+	decodeMemory(fb, p);
+	decodeFlags(fb, p);
+	decodeModelName(image, fb.fModelNameAddr, p);
+}
+
+template <typename T>
+static void decodeList(const Image &image, uint64_t address, std::vector<Platform> &platforms) {
+	// The list is terminated by a record with -1 framebuffer id.
+	for (size_t i = 0; i < MaxPlatforms; i++) {
+		auto ptr = image.resolve(address + i * sizeof(T), sizeof(T));
+		if (!ptr)
+			break;
+
+		T fb;
+		memcpy(&fb, ptr, sizeof(T));
+		if (fb.framebufferId == 0xFFFFFFFF)
+			break;
+
+		platforms.emplace_back();
+		decode(image, fb, platforms.back());
+	}
+}
+
+template <>
+void decodeList<FramebufferSNB>(const Image &image, uint64_t address, std::vector<Platform> &platforms) {
+	// There is no terminator on Sandy Bridge, the records are matched by position.
+	for (size_t i = 0; i < sizeof(SandyPlatformId) / sizeof(SandyPlatformId[0]); i++) {
+		auto ptr = image.resolve(address + i * sizeof(FramebufferSNB), sizeof(FramebufferSNB));
+		if (!ptr)
+			break;
+		if (SandyPlatformId[i] == 0xFFFFFFFF)
+			continue;
+
+		FramebufferSNB fb;
+		memcpy(&fb, ptr, sizeof(fb));
+		platforms.emplace_back();
+		decode(image, fb, platforms.back());
+		platforms.back().framebufferId = SandyPlatformId[i];
+	}
+}
+
+static Generation detectGeneration(const std::string &path, const uint8_t *list) {
+	auto slash = path.rfind('/');
+	auto name = path.substr(slash != std::string::npos ? slash + 1 : 0);
+	if (name.find("SNB") != std::string::npos) return Generation::SandyBridge;
+	if (name.find("Capri") != std::string::npos) return Generation::IvyBridge;
+	if (name.find("Azul") != std::string::npos) return Generation::Haswell;
+	if (name.find("BDW") != std::string::npos) return Generation::Broadwell;
+	if (name.find("SKL") != std::string::npos || name.find("KBL") != std::string::npos) return Generation::Skylake;
+	if (name.find("CFL") != std::string::npos) return Generation::CoffeeLake;
+
+	// Renamed binaries are recognised by the first platform like IntelFramebuffer.bt does.
+	uint32_t first = 0;
+	if (list)
+		memcpy(&first, list, sizeof(first));
+	switch (first) {
+		case 0x00040201: return Generation::SandyBridge;
+		case 0x01660000: return Generation::IvyBridge;
+		case 0x0C060000: return Generation::Haswell;
+		case 0x16060000: return Generation::Broadwell;
+		case 0x191E0000: case 0x591E0000: return Generation::Skylake;
+		case 0x3EA50009: return Generation::CoffeeLake;
+		default: return Generation::Unknown;
+	}
+}
+
+static void decodeFile(Result &result) {
+	int fd = open(result.path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+		result.error = "failed to open";
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	size_t fileSize = static_cast<size_t>(st.st_size);
+	auto file = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED) {
+		result.error = "failed to map";
+		return;
+	}
+
+	Image image;
+	uint64_t address = 0;
+	if (!image.init(static_cast<const uint8_t *>(file), fileSize)) {
+		result.error = "not an x86_64 Mach-O binary";
+	} else if (!image.findSymbol("_gPlatformInformationList", address)) {
+		result.error = "no _gPlatformInformationList symbol";
+	} else {
+		result.generation = detectGeneration(result.path, image.resolve(address, sizeof(uint32_t)));
+		switch (result.generation) {
+			case Generation::SandyBridge: decodeList<FramebufferSNB>(image, address, result.platforms); break;
+			case Generation::IvyBridge:   decodeList<FramebufferIVB>(image, address, result.platforms); break;
+			case Generation::Haswell:     decodeList<FramebufferHSW>(image, address, result.platforms); break;
+			case Generation::Broadwell:   decodeList<FramebufferBDW>(image, address, result.platforms); break;
+			case Generation::Skylake:     decodeList<FramebufferSKL>(image, address, result.platforms); break;
+			case Generation::CoffeeLake:  decodeList<FramebufferCFL>(image, address, result.platforms); break;
+			default: result.error = "unknown framebuffer generation"; break;
+		}
+	}
+
+	munmap(file, fileSize);
+}
+
+static const char *connectorTypeName(uint32_t type) {
+	switch (type) {
+		case ConnectorZero:       return "Zero";
+		case ConnectorDummy:      return "Dummy";
+		case ConnectorLVDS:       return "LVDS";
+		case ConnectorDigitalDVI: return "DigitalDVI";
+		case ConnectorSVID:       return "SVID";
+		case ConnectorVGA:        return "VGA";
+		case ConnectorDP:         return "DP";
+		case ConnectorHDMI:       return "HDMI";
+		case ConnectorAnalogDVI:  return "AnalogDVI";
+		default:                  return "Unknown";
+	}
+}
+
+static std::string bytesToPrintable(uint32_t bytes) {
+	char out[32];
+	if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0)
+		snprintf(out, sizeof(out), "%u MB", bytes / (1024 * 1024));
+	else if (bytes >= 1024 && bytes % 1024 == 0)
+		snprintf(out, sizeof(out), "%u KB", bytes / 1024);
+	else
+		snprintf(out, sizeof(out), "%u bytes", bytes);
+	return out;
+}
+
+static std::string jsonString(const std::string &str) {
+	std::string out = "\"";
+	for (auto c : str) {
+		if (c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back(c);
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char tmp[8];
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+			out += tmp;
+		} else {
+			out.push_back(c);
+		}
+	}
+	return out + "\"";
+}
+
+static void printTable(const Result &result) {
+	if (!result.error.empty()) {
+		printf("%s: %s\n\n", result.path.c_str(), result.error.c_str());
+		return;
+	}
+
+	printf("%s: %s, %zu platforms\n", result.path.c_str(), generationName(result.generation), result.platforms.size());
+	for (auto &p : result.platforms) {
+		printf("  0x%08X mobile %u, pipes %u, ports %u, memory count %u, stolen %s, fbmem %s, vram %s",
+			   p.framebufferId, p.mobile, p.pipeCount, p.portCount, p.fbMemoryCount, bytesToPrintable(p.stolenMemorySize).c_str(),
+			   bytesToPrintable(p.framebufferMemorySize).c_str(), bytesToPrintable(p.unifiedMemorySize).c_str());
+		if (p.hasFlags)
+			printf(", flags 0x%08X, camelia %u", p.flags, p.cameliaVersion);
+		if (p.hasBacklight)
+			printf(", backlight %u/%u", p.backlightFrequency, p.backlightMax);
+		printf("\n");
+		if (!p.modelName.empty())
+			printf("    model %s\n", p.modelName.c_str());
+		for (auto &con : p.connectors) {
+			printf("    [%d] busId 0x%02X, pipe %u, type 0x%08X %s, flags 0x%08X\n", con.index, con.busId, con.pipe,
+				   static_cast<uint32_t>(con.type), connectorTypeName(con.type), con.flags.value);
+		}
+	}
+	printf("\n");
+}
+
+static void printJson(const Result &result, bool last) {
+	printf("  {\n    \"path\": %s,\n", jsonString(result.path).c_str());
+	if (!result.error.empty()) {
+		printf("    \"error\": %s\n  }%s\n", jsonString(result.error).c_str(), last ? "" : ",");
+		return;
+	}
+
+	printf("    \"generation\": \"%s\",\n    \"platforms\": [\n", generationName(result.generation));
+	for (size_t i = 0; i < result.platforms.size(); i++) {
+		auto &p = result.platforms[i];
+		printf("      {\"framebufferId\": \"0x%08X\", \"mobile\": %u, \"pipeCount\": %u, \"portCount\": %u, \"fbMemoryCount\": %u, "
+			   "\"stolenMemorySize\": %u, \"framebufferMemorySize\": %u, \"unifiedMemorySize\": %u",
+			   p.framebufferId, p.mobile, p.pipeCount, p.portCount, p.fbMemoryCount, p.stolenMemorySize,
+			   p.framebufferMemorySize, p.unifiedMemorySize);
+		if (p.hasFlags)
+			printf(", \"flags\": \"0x%08X\", \"cameliaVersion\": %u", p.flags, p.cameliaVersion);
+		if (p.hasBacklight)
+			printf(", \"backlightFrequency\": %u, \"backlightMax\": %u", p.backlightFrequency, p.backlightMax);
+		if (!p.modelName.empty())
+			printf(", \"modelName\": %s", jsonString(p.modelName).c_str());
+		printf(", \"connectors\": [");
+		for (size_t j = 0; j < MaxFramebufferConnectorCount; j++) {
+			auto &con = p.connectors[j];
+			printf("%s{\"index\": %d, \"busId\": %u, \"pipe\": %u, \"type\": \"%s\", \"flags\": \"0x%08X\"}", j ? ", " : "",
+				   con.index, con.busId, con.pipe, connectorTypeName(con.type), con.flags.value);
+		}
+		printf("]}%s\n", i + 1 < result.platforms.size() ? "," : "");
+	}
+	printf("    ]\n  }%s\n", last ? "" : ",");
+}
+
+static bool isFramebufferBinary(const std::string &name) {
+	// E.g. AppleIntelSNBGraphicsFB, AppleIntelFramebufferAzul, AppleIntelSKLGraphicsFramebuffer.
+	return name.compare(0, strlen("AppleIntel"), "AppleIntel") == 0 && name.find('.') == std::string::npos &&
+		(name.find("Framebuffer") != std::string::npos || name.find("FB") != std::string::npos);
+}
+
+static void collectKexts(const std::string &path, bool explicitPath, std::vector<Result> &results) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		SYSLOG("failed to access %s", path.c_str());
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		auto slash = path.rfind('/');
+		if (explicitPath || isFramebufferBinary(path.substr(slash != std::string::npos ? slash + 1 : 0))) {
+			results.emplace_back();
+			results.back().path = path;
+		}
+		return;
+	}
+
+	auto dir = opendir(path.c_str());
+	if (!dir) {
+		SYSLOG("failed to open %s", path.c_str());
+		return;
+	}
+
+	std::vector<std::string> names;
+	while (auto entry = readdir(dir)) {
+		if (entry->d_name[0] != '.')
+			names.emplace_back(entry->d_name);
+	}
+	closedir(dir);
+
+	// Keep the output stable regardless of directory order.
+	std::sort(names.begin(), names.end());
+	for (auto &name : names)
+		collectKexts(path + "/" + name, false, results);
+}
+
+int main(int argc, char *argv[]) {
+	bool json = false;
+	std::vector<Result> results;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-json"))
+			json = true;
+		else
+			collectKexts(argv[i], true, results);
+	}
+
+	if (results.empty()) {
+		fprintf(stderr, "Usage: %s [-json] kext|binary|directory...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Binaries are independent, so they are simply distributed across the workers.
+	std::atomic<size_t> next {0};
+	auto worker = [&]() {
+		for (size_t i = next++; i < results.size(); i = next++)
+			decodeFile(results[i]);
+	};
+
+	size_t threadNum = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), results.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadNum; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto &thread : threads)
+		thread.join();
+
+	bool success = true;
+	if (json)
+		printf("[\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		if (json)
+			printJson(results[i], i + 1 == results.size());
+		else
+			printTable(results[i]);
+		success = success && results[i].error.empty();
+	}
+	if (json)
+		printf("]\n");
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
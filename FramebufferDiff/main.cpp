@@ -0,0 +1,157 @@
+//
+//  main.cpp
+//  FramebufferDiff
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Decodes weg-framebuffer-diff property into a list of Intel framebuffer changes for review.
+// The property could be passed either as a raw binary dump or as ioreg output, e.g.:
+//   ioreg -l -w0 -p IOService -n WhateverGreen | FramebufferDiff
+
+#include "../WhateverGreen/kern_fbdiff.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#define SYSLOG(str, ...) fprintf(stderr, "FramebufferDiff: " str "\n", ## __VA_ARGS__)
+
+static bool readInput(const char *path, std::string &data) {
+	if (path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	} else {
+		data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+	}
+
+	return true;
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool decodeText(const std::string &text, std::string &data) {
+	// Prefer the property value from ioreg output, otherwise treat the whole input as hex.
+	size_t start = 0, end = text.size();
+	auto prop = text.find("weg-framebuffer-diff");
+	if (prop != std::string::npos) {
+		start = text.find('<', prop);
+		end = start != std::string::npos ? text.find('>', start) : std::string::npos;
+		if (end == std::string::npos)
+			return false;
+		start++;
+	}
+
+	data.clear();
+	int high = -1;
+	for (size_t i = start; i < end; i++) {
+		int v = hexValue(text[i]);
+		if (v < 0) {
+			if (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r' || text[i] == '<' || text[i] == '>')
+				continue;
+			return false;
+		}
+
+		if (high < 0) {
+			high = v;
+		} else {
+			data.push_back(static_cast<char>(high << 4 | v));
+			high = -1;
+		}
+	}
+
+	return high < 0;
+}
+
+static void printBytes(const uint8_t *bytes, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		printf("%02X", bytes[i]);
+}
+
+static bool printDiff(const std::string &data) {
+	FramebufferDiff::Header header;
+	if (data.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != FramebufferDiff::Magic || header.version != FramebufferDiff::Version) {
+		SYSLOG("unsupported diff magic %08X version %u", header.magic, header.version);
+		return false;
+	}
+
+	if (header.stride > 0)
+		printf("%u changes, %u byte records\n", header.count, header.stride);
+	else
+		printf("%u changes, records are not indexed\n", header.count);
+	printf("%-12s %-8s %-12s %5s  %s\n", "framebuffer", "offset", "record", "size", "original -> patched");
+
+	auto bytes = reinterpret_cast<const uint8_t *>(data.data());
+	size_t pos = sizeof(header);
+	for (uint32_t i = 0; i < header.count; i++) {
+		FramebufferDiff::Entry entry;
+		if (data.size() - pos < sizeof(entry)) {
+			SYSLOG("diff is truncated at entry %u", i);
+			return false;
+		}
+
+		memcpy(&entry, &bytes[pos], sizeof(entry));
+		if (entry.size > (data.size() - pos - sizeof(entry)) / 2) {
+			SYSLOG("diff is truncated at entry %u", i);
+			return false;
+		}
+
+		char record[16] = "-";
+		if (header.stride > 0)
+			snprintf(record, sizeof(record), "%u+0x%X", entry.offset / header.stride, entry.offset % header.stride);
+		if (entry.framebufferId)
+			printf("0x%08X   0x%04X   %-12s %5u  ", entry.framebufferId, entry.offset, record, entry.size);
+		else
+			printf("%-12s 0x%04X   %-12s %5u  ", "-", entry.offset, record, entry.size);
+
+		auto original = &bytes[pos + sizeof(entry)];
+		printBytes(original, entry.size);
+		printf(" -> ");
+		printBytes(original + entry.size, entry.size);
+		printf("\n");
+
+		pos += FramebufferDiff::entrySize(entry);
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+		SYSLOG("usage: %s [diff.bin | ioreg.txt]", argv[0]);
+		return 1;
+	}
+
+	std::string input;
+	if (!readInput(argc == 2 ? argv[1] : nullptr, input)) {
+		SYSLOG("failed to read %s", argv[1]);
+		return 1;
+	}
+
+	std::string data;
+	uint32_t magic = 0;
+	if (input.size() >= sizeof(magic))
+		memcpy(&magic, input.data(), sizeof(magic));
+	if (magic == FramebufferDiff::Magic) {
+		data.swap(input);
+	} else if (!decodeText(input, data)) {
+		SYSLOG("input is neither a binary diff nor a hex dump");
+		return 1;
+	}
+
+	return printDiff(data) ? 0 : 1;
+}
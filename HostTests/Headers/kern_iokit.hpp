@@ -0,0 +1,45 @@
+//
+//  kern_iokit.hpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_iokit_hpp
+#define kern_iokit_hpp
+
+// Host stand-in for the Lilu IOKit helpers used by the checked kext sources.
+
+#include <Library/LegacyIOService.h>
+
+namespace WIOKit {
+	/**
+	 *  PCI Config registers
+	 */
+	enum PCIRegister : uint8_t {
+		kIOPCIConfigVendorID = 0x00,
+		kIOPCIConfigDeviceID = 0x02
+	};
+
+	/**
+	 *  PCI Config readers
+	 */
+	using t_PCIConfigRead16 = uint16_t (*)(IORegistryEntry *service, uint32_t space, uint8_t offset);
+	using t_PCIConfigRead32 = uint32_t (*)(IORegistryEntry *service, uint32_t space, uint8_t offset);
+
+	template <typename T>
+	inline bool getOSDataValue(const OSObject *obj, const char *, T &value) {
+		auto data = OSDynamicCast(OSData, const_cast<OSObject *>(obj));
+		if (!data || data->getLength() != sizeof(T))
+			return false;
+		memcpy(&value, data->getBytesNoCopy(), sizeof(T));
+		return true;
+	}
+
+	template <typename T>
+	inline bool getOSDataValue(IORegistryEntry *sect, const char *name, T &value) {
+		return getOSDataValue(sect->getProperty(name), name, value);
+	}
+}
+
+#endif /* kern_iokit_hpp */
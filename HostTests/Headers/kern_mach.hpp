@@ -0,0 +1,23 @@
+//
+//  kern_mach.hpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_mach_hpp
+#define kern_mach_hpp
+
+#include <Headers/kern_util.hpp>
+
+struct IOSimpleLock;
+
+/**
+ *  Write protection backend, every check provides its own implementation
+ */
+class MachInfo {
+public:
+	static kern_return_t setKernelWriting(bool enable, IOSimpleLock *lock);
+};
+
+#endif /* kern_mach_hpp */
@@ -0,0 +1,107 @@
+//
+//  kern_patcher.hpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_patcher_hpp
+#define kern_patcher_hpp
+
+#include <Headers/kern_mach.hpp>
+#include <mach/vm_types.h>
+
+/**
+ *  Host stand-in for the patcher, symbols are solved through a callback and routes are only counted
+ */
+class KernelPatcher {
+public:
+	static constexpr IOSimpleLock *kernelWriteLock {nullptr};
+
+	enum Error {
+		NoError,
+		NoSymbolFound,
+		MemoryIssue
+	};
+
+	struct KextInfo {
+		const char *id;
+	};
+
+	struct LookupPatch {
+		KextInfo *kext;
+		const uint8_t *find;
+		const uint8_t *replace;
+		size_t size;
+		size_t count;
+	};
+
+	struct RouteRequest {
+		const char *symbol {nullptr};
+		mach_vm_address_t to {0};
+		mach_vm_address_t *org {nullptr};
+		mach_vm_address_t from {0};
+
+		template <typename T>
+		RouteRequest(const char *s, T t, mach_vm_address_t &o) :
+			symbol(s), to(reinterpret_cast<mach_vm_address_t>(t)), org(&o) {}
+
+		template <typename T>
+		RouteRequest(const char *s, T t) : symbol(s), to(reinterpret_cast<mach_vm_address_t>(t)) {}
+	};
+
+	/**
+	 *  Symbol resolver used by solveSymbol and routeMultiple
+	 */
+	mach_vm_address_t (*resolver)(const char *symbol) {nullptr};
+
+	/**
+	 *  Amount of performed calls
+	 */
+	size_t solveCalls {0};
+	size_t routeFunctionCalls {0};
+	size_t routeMultipleCalls {0};
+	size_t routedFunctions {0};
+
+	mach_vm_address_t solveSymbol(size_t, const char *symbol, mach_vm_address_t, size_t) {
+		solveCalls++;
+		auto value = resolver ? resolver(symbol) : 0;
+		if (!value)
+			error = Error::NoSymbolFound;
+		return value;
+	}
+
+	mach_vm_address_t routeFunction(mach_vm_address_t from, mach_vm_address_t to, bool) {
+		routeFunctionCalls++;
+		routedFunctions++;
+		return from ^ to;
+	}
+
+	bool routeMultiple(size_t id, RouteRequest *requests, size_t num, mach_vm_address_t start, size_t size) {
+		routeMultipleCalls++;
+		for (size_t i = 0; i < num; i++) {
+			auto &request = requests[i];
+			if (!request.from)
+				request.from = solveSymbol(id, request.symbol, start, size);
+			if (!request.from)
+				return false;
+			routedFunctions++;
+			if (request.org)
+				*request.org = request.from ^ request.to;
+		}
+		return true;
+	}
+
+	Error getError() {
+		return error;
+	}
+
+	void clearError() {
+		error = Error::NoError;
+	}
+
+private:
+	Error error {Error::NoError};
+};
+
+#endif /* kern_patcher_hpp */
@@ -0,0 +1,57 @@
+//
+//  kern_util.hpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_util_hpp
+#define kern_util_hpp
+
+// Host stand-in for the Lilu utilities used by the checked kext sources.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PACKED __attribute__((packed))
+
+#define SYSLOG(mod, str, ...) fprintf(stderr, "%s: " str "\n", mod, ## __VA_ARGS__)
+#define DBGLOG(mod, str, ...) do { } while (0)
+
+#define lilu_os_memcpy memcpy
+#define lilu_os_memset memset
+
+typedef int kern_return_t;
+#define KERN_SUCCESS 0
+#define KERN_FAILURE 5
+
+template <typename T, size_t N>
+constexpr size_t arrsize(const T (&)[N]) {
+	return N;
+}
+
+namespace Buffer {
+	template <typename T>
+	inline T *create(size_t size) {
+		return static_cast<T *>(malloc(sizeof(T) * size));
+	}
+
+	template <typename T>
+	inline bool resize(T *&buf, size_t size) {
+		auto nbuf = static_cast<T *>(realloc(buf, sizeof(T) * size));
+		if (!nbuf)
+			return false;
+		buf = nbuf;
+		return true;
+	}
+
+	template <typename T>
+	inline void deleter(T *ptr) {
+		free(ptr);
+	}
+}
+
+#endif /* kern_util_hpp */
@@ -0,0 +1,15 @@
+//
+//  IODeviceTreeSupport.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef IODeviceTreeSupport_h
+#define IODeviceTreeSupport_h
+
+#include <Library/LegacyIOService.h>
+
+static const IORegistryPlane *gIODTPlane = nullptr;
+
+#endif /* IODeviceTreeSupport_h */
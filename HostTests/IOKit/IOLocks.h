@@ -0,0 +1,31 @@
+//
+//  IOLocks.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef IOLocks_h
+#define IOLocks_h
+
+#include <mutex>
+
+typedef std::mutex IOLock;
+
+inline IOLock *IOLockAlloc() {
+	return new std::mutex;
+}
+
+inline void IOLockFree(IOLock *lock) {
+	delete lock;
+}
+
+inline void IOLockLock(IOLock *lock) {
+	lock->lock();
+}
+
+inline void IOLockUnlock(IOLock *lock) {
+	lock->unlock();
+}
+
+#endif /* IOLocks_h */
@@ -0,0 +1,37 @@
+//
+//  IOGraphicsTypes.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef IOGraphicsTypes_h
+#define IOGraphicsTypes_h
+
+#include <stdint.h>
+
+typedef int32_t IOIndex;
+typedef int32_t IODisplayModeID;
+typedef uint32_t IOPixelAperture;
+typedef char IOPixelEncoding[64];
+
+enum {
+	kIOFBSystemAperture = 0
+};
+
+struct IOPixelInformation {
+	uint32_t bytesPerRow;
+	uint32_t bytesPerPlane;
+	uint32_t bitsPerPixel;
+	uint32_t pixelType;
+	uint32_t componentCount;
+	uint32_t bitsPerComponent;
+	uint32_t componentMasks[8 * 2];
+	IOPixelEncoding pixelFormat;
+	uint32_t flags;
+	uint32_t activeWidth;
+	uint32_t activeHeight;
+	uint32_t reserved[2];
+};
+
+#endif /* IOGraphicsTypes_h */
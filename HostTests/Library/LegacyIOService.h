@@ -0,0 +1,270 @@
+//
+//  LegacyIOService.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef LegacyIOService_h
+#define LegacyIOService_h
+
+// Host stand-in for the IOKit registry objects used by the checked kext sources.
+// The only registry path is NVRAM (/options), which counts its writes, other entries are created directly.
+// Dictionaries keep key order and look keys up linearly, just like OSDictionary.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+	kMillisecondScale = 1000 * 1000
+};
+
+class OSObject {
+public:
+	virtual ~OSObject() {}
+
+	void retain() {
+		refs++;
+	}
+
+	void release() {
+		if (--refs == 0)
+			delete this;
+	}
+
+private:
+	int refs {1};
+};
+
+#define OSDynamicCast(type, inst) dynamic_cast<type *>(static_cast<OSObject *>(inst))
+
+class OSData : public OSObject {
+public:
+	static OSData *withCapacity(unsigned capacity) {
+		auto data = new OSData;
+		data->bytes.reserve(capacity);
+		return data;
+	}
+
+	static OSData *withBytes(const void *bytes, unsigned length) {
+		auto data = withCapacity(length);
+		data->appendBytes(bytes, length);
+		return data;
+	}
+
+	bool appendBytes(const void *data, unsigned length) {
+		auto start = static_cast<const uint8_t *>(data);
+		bytes.insert(bytes.end(), start, start + length);
+		return true;
+	}
+
+	const void *getBytesNoCopy() const {
+		return bytes.data();
+	}
+
+	unsigned getLength() const {
+		return static_cast<unsigned>(bytes.size());
+	}
+
+private:
+	std::vector<uint8_t> bytes;
+};
+
+class OSSymbol : public OSObject {
+public:
+	static const OSSymbol *withCString(const char *str) {
+		auto symbol = new OSSymbol;
+		symbol->string = str;
+		return symbol;
+	}
+
+	const char *getCStringNoCopy() const {
+		return string.c_str();
+	}
+
+	unsigned getLength() const {
+		return static_cast<unsigned>(string.size());
+	}
+
+private:
+	std::string string;
+};
+
+class OSBoolean : public OSObject {
+public:
+	/**
+	 *  Shared booleans, never freed
+	 */
+	static OSBoolean *shared(bool value) {
+		static auto trueValue = new OSBoolean;
+		static auto falseValue = new OSBoolean;
+		return value ? trueValue : falseValue;
+	}
+};
+
+#define kOSBooleanTrue OSBoolean::shared(true)
+#define kOSBooleanFalse OSBoolean::shared(false)
+
+class OSDictionary : public OSObject {
+public:
+	~OSDictionary() {
+		for (auto &entry : entries) {
+			const_cast<OSSymbol *>(entry.first)->release();
+			entry.second->release();
+		}
+	}
+
+	static OSDictionary *withCapacity(unsigned capacity) {
+		auto dict = new OSDictionary;
+		dict->entries.reserve(capacity);
+		return dict;
+	}
+
+	/**
+	 *  Symbols are not interned, so keys with equal names are replaced
+	 */
+	bool setObject(const char *key, OSObject *value) {
+		value->retain();
+		for (auto &entry : entries) {
+			if (!strcmp(entry.first->getCStringNoCopy(), key)) {
+				entry.second->release();
+				entry.second = value;
+				return true;
+			}
+		}
+		entries.emplace_back(OSSymbol::withCString(key), value);
+		return true;
+	}
+
+	bool merge(const OSDictionary *dict) {
+		for (auto &entry : dict->entries)
+			setObject(entry.first->getCStringNoCopy(), entry.second);
+		return true;
+	}
+
+	OSObject *getObject(const char *key) const {
+		for (auto &entry : entries) {
+			if (!strcmp(entry.first->getCStringNoCopy(), key))
+				return entry.second;
+		}
+		return nullptr;
+	}
+
+	OSObject *getObject(const OSSymbol *key) const {
+		for (auto &entry : entries) {
+			if (entry.first == key)
+				return entry.second;
+		}
+		return nullptr;
+	}
+
+	unsigned getCount() const {
+		return static_cast<unsigned>(entries.size());
+	}
+
+	const OSSymbol *getKey(unsigned index) const {
+		return index < entries.size() ? entries[index].first : nullptr;
+	}
+
+private:
+	std::vector<std::pair<const OSSymbol *, OSObject *>> entries;
+};
+
+class OSCollectionIterator : public OSObject {
+public:
+	static OSCollectionIterator *withCollection(const OSDictionary *dict) {
+		auto iterator = new OSCollectionIterator;
+		iterator->dict = dict;
+		return iterator;
+	}
+
+	OSObject *getNextObject() {
+		return const_cast<OSSymbol *>(dict->getKey(next++));
+	}
+
+private:
+	const OSDictionary *dict {nullptr};
+	unsigned next {0};
+};
+
+struct IORegistryPlane;
+
+class IORegistryEntry : public OSObject {
+public:
+	static IORegistryEntry *fromPath(const char *path, const IORegistryPlane *) {
+		auto &nvram = options();
+		if (!nvramAvailable() || strcmp(path, "/options") != 0)
+			return nullptr;
+		nvram.retain();
+		return &nvram;
+	}
+
+	OSObject *getProperty(const char *key) const {
+		auto it = properties.find(key);
+		return it != properties.end() ? it->second : nullptr;
+	}
+
+	bool setProperty(const char *key, OSObject *value) {
+		writes++;
+		value->retain();
+		auto &slot = properties[key];
+		if (slot)
+			slot->release();
+		slot = value;
+		return true;
+	}
+
+	/**
+	 *  Names are properties looked up on every call, like IORegistryEntry::getName does
+	 */
+	const char *getName() const {
+		auto name = OSDynamicCast(const OSSymbol, getProperty("IOName"));
+		return name ? name->getCStringNoCopy() : nullptr;
+	}
+
+	void setName(const char *name) {
+		auto symbol = const_cast<OSSymbol *>(OSSymbol::withCString(name));
+		auto &slot = properties["IOName"];
+		if (slot)
+			slot->release();
+		slot = symbol;
+	}
+
+	void removeProperty(const char *key) {
+		auto it = properties.find(key);
+		if (it != properties.end()) {
+			it->second->release();
+			properties.erase(it);
+		}
+	}
+
+	/**
+	 *  Fake NVRAM entry, never freed
+	 */
+	static IORegistryEntry &options() {
+		static auto entry = new IORegistryEntry;
+		return *entry;
+	}
+
+	/**
+	 *  Fake NVRAM presence
+	 */
+	static bool &nvramAvailable() {
+		static bool available {true};
+		return available;
+	}
+
+	/**
+	 *  Amount of setProperty calls
+	 */
+	size_t writes {0};
+
+private:
+	std::map<std::string, OSObject *> properties;
+};
+
+#endif /* LegacyIOService_h */
@@ -0,0 +1,512 @@
+//
+//  atom.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// AtomObjectParser checks, fuzzing and benchmark on a synthetic VBIOS image, e.g.:
+//   HostTests/build.tool Sapphire.R9.280X.rom
+// Dumped Radeon ROM arguments are fuzzed and benchmarked as well, other files are skipped.
+// Connector handling specialised on the layout is compared against the union branching it replaced.
+
+#include "check.hpp"
+#include <Headers/kern_util.hpp>
+#include "../WhateverGreen/kern_con.hpp"
+
+#include <fcntl.h>
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ *  Synthetic VBIOS layout
+ */
+static constexpr size_t RomSize {0x1000};
+static constexpr size_t RomHeader {0x100};
+static constexpr size_t MasterDataTable {0x200};
+static constexpr size_t ObjectHeader {0x400};
+static constexpr size_t DisplayPathTable {0x10};
+static constexpr size_t ConnectorTable {0x80};
+static constexpr size_t RecordArea {0x100};
+
+/**
+ *  Synthetic connectors
+ */
+static constexpr struct {
+	uint8_t connector;
+	uint16_t encoder;
+	uint8_t i2cId;
+} Connectors[] {
+	{CONNECTOR_OBJECT_ID_DISPLAYPORT,     ENCODER_OBJECT_ID_INTERNAL_UNIPHY,  0x90},
+	{CONNECTOR_OBJECT_ID_HDMI_TYPE_A,     ENCODER_OBJECT_ID_INTERNAL_UNIPHY1 | 0x100, 0x92},
+	{CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_D, ENCODER_OBJECT_ID_INTERNAL_UNIPHY2 | 0x200, 0x94},
+	{CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_I, ENCODER_OBJECT_ID_INTERNAL_UNIPHY, 0x95}
+};
+
+static void write16(std::vector<uint8_t> &rom, size_t off, uint16_t value) {
+	rom[off] = static_cast<uint8_t>(value);
+	rom[off + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+/**
+ *  Build a VBIOS image with display paths and connector objects with HPD and I2C records
+ */
+static std::vector<uint8_t> makeRom() {
+	std::vector<uint8_t> rom(RomSize);
+	rom[0] = 0x55;
+	rom[1] = 0xAA;
+	write16(rom, AtomObjectParser::RomHeaderPointer, RomHeader);
+	memcpy(&rom[RomHeader + AtomObjectParser::RomHeaderSignature], "ATOM", 4);
+	write16(rom, RomHeader + AtomObjectParser::RomHeaderMasterDataTable, MasterDataTable);
+	write16(rom, MasterDataTable + sizeof(AtomCommonTableHeader) + AtomObjectParser::ObjectHeaderIndex * sizeof(uint16_t), ObjectHeader);
+
+	write16(rom, ObjectHeader + offsetof(AtomObjectHeader, usConnectorObjectTableOffset), ConnectorTable);
+	write16(rom, ObjectHeader + offsetof(AtomObjectHeader, usEncoderObjectTableOffset), ConnectorTable);
+	write16(rom, ObjectHeader + offsetof(AtomObjectHeader, usRouterObjectTableOffset), ConnectorTable);
+	write16(rom, ObjectHeader + offsetof(AtomObjectHeader, usDisplayPathTableOffset), DisplayPathTable);
+
+	size_t path = ObjectHeader + DisplayPathTable;
+	rom[path] = arrsize(Connectors);
+	path += sizeof(AtomDisplayObjectPathTableHeader);
+	size_t table = ObjectHeader + ConnectorTable;
+	rom[table] = arrsize(Connectors);
+	table += sizeof(AtomObjectTableHeader);
+	size_t record = RecordArea;
+
+	for (size_t i = 0; i < arrsize(Connectors); i++) {
+		// Every other path carries an extra graphic object, making the path sizes vary.
+		uint16_t pathSize = sizeof(AtomDisplayObjectPath) + (i % 2) * sizeof(uint16_t);
+		uint16_t connectorId = static_cast<uint16_t>((GRAPH_OBJECT_TYPE_CONNECTOR << OBJECT_TYPE_SHIFT) | Connectors[i].connector);
+		write16(rom, path + offsetof(AtomDisplayObjectPath, usSize), pathSize);
+		write16(rom, path + offsetof(AtomDisplayObjectPath, usConnObjectId), connectorId);
+		write16(rom, path + offsetof(AtomDisplayObjectPath, usGraphicObjIds),
+				static_cast<uint16_t>((GRAPH_OBJECT_TYPE_ENCODER << OBJECT_TYPE_SHIFT) | Connectors[i].encoder));
+		path += pathSize;
+
+		write16(rom, table + offsetof(AtomConnectorObject, usObjectID), connectorId);
+		write16(rom, table + offsetof(AtomConnectorObject, usRecordOffset), static_cast<uint16_t>(record));
+		table += sizeof(AtomConnectorObject);
+
+		// HPD record goes first, so that I2C lookup walks the list.
+		uint8_t *r = &rom[ObjectHeader + record];
+		r[0] = static_cast<uint8_t>(AtomRecordType::HPD);
+		r[1] = sizeof(AtomHPDRecord);
+		r += sizeof(AtomHPDRecord);
+		r[0] = static_cast<uint8_t>(AtomRecordType::I2C);
+		r[1] = sizeof(AtomI2CRecord);
+		r[2] = Connectors[i].i2cId;
+		r += sizeof(AtomI2CRecord);
+		r[0] = static_cast<uint8_t>(AtomRecordType::Max);
+		record += 0x10;
+	}
+
+	return rom;
+}
+
+/**
+ *  Walk everything the kext reads through the parser and check that it stays within the image
+ *
+ *  @param rom   image
+ *  @param size  image size
+ *
+ *  @return amount of display paths with a sense id
+ */
+static size_t exercise(const uint8_t *rom, size_t size) {
+	auto inside = [rom, size](const void *ptr, size_t len) {
+		auto p = static_cast<const uint8_t *>(ptr);
+		return p >= rom && p <= rom + size && len <= static_cast<size_t>(rom + size - p);
+	};
+
+	AtomObjectParser parser;
+	if (!parser.initWithRom(rom, size))
+		return 0;
+
+	const AtomDisplayObjectPath *paths[AtomObjectParser::MaxDisplayPaths];
+	size_t pathNum = parser.getDisplayPaths(paths, arrsize(paths));
+	for (size_t i = 0; i < pathNum; i++)
+		CHECK(inside(paths[i], paths[i]->usSize));
+
+	size_t sensed = 0;
+	for (auto type : {AtomObjectTableType::ConnectorObject, AtomObjectTableType::EncoderObject, AtomObjectTableType::RouterObject}) {
+		const AtomConnectorObject *objects = nullptr;
+		size_t num = parser.getObjects(type, objects);
+		CHECK(num == 0 || inside(objects, num * sizeof(AtomConnectorObject)));
+		for (size_t i = 0; i < num; i++) {
+			auto i2c = parser.getRecord<AtomI2CRecord>(objects[i], AtomRecordType::I2C);
+			CHECK(!i2c || (inside(i2c, i2c->sheader.ucRecordSize) && i2c->sheader.ucRecordSize >= sizeof(AtomI2CRecord)));
+			auto hpd = parser.getRecord<AtomHPDRecord>(objects[i], AtomRecordType::HPD);
+			CHECK(!hpd || (inside(hpd, hpd->sheader.ucRecordSize) && hpd->sheader.ucRecordSize >= sizeof(AtomHPDRecord)));
+			if (type == AtomObjectTableType::ConnectorObject && i < pathNum && parser.getSenseID(objects[i]))
+				sensed++;
+		}
+	}
+
+	RADConnectors::ModernConnector connectors[6] {};
+	for (size_t i = 0; i < arrsize(connectors); i++) {
+		connectors[i].sense = static_cast<uint8_t>(i + 1);
+		connectors[i].transmitter = static_cast<uint8_t>(i);
+	}
+	CHECK(RADConnectors::autocorrectConnectors(parser, connectors, arrsize(connectors)) <= arrsize(connectors));
+
+	return sensed;
+}
+
+static void checkRom() {
+	auto rom = makeRom();
+	GuardedImage guarded(rom.size());
+	auto image = guarded.place(rom.data(), rom.size());
+
+	AtomObjectParser parser;
+	CHECK(parser.initWithRom(image, rom.size()));
+	const AtomDisplayObjectPath *paths[AtomObjectParser::MaxDisplayPaths];
+	CHECK(parser.getDisplayPaths(paths, arrsize(paths)) == arrsize(Connectors));
+	CHECK(parser.getDisplayPaths(paths, 2) == 2);
+
+	const AtomConnectorObject *objects = nullptr;
+	CHECK(parser.getObjects(AtomObjectTableType::ConnectorObject, objects) == arrsize(Connectors));
+	CHECK(parser.getObjects(AtomObjectTableType::Common, objects) == 0 && !objects);
+	CHECK(parser.getObjects(AtomObjectTableType::ConnectorObject, objects) == arrsize(Connectors));
+	for (size_t i = 0; i < arrsize(Connectors); i++) {
+		CHECK(getConnectorID(paths[i]->usConnObjectId) == Connectors[i].connector);
+		CHECK(parser.getSenseID(objects[i]) == (Connectors[i].i2cId & 0xF) + 1);
+		CHECK(parser.getRecord<AtomHPDRecord>(objects[i], AtomRecordType::HPD) != nullptr);
+	}
+
+	// The single link DVI transmitter of the third connector is corrected.
+	RADConnectors::ModernConnector connectors[arrsize(Connectors)] {};
+	for (size_t i = 0; i < arrsize(Connectors); i++)
+		connectors[i].sense = static_cast<uint8_t>((Connectors[i].i2cId & 0xF) + 1);
+	connectors[2].transmitter = 0x02;
+	CHECK(RADConnectors::autocorrectConnectors(parser, connectors, arrsize(connectors)) == 2);
+	CHECK(connectors[2].transmitter == 0x22);
+
+	// Truncated images are rejected or parsed in bounds.
+	for (size_t size = 0; size <= rom.size(); size++)
+		exercise(guarded.place(rom.data(), size), size);
+	CHECK(exercise(guarded.place(rom.data(), rom.size()), rom.size()) == arrsize(Connectors));
+
+	// The object header alone is bounded by its own size.
+	CHECK(!parser.initWithObjectHeader(nullptr));
+	CHECK(!parser.initWithObjectHeader(image + rom.size() - 8, 8));
+	CHECK(parser.initWithObjectHeader(image + ObjectHeader, rom.size() - ObjectHeader));
+	CHECK(parser.getDisplayPaths(paths, arrsize(paths)) == arrsize(Connectors));
+
+	// Endless and empty record lists.
+	auto broken = rom;
+	broken[ObjectHeader + RecordArea + 1] = 0;
+	CHECK(exercise(guarded.place(broken.data(), broken.size()), broken.size()) == arrsize(Connectors) - 1);
+	broken = rom;
+	broken[ObjectHeader + RecordArea + 1] = 0xFF;
+	CHECK(exercise(guarded.place(broken.data(), broken.size()), broken.size()) == arrsize(Connectors) - 1);
+}
+
+/**
+ *  Mutate an image around its ATOM structures and parse it
+ *
+ *  @param seed    valid image
+ *  @param rounds  amount of mutated images
+ *  @param hot     hot areas of the image, the structures mutations are biased to
+ */
+static void fuzz(const std::vector<uint8_t> &seed, size_t rounds, const std::vector<std::pair<size_t, size_t>> &hot) {
+	GuardedImage guarded(seed.size());
+	std::mt19937 rng(1);
+	auto rom = seed;
+	size_t sensed = 0;
+	for (size_t round = 0; round < rounds; round++) {
+		memcpy(rom.data(), seed.data(), seed.size());
+		size_t mutations = 1 + rng() % 8;
+		for (size_t i = 0; i < mutations; i++) {
+			auto &area = hot[rng() % hot.size()];
+			size_t off = area.first + rng() % area.second;
+			if (off + 1 >= rom.size())
+				continue;
+			switch (rng() % 4) {
+				case 0:
+					rom[off] = static_cast<uint8_t>(rng());
+					break;
+				case 1:
+					rom[off] ^= static_cast<uint8_t>(1 << (rng() % 8));
+					break;
+				case 2:
+					// Offsets and sizes pointing close to the image end.
+					write16(rom, off, static_cast<uint16_t>(rom.size() - rng() % 32));
+					break;
+				default:
+					write16(rom, off, static_cast<uint16_t>(rng() % 0x10000));
+					break;
+			}
+		}
+
+		size_t size = rng() % 4 == 0 ? rng() % (rom.size() + 1) : rom.size();
+		sensed += exercise(guarded.place(rom.data(), size), size) > 0;
+	}
+	printf("  %zu of %zu mutated images still have sensed connectors\n", sensed, rounds);
+}
+
+/**
+ *  Hot areas of an image: ROM header, master data table, object header and everything after it
+ */
+static std::vector<std::pair<size_t, size_t>> hotAreas(const std::vector<uint8_t> &rom) {
+	std::vector<std::pair<size_t, size_t>> hot {{AtomObjectParser::RomHeaderPointer, 2}};
+	size_t romHeader = rom[AtomObjectParser::RomHeaderPointer] | (rom[AtomObjectParser::RomHeaderPointer + 1] << 8);
+	hot.emplace_back(romHeader, 0x24);
+	size_t masterData = rom[romHeader + AtomObjectParser::RomHeaderMasterDataTable] | (rom[romHeader + AtomObjectParser::RomHeaderMasterDataTable + 1] << 8);
+	hot.emplace_back(masterData, 0x40);
+	size_t objectOff = masterData + sizeof(AtomCommonTableHeader) + AtomObjectParser::ObjectHeaderIndex * sizeof(uint16_t);
+	size_t objectHeader = rom[objectOff] | (rom[objectOff + 1] << 8);
+	hot.emplace_back(objectHeader, sizeof(AtomObjectHeader));
+	hot.emplace_back(objectHeader, rom.size() - objectHeader < 0x400 ? rom.size() - objectHeader : 0x400);
+	return hot;
+}
+
+/**
+ *  Connector copy branching on both layouts for every connector, as RADConnectors::copy did before
+ */
+static void referenceCopy(RADConnectors::Connector *out, uint8_t num, const RADConnectors::Connector *in, uint32_t size, bool outModern) {
+	bool inModern = size % sizeof(RADConnectors::ModernConnector) == 0 && size / sizeof(RADConnectors::ModernConnector) == num;
+
+	for (uint8_t i = 0; i < num; i++) {
+		if (outModern) {
+			if (inModern)
+				RADConnectors::Connector::assign((&out->modern)[i], (&in->modern)[i]);
+			else
+				RADConnectors::Connector::assign((&out->modern)[i], (&in->legacy)[i]);
+		} else {
+			if (inModern)
+				RADConnectors::Connector::assign((&out->legacy)[i], (&in->modern)[i]);
+			else
+				RADConnectors::Connector::assign((&out->legacy)[i], (&in->legacy)[i]);
+		}
+	}
+}
+
+/**
+ *  Transmitter correction branching on the layout, as RAD::autocorrectConnector did before with -raddvi
+ */
+static void referenceAutocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, RADConnectors::Connector *connectors, uint8_t sz, bool isModern) {
+	if (connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_I &&
+		connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_D &&
+		connector != CONNECTOR_OBJECT_ID_LVDS)
+		return;
+
+	auto fixTransmit = [](auto &con, uint8_t sense, uint8_t txmit) {
+		if (con.sense == sense) {
+			if (con.transmitter != txmit && (con.transmitter & 0xCF) == con.transmitter)
+				con.transmitter = txmit;
+			return true;
+		}
+		return false;
+	};
+
+	for (uint8_t j = 0; j < sz; j++) {
+		if (isModern) {
+			if (fixTransmit((&connectors->modern)[j], sense, txmit))
+				break;
+		} else {
+			if (fixTransmit((&connectors->legacy)[j], sense, txmit))
+				break;
+		}
+	}
+}
+
+/**
+ *  Display path walk of RAD::autocorrectConnectors before, reading the tables through the parser
+ */
+static void referenceAutocorrectConnectors(const AtomObjectParser &parser, RADConnectors::Connector *connectors, uint8_t sz, bool isModern) {
+	const AtomDisplayObjectPath *displayPaths[AtomObjectParser::MaxDisplayPaths];
+	const AtomConnectorObject *connectorObjects = nullptr;
+	size_t displayPathNum = parser.getDisplayPaths(displayPaths, arrsize(displayPaths));
+	size_t connectorObjectNum = parser.getObjects(AtomObjectTableType::ConnectorObject, connectorObjects);
+	if (displayPathNum != connectorObjectNum)
+		return;
+
+	for (uint8_t i = 0; i < displayPathNum; i++) {
+		if (!isEncoder(displayPaths[i]->usGraphicObjIds))
+			continue;
+
+		uint8_t txmit = 0, enc = 0;
+		if (!getTxEnc(displayPaths[i]->usGraphicObjIds, txmit, enc))
+			continue;
+
+		uint8_t sense = parser.getSenseID(connectorObjects[i]);
+		if (!sense)
+			continue;
+
+		referenceAutocorrectConnector(getConnectorID(displayPaths[i]->usConnObjectId), sense, txmit, connectors, sz, isModern);
+	}
+}
+
+/**
+ *  Priority assignment branching on the layout for every connector, as RAD::reprioritiseConnectors did before
+ */
+static void referenceReprioritiseConnectors(const uint8_t *senseList, uint8_t senseNum, RADConnectors::Connector *connectors, uint8_t sz, bool isModern) {
+	static constexpr uint32_t typeList[] {
+		RADConnectors::ConnectorLVDS,
+		RADConnectors::ConnectorDigitalDVI,
+		RADConnectors::ConnectorHDMI,
+		RADConnectors::ConnectorDP,
+		RADConnectors::ConnectorVGA
+	};
+	static constexpr uint8_t typeNum {static_cast<uint8_t>(arrsize(typeList))};
+
+	uint16_t priCount = 1;
+	for (uint8_t i = 0; i < senseNum + typeNum + 1; i++) {
+		for (uint8_t j = 0; j < sz; j++) {
+			auto reorder = [&](auto &con) {
+				if (i == senseNum + typeNum) {
+					if (con.priority == 0)
+						con.priority = priCount++;
+				} else if (i < senseNum) {
+					if (con.sense == senseList[i]) {
+						con.priority = priCount++;
+						return true;
+					}
+				} else {
+					if (con.priority == 0 && con.type == typeList[i-senseNum])
+						con.priority = priCount++;
+				}
+				return false;
+			};
+
+			if ((isModern && reorder((&connectors->modern)[j])) ||
+				(!isModern && reorder((&connectors->legacy)[j])))
+				break;
+		}
+	}
+}
+
+/**
+ *  Run the specialised connector pipeline on the typed array, like RAD::updateConnectorsInfo does
+ */
+template <typename T>
+static void specialisedPipeline(const AtomObjectParser &parser, const uint8_t *senseList, uint8_t senseNum,
+								RADConnectors::Connector *out, uint8_t num, const RADConnectors::Connector *in, uint32_t size) {
+	auto connectors = reinterpret_cast<T *>(out);
+	RADConnectors::copy(connectors, num, in, size);
+	RADConnectors::autocorrectConnectors(parser, connectors, num);
+	RADConnectors::reprioritiseConnectors(senseList, senseNum, connectors, num);
+}
+
+static void checkLayouts() {
+	static constexpr uint32_t types[] {
+		RADConnectors::ConnectorLVDS, RADConnectors::ConnectorDigitalDVI, RADConnectors::ConnectorSVID, RADConnectors::ConnectorVGA,
+		RADConnectors::ConnectorDP, RADConnectors::ConnectorHDMI, RADConnectors::ConnectorAnalogDVI, 0x1234
+	};
+	static constexpr uint8_t transmitters[] {0x00, 0x01, 0x02, 0x10, 0x11, 0x20, 0x22, 0x30, 0xFF};
+	static constexpr size_t MaxConnectors {8};
+
+	auto seed = makeRom();
+	auto hot = hotAreas(seed);
+	std::mt19937 rng(1);
+	size_t corrected = 0;
+
+	// Both output layouts, both source sizes, every connector count, on intact and mutated images.
+	for (size_t round = 0; round < 20000; round++) {
+		auto rom = seed;
+		if (round % 2) {
+			auto &area = hot[rng() % hot.size()];
+			rom[area.first + rng() % area.second] = static_cast<uint8_t>(rng());
+		}
+		AtomObjectParser parser;
+		parser.initWithRom(rom.data(), rom.size());
+
+		bool outModern = rng() % 2;
+		bool inModern = rng() % 2;
+		uint8_t num = static_cast<uint8_t>(1 + rng() % MaxConnectors);
+		uint32_t size = num * static_cast<uint32_t>(inModern ? sizeof(RADConnectors::ModernConnector) : sizeof(RADConnectors::LegacyConnector));
+		CHECK(RADConnectors::valid(size, num));
+
+		RADConnectors::Connector in[MaxConnectors];
+		auto bytes = reinterpret_cast<uint8_t *>(in);
+		for (size_t i = 0; i < sizeof(in); i++)
+			bytes[i] = static_cast<uint8_t>(rng());
+
+		// Mostly plausible fields, so that corrections and every priority rule happen.
+		for (uint8_t i = 0; i < num; i++) {
+			auto assign = [&](auto &con) {
+				con.type = types[rng() % arrsize(types)];
+				con.priority = rng() % 3 ? 0 : static_cast<uint16_t>(rng());
+				con.transmitter = transmitters[rng() % arrsize(transmitters)];
+				con.sense = static_cast<uint8_t>(rng() % 8);
+			};
+			if (inModern)
+				assign((&in->modern)[i]);
+			else
+				assign((&in->legacy)[i]);
+		}
+
+		uint8_t senseList[4];
+		uint8_t senseNum = static_cast<uint8_t>(rng() % (arrsize(senseList) + 1));
+		for (auto &sense : senseList)
+			sense = static_cast<uint8_t>(rng() % 8);
+
+		RADConnectors::Connector reference[MaxConnectors], specialised[MaxConnectors];
+		for (size_t i = 0; i < sizeof(reference); i++)
+			reinterpret_cast<uint8_t *>(reference)[i] = static_cast<uint8_t>(rng());
+		memcpy(specialised, reference, sizeof(reference));
+
+		referenceCopy(reference, num, in, size, outModern);
+		if (outModern)
+			specialisedPipeline<RADConnectors::ModernConnector>(parser, senseList, senseNum, specialised, num, in, size);
+		else
+			specialisedPipeline<RADConnectors::LegacyConnector>(parser, senseList, senseNum, specialised, num, in, size);
+
+		RADConnectors::Connector copied[MaxConnectors];
+		memcpy(copied, reference, sizeof(copied));
+		referenceAutocorrectConnectors(parser, reference, num, outModern);
+		corrected += memcmp(copied, reference, sizeof(copied)) != 0;
+		referenceReprioritiseConnectors(senseList, senseNum, reference, num, outModern);
+
+		CHECK(memcmp(reference, specialised, sizeof(reference)) == 0);
+	}
+
+	printf("  %zu of 20000 connector sets corrected, legacy and modern layouts compared\n", corrected);
+}
+
+static void benchRom(const char *name, const std::vector<uint8_t> &rom) {
+	printf("%s, %zu bytes\n", name, rom.size());
+	volatile size_t sum = 0;
+	benchmark("parse paths, objects, records", 100000, [&]() {
+		sum = sum + exercise(rom.data(), rom.size());
+	});
+}
+
+static void checkFile(const char *path) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+		fprintf(stderr, "failed to open %s\n", path);
+		checkFailures++;
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	std::vector<uint8_t> rom(static_cast<size_t>(st.st_size));
+	bool complete = read(fd, rom.data(), rom.size()) == static_cast<ssize_t>(rom.size());
+	close(fd);
+
+	AtomObjectParser parser;
+	if (!complete || !parser.initWithRom(rom.data(), rom.size())) {
+		printf("%s: not an ATOM VBIOS, skipped\n", path);
+		return;
+	}
+
+	benchRom(path, rom);
+	fuzz(rom, 20000, hotAreas(rom));
+}
+
+int main(int argc, char *argv[]) {
+	checkRom();
+	checkLayouts();
+	auto rom = makeRom();
+	benchRom("synthetic VBIOS", rom);
+	fuzz(rom, 200000, hotAreas(rom));
+
+	for (int i = 1; i < argc; i++)
+		checkFile(argv[i]);
+
+	return finishChecks();
+}
@@ -0,0 +1,96 @@
+//
+//  check.hpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef check_hpp
+#define check_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ *  Amount of failed checks in this program
+ */
+static size_t checkFailures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		checkFailures++; \
+	} \
+} while (0)
+
+/**
+ *  Measure average function run time
+ *
+ *  @param name    printed benchmark name
+ *  @param rounds  amount of runs
+ *  @param func    benchmarked function
+ *
+ *  @return average time in microseconds
+ */
+template <typename F>
+static double benchmark(const char *name, size_t rounds, F func) {
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < rounds; i++)
+		func();
+	std::chrono::duration<double, std::micro> spent = std::chrono::steady_clock::now() - start;
+	double avg = spent.count() / rounds;
+	printf("  %-48s %10.2f us\n", name, avg);
+	return avg;
+}
+
+/**
+ *  Data copy placed right before an inaccessible page, so that any overread faults
+ */
+class GuardedImage {
+public:
+	explicit GuardedImage(size_t capacity) {
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		mapSize = (capacity + page - 1) / page * page + page;
+		map = static_cast<uint8_t *>(mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (map == MAP_FAILED || mprotect(map + mapSize - page, page, PROT_NONE) != 0)
+			abort();
+		end = map + mapSize - page;
+	}
+
+	GuardedImage(const GuardedImage &) = delete;
+	GuardedImage &operator =(const GuardedImage &) = delete;
+
+	~GuardedImage() {
+		munmap(map, mapSize);
+	}
+
+	const uint8_t *place(const uint8_t *data, size_t size) {
+		memcpy(end - size, data, size);
+		return end - size;
+	}
+
+private:
+	uint8_t *map {nullptr};
+	uint8_t *end {nullptr};
+	size_t mapSize {0};
+};
+
+/**
+ *  Report check results
+ *
+ *  @return process exit code
+ */
+static int finishChecks() {
+	if (checkFailures > 0) {
+		fprintf(stderr, "%zu checks failed\n", checkFailures);
+		return 1;
+	}
+	return 0;
+}
+
+#endif /* check_hpp */
@@ -0,0 +1,182 @@
+//
+//  devid.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// IGPU device-id cache checks and PCI Config read benchmark over mocked original readers.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_devid.cpp"
+
+#include <random>
+#include <vector>
+
+/**
+ *  Real IGPU and faked device-ids
+ */
+static constexpr uint16_t RealDevice {0x5912};
+static constexpr uint16_t FakeDevice {0x591B};
+static constexpr uint16_t VendorIntel {0x8086};
+
+/**
+ *  Mocked PCI Config space, the register value is derived from the device, space and offset
+ */
+static IORegistryEntry *igpuEntry;
+static size_t originalReads;
+
+static uint16_t orgRead16(IORegistryEntry *service, uint32_t space, uint8_t offset) {
+	originalReads++;
+	if (service == igpuEntry && offset == WIOKit::kIOPCIConfigDeviceID)
+		return RealDevice;
+	return static_cast<uint16_t>(reinterpret_cast<uintptr_t>(service) ^ space ^ offset);
+}
+
+static uint32_t orgRead32(IORegistryEntry *service, uint32_t space, uint8_t offset) {
+	originalReads++;
+	if (service == igpuEntry && offset == WIOKit::kIOPCIConfigVendorID)
+		return VendorIntel | (RealDevice << 16);
+	return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(service) ^ space ^ offset);
+}
+
+static void setDeviceId(IORegistryEntry *entry, uint32_t device) {
+	auto data = OSData::withBytes(&device, sizeof(device));
+	entry->setProperty("device-id", data);
+	data->release();
+}
+
+/**
+ *  Create a PCI device with a device-id property
+ */
+static IORegistryEntry *makeDevice(const char *name, uint32_t device) {
+	auto entry = new IORegistryEntry;
+	entry->setName(name);
+	setDeviceId(entry, device);
+	return entry;
+}
+
+static void checkCache() {
+	auto gfx = makeDevice("GFX0", 0x67DF);
+	igpuEntry = makeDevice("IGPU", FakeDevice);
+
+	DeviceIdCache cache;
+	uint32_t device = 0;
+	CHECK(!cache.get(igpuEntry, device) && !cache.get(nullptr, device));
+	CHECK(cache.store(igpuEntry));
+
+	// Only the device-id of the cached service is faked.
+	CHECK(cache.read16(igpuEntry, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16) == FakeDevice);
+	CHECK(cache.read32(igpuEntry, 0, WIOKit::kIOPCIConfigVendorID, orgRead32) == (VendorIntel | (FakeDevice << 16)));
+	CHECK(cache.read16(igpuEntry, 0, 0x2C, orgRead16) == orgRead16(igpuEntry, 0, 0x2C));
+	CHECK(cache.read16(gfx, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16) == orgRead16(gfx, 0, WIOKit::kIOPCIConfigDeviceID));
+	CHECK(cache.read32(gfx, 0, WIOKit::kIOPCIConfigVendorID, orgRead32) == orgRead32(gfx, 0, WIOKit::kIOPCIConfigVendorID));
+	CHECK(cache.read16(nullptr, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16) == orgRead16(nullptr, 0, WIOKit::kIOPCIConfigDeviceID));
+
+	// The hardware is always read once, even when the result is replaced.
+	size_t reads = originalReads;
+	cache.read16(igpuEntry, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16);
+	cache.read32(gfx, 0, WIOKit::kIOPCIConfigVendorID, orgRead32);
+	CHECK(originalReads == reads + 2);
+
+	// A replaced property is never reported stale.
+	setDeviceId(igpuEntry, 0x5917);
+	CHECK(cache.get(igpuEntry, device) && device == 0x5917);
+	CHECK(cache.read16(igpuEntry, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16) == 0x5917);
+
+	// The real device-id is passed through.
+	setDeviceId(igpuEntry, RealDevice);
+	CHECK(cache.store(igpuEntry));
+	CHECK(cache.read16(igpuEntry, 0, WIOKit::kIOPCIConfigDeviceID, orgRead16) == RealDevice);
+
+	// Malformed properties are not cached.
+	auto bad = new IORegistryEntry;
+	uint16_t shortId = FakeDevice;
+	auto data = OSData::withBytes(&shortId, sizeof(shortId));
+	bad->setProperty("device-id", data);
+	data->release();
+	CHECK(!cache.store(bad));
+	CHECK(cache.get(igpuEntry, device) && device == RealDevice);
+
+	cache.release();
+	CHECK(!cache.get(igpuEntry, device));
+	bad->release();
+	gfx->release();
+	igpuEntry->release();
+	igpuEntry = nullptr;
+}
+
+/**
+ *  Wrapper lookup before the cache, name compare and device-id property lookup per IGPU read
+ */
+static uint16_t lookupRead16(IORegistryEntry *service, uint32_t space, uint8_t offset) {
+	auto result = orgRead16(service, space, offset);
+	if (offset == WIOKit::kIOPCIConfigDeviceID && service != nullptr) {
+		auto name = service->getName();
+		if (name && name[0] == 'I' && name[1] == 'G' && name[2] == 'P' && name[3] == 'U') {
+			uint32_t device;
+			if (WIOKit::getOSDataValue(service, "device-id", device) && device != result)
+				return device;
+		}
+	}
+
+	return result;
+}
+
+static void benchReads() {
+	// A typical machine with a few dozen PCI devices, all sharing the wrapped vtable.
+	std::vector<IORegistryEntry *> devices;
+	const char *names[] {"PXSX", "XHC", "SATA", "HDEF", "RP01", "GFX0", "LPCB", "SBUS", "ARPT", "PEG0"};
+	for (size_t i = 0; i < 30; i++)
+		devices.push_back(makeDevice(names[i % arrsize(names)], static_cast<uint32_t>(0x1000 + i)));
+	igpuEntry = makeDevice("IGPU", FakeDevice);
+	devices.push_back(igpuEntry);
+
+	// Most reads go to other registers, a quarter of them to device-id.
+	struct Read {
+		IORegistryEntry *service;
+		uint8_t offset;
+	};
+	std::vector<Read> reads(100000);
+	std::mt19937 rng(1);
+	for (auto &read : reads) {
+		read.service = devices[rng() % devices.size()];
+		read.offset = rng() % 4 == 0 ? static_cast<uint8_t>(WIOKit::kIOPCIConfigDeviceID) : static_cast<uint8_t>(4 + (rng() % 60) * 4);
+	}
+	printf("%zu PCI Config reads over %zu devices\n", reads.size(), devices.size());
+
+	volatile uint32_t sum = 0;
+	benchmark("name and property lookup per read", 20, [&]() {
+		uint32_t s = 0;
+		for (auto &read : reads)
+			s += lookupRead16(read.service, 0, read.offset);
+		sum = sum + s;
+	});
+
+	DeviceIdCache cache;
+	cache.store(igpuEntry);
+	benchmark("cached device-id", 20, [&]() {
+		uint32_t s = 0;
+		for (auto &read : reads)
+			s += cache.read16(read.service, 0, read.offset, orgRead16);
+		sum = sum + s;
+	});
+
+	benchmark("original reader only", 20, [&]() {
+		uint32_t s = 0;
+		for (auto &read : reads)
+			s += orgRead16(read.service, 0, read.offset);
+		sum = sum + s;
+	});
+
+	cache.release();
+	for (auto device : devices)
+		device->release();
+	igpuEntry = nullptr;
+}
+
+int main() {
+	checkCache();
+	benchReads();
+	return finishChecks();
+}
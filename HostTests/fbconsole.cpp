@@ -0,0 +1,377 @@
+//
+//  fbconsole.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Console backcopy checks and benchmark on synthetic boot screens restored in the same mode and across mode changes.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_fbcopy.cpp"
+#include "../WhateverGreen/kern_fbconsole.cpp"
+
+#include <vector>
+
+using namespace FramebufferConsole;
+using FramebufferCopy::PixelFormat;
+
+/**
+ *  Synthetic console framebuffer
+ */
+struct Screen {
+	vc_info info {};
+	std::vector<uint32_t> pixels;
+	PixelFormat format {PixelFormat::RGB888};
+
+	uint32_t pixel(size_t x, size_t y) const {
+		return pixels[y * (info.v_rowbytes / sizeof(uint32_t)) + x];
+	}
+};
+
+/**
+ *  Stride padding value, which must never be read as content or overwritten
+ */
+static constexpr uint32_t PaddingPixel {0xDEADBEEF};
+
+/**
+ *  Build a boot screen with a logo and a progress bar on a solid background
+ *
+ *  @param width       width in pixels
+ *  @param height      height in pixels
+ *  @param padding     stride padding in pixels
+ *  @param format      pixel format
+ *  @param background  background pixel in RGB888
+ *
+ *  @return synthetic screen
+ */
+static Screen makeScreen(size_t width, size_t height, size_t padding, PixelFormat format, uint32_t background) {
+	Screen screen;
+	screen.format = format;
+	screen.info.v_width = static_cast<unsigned>(width);
+	screen.info.v_height = static_cast<unsigned>(height);
+	screen.info.v_depth = format == PixelFormat::RGB888 ? 32 : 30;
+	screen.info.v_rowbytes = static_cast<unsigned>((width + padding) * sizeof(uint32_t));
+	screen.info.v_rowscanbytes = static_cast<unsigned>(width * sizeof(uint32_t));
+
+	size_t stride = width + padding;
+	screen.pixels.assign(stride * height, PaddingPixel);
+	auto bg = FramebufferCopy::convertPixel(background, PixelFormat::RGB888, format);
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++)
+			screen.pixels[y * stride + x] = bg;
+	}
+
+	// Logo with 4 pixel wide gradient steps, so that it has both runs and literals.
+	size_t logoWidth = width / 8, logoHeight = height / 6;
+	size_t logoLeft = (width - logoWidth) / 2, logoTop = height / 3;
+	for (size_t y = 0; y < logoHeight; y++) {
+		for (size_t x = 0; x < logoWidth; x++) {
+			uint32_t c = static_cast<uint32_t>((x / 4 * 7 + y * 3) & 0xFF);
+			uint32_t rgb = (c << 16) | ((255 - c) << 8) | ((x * y) & 0xFF);
+			screen.pixels[(logoTop + y) * stride + logoLeft + x] = FramebufferCopy::convertPixel(rgb, PixelFormat::RGB888, format);
+		}
+	}
+
+	// Half filled progress bar.
+	size_t barWidth = width / 5, barHeight = height / 100 + 1;
+	size_t barLeft = (width - barWidth) / 2, barTop = logoTop + logoHeight + height / 10;
+	for (size_t y = 0; y < barHeight; y++) {
+		for (size_t x = 0; x < barWidth; x++) {
+			uint32_t rgb = x < barWidth / 2 ? 0xFFFFFF : 0x404040;
+			screen.pixels[(barTop + y) * stride + barLeft + x] = FramebufferCopy::convertPixel(rgb, PixelFormat::RGB888, format);
+		}
+	}
+
+	screen.info.v_baseaddr = reinterpret_cast<unsigned long>(screen.pixels.data());
+	return screen;
+}
+
+/**
+ *  Restore a saved screen to the same mode and compare the visible bytes, padding must stay untouched
+ */
+static void checkRestore(const char *name, const Screen &src) {
+	Backup backup;
+	save(backup, src.info);
+	CHECK(backup.valid);
+	CHECK(backup.size <= src.info.v_rowscanbytes * src.info.v_height);
+
+	std::vector<uint32_t> dst(src.pixels.size(), PaddingPixel);
+	restore(backup, src.info, reinterpret_cast<uint8_t *>(dst.data()));
+	CHECK(!backup.valid && !backup.buffer);
+
+	size_t stride = src.info.v_rowbytes / sizeof(uint32_t), visible = backup.visibleRowSize / sizeof(uint32_t);
+	size_t mismatches = 0;
+	for (size_t y = 0; y < src.info.v_height; y++) {
+		for (size_t x = 0; x < stride; x++)
+			mismatches += dst[y * stride + x] != (x < visible ? src.pixel(x, y) : PaddingPixel);
+	}
+	CHECK(mismatches == 0);
+	if (mismatches > 0)
+		fprintf(stderr, "%s: %zu pixels differ\n", name, mismatches);
+}
+
+/**
+ *  Backup of visible row bytes on synthetic vc_info geometries
+ */
+static void checkVisibleRows() {
+	// Padded strides keep only the visible bytes.
+	auto laptop = makeScreen(1366, 768, 10, PixelFormat::RGB888, 0x000000);
+	checkRestore("1366x768 padded", laptop);
+	auto wide = makeScreen(1920, 1080, 128, PixelFormat::RGB101010, 0x191919);
+	checkRestore("1080p 10-bit padded", wide);
+
+	// Without background detection whole visible rows are saved, raw when they do not compress.
+	auto noise = makeScreen(1366, 768, 10, PixelFormat::RGB888, 0x000000);
+	noise.info.v_depth = 24;
+	uint32_t seed = 1;
+	for (size_t y = 0; y < 768; y++) {
+		for (size_t x = 0; x < 1366; x++) {
+			seed = seed * 1664525 + 1013904223;
+			noise.pixels[y * 1376 + x] = seed;
+		}
+	}
+	Backup backup;
+	save(backup, noise.info);
+	CHECK(backup.valid && !backup.hasBackground && !backup.compressed);
+	CHECK(backup.rowSize == 1366 * sizeof(uint32_t) && backup.rows == 768 && backup.size == backup.rowSize * backup.rows);
+	release(backup);
+	checkRestore("1366x768 raw", noise);
+
+	// Missing or bogus v_rowscanbytes fall back to the full stride.
+	auto legacy = makeScreen(800, 600, 32, PixelFormat::RGB888, 0x000000);
+	legacy.info.v_rowscanbytes = 0;
+	save(backup, legacy.info);
+	CHECK(backup.visibleRowSize == legacy.info.v_rowbytes);
+	release(backup);
+	legacy.info.v_rowscanbytes = legacy.info.v_rowbytes + 4;
+	save(backup, legacy.info);
+	CHECK(backup.visibleRowSize == legacy.info.v_rowbytes);
+	release(backup);
+}
+
+/**
+ *  Framebuffer pixel information of a mode
+ */
+static IOPixelInformation makePixelInfo(size_t width, size_t height, size_t padding, PixelFormat format) {
+	IOPixelInformation pixelInfo {};
+	pixelInfo.bytesPerRow = static_cast<uint32_t>((width + padding) * sizeof(uint32_t));
+	pixelInfo.bitsPerPixel = 32;
+	pixelInfo.componentCount = 3;
+	pixelInfo.bitsPerComponent = format == PixelFormat::RGB888 ? 8 : 10;
+	pixelInfo.activeWidth = static_cast<uint32_t>(width);
+	pixelInfo.activeHeight = static_cast<uint32_t>(height);
+	return pixelInfo;
+}
+
+/**
+ *  Nearest neighbour resampling with per pixel divisions, the reference for scaled restoration
+ */
+static void referenceScale(const Screen &src, std::vector<uint32_t> &dst, const IOPixelInformation &pixelInfo, PixelFormat format) {
+	size_t stride = pixelInfo.bytesPerRow / sizeof(uint32_t);
+	for (size_t y = 0; y < pixelInfo.activeHeight; y++) {
+		size_t sy = y * src.info.v_height / pixelInfo.activeHeight;
+		for (size_t x = 0; x < pixelInfo.activeWidth; x++) {
+			size_t sx = x * src.info.v_width / pixelInfo.activeWidth;
+			dst[y * stride + x] = FramebufferCopy::convertPixel(src.pixel(sx, sy), src.format, format);
+		}
+	}
+}
+
+/**
+ *  Check that a screen saved in one mode is restored to another one exactly as the reference does
+ */
+static void checkScaled(const char *name, const Screen &src, size_t width, size_t height, size_t padding, PixelFormat format) {
+	Backup backup;
+	save(backup, src.info);
+	CHECK(backup.valid && backup.hasBackground && backup.compressed);
+	CHECK(backup.rowSize < src.info.v_width * sizeof(uint32_t) && backup.rows < src.info.v_height);
+
+	auto pixelInfo = makePixelInfo(width, height, padding, format);
+	PixelFormat scaledFormat {};
+	CHECK(getScaledFormat(backup, pixelInfo, scaledFormat) && scaledFormat == format);
+
+	std::vector<uint32_t> dst((width + padding) * height, PaddingPixel);
+	std::vector<uint32_t> expected(dst.size(), PaddingPixel);
+	restoreScaled(backup, src.info, reinterpret_cast<uint8_t *>(dst.data()), pixelInfo, scaledFormat);
+	referenceScale(src, expected, pixelInfo, format);
+	CHECK(!backup.valid && !backup.buffer);
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < dst.size(); i++)
+		mismatches += dst[i] != expected[i];
+	CHECK(mismatches == 0);
+	if (mismatches > 0)
+		fprintf(stderr, "%s: %zu pixels differ\n", name, mismatches);
+}
+
+static void checkScaledModes() {
+	auto fullHD = makeScreen(1920, 1080, 64, PixelFormat::RGB888, 0x000000);
+	checkScaled("1080p to 4K", fullHD, 3840, 2160, 0, PixelFormat::RGB888);
+	checkScaled("1080p to 4K 10-bit", fullHD, 3840, 2160, 32, PixelFormat::RGB101010);
+
+	auto ultraHD = makeScreen(3840, 2160, 0, PixelFormat::RGB888, 0x191919);
+	checkScaled("4K to 5K", ultraHD, 5120, 2880, 0, PixelFormat::RGB888);
+	checkScaled("4K to 5K 10-bit", ultraHD, 5120, 2880, 128, PixelFormat::RGB101010);
+
+	auto deepHD = makeScreen(3840, 2160, 0, PixelFormat::RGB101010, 0x191919);
+	checkScaled("4K 10-bit to 5K", deepHD, 5120, 2880, 0, PixelFormat::RGB888);
+	checkScaled("4K 10-bit to 1080p", deepHD, 1920, 1080, 0, PixelFormat::RGB888);
+}
+
+static void checkPixelFormats() {
+	// White stays white, channels are not mixed up.
+	CHECK(FramebufferCopy::convertPixel(0xFFFFFFFF, PixelFormat::RGB888, PixelFormat::RGB101010) == 0x3FFFFFFF);
+	CHECK(FramebufferCopy::convertPixel(0x3FFFFFFF, PixelFormat::RGB101010, PixelFormat::RGB888) == 0xFFFFFF);
+	CHECK(FramebufferCopy::convertPixel(0xFF0000, PixelFormat::RGB888, PixelFormat::RGB101010) == 0x3FF00000);
+	CHECK(FramebufferCopy::convertPixel(0x3FF, PixelFormat::RGB101010, PixelFormat::RGB888) == 0xFF);
+	for (uint32_t c = 0; c < 256; c++) {
+		uint32_t rgb = (c << 16) | ((c ^ 0x5A) << 8) | (255 - c);
+		CHECK(FramebufferCopy::convertPixel(FramebufferCopy::convertPixel(rgb, PixelFormat::RGB888, PixelFormat::RGB101010),
+											PixelFormat::RGB101010, PixelFormat::RGB888) == rgb);
+	}
+
+	// Only 32-bit modes with 8 or 10 bits per component can be restored to.
+	auto screen = makeScreen(640, 480, 0, PixelFormat::RGB888, 0);
+	Backup backup;
+	save(backup, screen.info);
+	PixelFormat format {};
+	auto pixelInfo = makePixelInfo(800, 600, 0, PixelFormat::RGB888);
+	pixelInfo.bitsPerPixel = 16;
+	CHECK(!getScaledFormat(backup, pixelInfo, format));
+	pixelInfo = makePixelInfo(800, 600, 0, PixelFormat::RGB888);
+	pixelInfo.bitsPerComponent = 5;
+	CHECK(!getScaledFormat(backup, pixelInfo, format));
+	pixelInfo = makePixelInfo(800, 600, 0, PixelFormat::RGB888);
+	pixelInfo.bytesPerRow = 799 * sizeof(uint32_t);
+	CHECK(!getScaledFormat(backup, pixelInfo, format));
+	release(backup);
+
+	// Unknown console depths have no background to scale around.
+	screen.info.v_depth = 16;
+	save(backup, screen.info);
+	CHECK(!getScaledFormat(backup, makePixelInfo(800, 600, 0, PixelFormat::RGB888), format));
+	release(backup);
+}
+
+static void checkCorruptImage() {
+	auto screen = makeScreen(1920, 1080, 0, PixelFormat::RGB888, 0);
+	Backup backup;
+	save(backup, screen.info);
+
+	FramebufferCopy::SourceImage image {
+		reinterpret_cast<const uint32_t *>(backup.buffer), backup.size / 2, backup.compressed,
+		screen.info.v_width, screen.info.v_height,
+		backup.left / sizeof(uint32_t), backup.top, backup.rowSize / sizeof(uint32_t), backup.rows,
+		backup.background, backup.format
+	};
+
+	std::vector<uint32_t> dst(3840 * 2160);
+	CHECK(!FramebufferCopy::scaleRows(dst.data(), 3840 * sizeof(uint32_t), 3840, 2160, PixelFormat::RGB888, image));
+	image.size = backup.size;
+	image.rectWidth = image.width;
+	CHECK(!FramebufferCopy::scaleRows(dst.data(), 3840 * sizeof(uint32_t), 3840, 2160, PixelFormat::RGB888, image));
+	release(backup);
+}
+
+/**
+ *  Duplicate a saved backcopy, restoration frees it
+ */
+static Backup cloneBackup(const Backup &backup) {
+	Backup copy = backup;
+	copy.buffer = Buffer::create<uint8_t>(backup.size);
+	memcpy(copy.buffer, backup.buffer, backup.size);
+	return copy;
+}
+
+/**
+ *  Report backcopy compression ratio and same mode restoration latency against the raw copy restored before
+ */
+static void benchRestore(const char *name, const Screen &src) {
+	size_t visible = src.info.v_rowscanbytes * src.info.v_height;
+	printf("%s, %ux%u, %zu visible bytes\n", name, src.info.v_width, src.info.v_height, visible);
+
+	uint32_t *stream = nullptr;
+	size_t streamSize = 0;
+	if (FramebufferCopy::compressRows(src.pixels.data(), src.info.v_rowbytes, src.info.v_rowscanbytes, src.info.v_height, stream, streamSize)) {
+		printf("  compressRows of the whole screen: %zu bytes, %.2f%%\n", streamSize, streamSize * 100.0 / visible);
+		Buffer::deleter(stream);
+	} else {
+		printf("  compressRows of the whole screen: does not compress\n");
+	}
+
+	Backup backup;
+	save(backup, src.info);
+	CHECK(backup.valid);
+	printf("  backcopy: %zu bytes, %.2f%%, %s\n", backup.size, backup.size * 100.0 / visible, backup.compressed ? "compressed" : "raw");
+
+	std::vector<uint32_t> dst(src.pixels.size());
+	benchmark("raw copy of the visible rows", 20, [&]() {
+		auto s = reinterpret_cast<const uint8_t *>(src.pixels.data());
+		auto d = reinterpret_cast<uint8_t *>(dst.data());
+		for (size_t y = 0; y < src.info.v_height; y++)
+			memcpy(d + y * src.info.v_rowbytes, s + y * src.info.v_rowbytes, src.info.v_rowscanbytes);
+	});
+
+	benchmark("save", 20, [&]() {
+		release(backup);
+		save(backup, src.info);
+	});
+
+	// Restoration frees the backcopy, so every round restores a duplicate made beforehand.
+	std::vector<Backup> copies;
+	for (size_t i = 0; i < 20; i++)
+		copies.push_back(cloneBackup(backup));
+	size_t next = 0;
+	benchmark("restore", copies.size(), [&]() {
+		restore(copies[next++], src.info, reinterpret_cast<uint8_t *>(dst.data()));
+	});
+
+	release(backup);
+}
+
+static void benchScaled(const char *name, const Screen &src, size_t width, size_t height, PixelFormat format) {
+	printf("%s, %ux%u to %zux%zu\n", name, src.info.v_width, src.info.v_height, width, height);
+
+	Backup backup;
+	benchmark("save", 10, [&]() {
+		release(backup);
+		save(backup, src.info);
+	});
+
+	auto pixelInfo = makePixelInfo(width, height, 0, format);
+	std::vector<uint32_t> dst(width * height);
+	benchmark("per pixel reference scaling", 5, [&]() {
+		referenceScale(src, dst, pixelInfo, format);
+	});
+
+	benchmark("restoreScaled", 10, [&]() {
+		auto copy = cloneBackup(backup);
+		restoreScaled(copy, src.info, reinterpret_cast<uint8_t *>(dst.data()), pixelInfo, format);
+	});
+
+	release(backup);
+}
+
+int main() {
+	checkVisibleRows();
+	checkPixelFormats();
+	checkScaledModes();
+	checkCorruptImage();
+
+	auto fullHD = makeScreen(1920, 1080, 0, PixelFormat::RGB888, 0);
+	benchRestore("1080p boot screen", fullHD);
+	auto greyUltraHD = makeScreen(3840, 2160, 64, PixelFormat::RGB888, 0x191919);
+	benchRestore("4K grey boot screen", greyUltraHD);
+
+	// Every pixel differs from its neighbours, as with a gradient wallpaper left by the bootloader.
+	auto wallpaper = makeScreen(2560, 1440, 0, PixelFormat::RGB888, 0);
+	for (size_t i = 0; i < wallpaper.pixels.size(); i++)
+		wallpaper.pixels[i] = static_cast<uint32_t>(i * 0x010203);
+	benchRestore("1440p wallpaper", wallpaper);
+
+	benchScaled("1080p to 4K", fullHD, 3840, 2160, PixelFormat::RGB888);
+	auto ultraHD = makeScreen(3840, 2160, 0, PixelFormat::RGB888, 0);
+	benchScaled("4K to 5K 10-bit", ultraHD, 5120, 2880, PixelFormat::RGB101010);
+	return finishChecks();
+}
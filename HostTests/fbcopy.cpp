@@ -0,0 +1,314 @@
+//
+//  fbcopy.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// FramebufferCopy checks and benchmark against memcpy / memset around the streaming threshold and on common framebuffer sizes,
+// content bounds detection against a full scan.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_fbcopy.cpp"
+
+#include <random>
+#include <vector>
+
+/**
+ *  Common framebuffer modes with 32-bit pixels
+ */
+static constexpr struct {
+	const char *name;
+	size_t width;
+	size_t height;
+} Modes[] {
+	{"1080p", 1920, 1080},
+	{"1440p", 2560, 1440},
+	{"4K",    3840, 2160},
+	{"5K",    5120, 2880}
+};
+
+/**
+ *  Guard bytes around the destination, which must stay intact
+ */
+static constexpr size_t Guard {64};
+static constexpr uint8_t GuardByte {0xA5};
+
+static bool guardsIntact(const std::vector<uint8_t> &buf, size_t offset, size_t size) {
+	for (size_t i = 0; i < offset; i++)
+		if (buf[i] != GuardByte)
+			return false;
+	for (size_t i = offset + size; i < buf.size(); i++)
+		if (buf[i] != GuardByte)
+			return false;
+	return true;
+}
+
+static void checkCopy() {
+	std::vector<uint8_t> src(MinStreamingCopySize + 8192 + Guard);
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = static_cast<uint8_t>(i * 31 + 7);
+
+	// Every misalignment on both sides across the memcpy and streaming thresholds and block sizes.
+	for (size_t size : {size_t(0), size_t(1), size_t(7), size_t(8), size_t(31), size_t(255), size_t(256), size_t(257), size_t(1000),
+		size_t(4096), size_t(8191), MinStreamingCopySize - 1, MinStreamingCopySize, MinStreamingCopySize + 8191}) {
+		for (size_t dstOff = 0; dstOff < 8; dstOff++) {
+			for (size_t srcOff = 0; srcOff < 8; srcOff += 3) {
+				std::vector<uint8_t> dst(size + 2 * Guard, GuardByte);
+				FramebufferCopy::copy(&dst[Guard + dstOff], &src[srcOff], size);
+				CHECK(!memcmp(&dst[Guard + dstOff], &src[srcOff], size));
+				CHECK(guardsIntact(dst, Guard + dstOff, size));
+			}
+		}
+	}
+}
+
+static void checkFill() {
+	const uint32_t value = 0x11223344;
+	for (size_t size : {0, 1, 3, 4, 9, 255, 256, 258, 1001, 4096, 8190}) {
+		for (size_t dstOff = 0; dstOff < 8; dstOff++) {
+			std::vector<uint8_t> dst(size + 2 * Guard, GuardByte);
+			FramebufferCopy::fill(&dst[Guard + dstOff], value, size);
+			bool pattern = true;
+			for (size_t i = 0; i < size; i++)
+				pattern = pattern && dst[Guard + dstOff + i] == static_cast<uint8_t>(value >> ((i % sizeof(uint32_t)) * 8));
+			CHECK(pattern);
+			CHECK(guardsIntact(dst, Guard + dstOff, size));
+		}
+	}
+}
+
+static void checkRows() {
+	// A 100x50 rectangle inside a padded 128 pixel stride framebuffer.
+	const size_t width = 100, height = 50, stride = 128 * sizeof(uint32_t), rowSize = width * sizeof(uint32_t);
+	std::vector<uint32_t> src(width * height);
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = static_cast<uint32_t>(i * 2654435761U);
+
+	std::vector<uint32_t> vram(stride / sizeof(uint32_t) * height, 0xDEADBEEF);
+	FramebufferCopy::copyRows(vram.data(), stride, src.data(), rowSize, rowSize, height);
+	FramebufferCopy::fillRows(&vram[width], stride, 0x00FF00FF, (stride - rowSize) / 2, height);
+
+	bool rows = true;
+	for (size_t y = 0; y < height; y++) {
+		auto row = &vram[y * stride / sizeof(uint32_t)];
+		rows = rows && !memcmp(row, &src[y * width], rowSize);
+		for (size_t x = width; x < stride / sizeof(uint32_t); x++)
+			rows = rows && row[x] == (x < width + 14 ? 0x00FF00FF : 0xDEADBEEF);
+	}
+	CHECK(rows);
+
+	// Rectangles above the streaming threshold are streamed row by row.
+	const size_t bigWidth = 1000, bigHeight = MinStreamingCopySize / (bigWidth * sizeof(uint32_t)) + 1, bigStride = 1024;
+	std::vector<uint32_t> bigSrc(bigWidth * bigHeight);
+	for (size_t i = 0; i < bigSrc.size(); i++)
+		bigSrc[i] = static_cast<uint32_t>(i * 2654435761U);
+	std::vector<uint32_t> bigVram(bigStride * bigHeight, 0xDEADBEEF);
+	FramebufferCopy::copyRows(bigVram.data(), bigStride * sizeof(uint32_t), bigSrc.data(), bigWidth * sizeof(uint32_t),
+							  bigWidth * sizeof(uint32_t), bigHeight);
+	rows = true;
+	for (size_t y = 0; y < bigHeight; y++) {
+		rows = rows && !memcmp(&bigVram[y * bigStride], &bigSrc[y * bigWidth], bigWidth * sizeof(uint32_t));
+		for (size_t x = bigWidth; x < bigStride; x++)
+			rows = rows && bigVram[y * bigStride + x] == 0xDEADBEEF;
+	}
+	CHECK(rows);
+
+	// Contiguous rows are copied back in one go.
+	std::vector<uint32_t> back(src.size());
+	FramebufferCopy::copyRows(back.data(), rowSize, src.data(), rowSize, rowSize, height);
+	CHECK(back == src);
+}
+
+/**
+ *  Content rectangle found by a full scan of every pixel
+ */
+struct Bounds {
+	bool found {false};
+	size_t left {0}, top {0}, right {0}, bottom {0};
+
+	bool operator ==(const Bounds &other) const {
+		return found == other.found && (!found ||
+			(left == other.left && top == other.top && right == other.right && bottom == other.bottom));
+	}
+};
+
+static Bounds naiveBounds(const std::vector<uint32_t> &pixels, size_t stride, size_t width, size_t height, uint32_t mask, uint32_t background) {
+	Bounds b;
+	b.left = width;
+	b.top = height;
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			if ((pixels[y * stride + x] & mask) != (background & mask)) {
+				b.found = true;
+				b.left = std::min(b.left, x);
+				b.top = std::min(b.top, y);
+				b.right = std::max(b.right, x + 1);
+				b.bottom = std::max(b.bottom, y + 1);
+			}
+		}
+	}
+	return b;
+}
+
+static Bounds findBounds(const std::vector<uint32_t> &pixels, size_t stride, size_t width, size_t height, uint32_t mask, uint32_t background) {
+	Bounds b;
+	b.found = FramebufferCopy::findBounds(pixels.data(), stride * sizeof(uint32_t), width, height, mask, background,
+										  b.left, b.top, b.right, b.bottom);
+	return b;
+}
+
+/**
+ *  Pixel depths as reported by vc_info, with the bits outside of the mask being noise
+ */
+static constexpr struct {
+	uint32_t depth;
+	uint32_t mask;
+} Depths[] {
+	{32, 0x00FFFFFF},
+	{30, 0x3FFFFFFF}
+};
+
+static void checkBounds() {
+	const size_t width = 67, height = 41, stride = 80;
+	const uint32_t background = 0x00102030;
+	std::mt19937 rng(1);
+
+	for (auto &depth : Depths) {
+		// Background with random bits outside of the mask, e.g. alpha, and garbage in the stride padding.
+		auto noise = [&](uint32_t value) {
+			return (value & depth.mask) | (static_cast<uint32_t>(rng()) & ~depth.mask);
+		};
+		auto blank = [&]() {
+			std::vector<uint32_t> pixels(stride * height);
+			for (size_t y = 0; y < height; y++)
+				for (size_t x = 0; x < stride; x++)
+					pixels[y * stride + x] = x < width ? noise(background) : static_cast<uint32_t>(rng());
+			return pixels;
+		};
+
+		// Solid screen has no content.
+		auto pixels = blank();
+		CHECK(!findBounds(pixels, stride, width, height, depth.mask, background).found);
+		CHECK(!findBounds(pixels, stride, 0, height, depth.mask, background).found);
+		CHECK(!findBounds(pixels, stride, width, 0, depth.mask, background).found);
+
+		// Single pixels at the corners, edges and inside, differing in the lowest significant bit only.
+		size_t xs[] {0, 1, width / 2, width - 2, width - 1};
+		size_t ys[] {0, 1, height / 2, height - 2, height - 1};
+		for (auto x : xs) {
+			for (auto y : ys) {
+				pixels = blank();
+				pixels[y * stride + x] = noise(background ^ 1);
+				auto b = findBounds(pixels, stride, width, height, depth.mask, background);
+				CHECK(b.found && b.left == x && b.top == y && b.right == x + 1 && b.bottom == y + 1);
+			}
+		}
+
+		// Full screen content.
+		pixels = blank();
+		for (size_t y = 0; y < height; y++)
+			for (size_t x = 0; x < width; x++)
+				pixels[y * stride + x] = noise(background + 1);
+		auto b = findBounds(pixels, stride, width, height, depth.mask, background);
+		CHECK(b.found && b.left == 0 && b.top == 0 && b.right == width && b.bottom == height);
+
+		// Random scattered content against the full scan, including pixels that only affect inner rows.
+		bool matches = true;
+		for (size_t round = 0; round < 500; round++) {
+			pixels = blank();
+			size_t count = rng() % 6;
+			for (size_t i = 0; i < count; i++)
+				pixels[(rng() % height) * stride + rng() % width] = noise(static_cast<uint32_t>(rng()) | 1);
+			matches = matches && findBounds(pixels, stride, width, height, depth.mask, background) ==
+				naiveBounds(pixels, stride, width, height, depth.mask, background);
+		}
+		CHECK(matches);
+	}
+}
+
+static void benchBounds() {
+	// A 4K boot screen with the logo and the progress bar in the middle.
+	const size_t width = 3840, height = 2160;
+	const uint32_t background = 0xFF000000;
+	std::vector<uint32_t> pixels(width * height, background);
+	for (size_t y = height / 3; y < height / 2; y++)
+		for (size_t x = width * 7 / 16; x < width * 9 / 16; x++)
+			pixels[y * width + x] = 0xFF000000 | static_cast<uint32_t>(x * y);
+	for (size_t x = width * 2 / 5; x < width * 3 / 5; x++)
+		pixels[(height * 3 / 5) * width + x] = 0xFFFFFFFF;
+	printf("4K boot screen content bounds\n");
+
+	volatile size_t sum = 0;
+	benchmark("full scan", 10, [&]() {
+		auto b = naiveBounds(pixels, width, width, height, 0x00FFFFFF, background);
+		sum = sum + b.right;
+	});
+
+	benchmark("FramebufferCopy::findBounds", 10, [&]() {
+		auto b = findBounds(pixels, width, width, height, 0x00FFFFFF, background);
+		sum = sum + b.right;
+	});
+
+	CHECK(findBounds(pixels, width, width, height, 0x00FFFFFF, background) ==
+		  naiveBounds(pixels, width, width, height, 0x00FFFFFF, background));
+}
+
+static void benchSmallCopies() {
+	// Sizes around the point where streaming starts to pay off, e.g. content rectangles and small modes.
+	for (size_t size : {size_t(256 * 1024), size_t(1024 * 1024), MinStreamingCopySize, size_t(4 * 1024 * 1024)}) {
+		printf("%zu KB copy\n", size / 1024);
+		std::vector<uint8_t> src(size, 0x5A), dst(size);
+		benchmark("memcpy", 100, [&]() {
+			memcpy(dst.data(), src.data(), size);
+			asm volatile ("" : : "r" (dst.data()) : "memory");
+		});
+
+		benchmark("streaming copy", 100, [&]() {
+			streamCopy(dst.data(), src.data(), size);
+			FramebufferCopy::flush();
+		});
+
+		benchmark("FramebufferCopy::copy", 100, [&]() {
+			FramebufferCopy::copy(dst.data(), src.data(), size);
+			asm volatile ("" : : "r" (dst.data()) : "memory");
+		});
+	}
+}
+
+static void benchModes() {
+	for (auto &mode : Modes) {
+		size_t size = mode.width * mode.height * sizeof(uint32_t);
+		printf("%s, %zu bytes\n", mode.name, size);
+
+		std::vector<uint8_t> src(size, 0x5A), dst(size);
+		benchmark("memcpy", 10, [&]() {
+			memcpy(dst.data(), src.data(), size);
+			asm volatile ("" : : "r" (dst.data()) : "memory");
+		});
+
+		benchmark("FramebufferCopy::copy", 10, [&]() {
+			FramebufferCopy::copy(dst.data(), src.data(), size);
+		});
+
+		benchmark("memset", 10, [&]() {
+			memset(dst.data(), 0, size);
+			asm volatile ("" : : "r" (dst.data()) : "memory");
+		});
+
+		benchmark("FramebufferCopy::fill", 10, [&]() {
+			FramebufferCopy::fill(dst.data(), 0, size);
+		});
+	}
+}
+
+int main() {
+	checkCopy();
+	checkFill();
+	checkRows();
+	checkBounds();
+	benchSmallCopies();
+	benchModes();
+	benchBounds();
+	return finishChecks();
+}
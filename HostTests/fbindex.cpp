@@ -0,0 +1,291 @@
+//
+//  fbindex.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// FramebufferIndex checks and lookup benchmark on synthetic lists of every generation, e.g.:
+//   HostTests/build.tool AppleIntelSNBGraphicsFB AppleIntelSKLGraphicsFramebuffer AppleIntelCFLGraphicsFramebuffer
+// Framebuffer kext arguments are decoded with FramebufferDecoder and checked against the index, others are skipped.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_fbindex.cpp"
+
+// The decoder logs with its own SYSLOG and has its own entry point.
+#undef SYSLOG
+#define main decoderMain
+#include "../FramebufferDecoder/main.cpp"
+#undef main
+
+#include <random>
+#include <vector>
+
+/**
+ *  Amount of records in the large synthetic lists, more than the former fixed index capacity
+ */
+static constexpr size_t RecordCount {200};
+
+/**
+ *  Framebuffer id of a synthetic record
+ */
+static uint32_t recordId(size_t i) {
+	return 0x3E900000 + static_cast<uint32_t>(i) * 0x10003;
+}
+
+/**
+ *  Build a terminated synthetic list
+ *
+ *  @param num  amount of records before the terminator
+ *
+ *  @return list records including the terminator
+ */
+template <typename T>
+static std::vector<T> makeList(size_t num) {
+	std::vector<T> list(num + 1);
+	memset(list.data(), 0, list.size() * sizeof(T));
+	for (size_t i = 0; i < num; i++) {
+		list[i].framebufferId = recordId(i);
+		list[i].fPipeCount = 3;
+		list[i].fPortCount = static_cast<uint8_t>(i % 5);
+		list[i].fFBMemoryCount = 2;
+		for (size_t c = 0; c < MaxFramebufferConnectorCount; c++)
+			list[i].connectors[c].index = c < list[i].fPortCount ? static_cast<int8_t>(c) : -1;
+	}
+	list[num].framebufferId = 0xFFFFFFFF;
+	return list;
+}
+
+template <typename T>
+static const uint8_t *listEnd(const std::vector<T> &list, size_t num) {
+	return reinterpret_cast<const uint8_t *>(list.data() + num);
+}
+
+template <typename T>
+static void checkGeneration(const char *name) {
+	auto list = makeList<T>(RecordCount);
+	FramebufferIndex index;
+	CHECK(index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == RecordCount);
+	CHECK(index.stride() == sizeof(T));
+	CHECK(index.size() == RecordCount * sizeof(T));
+
+	for (size_t i = 0; i < RecordCount; i++) {
+		size_t offset = 0;
+		CHECK(index.find(recordId(i), offset) && offset == i * sizeof(T));
+		CHECK(index.framebufferIdAt(i * sizeof(T) + sizeof(T) - 1) == recordId(i));
+	}
+
+	size_t offset = 0;
+	CHECK(!index.find(0, offset) && !index.find(0xFFFFFFFF, offset) && !index.find(recordId(RecordCount), offset));
+	CHECK(index.framebufferIdAt(RecordCount * sizeof(T)) == 0);
+
+	// Records past the end of the kext are never read.
+	CHECK(index.build(list.data(), listEnd(list, 50) + sizeof(T) - 1));
+	CHECK(index.count() == 50 && !index.find(recordId(50), offset));
+
+	// Invalid records end the list.
+	list[70].connectors[2].index = 4;
+	CHECK(index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == 70);
+	list[70].connectors[2].index = -1;
+	list[90].fPipeCount = MaxFramebufferConnectorCount + 1;
+	CHECK(index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == 90);
+
+	// The first of duplicate ids is found, offsets of both still map to the id.
+	list[90].fPipeCount = 3;
+	list[120].framebufferId = list[30].framebufferId;
+	CHECK(index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == RecordCount - 1);
+	CHECK(index.find(recordId(30), offset) && offset == 30 * sizeof(T));
+	CHECK(index.framebufferIdAt(120 * sizeof(T)) == recordId(30));
+
+	// Nothing to index.
+	list[0].framebufferId = 0;
+	CHECK(!index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == 0 && index.stride() == 0 && !index.find(recordId(1), offset));
+
+	if (checkFailures > 0)
+		fprintf(stderr, "%s index checks failed\n", name);
+}
+
+static void checkSandyBridge() {
+	std::vector<FramebufferSNB> list(arrsize(SandyPlatformId) + 2);
+	memset(list.data(), 0, list.size() * sizeof(FramebufferSNB));
+	for (auto &frame : list) {
+		frame.fPipeCount = 2;
+		for (size_t c = 0; c < MaxFramebufferConnectorCount; c++)
+			frame.connectors[c].index = -1;
+	}
+
+	FramebufferIndex index;
+	CHECK(index.build(list.data(), listEnd(list, list.size())));
+	CHECK(index.count() == arrsize(SandyPlatformId) - 2);
+	CHECK(index.size() == arrsize(SandyPlatformId) * sizeof(FramebufferSNB));
+
+	for (size_t i = 0; i < arrsize(SandyPlatformId); i++) {
+		size_t offset = 0;
+		if (SandyPlatformId[i] != 0xFFFFFFFF)
+			CHECK(index.find(SandyPlatformId[i], offset) && offset == i * sizeof(FramebufferSNB));
+		CHECK(index.framebufferIdAt(i * sizeof(FramebufferSNB)) == (SandyPlatformId[i] != 0xFFFFFFFF ? SandyPlatformId[i] : 0));
+	}
+
+	// Positions without ids still count towards the walked records.
+	CHECK(index.build(list.data(), listEnd(list, 7)));
+	CHECK(index.count() == 5 && index.size() == 7 * sizeof(FramebufferSNB));
+	size_t offset = 0;
+	CHECK(!index.find(0x00030020, offset));
+
+	// Without an index, e.g. prior to 10.10.5, records are still found by position and never by scanning.
+	for (size_t i = 0; i < arrsize(SandyPlatformId); i++) {
+		if (SandyPlatformId[i] != 0xFFFFFFFF)
+			CHECK(FramebufferIndex::findSandyBridge(SandyPlatformId[i], offset) && offset == i * sizeof(FramebufferSNB));
+	}
+	CHECK(!FramebufferIndex::findSandyBridge(0xFFFFFFFF, offset) && !FramebufferIndex::findSandyBridge(0, offset));
+	CHECK(!FramebufferIndex::findSandyBridge(0x0166000B, offset));
+}
+
+/**
+ *  Lookup by walking the records, as done before the index
+ */
+template <typename T>
+static const T *linearFind(const T *list, size_t num, uint32_t framebufferId) {
+	for (size_t i = 0; i < num; i++) {
+		if (list[i].framebufferId == framebufferId)
+			return &list[i];
+	}
+	return nullptr;
+}
+
+static void benchLookup() {
+	auto list = makeList<FramebufferCFL>(RecordCount);
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i < RecordCount; i++)
+		ids.push_back(recordId(i));
+	std::mt19937 rng(1);
+	std::shuffle(ids.begin(), ids.end(), rng);
+	printf("%zu CFL records, %zu lookups per round\n", RecordCount, ids.size() * 100);
+
+	// Offsets are summed so that the lookups cannot be optimised away.
+	volatile size_t sum = 0;
+	size_t found = 0;
+	benchmark("linear record walk", 20, [&]() {
+		found = 0;
+		for (size_t r = 0; r < 100; r++) {
+			for (auto id : ids) {
+				auto frame = linearFind(list.data(), RecordCount, id);
+				if (frame) {
+					sum = sum + (frame - list.data());
+					found++;
+				}
+			}
+		}
+	});
+
+	FramebufferIndex index;
+	index.build(list.data(), listEnd(list, list.size()));
+	benchmark("indexed lookup", 20, [&]() {
+		found = 0;
+		size_t offset = 0;
+		for (size_t r = 0; r < 100; r++) {
+			for (auto id : ids) {
+				if (index.find(id, offset)) {
+					sum = sum + offset / sizeof(FramebufferCFL);
+					found++;
+				}
+			}
+		}
+	});
+
+	printf("  %zu records found\n", found);
+}
+
+/**
+ *  Check the index built over a list in a kext image against the decoded platforms
+ */
+template <typename T>
+static void checkImage(const char *path, const Image &image, uint64_t address) {
+	std::vector<Platform> platforms;
+	decodeList<T>(image, address, platforms);
+
+	// Bound the list by its segment like the kext bounds it by the framebuffer image.
+	size_t num = MaxPlatforms + 1;
+	const uint8_t *list = nullptr;
+	while (num > 0 && !(list = image.resolve(address, num * sizeof(T))))
+		num--;
+
+	// Mapped files keep no alignment guarantees, so the records are copied.
+	std::vector<T> records(num);
+	if (num > 0)
+		memcpy(records.data(), list, num * sizeof(T));
+
+	FramebufferIndex index;
+	CHECK(index.build(records.data(), listEnd(records, num)));
+
+	size_t matched = 0;
+	for (auto &p : platforms) {
+		size_t offset = 0;
+		bool found = index.find(p.framebufferId, offset);
+		CHECK(found);
+		if (found && index.framebufferIdAt(offset) == p.framebufferId)
+			matched++;
+	}
+
+	CHECK(index.count() == platforms.size());
+	printf("%s: %zu of %zu platforms indexed, %lu bytes per record\n", path, matched, platforms.size(), index.stride());
+}
+
+static void checkBinary(const char *path) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+		fprintf(stderr, "failed to open %s\n", path);
+		checkFailures++;
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	size_t fileSize = static_cast<size_t>(st.st_size);
+	auto file = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED) {
+		fprintf(stderr, "failed to map %s\n", path);
+		checkFailures++;
+		return;
+	}
+
+	Image image;
+	uint64_t address = 0;
+	if (image.init(static_cast<const uint8_t *>(file), fileSize) && image.findSymbol("_gPlatformInformationList", address)) {
+		switch (detectGeneration(path, image.resolve(address, sizeof(uint32_t)))) {
+			case Generation::SandyBridge: checkImage<FramebufferSNB>(path, image, address); break;
+			case Generation::IvyBridge:   checkImage<FramebufferIVB>(path, image, address); break;
+			case Generation::Haswell:     checkImage<FramebufferHSW>(path, image, address); break;
+			case Generation::Broadwell:   checkImage<FramebufferBDW>(path, image, address); break;
+			case Generation::Skylake:     checkImage<FramebufferSKL>(path, image, address); break;
+			case Generation::CoffeeLake:  checkImage<FramebufferCFL>(path, image, address); break;
+			default: printf("%s: unknown framebuffer generation, skipped\n", path); break;
+		}
+	} else {
+		printf("%s: not a framebuffer kext, skipped\n", path);
+	}
+
+	munmap(file, fileSize);
+}
+
+int main(int argc, char *argv[]) {
+	checkSandyBridge();
+	checkGeneration<FramebufferIVB>("IVB");
+	checkGeneration<FramebufferHSW>("HSW");
+	checkGeneration<FramebufferBDW>("BDW");
+	checkGeneration<FramebufferSKL>("SKL");
+	checkGeneration<FramebufferCFL>("CFL");
+	benchLookup();
+
+	for (int i = 1; i < argc; i++)
+		checkBinary(argv[i]);
+
+	return finishChecks();
+}
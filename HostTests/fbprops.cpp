@@ -0,0 +1,365 @@
+//
+//  fbprops.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// framebuffer-* property collection checks and benchmark on IGPU property dictionaries with many patches,
+// masked find / replace checks against a reference matcher and benchmark against the exact-match loop.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_fbprops.cpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace FramebufferProperties;
+
+/**
+ *  Amount of patches in the large dictionary
+ */
+static constexpr size_t PatchCount {1000};
+
+/**
+ *  Disabled and malformed patches in the large dictionary
+ */
+static constexpr size_t DisabledPatch {500};
+static constexpr size_t MismatchedPatch {700};
+
+/**
+ *  Current framebuffer id passed to the patch builder
+ */
+static constexpr uint32_t CurrentFramebuffer {0x3E9B0007};
+
+template <typename T>
+static OSData *makeValue(T value) {
+	return OSData::withBytes(&value, sizeof(value));
+}
+
+/**
+ *  Patch find bytes, unique per patch
+ */
+static std::vector<uint8_t> patchFind(size_t i) {
+	return {0x01, 0x03, static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8), 0x00, 0x00, 0x00, 0x00};
+}
+
+/**
+ *  Build an IGPU property dictionary with shuffled framebuffer-* properties
+ */
+static OSDictionary *makeProperties(size_t patchCount) {
+	std::vector<std::pair<std::string, OSData *>> props;
+	props.emplace_back("framebuffer-patch-enable", makeValue<uint32_t>(1));
+	props.emplace_back("framebuffer-framebufferid", makeValue<uint32_t>(0x3E9B0000));
+	props.emplace_back("framebuffer-stolenmem", makeValue<uint32_t>(0x3000000));
+	props.emplace_back("framebuffer-con1-enable", makeValue<uint32_t>(1));
+	props.emplace_back("framebuffer-con1-busid", makeValue<uint32_t>(4));
+	props.emplace_back("framebuffer-con1-type", makeValue<uint32_t>(0x800));
+	// Out of range, aliased and unknown names are ignored.
+	props.emplace_back("framebuffer-con9-enable", makeValue<uint32_t>(1));
+	props.emplace_back("framebuffer-patch07-find", makeValue<uint32_t>(7));
+	props.emplace_back("framebuffer-patch3-unknown", makeValue<uint32_t>(3));
+	props.emplace_back("framebuffer-patch" + std::to_string(patchCount) + "-find", makeValue<uint32_t>(0));
+	props.emplace_back("model", makeValue<uint32_t>(0));
+
+	for (size_t i = 0; i < patchCount; i++) {
+		auto prefix = "framebuffer-patch" + std::to_string(i) + "-";
+		auto find = patchFind(i);
+		auto replace = find;
+		replace[4] = 0xFF;
+		if (i == MismatchedPatch)
+			replace.push_back(0);
+		props.emplace_back(prefix + "enable", makeValue<uint32_t>(i != DisabledPatch));
+		props.emplace_back(prefix + "find", OSData::withBytes(find.data(), static_cast<unsigned>(find.size())));
+		props.emplace_back(prefix + "replace", OSData::withBytes(replace.data(), static_cast<unsigned>(replace.size())));
+		if (i % 3 == 0)
+			props.emplace_back(prefix + "count", makeValue<uint32_t>(static_cast<uint32_t>(i % 5)));
+		if (i % 4 == 0)
+			props.emplace_back(prefix + "framebufferid", makeValue<uint32_t>(static_cast<uint32_t>(0x59120000 + i)));
+		if (i % 10 == 0)
+			props.emplace_back(prefix + "findmask", OSData::withBytes(find.data(), static_cast<unsigned>(find.size())));
+	}
+
+	// Registry order has nothing to do with patch numbering.
+	std::mt19937 rng(1);
+	std::shuffle(props.begin(), props.end(), rng);
+
+	auto dict = OSDictionary::withCapacity(static_cast<unsigned>(props.size()));
+	for (auto &prop : props) {
+		dict->setObject(prop.first.c_str(), prop.second);
+		prop.second->release();
+	}
+	return dict;
+}
+
+static void checkLargeDictionary() {
+	auto dict = makeProperties(PatchCount);
+	Collection props;
+	CHECK(collect(dict, props));
+	CHECK(props.enableCount == PatchCount);
+
+	uint32_t value = 0;
+	CHECK(getValue<uint32_t>(props.framebuffer[FramebufferFieldPatchEnable], value) && value == 1);
+	CHECK(getValue<uint32_t>(props.framebuffer[FramebufferFieldId], value) && value == 0x3E9B0000);
+	CHECK(getValue<uint32_t>(props.framebuffer[FramebufferFieldStolenMem], value) && value == 0x3000000);
+	CHECK(!props.framebuffer[FramebufferFieldMobile]);
+	CHECK(getValue<uint32_t>(props.connectors[1][ConnectorFieldBusId], value) && value == 4);
+	CHECK(!props.connectors[0][ConnectorFieldEnable] && !props.connectors[1][ConnectorFieldPipe]);
+
+	uint8_t *arena = nullptr;
+	size_t count = buildPatches(props, CurrentFramebuffer, arena);
+	CHECK(count == PatchCount - 2);
+	CHECK(arena != nullptr);
+
+	// Patches keep their numbering order, disabled and malformed ones are skipped.
+	auto patches = reinterpret_cast<const Patch *>(arena);
+	size_t index = 0;
+	for (size_t i = 0; i < PatchCount && index < count; i++) {
+		if (i == DisabledPatch || i == MismatchedPatch)
+			continue;
+
+		auto &patch = patches[index++];
+		auto find = patchFind(i);
+		CHECK(patch.size == find.size());
+		CHECK(!memcmp(patch.find, find.data(), find.size()));
+		CHECK(patch.replace[4] == 0xFF && !memcmp(patch.replace, find.data(), 4));
+		CHECK((patch.findMask != nullptr) == (i % 10 == 0));
+		CHECK(!patch.replaceMask);
+		CHECK(patch.count == (i % 3 == 0 && i % 5 != 0 ? i % 5 : 1));
+		CHECK(patch.framebufferId == (i % 4 == 0 ? 0x59120000 + i : CurrentFramebuffer));
+	}
+	CHECK(index == count);
+
+	Buffer::deleter(arena);
+	release(props);
+	CHECK(!props.patches && props.patchCount == 0);
+	dict->release();
+}
+
+static void checkMissingEnable() {
+	// A missing enable property ends the patch list.
+	auto dict = OSDictionary::withCapacity(8);
+	auto find = patchFind(0);
+	for (auto i : {0, 2}) {
+		auto prefix = "framebuffer-patch" + std::to_string(i) + "-";
+		auto enable = makeValue<uint32_t>(1);
+		auto bytes = OSData::withBytes(find.data(), static_cast<unsigned>(find.size()));
+		dict->setObject((prefix + "enable").c_str(), enable);
+		dict->setObject((prefix + "find").c_str(), bytes);
+		dict->setObject((prefix + "replace").c_str(), bytes);
+		enable->release();
+		bytes->release();
+	}
+
+	Collection props;
+	CHECK(collect(dict, props));
+	uint8_t *arena = nullptr;
+	CHECK(buildPatches(props, CurrentFramebuffer, arena) == 1);
+	Buffer::deleter(arena);
+	release(props);
+
+	// No patches allocate nothing.
+	Collection empty;
+	CHECK(buildPatches(empty, CurrentFramebuffer, arena) == 0 && !arena);
+	dict->release();
+}
+
+/**
+ *  Property lookup by name, as done by separate getProperty calls per patch field
+ */
+static OSObject *lookupName(const OSDictionary *dict, const char *name) {
+	for (unsigned i = 0; i < dict->getCount(); i++) {
+		auto key = dict->getKey(i);
+		if (!strcmp(key->getCStringNoCopy(), name))
+			return dict->getObject(key);
+	}
+	return nullptr;
+}
+
+static void benchDictionary() {
+	auto dict = makeProperties(PatchCount);
+	printf("%zu patches, %u properties\n", PatchCount, dict->getCount());
+
+	size_t found = 0;
+	benchmark("per-patch name lookups", 5, [&]() {
+		found = 0;
+		char name[64];
+		for (size_t i = 0; i < PatchCount; i++) {
+			for (auto field : patchFields) {
+				snprintf(name, sizeof(name), "framebuffer-patch%zu-%s", i, field);
+				found += lookupName(dict, name) != nullptr;
+			}
+		}
+	});
+
+	size_t count = 0;
+	benchmark("single pass collection", 5, [&]() {
+		Collection props;
+		collect(dict, props);
+		uint8_t *arena = nullptr;
+		count = buildPatches(props, CurrentFramebuffer, arena);
+		Buffer::deleter(arena);
+		release(props);
+	});
+
+	printf("  %zu properties found, %zu patches built\n", found, count);
+	dict->release();
+}
+
+/**
+ *  Reference masked find / replace, comparing and replacing every byte at every position
+ */
+static bool referencePatch(const Patch &patch, uint8_t *data, size_t size) {
+	size_t patched = 0;
+	for (size_t off = 0; patch.size > 0 && off + patch.size <= size && patched < patch.count; off++) {
+		bool match = true;
+		for (size_t i = 0; i < patch.size && match; i++) {
+			uint8_t mask = patch.findMask ? patch.findMask[i] : 0xFF;
+			match = (data[off + i] & mask) == (patch.find[i] & mask);
+		}
+		if (!match)
+			continue;
+
+		for (size_t i = 0; i < patch.size; i++) {
+			uint8_t mask = patch.replaceMask ? patch.replaceMask[i] : 0xFF;
+			data[off + i] = (data[off + i] & ~mask) | (patch.replace[i] & mask);
+		}
+		patched++;
+		off += patch.size - 1;
+	}
+	return patched > 0;
+}
+
+static void checkApplyPatch() {
+	std::mt19937 rng(1);
+	std::vector<uint8_t> find, replace, findMask, replaceMask, data, expected;
+	bool matches = true;
+
+	for (size_t round = 0; round < 200000; round++) {
+		// Small alphabets and short windows make matches, overlaps and tail matches common.
+		size_t size = 1 + rng() % 12;
+		size_t window = rng() % 48;
+		uint8_t alphabet = rng() % 2 ? 2 : 0xFF;
+		auto byte = [&]() { return static_cast<uint8_t>(rng() % (alphabet + 1)); };
+
+		find.resize(size);
+		replace.resize(size);
+		findMask.resize(size);
+		replaceMask.resize(size);
+		for (size_t i = 0; i < size; i++) {
+			find[i] = byte();
+			replace[i] = static_cast<uint8_t>(rng());
+			static constexpr uint8_t masks[] {0xFF, 0xFF, 0x00, 0x0F, 0xF0};
+			findMask[i] = masks[rng() % arrsize(masks)];
+			replaceMask[i] = masks[rng() % arrsize(masks)];
+		}
+
+		data.resize(window + 16);
+		for (auto &b : data)
+			b = byte();
+		// Plant the pattern, often at the very end of the window.
+		if (window >= size && rng() % 2)
+			memcpy(&data[rng() % 2 ? window - size : rng() % (window - size + 1)], find.data(), size);
+		expected = data;
+
+		Patch patch {};
+		patch.size = size;
+		patch.find = find.data();
+		patch.replace = replace.data();
+		patch.findMask = rng() % 2 ? findMask.data() : nullptr;
+		patch.replaceMask = rng() % 2 ? replaceMask.data() : nullptr;
+		patch.count = 1 + rng() % 3;
+
+		// The bytes past the window must neither match nor change.
+		bool patched = applyPatch(patch, data.data(), window);
+		bool reference = referencePatch(patch, expected.data(), window);
+		matches = matches && patched == reference && data == expected;
+	}
+	CHECK(matches);
+
+	// Empty patches and windows shorter than the pattern are never applied.
+	uint8_t bytes[] {1, 2, 3, 4};
+	Patch patch {};
+	patch.find = patch.replace = bytes;
+	patch.count = 1;
+	CHECK(!applyPatch(patch, bytes, sizeof(bytes)));
+	patch.size = sizeof(bytes);
+	CHECK(!applyPatch(patch, bytes, sizeof(bytes) - 1));
+	CHECK(applyPatch(patch, bytes, sizeof(bytes)));
+}
+
+/**
+ *  Byte-wise exact-match loop used before masked patches
+ */
+static bool exactPatch(const Patch &patch, uint8_t *data, size_t size) {
+	bool r = false;
+	size_t patched = 0;
+	uint8_t *address = data, *end = data + size - patch.size;
+	while (address < end) {
+		size_t i = 0;
+		while (i < patch.size && address[i] == patch.find[i])
+			i++;
+		if (i == patch.size) {
+			for (i = 0; i < patch.size; i++)
+				address[i] = patch.replace[i];
+			r = true;
+			if (++patched >= patch.count)
+				break;
+			address += patch.size;
+		} else {
+			address++;
+		}
+	}
+	return r;
+}
+
+static void benchApplyPatch() {
+	// Framebuffer list like data, mostly zeroes and small values, with a connector patch near the end.
+	const uint8_t find[] {0x02, 0x04, 0x0A, 0x00, 0x00, 0x08, 0x00, 0x00};
+	const uint8_t replace[] {0x02, 0x04, 0x0A, 0x00, 0x00, 0x04, 0x00, 0x00};
+	const uint8_t mask[] {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0xFF};
+
+	for (size_t window : {static_cast<size_t>(4096), static_cast<size_t>(65536)}) {
+		std::vector<uint8_t> data(window);
+		std::mt19937 rng(1);
+		for (auto &b : data)
+			b = rng() % 4 == 0 ? static_cast<uint8_t>(rng() % 16) : 0;
+		printf("%zu byte window\n", window);
+
+		Patch patch {};
+		patch.size = sizeof(find);
+		patch.count = 1;
+		patch.find = find;
+		patch.replace = replace;
+
+		// Every round restores the pattern, so that both loops scan the whole window.
+		volatile size_t sum = 0;
+		size_t off = window - 2 * sizeof(find);
+		benchmark("exact-match loop", 2000, [&]() {
+			memcpy(&data[off], find, sizeof(find));
+			sum = sum + exactPatch(patch, data.data(), window);
+		});
+
+		benchmark("FramebufferProperties::applyPatch", 2000, [&]() {
+			memcpy(&data[off], find, sizeof(find));
+			sum = sum + applyPatch(patch, data.data(), window);
+		});
+
+		patch.findMask = mask;
+		benchmark("FramebufferProperties::applyPatch masked", 2000, [&]() {
+			memcpy(&data[off], find, sizeof(find));
+			sum = sum + applyPatch(patch, data.data(), window);
+		});
+	}
+}
+
+int main() {
+	checkLargeDictionary();
+	checkMissingEnable();
+	checkApplyPatch();
+	benchDictionary();
+	benchApplyPatch();
+	return finishChecks();
+}
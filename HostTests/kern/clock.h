@@ -0,0 +1,29 @@
+//
+//  clock.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef clock_h
+#define clock_h
+
+#include <stdint.h>
+#include <time.h>
+
+inline void clock_get_uptime(uint64_t *result) {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*result = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+inline void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result) {
+	*result = abstime;
+}
+
+inline void clock_interval_to_deadline(uint32_t interval, uint32_t scale, uint64_t *result) {
+	clock_get_uptime(result);
+	*result += static_cast<uint64_t>(interval) * scale;
+}
+
+#endif /* clock_h */
@@ -0,0 +1,66 @@
+//
+//  thread_call.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef thread_call_h
+#define thread_call_h
+
+// Host stand-in for delayed thread calls, pending calls only run when the check fires them.
+
+#include <stdint.h>
+
+typedef void *thread_call_param_t;
+typedef void (*thread_call_func_t)(thread_call_param_t, thread_call_param_t);
+
+struct thread_call {
+	thread_call_func_t func;
+	thread_call_param_t param;
+	bool pending;
+	uint64_t deadline;
+	size_t entered;
+};
+
+typedef thread_call *thread_call_t;
+
+inline thread_call_t thread_call_allocate(thread_call_func_t func, thread_call_param_t param) {
+	return new thread_call {func, param, false, 0, 0};
+}
+
+inline bool thread_call_enter_delayed(thread_call_t call, uint64_t deadline) {
+	bool pending = call->pending;
+	call->pending = true;
+	call->deadline = deadline;
+	call->entered++;
+	return pending;
+}
+
+inline bool thread_call_cancel(thread_call_t call) {
+	bool pending = call->pending;
+	call->pending = false;
+	return pending;
+}
+
+inline bool thread_call_free(thread_call_t call) {
+	delete call;
+	return true;
+}
+
+/**
+ *  Run a pending call as if its deadline passed
+ *
+ *  @param call  thread call
+ *
+ *  @return true if the call was pending
+ */
+inline bool thread_call_fire(thread_call_t call) {
+	if (!call->pending)
+		return false;
+	call->pending = false;
+	call->func(call->param, nullptr);
+	return true;
+}
+
+#endif /* thread_call_h */
@@ -0,0 +1,58 @@
+//
+//  loader.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef loader_h
+#define loader_h
+
+// Host stand-in for the Mach-O definitions used by the checked kext sources.
+
+#include <stdint.h>
+
+#define MH_MAGIC_64 0xFEEDFACF
+#define LC_SYMTAB   0x2
+#define LC_UUID     0x1B
+
+struct mach_header_64 {
+	uint32_t magic;
+	int32_t cputype;
+	int32_t cpusubtype;
+	uint32_t filetype;
+	uint32_t ncmds;
+	uint32_t sizeofcmds;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct load_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+};
+
+struct uuid_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint8_t uuid[16];
+};
+
+struct symtab_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint32_t symoff;
+	uint32_t nsyms;
+	uint32_t stroff;
+	uint32_t strsize;
+};
+
+struct nlist_64 {
+	uint32_t n_strx;
+	uint8_t n_type;
+	uint8_t n_sect;
+	uint16_t n_desc;
+	uint64_t n_value;
+};
+
+#endif /* loader_h */
@@ -0,0 +1,15 @@
+//
+//  vm_types.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef vm_types_h
+#define vm_types_h
+
+#include <stdint.h>
+
+typedef uint64_t mach_vm_address_t;
+
+#endif /* vm_types_h */
@@ -0,0 +1,284 @@
+//
+//  opts.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Options parser checks, fuzzing against per-option PE_parse_boot_argn-style scans, and benchmark.
+
+#include "check.hpp"
+#include <Headers/kern_util.hpp>
+
+// Invalid values are reported for every fuzzed boot-args string, so they are only counted.
+static size_t loggedMessages;
+#undef SYSLOG
+#define SYSLOG(mod, str, ...) (loggedMessages++)
+
+#include "../WhateverGreen/kern_opts.cpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ *  Expected option table
+ */
+static const struct {
+	Options::Id id;
+	const char *name;
+	Options::Type type;
+} OptionList[] {
+	{Options::Id::GfxReset,          "gfxrst",         Options::Type::Integer},
+	{Options::Id::GraphicsPolicyMod, "agdpmod",        Options::Type::String},
+	{Options::Id::IgfxSandyBridge,   "igfxsnb",        Options::Type::Integer},
+	{Options::Id::IgfxOpenGL,        "igfxgl",         Options::Type::Integer},
+	{Options::Id::IgfxNoHdmi,        "-igfxnohdmi",    Options::Type::Flag},
+	{Options::Id::IgfxDump,          "-igfxdump",      Options::Type::Flag},
+	{Options::Id::NgfxCompat,        "ngfxcompat",     Options::Type::Integer},
+	{Options::Id::NgfxSubmit,        "ngfxsubmit",     Options::Type::Integer},
+	{Options::Id::NgfxOpenGL,        "ngfxgl",         Options::Type::Integer},
+	{Options::Id::NgfxLibValFix,     "-ngfxlibvalfix", Options::Type::Flag},
+	{Options::Id::Rad24Bit,          "-rad24",         Options::Type::Flag},
+	{Options::Id::RadDviSingleLink,  "-raddvi",        Options::Type::Flag},
+	{Options::Id::RadOpenGL,         "-radgl",         Options::Type::Flag},
+	{Options::Id::RadConfigName,     "-radcfg",        Options::Type::Flag},
+	{Options::Id::RadVesa,           "-radvesa",       Options::Type::Flag},
+	{Options::Id::RadPowerGating,    "radpg",          Options::Type::Integer},
+	{Options::Id::ShikiGva,          "shikigva",       Options::Type::Integer},
+	{Options::Id::ShikiGvaLegacy,    "-shikigva",      Options::Type::Flag},
+	{Options::Id::ShikiFps,          "-shikifps",      Options::Type::Flag},
+	{Options::Id::ShikiBoardId,      "shiki-id",       Options::Type::String},
+	{Options::Id::CdfOff,            "-cdfoff",        Options::Type::Flag},
+	{Options::Id::SymbolCache,       "-wegsymcache",   Options::Type::Flag},
+	{Options::Id::BootTrace,         "-wegtrace",      Options::Type::Flag}
+};
+
+static_assert(arrsize(OptionList) == static_cast<size_t>(Options::Id::Total), "Incomplete option list");
+
+/**
+ *  Reference integer parser, values not fitting into 32 bits are rejected instead of wrapping
+ */
+static bool referenceInteger(std::string value, int32_t &out) {
+	bool negative = !value.empty() && value[0] == '-';
+	if (negative)
+		value.erase(0, 1);
+	int base = 10;
+	if (value.size() > 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'X')) {
+		base = 16;
+		value.erase(0, 2);
+	}
+	if (value.empty() || value.find_first_not_of(base == 16 ? "0123456789abcdefABCDEF" : "0123456789") != std::string::npos)
+		return false;
+	uint64_t result = 0;
+	for (char c : value) {
+		result = result * base + static_cast<uint64_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+		if (result > UINT32_MAX)
+			return false;
+	}
+	if (negative && result > static_cast<uint64_t>(INT32_MAX) + 1)
+		return false;
+	out = static_cast<int32_t>(negative ? -static_cast<int64_t>(result) : static_cast<int64_t>(result));
+	return true;
+}
+
+/**
+ *  Result of a single option lookup
+ */
+struct Lookup {
+	bool present {false};
+	int32_t number {0};
+	std::string string;
+};
+
+/**
+ *  PE_parse_boot_argn-style lookup scanning the whole boot-args string for a single option
+ */
+static Lookup referenceLookup(const char *bootArgs, const char *name, Options::Type type) {
+	Lookup result;
+	const char *arg = bootArgs;
+	while (*arg != '\0') {
+		while (*arg == ' ' || *arg == '\t')
+			arg++;
+		size_t argLen = strcspn(arg, " \t");
+		if (argLen == 0)
+			break;
+
+		std::string current(arg, argLen);
+		arg += argLen;
+		auto equals = current.find('=');
+		if (current.substr(0, equals) != name)
+			continue;
+
+		bool hasValue = equals != std::string::npos;
+		auto value = hasValue ? current.substr(equals + 1) : std::string();
+		if (type == Options::Type::Integer && hasValue && !referenceInteger(value, result.number))
+			continue;
+
+		result.present = true;
+		if (type == Options::Type::Flag || (type == Options::Type::Integer && !hasValue))
+			result.number = 1;
+		else if (type == Options::Type::String)
+			result.string = hasValue ? value.substr(0, Options::MaxStringSize - 1) : "1";
+		break;
+	}
+
+	return result;
+}
+
+/**
+ *  Compare the snapshot with per-option lookups
+ */
+static bool matchesReference(const char *bootArgs) {
+	bool matches = true;
+	for (auto &opt : OptionList) {
+		auto expected = referenceLookup(bootArgs, opt.name, opt.type);
+		matches = matches && Options::has(opt.id) == expected.present;
+		if (!expected.present)
+			continue;
+		if (opt.type == Options::Type::String)
+			matches = matches && Options::string(opt.id) && expected.string == Options::string(opt.id);
+		else
+			matches = matches && Options::integer(opt.id) == expected.number;
+	}
+	return matches;
+}
+
+static void checkParse() {
+	Options::parse("-v keepsyms=1 -igfxnohdmi\tigfxgl=0x1 ngfxcompat=-1 agdpmod=pikera,vit9696 shiki-id agdpmod=detect");
+	CHECK(Options::enabled(Options::Id::IgfxNoHdmi) && !Options::enabled(Options::Id::IgfxDump));
+	CHECK(Options::has(Options::Id::IgfxOpenGL) && Options::integer(Options::Id::IgfxOpenGL) == 1);
+	CHECK(Options::integer(Options::Id::NgfxCompat) == -1);
+	// The first occurrence wins.
+	CHECK(!strcmp(Options::string(Options::Id::GraphicsPolicyMod), "pikera,vit9696"));
+	// A bare string option reads as 1, same as in PE_parse_boot_argn.
+	CHECK(!strcmp(Options::string(Options::Id::ShikiBoardId), "1"));
+
+	// Defaults and device properties apply without boot-args.
+	CHECK(!Options::has(Options::Id::IgfxSandyBridge) && Options::integer(Options::Id::IgfxSandyBridge) == 1);
+	CHECK(!Options::has(Options::Id::NgfxSubmit) && Options::integer(Options::Id::NgfxSubmit) == 1);
+	auto device = new IORegistryEntry;
+	CHECK(Options::integer(Options::Id::NgfxOpenGL, device) == 0);
+	auto data = OSData::withCapacity(1);
+	device->setProperty("disable-metal", data);
+	data->release();
+	CHECK(Options::integer(Options::Id::NgfxOpenGL, device) == 1 && Options::integer(Options::Id::RadPowerGating, device) == 0);
+	CHECK(Options::integer(Options::Id::IgfxOpenGL, device) == 1);
+	device->release();
+
+	// Bare integers are enabled, invalid values are skipped in favour of later occurrences.
+	Options::parse("gfxrst radpg=0xZ radpg=15 igfxsnb=0x igfxsnb= ngfxsubmit=-0x10");
+	CHECK(Options::integer(Options::Id::GfxReset) == 1);
+	CHECK(Options::integer(Options::Id::RadPowerGating) == 15);
+	CHECK(!Options::has(Options::Id::IgfxSandyBridge));
+	CHECK(Options::integer(Options::Id::NgfxSubmit) == -16);
+
+	// Positive values are 32-bit patterns, anything not fitting into them is rejected.
+	Options::parse("radpg=0xFFFFFFFF ngfxsubmit=-2147483648 gfxrst=4294967295");
+	CHECK(static_cast<uint32_t>(Options::integer(Options::Id::RadPowerGating)) == 0xFFFFFFFF);
+	CHECK(Options::integer(Options::Id::NgfxSubmit) == INT32_MIN);
+	CHECK(static_cast<uint32_t>(Options::integer(Options::Id::GfxReset)) == 0xFFFFFFFF);
+	Options::parse("radpg=0x100000000 ngfxsubmit=-2147483649 gfxrst=4294967296 ngfxcompat=4294967297 igfxgl=99999999999");
+	CHECK(!Options::has(Options::Id::RadPowerGating) && !Options::has(Options::Id::NgfxSubmit) && !Options::has(Options::Id::GfxReset));
+	CHECK(!Options::has(Options::Id::NgfxCompat) && !Options::has(Options::Id::IgfxOpenGL));
+	CHECK(Options::integer(Options::Id::NgfxCompat) == -1);
+
+	// Names must match in full, values of flags are ignored.
+	Options::parse("-igfxnohdmix -igfx igfxg=1 -raddvi=0 agdpmod= shiki-idx=1");
+	CHECK(!Options::has(Options::Id::IgfxNoHdmi) && !Options::has(Options::Id::IgfxDump) && !Options::has(Options::Id::IgfxOpenGL));
+	CHECK(Options::enabled(Options::Id::RadDviSingleLink));
+	CHECK(Options::string(Options::Id::GraphicsPolicyMod) && Options::string(Options::Id::GraphicsPolicyMod)[0] == '\0');
+	CHECK(!Options::string(Options::Id::ShikiBoardId));
+
+	// Long strings are truncated.
+	std::string args = "shiki-id=" + std::string(300, 'M');
+	Options::parse(args.c_str());
+	CHECK(strlen(Options::string(Options::Id::ShikiBoardId)) == Options::MaxStringSize - 1);
+
+	// Parsing resets the snapshot, load reads the kernel boot-args.
+	Options::parse("");
+	CHECK(!Options::has(Options::Id::RadDviSingleLink) && !Options::string(Options::Id::GraphicsPolicyMod));
+	hostBootArgs = "-wegtrace agdpmod";
+	Options::load();
+	CHECK(Options::enabled(Options::Id::BootTrace) && !strcmp(Options::string(Options::Id::GraphicsPolicyMod), "1"));
+	hostBootArgs = "";
+}
+
+static void fuzzParse() {
+	// Names, near misses and values, glued with and without separators.
+	std::vector<std::string> names, values {"", "0", "1", "-1", "0x", "0X1f", "-0x80000000", "-0x80000001", "4294967295", "4294967296", "4294967297", "12a", "0xg",
+		"detect", "pikera", "=", "==1", std::string(200, 'x'), "1234567890123456", "0xFFFFFFFFFFFFFFFF"};
+	for (auto &opt : OptionList) {
+		names.emplace_back(opt.name);
+		names.emplace_back(std::string(opt.name) + "x");
+		names.emplace_back(std::string(opt.name).substr(0, strlen(opt.name) - 1));
+	}
+	names.insert(names.end(), {"-", "-v", "keepsyms", "", "="});
+	const char *separators[] {" ", "\t", "  ", "", "=", " \t"};
+
+	std::mt19937 rng(1);
+	GuardedImage guarded(4096);
+	size_t mismatches = 0;
+	for (size_t round = 0; round < 100000; round++) {
+		std::string args;
+		size_t count = rng() % 12;
+		for (size_t i = 0; i < count; i++) {
+			if (rng() % 16 == 0) {
+				// Raw bytes, including ones outside of ASCII.
+				size_t len = rng() % 8;
+				for (size_t j = 0; j < len; j++)
+					args += static_cast<char>(1 + rng() % 255);
+			} else {
+				args += names[rng() % names.size()];
+				if (rng() % 2)
+					args += "=" + values[rng() % values.size()];
+			}
+			args += separators[rng() % arrsize(separators)];
+		}
+
+		auto bootArgs = reinterpret_cast<const char *>(guarded.place(reinterpret_cast<const uint8_t *>(args.c_str()), args.size() + 1));
+		Options::parse(bootArgs);
+		if (!matchesReference(bootArgs)) {
+			if (mismatches++ < 5)
+				fprintf(stderr, "mismatch on boot-args \"%s\"\n", args.c_str());
+		}
+	}
+	CHECK(mismatches == 0);
+	printf("  100000 fuzzed boot-args, %zu invalid values reported\n", loggedMessages);
+}
+
+static void benchParse() {
+	const char *bootArgs = "-v keepsyms=1 debug=0x100 darkwake=0 npci=0x2000 -lilubetaall -disablegfxfirmware "
+		"agdpmod=pikera shikigva=80 igfxgl=1 -igfxnohdmi ngfxcompat=1 ngfxsubmit=0 -raddvi radpg=15 "
+		"shiki-id=Mac-7BA5B2D9E42DDD94 -cdfoff -wegsymcache alcid=1 brcmfx-country=#a";
+	printf("%zu byte boot-args, %zu options\n", strlen(bootArgs), arrsize(OptionList));
+
+	volatile int32_t sum = 0;
+	benchmark("per-option PE_parse_boot_argn scans", 20000, [&]() {
+		int32_t s = 0;
+		for (auto &opt : OptionList) {
+			auto result = referenceLookup(bootArgs, opt.name, opt.type);
+			s += result.number + static_cast<int32_t>(result.string.size());
+		}
+		sum = sum + s;
+	});
+
+	benchmark("single pass snapshot", 20000, [&]() {
+		Options::parse(bootArgs);
+		int32_t s = 0;
+		for (auto &opt : OptionList) {
+			auto str = opt.type == Options::Type::String ? Options::string(opt.id) : nullptr;
+			s += Options::integer(opt.id) + static_cast<int32_t>(str ? strlen(str) : 0);
+		}
+		sum = sum + s;
+	});
+
+	CHECK(matchesReference(bootArgs));
+}
+
+int main() {
+	checkParse();
+	fuzzParse();
+	benchParse();
+	return finishChecks();
+}
@@ -0,0 +1,20 @@
+//
+//  pexpert.h
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef pexpert_h
+#define pexpert_h
+
+/**
+ *  Fake boot-args, checks assign them before Options::load
+ */
+static const char *hostBootArgs = "";
+
+inline char *PE_boot_args() {
+	return const_cast<char *>(hostBootArgs);
+}
+
+#endif /* pexpert_h */
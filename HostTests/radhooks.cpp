@@ -0,0 +1,208 @@
+//
+//  radhooks.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// RAD property hook retirement checks, replaying controller starts and cail_properties merges against a mock patcher.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_radhooks.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ *  Mock patcher recording getProperty hook routes, retired merges count as unrouted
+ */
+struct MockPatcher {
+	std::string events;
+	bool routed {false};
+
+	void route() {
+		events += 'R';
+		routed = true;
+	}
+
+	void unroute() {
+		events += 'U';
+		routed = false;
+	}
+};
+
+/**
+ *  Controller events as reported by RAD wrappers
+ */
+struct MockRAD {
+	PropertyHookTracker tracker;
+	MockPatcher patcher;
+	size_t merges {0};
+
+	MockRAD(std::vector<const void *> providers) {
+		tracker.init(providers.data(), providers.size());
+		patcher.route();
+	}
+
+	~MockRAD() {
+		tracker.deinit();
+	}
+
+	/**
+	 *  Mirror the tracker state in the patcher
+	 */
+	void sync() {
+		if (tracker.isRetired() && patcher.routed)
+			patcher.unroute();
+		else if (!tracker.isRetired() && !patcher.routed)
+			patcher.route();
+	}
+
+	/**
+	 *  wrapATIControllerStart, CFG and PP merges happen during the start
+	 */
+	void start(const void *provider, bool result) {
+		tracker.controllerStarting(provider);
+		sync();
+		if (!tracker.isRetired())
+			merges++;
+		tracker.controllerStarted(provider, result);
+		sync();
+	}
+
+	/**
+	 *  wrapATIControllerStart with -radvesa
+	 */
+	void startVesa(const void *provider) {
+		tracker.controllerStarted(provider, false);
+		sync();
+	}
+
+	/**
+	 *  wrapGetProperty for cail_properties of the provider accelerator
+	 */
+	void readCail(const void *provider) {
+		if (tracker.isRetired())
+			return;
+		merges++;
+		tracker.cailMerged(provider);
+		sync();
+	}
+};
+
+static int gpus[16];
+
+static void checkRetirement() {
+	// Merges retire after the last counted controller started and merged cail_properties.
+	{
+		MockRAD rad({&gpus[0], &gpus[1]});
+		rad.start(&gpus[0], true);
+		rad.readCail(&gpus[0]);
+		// Repeated merges for one controller never account for the other one.
+		rad.readCail(&gpus[0]);
+		CHECK(!rad.tracker.isRetired());
+		rad.start(&gpus[1], true);
+		CHECK(!rad.tracker.isRetired());
+		rad.readCail(&gpus[1]);
+		CHECK(rad.tracker.isRetired() && rad.patcher.events == "RU");
+		rad.readCail(&gpus[1]);
+		CHECK(rad.merges == 5);
+	}
+
+	// Failed and VESA starts get no accelerator, so no cail_properties merge is awaited.
+	{
+		MockRAD rad({&gpus[0], &gpus[1]});
+		rad.start(&gpus[0], false);
+		CHECK(!rad.tracker.isRetired());
+		rad.startVesa(&gpus[1]);
+		CHECK(rad.tracker.isRetired() && rad.patcher.events == "RU");
+	}
+
+	// A controller not counted at boot, e.g. a Thunderbolt eGPU, re-arms the merges.
+	{
+		MockRAD rad({&gpus[0]});
+		rad.start(&gpus[0], true);
+		rad.readCail(&gpus[0]);
+		CHECK(rad.tracker.isRetired());
+		size_t merges = rad.merges;
+		rad.start(&gpus[1], true);
+		CHECK(!rad.tracker.isRetired() && rad.merges == merges + 1);
+		rad.readCail(&gpus[1]);
+		CHECK(rad.tracker.isRetired() && rad.merges == merges + 2);
+		CHECK(rad.patcher.events == "RURU");
+
+		// Restarted controllers get their merges as well.
+		rad.start(&gpus[0], true);
+		rad.readCail(&gpus[0]);
+		CHECK(rad.tracker.isRetired() && rad.merges == merges + 4 && rad.patcher.events == "RURURU");
+	}
+
+	// Starts not matching the counted controllers never retire the merges.
+	{
+		MockRAD rad({&gpus[0], &gpus[1]});
+		rad.start(&gpus[0], true);
+		rad.readCail(&gpus[0]);
+		rad.start(&gpus[2], true);
+		rad.readCail(&gpus[2]);
+		CHECK(!rad.tracker.isRetired() && rad.patcher.events == "R");
+	}
+
+	// Too many controllers to track keep the merges active.
+	{
+		std::vector<const void *> providers;
+		for (size_t i = 0; i <= PropertyHookTracker::MaxControllers; i++)
+			providers.push_back(&gpus[i]);
+		MockRAD rad(providers);
+		for (auto provider : providers) {
+			rad.start(provider, true);
+			rad.readCail(provider);
+		}
+		CHECK(!rad.tracker.isRetired() && rad.patcher.events == "R");
+	}
+	{
+		std::vector<const void *> providers;
+		for (size_t i = 0; i < PropertyHookTracker::MaxControllers; i++)
+			providers.push_back(&gpus[i]);
+		MockRAD rad(providers);
+		rad.start(&gpus[PropertyHookTracker::MaxControllers], true);
+		for (auto provider : providers) {
+			rad.start(provider, true);
+			rad.readCail(provider);
+		}
+		rad.readCail(&gpus[PropertyHookTracker::MaxControllers]);
+		CHECK(!rad.tracker.isRetired() && rad.patcher.events == "R");
+	}
+}
+
+static void checkConcurrentStarts() {
+	// Controllers start on separate threads, merges only retire after all of them.
+	for (size_t round = 0; round < 200; round++) {
+		std::vector<const void *> providers;
+		for (size_t i = 0; i < PropertyHookTracker::MaxControllers; i++)
+			providers.push_back(&gpus[i]);
+		PropertyHookTracker tracker;
+		tracker.init(providers.data(), providers.size());
+
+		std::vector<std::thread> threads;
+		for (auto provider : providers) {
+			threads.emplace_back([&tracker, provider]() {
+				tracker.controllerStarting(provider);
+				tracker.controllerStarted(provider, true);
+				tracker.cailMerged(provider);
+			});
+		}
+
+		for (auto &thread : threads)
+			thread.join();
+
+		CHECK(tracker.isRetired());
+		tracker.deinit();
+	}
+}
+
+int main() {
+	checkRetirement();
+	checkConcurrentStarts();
+	return finishChecks();
+}
@@ -0,0 +1,178 @@
+//
+//  radindex.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// RAD provider property index checks and benchmark against the per-merge property table walk it replaced.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_radindex.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ *  Per-merge property table walk, as mergeProperties did before the index
+ */
+static void mergeLinear(OSDictionary *props, const char *prefix, const OSDictionary *dict) {
+	auto iterator = OSCollectionIterator::withCollection(dict);
+	OSSymbol *propname;
+	size_t prefixlen = strlen(prefix);
+	while ((propname = OSDynamicCast(OSSymbol, iterator->getNextObject())) != nullptr) {
+		auto name = propname->getCStringNoCopy();
+		if (name && propname->getLength() > prefixlen && !strncmp(name, prefix, prefixlen)) {
+			auto prop = dict->getObject(propname);
+			if (prop) {
+				auto data = OSDynamicCast(OSData, prop);
+				if (data && data->getLength() == 1) {
+					auto val = static_cast<const uint8_t *>(data->getBytesNoCopy());
+					if (val && val[0] == 1) {
+						props->setObject(name+prefixlen, kOSBooleanTrue);
+						continue;
+					} else if (val && val[0] == 0) {
+						props->setObject(name+prefixlen, kOSBooleanFalse);
+						continue;
+					}
+				}
+
+				props->setObject(name+prefixlen, prop);
+			}
+		}
+	}
+	iterator->release();
+}
+
+/**
+ *  Compare dictionaries by key names and values
+ */
+static bool sameProperties(const OSDictionary *a, const OSDictionary *b) {
+	if (a->getCount() != b->getCount())
+		return false;
+	for (unsigned i = 0; i < a->getCount(); i++) {
+		auto key = a->getKey(i);
+		if (a->getObject(key) != b->getObject(key->getCStringNoCopy()))
+			return false;
+	}
+	return true;
+}
+
+/**
+ *  Synthetic provider property table, about a third of the properties are prefixed
+ */
+static OSDictionary *makeProperties(size_t num, uint32_t seed) {
+	static const char *prefixes[] {"CFG,", "PP,", "CAIL,", "", "", "", "ATY,", "CFG", "CA", "PP_", "@0,", "AAPL,"};
+	auto dict = OSDictionary::withCapacity(static_cast<unsigned>(num));
+	std::mt19937 rng(seed);
+	for (size_t i = 0; i < num; i++) {
+		auto name = std::string(prefixes[rng() % arrsize(prefixes)]) + "Property" + std::to_string(i);
+		uint8_t bytes[4] {static_cast<uint8_t>(rng() % 3), static_cast<uint8_t>(rng()), 0, 0};
+		auto data = OSData::withBytes(bytes, rng() % 2 ? 1 : 4);
+		dict->setObject(name.c_str(), data);
+		data->release();
+	}
+
+	// Prefixes alone are not merged.
+	for (auto prefix : {"CFG,", "PP,", "CAIL,"}) {
+		auto data = OSData::withBytes("\x01", 1);
+		dict->setObject(prefix, data);
+		data->release();
+	}
+	return dict;
+}
+
+static const MergedKey MergedKeys[] {MergedKey::Config, MergedKey::Properties, MergedKey::Cail};
+
+static void checkIndex() {
+	size_t prefixlen;
+	CHECK(MergedPropertyIndex::classify("CFG,CFG_FB_LIMIT", 16, prefixlen) == MergedKey::Config && prefixlen == 4);
+	CHECK(MergedPropertyIndex::classify("PP,PP_WorkLoadPolicyMask", 24, prefixlen) == MergedKey::Properties && prefixlen == 3);
+	CHECK(MergedPropertyIndex::classify("CAIL,CAIL_DisableGfxCGPowerGating", 33, prefixlen) == MergedKey::Cail && prefixlen == 5);
+	CHECK(MergedPropertyIndex::classify("CAIL,", 5, prefixlen) == MergedKey::None && prefixlen == 0);
+	CHECK(MergedPropertyIndex::classify("CA", 2, prefixlen) == MergedKey::None);
+	CHECK(MergedPropertyIndex::classify("ATY,EFIVersion", 14, prefixlen) == MergedKey::None);
+
+	// Every bucket matches the properties a table walk merges, including the boolean conversion.
+	for (uint32_t seed = 1; seed <= 50; seed++) {
+		auto dict = makeProperties(100 + seed * 10, seed);
+		MergedPropertyIndex index;
+		index.build(dict);
+		CHECK(index.get(MergedKey::None) == nullptr);
+		for (auto key : MergedKeys) {
+			auto linear = OSDictionary::withCapacity(8);
+			mergeLinear(linear, MergedPropertyIndex::prefix(key), dict);
+			auto indexed = OSDictionary::withCapacity(8);
+			if (index.get(key))
+				indexed->merge(index.get(key));
+			CHECK(linear->getCount() > 0 && sameProperties(linear, indexed));
+			CHECK(!linear->getObject(""));
+			linear->release();
+			indexed->release();
+		}
+		index.release();
+		CHECK(index.get(MergedKey::Config) == nullptr);
+		dict->release();
+	}
+
+	// Properties without prefixed entries have no buckets.
+	auto empty = OSDictionary::withCapacity(1);
+	auto data = OSData::withBytes("\x01", 1);
+	empty->setObject("device-id", data);
+	data->release();
+	MergedPropertyIndex index;
+	index.build(empty);
+	for (auto key : MergedKeys)
+		CHECK(index.get(key) == nullptr);
+	index.release();
+	empty->release();
+}
+
+static void benchIndex() {
+	auto dict = makeProperties(600, 1);
+
+	// A controller start merges aty_config and aty_properties, the accelerator merges cail_properties,
+	// later reads of every merged key merge again.
+	const size_t merges = 30;
+	printf("%u properties, %zu merges of each key\n", dict->getCount(), merges);
+
+	volatile size_t sum = 0;
+	benchmark("table walk per merge", 200, [&]() {
+		size_t s = 0;
+		for (size_t i = 0; i < merges; i++) {
+			for (auto key : MergedKeys) {
+				auto props = OSDictionary::withCapacity(8);
+				mergeLinear(props, MergedPropertyIndex::prefix(key), dict);
+				s += props->getCount();
+				props->release();
+			}
+		}
+		sum = sum + s;
+	});
+
+	benchmark("index once, bucket merges", 200, [&]() {
+		size_t s = 0;
+		MergedPropertyIndex index;
+		index.build(dict);
+		for (size_t i = 0; i < merges; i++) {
+			for (auto key : MergedKeys) {
+				auto props = OSDictionary::withCapacity(8);
+				if (index.get(key))
+					props->merge(index.get(key));
+				s += props->getCount();
+				props->release();
+			}
+		}
+		index.release();
+		sum = sum + s;
+	});
+
+	dict->release();
+}
+
+int main() {
+	checkIndex();
+	benchIndex();
+	return finishChecks();
+}
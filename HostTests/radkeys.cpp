@@ -0,0 +1,171 @@
+//
+//  radkeys.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// RAD getProperty key filter checks and benchmark replaying registry reads through the wrapper with a mocked original.
+
+// Hit and miss counters are only built in DEBUG.
+#define DEBUG
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_radkeys.hpp"
+#include <Library/LegacyIOService.h>
+
+#include <random>
+#include <vector>
+
+/**
+ *  Keys commonly read from the registry during boot, a few of them merged by RAD
+ */
+static const char *CommonKeys[] {
+	"IOName", "IOClass", "IOProviderClass", "IOMatchCategory", "IOPCIMatch", "IOPropertyMatch",
+	"compatible", "device-id", "vendor-id", "subsystem-id", "subsystem-vendor-id", "class-code",
+	"revision-id", "reg", "assigned-addresses", "name", "model", "AAPL,slot-name", "acpi-path",
+	"built-in", "IOPMResetPowerStateOnWake", "IODeviceMemory", "IOInterruptSpecifiers",
+	"IOUserClientClass", "IOGeneralInterest", "IOKitDebug", "CFBundleIdentifier", "IOPowerManagement",
+	"ATY,EFIVersion", "ATY,DeviceID", "ATY,VendorID", "AAPL,ndrv-dev", "cail_properties_version",
+	"aty_", "at", "a", "c", "", "aty_config2", "aty_propertie", "cail_propertiesx"
+};
+
+/**
+ *  Merged keys
+ */
+static const char *MergedKeys[] {
+	"aty_config", "aty_properties", "cail_properties"
+};
+
+static void checkClassify() {
+	CHECK(MergedKeyFilter::classify("aty_config") == MergedKey::Config);
+	CHECK(MergedKeyFilter::classify("aty_properties") == MergedKey::Properties);
+	CHECK(MergedKeyFilter::classify("cail_properties") == MergedKey::Cail);
+	CHECK(MergedKeyFilter::classify(nullptr) == MergedKey::None);
+	for (auto key : CommonKeys)
+		CHECK(MergedKeyFilter::classify(key) == MergedKey::None);
+
+	// Every prefix of a merged key is rejected, including the ones stopping inside the character compares.
+	for (auto key : MergedKeys) {
+		char prefix[32] {};
+		for (size_t i = 0; i < strlen(key); i++) {
+			CHECK(MergedKeyFilter::classify(prefix) == MergedKey::None);
+			prefix[i] = key[i];
+		}
+	}
+
+	MergedKeyFilter filter;
+	for (auto key : CommonKeys)
+		filter.check(key);
+	for (auto key : MergedKeys)
+		filter.check(key);
+	CHECK(filter.hits == arrsize(MergedKeys) && filter.misses == arrsize(CommonKeys));
+}
+
+/**
+ *  Mocked original getProperty, dictionaries for keys starting with I, a or c, data for the rest
+ */
+static OSDictionary *dictionaryValue;
+static OSData *dataValue;
+
+static OSObject *orgGetProperty(IORegistryEntry *, const char *key) {
+	if (key[0] == 'I' || key[0] == 'a' || key[0] == 'c')
+		return dictionaryValue;
+	return dataValue;
+}
+
+/**
+ *  Amount of reads reaching the merge path
+ */
+static size_t mergeRequests;
+
+/**
+ *  Wrapper before the key filter, casting every object and comparing keys afterwards
+ */
+static OSObject *wrapGetPropertyUnfiltered(IORegistryEntry *that, const char *aKey) {
+	auto obj = orgGetProperty(that, aKey);
+	auto props = OSDynamicCast(OSDictionary, obj);
+	if (props && aKey) {
+		if (aKey[0] == 'a') {
+			if (!strcmp(aKey, "aty_config") || !strcmp(aKey, "aty_properties"))
+				mergeRequests++;
+		} else if (aKey[0] == 'c' && !strcmp(aKey, "cail_properties")) {
+			mergeRequests++;
+		}
+	}
+	return obj;
+}
+
+/**
+ *  Wrapper with the key filter, as in RAD::wrapGetProperty
+ */
+static MergedKeyFilter keyFilter;
+
+static OSObject *wrapGetProperty(IORegistryEntry *that, const char *aKey) {
+	auto obj = orgGetProperty(that, aKey);
+	auto key = keyFilter.check(aKey);
+	if (key == MergedKey::None)
+		return obj;
+
+	auto props = OSDynamicCast(OSDictionary, obj);
+	if (props)
+		mergeRequests++;
+	return obj;
+}
+
+static void benchReads() {
+	dictionaryValue = OSDictionary::withCapacity(1);
+	dataValue = OSData::withCapacity(4);
+	auto entry = new IORegistryEntry;
+
+	// About one read in a thousand is a merged key.
+	std::vector<const char *> keys(200000);
+	std::mt19937 rng(1);
+	size_t merged = 0;
+	for (auto &key : keys) {
+		if (rng() % 1000 == 0) {
+			key = MergedKeys[rng() % arrsize(MergedKeys)];
+			merged++;
+		} else {
+			key = CommonKeys[rng() % arrsize(CommonKeys)];
+		}
+	}
+	printf("%zu getProperty calls, %zu merged keys\n", keys.size(), merged);
+
+	volatile uintptr_t sum = 0;
+	mergeRequests = 0;
+	benchmark("cast and compare every key", 20, [&]() {
+		uintptr_t s = 0;
+		for (auto key : keys)
+			s += reinterpret_cast<uintptr_t>(wrapGetPropertyUnfiltered(entry, key));
+		sum = sum + s;
+	});
+	CHECK(mergeRequests == merged * 20);
+
+	mergeRequests = 0;
+	benchmark("key filter", 20, [&]() {
+		uintptr_t s = 0;
+		for (auto key : keys)
+			s += reinterpret_cast<uintptr_t>(wrapGetProperty(entry, key));
+		sum = sum + s;
+	});
+	CHECK(mergeRequests == merged * 20);
+	CHECK(keyFilter.hits == merged * 20 && keyFilter.misses == (keys.size() - merged) * 20);
+
+	benchmark("original getProperty only", 20, [&]() {
+		uintptr_t s = 0;
+		for (auto key : keys)
+			s += reinterpret_cast<uintptr_t>(orgGetProperty(entry, key));
+		sum = sum + s;
+	});
+
+	entry->release();
+	dataValue->release();
+	dictionaryValue->release();
+}
+
+int main() {
+	checkClassify();
+	benchReads();
+	return finishChecks();
+}
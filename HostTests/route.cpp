@@ -0,0 +1,337 @@
+//
+//  route.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// RoutePlan lookup patch and route checks, single pass benchmark, e.g.:
+//   HostTests/build.tool AMDRadeonX4000 AMDFramebuffer AppleGraphicsDevicePolicy
+// Without arguments a synthetic image is used.
+
+#define WEG_TRACE_SCOPE(phase, ...)
+#define WEG_TRACE_CALL(phase, ...) (__VA_ARGS__)
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_route.cpp"
+#include "../WhateverGreen/kern_session.cpp"
+
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ *  Amount of opened kernel writing windows
+ */
+static size_t writingWindows;
+
+kern_return_t MachInfo::setKernelWriting(bool enable, IOSimpleLock *) {
+	if (enable)
+		writingWindows++;
+	return KERN_SUCCESS;
+}
+
+bool SymbolCache::enabled() {
+	return false;
+}
+
+mach_vm_address_t SymbolCache::find(mach_vm_address_t, size_t, const char *) {
+	return 0;
+}
+
+void SymbolCache::store(mach_vm_address_t, size_t, const char *, mach_vm_address_t) {}
+
+void SymbolCache::flush() {}
+
+/**
+ *  Lookup patches WhateverGreen schedules, see CDF, RAD and WEG modules
+ */
+static const uint8_t gk100Find[] {0x88, 0x84, 0x02, 0x00};
+static const uint8_t gk100Repl[] {0x80, 0x1A, 0x06, 0x00};
+static const uint8_t agdpFind[] {0xBA, 0x05, 0x00, 0x00, 0x00};
+static const uint8_t agdpRepl[] {0xBA, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t metalFind1[] {0x4D, 0x65, 0x74, 0x61, 0x6C, 0x53, 0x74, 0x61};
+static const uint8_t metalFind2[] {0x4D, 0x65, 0x74, 0x61, 0x6C, 0x50, 0x6C, 0x75};
+static const uint8_t metalRepl1[] {0x50, 0x65, 0x74, 0x61, 0x6C, 0x53, 0x74, 0x61};
+static const uint8_t metalRepl2[] {0x50, 0x65, 0x74, 0x61, 0x6C, 0x50, 0x6C, 0x75};
+
+static KernelPatcher::LookupPatch benchPatches[] {
+	{nullptr, gk100Find, gk100Repl, sizeof(gk100Find), 1},
+	{nullptr, agdpFind, agdpRepl, sizeof(agdpFind), 1},
+	{nullptr, reinterpret_cast<const uint8_t *>("board-id"), reinterpret_cast<const uint8_t *>("board-ix"), sizeof("board-id"), 1},
+	{nullptr, reinterpret_cast<const uint8_t *>("--RRRRRRRRRRGGGGGGGGGGBBBBBBBBBB"),
+		reinterpret_cast<const uint8_t *>("--------RRRRRRRRGGGGGGGGBBBBBBBB"), 32, 2},
+	{nullptr, metalFind1, metalRepl1, sizeof(metalFind1), 2},
+	{nullptr, metalFind2, metalRepl2, sizeof(metalFind2), 2}
+};
+
+/**
+ *  Sequential lookups as done by separate KernelPatcher::applyLookupPatch calls
+ */
+static size_t applySequential(uint8_t *data, size_t size, const KernelPatcher::LookupPatch *patches, size_t num) {
+	size_t found = 0;
+	for (size_t i = 0; i < num; i++) {
+		auto &p = patches[i];
+		size_t changes = 0;
+		for (size_t off = 0; off + p.size <= size; off++) {
+			if (!memcmp(&data[off], p.find, p.size)) {
+				memcpy(&data[off], p.replace, p.size);
+				if (++changes == p.count)
+					break;
+			}
+		}
+		found += changes > 0;
+	}
+	return found;
+}
+
+static bool applyPlan(uint8_t *data, size_t size, const KernelPatcher::LookupPatch *patches, size_t num, bool optional=true) {
+	KernelPatcher patcher;
+	RoutePlan plan(0, reinterpret_cast<mach_vm_address_t>(data), size);
+	for (size_t i = 0; i < num; i++)
+		plan.add(patches[i], "bench", optional);
+	return plan.apply(patcher);
+}
+
+static void checkPlan() {
+	// Both patches are applied in one pass with their counts respected.
+	uint8_t data[256] {};
+	memcpy(&data[10], agdpFind, sizeof(agdpFind));
+	memcpy(&data[40], metalFind1, sizeof(metalFind1));
+	memcpy(&data[80], metalFind1, sizeof(metalFind1));
+	memcpy(&data[120], metalFind1, sizeof(metalFind1));
+	uint8_t expected[sizeof(data)];
+	memcpy(expected, data, sizeof(data));
+	KernelPatcher::LookupPatch patches[] {
+		{nullptr, agdpFind, agdpRepl, sizeof(agdpFind), 1},
+		{nullptr, metalFind1, metalRepl1, sizeof(metalFind1), 2}
+	};
+	applySequential(expected, sizeof(expected), patches, arrsize(patches));
+	CHECK(applyPlan(data, sizeof(data), patches, arrsize(patches), false));
+	CHECK(!memcmp(data, expected, sizeof(data)));
+	CHECK(!memcmp(&data[120], metalFind1, sizeof(metalFind1)));
+
+	// Missing optional patches do not fail the plan, required ones do.
+	KernelPatcher::LookupPatch missing {nullptr, metalFind2, metalRepl2, sizeof(metalFind2), 2};
+	CHECK(applyPlan(data, sizeof(data), &missing, 1, true));
+	CHECK(!applyPlan(data, sizeof(data), &missing, 1, false));
+
+	// Patches that may not fit into one session are refused, so a scan never overflows.
+	memset(data, 0, sizeof(data));
+	for (size_t i = 0; i < 20; i++)
+		memcpy(&data[i * 8], gk100Find, sizeof(gk100Find));
+	KernelPatcher::LookupPatch unlimited {nullptr, gk100Find, gk100Repl, sizeof(gk100Find), 0};
+	KernelPatcher::LookupPatch many {nullptr, gk100Find, gk100Repl, sizeof(gk100Find), PatchSession::MaxWrites + 1};
+	CHECK(!applyPlan(data, sizeof(data), &unlimited, 1, false));
+	CHECK(!applyPlan(data, sizeof(data), &many, 1, false));
+	CHECK(!memcmp(data, gk100Find, sizeof(gk100Find)));
+
+	KernelPatcher::LookupPatch fitting {nullptr, gk100Find, gk100Repl, sizeof(gk100Find), PatchSession::MaxWrites};
+	CHECK(applyPlan(data, sizeof(data), &fitting, 1, false));
+	CHECK(!memcmp(&data[(PatchSession::MaxWrites - 1) * 8], gk100Repl, sizeof(gk100Repl)));
+	CHECK(!memcmp(&data[PatchSession::MaxWrites * 8], gk100Find, sizeof(gk100Find)));
+}
+
+static void checkChained() {
+	// The Metal patches of RAD never overlap, so they share one pass and one writing window.
+	uint8_t data[64] {};
+	memcpy(&data[8], metalFind2, sizeof(metalFind2));
+	memcpy(&data[16], metalFind1, sizeof(metalFind1));
+	KernelPatcher::LookupPatch metal[] {
+		{nullptr, metalFind1, metalRepl1, sizeof(metalFind1), 2},
+		{nullptr, metalFind2, metalRepl2, sizeof(metalFind2), 2}
+	};
+	writingWindows = 0;
+	CHECK(applyPlan(data, sizeof(data), metal, arrsize(metal)));
+	CHECK(writingWindows == 1);
+	CHECK(!memcmp(&data[8], metalRepl2, sizeof(metalRepl2)) && !memcmp(&data[16], metalRepl1, sizeof(metalRepl1)));
+
+	// A later patch matching the output of an earlier one sees it, like with separate lookups.
+	static const uint8_t stepA[] {0x11, 0x22, 0x33};
+	static const uint8_t stepB[] {0x44, 0x55, 0x66};
+	static const uint8_t stepC[] {0x77, 0x88, 0x99};
+	KernelPatcher::LookupPatch chained[] {
+		{nullptr, stepA, stepB, sizeof(stepA), 1},
+		{nullptr, stepB, stepC, sizeof(stepB), 1}
+	};
+	memset(data, 0, sizeof(data));
+	memcpy(&data[20], stepA, sizeof(stepA));
+	uint8_t expected[sizeof(data)];
+	memcpy(expected, data, sizeof(data));
+	applySequential(expected, sizeof(expected), chained, arrsize(chained));
+	writingWindows = 0;
+	CHECK(applyPlan(data, sizeof(data), chained, arrsize(chained), false));
+	CHECK(writingWindows == arrsize(chained));
+	CHECK(!memcmp(data, expected, sizeof(data)) && !memcmp(&data[20], stepC, sizeof(stepC)));
+
+	// Overlapping matches go to the earlier patch even when the later one starts first.
+	static const uint8_t overlapFind1[] {0x33, 0x44, 0x55};
+	static const uint8_t overlapFind2[] {0x22, 0x33, 0x44};
+	static const uint8_t overlapRepl[] {0xEE, 0xEE, 0xEE};
+	KernelPatcher::LookupPatch overlapping[] {
+		{nullptr, overlapFind1, overlapRepl, sizeof(overlapFind1), 1},
+		{nullptr, overlapFind2, overlapRepl, sizeof(overlapFind2), 1}
+	};
+	static const uint8_t overlapData[] {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+	memset(data, 0, sizeof(data));
+	memcpy(&data[30], overlapData, sizeof(overlapData));
+	memcpy(expected, data, sizeof(data));
+	applySequential(expected, sizeof(expected), overlapping, arrsize(overlapping));
+	CHECK(!applyPlan(data, sizeof(data), overlapping, arrsize(overlapping), false));
+	CHECK(!memcmp(data, expected, sizeof(data)) && data[31] == 0x22);
+
+	// Random short patterns over a small alphabet are compared against separate lookups.
+	// Each of them replaces non-overlapping matches found before its own writes, as the plan does within a patch.
+	auto applySeparate = [](uint8_t *dst, size_t size, const KernelPatcher::LookupPatch *patches, size_t num) {
+		std::vector<uint8_t> before(size);
+		for (size_t i = 0; i < num; i++) {
+			auto &p = patches[i];
+			memcpy(before.data(), dst, size);
+			size_t changes = 0;
+			for (size_t off = 0; off + p.size <= size && changes < p.count; off++) {
+				if (!memcmp(&before[off], p.find, p.size)) {
+					memcpy(&dst[off], p.replace, p.size);
+					changes++;
+					off += p.size - 1;
+				}
+			}
+		}
+	};
+
+	std::mt19937 rng(1);
+	for (size_t round = 0; round < 20000; round++) {
+		uint8_t bytes[4][2][3];
+		KernelPatcher::LookupPatch random[4];
+		size_t num = 2 + rng() % 3;
+		for (size_t i = 0; i < num; i++) {
+			size_t len = 1 + rng() % 3;
+			for (size_t b = 0; b < len; b++) {
+				bytes[i][0][b] = static_cast<uint8_t>(rng() % 3);
+				bytes[i][1][b] = static_cast<uint8_t>(rng() % 3);
+			}
+			random[i] = {nullptr, bytes[i][0], bytes[i][1], len, 1 + rng() % 2};
+		}
+		for (auto &b : data)
+			b = static_cast<uint8_t>(rng() % 3);
+		memcpy(expected, data, sizeof(data));
+		applySeparate(expected, sizeof(expected), random, num);
+		applyPlan(data, sizeof(data), random, num);
+		CHECK(!memcmp(data, expected, sizeof(data)));
+	}
+}
+
+/**
+ *  Symbols of unrelated hooks, one of them missing from the kext
+ */
+static mach_vm_address_t resolveRouteSymbol(const char *symbol) {
+	if (!strcmp(symbol, "missing"))
+		return 0;
+	return 0x1000 + strlen(symbol);
+}
+
+static void wrapFirst() {}
+static void wrapSecond() {}
+static void wrapThird() {}
+
+static void checkRoutes() {
+	uint8_t data[16] {};
+	mach_vm_address_t orgFirst {0}, orgSecond {0}, orgThird {0};
+
+	// All the routes go through a single call.
+	KernelPatcher patcher;
+	patcher.resolver = resolveRouteSymbol;
+	RoutePlan plan(0, reinterpret_cast<mach_vm_address_t>(data), sizeof(data));
+	plan.add("first", wrapFirst, orgFirst);
+	plan.add("second", wrapSecond, orgSecond);
+	CHECK(plan.apply(patcher));
+	CHECK(patcher.routeMultipleCalls == 1 && patcher.routedFunctions == 2 && orgFirst && orgSecond);
+
+	// A missing symbol fails the plan, the routes around it are still applied exactly once.
+	orgFirst = orgSecond = 0;
+	patcher = KernelPatcher();
+	patcher.resolver = resolveRouteSymbol;
+	plan.add("first", wrapFirst, orgFirst);
+	plan.add("missing", wrapSecond, orgSecond);
+	plan.add("third", wrapThird, orgThird);
+	CHECK(!plan.apply(patcher));
+	CHECK(orgFirst && !orgSecond && orgThird);
+	CHECK(patcher.routedFunctions == 2 && patcher.getError() == KernelPatcher::Error::NoError);
+
+	// Storage already holding the original of another kext route is kept when the batch fails.
+	mach_vm_address_t orgOther {0x1234};
+	orgFirst = 0;
+	patcher = KernelPatcher();
+	patcher.resolver = resolveRouteSymbol;
+	plan.add("missing", wrapFirst, orgOther);
+	plan.add("first", wrapFirst, orgFirst);
+	CHECK(!plan.apply(patcher));
+	CHECK(orgOther == 0x1234 && orgFirst && patcher.routedFunctions == 1);
+}
+
+static void benchImage(const char *name, const std::vector<uint8_t> &image) {
+	printf("%s, %zu bytes\n", name, image.size());
+	std::vector<uint8_t> seq, plan;
+	size_t found = 0;
+	benchmark("sequential lookups", 10, [&]() {
+		seq = image;
+		found = applySequential(seq.data(), seq.size(), benchPatches, arrsize(benchPatches));
+	});
+	benchmark("single pass plan", 10, [&]() {
+		plan = image;
+		applyPlan(plan.data(), plan.size(), benchPatches, arrsize(benchPatches));
+	});
+	printf("  %zu of %zu patches found\n", found, arrsize(benchPatches));
+	CHECK(seq == plan);
+}
+
+static bool readImage(const char *path, std::vector<uint8_t> &image) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	auto file = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+		return false;
+	auto bytes = static_cast<const uint8_t *>(file);
+	image.assign(bytes, bytes + st.st_size);
+	munmap(file, static_cast<size_t>(st.st_size));
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	checkPlan();
+	checkChained();
+	checkRoutes();
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++) {
+			std::vector<uint8_t> image;
+			if (readImage(argv[i], image))
+				benchImage(argv[i], image);
+			else
+				fprintf(stderr, "failed to read %s\n", argv[i]);
+		}
+	} else {
+		// Kext sized image with the patterns placed towards its end.
+		std::vector<uint8_t> image(16 * 1024 * 1024);
+		std::mt19937 rng(1);
+		for (auto &b : image)
+			b = static_cast<uint8_t>(rng());
+		size_t off = image.size() - 4096;
+		for (auto &p : benchPatches) {
+			for (size_t i = 0; i < p.count; i++, off += 64)
+				memcpy(&image[off], p.find, p.size);
+		}
+		benchImage("synthetic image", image);
+	}
+
+	return finishChecks();
+}
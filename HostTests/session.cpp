@@ -0,0 +1,111 @@
+//
+//  session.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// PatchSession checks against a fake write protection backend counting protection transitions.
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_session.cpp"
+
+static size_t writeEnables, writeDisables;
+static bool writeFails, writeEnabled;
+
+kern_return_t MachInfo::setKernelWriting(bool enable, IOSimpleLock *) {
+	if (enable && writeFails)
+		return KERN_FAILURE;
+	if (enable == writeEnabled)
+		fprintf(stderr, "session: redundant protection transition\n");
+	writeEnabled = enable;
+	(enable ? writeEnables : writeDisables)++;
+	return KERN_SUCCESS;
+}
+
+static void resetBackend() {
+	writeEnables = writeDisables = 0;
+	writeFails = writeEnabled = false;
+}
+
+int main() {
+	uint32_t target[PatchSession::MaxWrites + 1] {};
+
+	// A whole batch is written within a single window and can be reverted.
+	{
+		resetBackend();
+		PatchSession session;
+		for (size_t i = 0; i < PatchSession::MaxWrites; i++) {
+			target[i] = static_cast<uint32_t>(i);
+			CHECK(session.add(&target[i], static_cast<uint32_t>(i + 100)));
+		}
+		CHECK(session.commit());
+		CHECK(writeEnables == 1 && writeDisables == 1);
+		for (size_t i = 0; i < PatchSession::MaxWrites; i++)
+			CHECK(target[i] == i + 100);
+		CHECK(!session.add(&target[0], 1U));
+		CHECK(session.revert());
+		CHECK(writeEnables == 2 && writeDisables == 2);
+		for (size_t i = 0; i < PatchSession::MaxWrites; i++)
+			CHECK(target[i] == i);
+	}
+
+	// Overlapping writes are applied in order and reverted in reverse.
+	{
+		resetBackend();
+		PatchSession session;
+		target[0] = 1;
+		CHECK(session.add(&target[0], 2U));
+		CHECK(session.add(&target[0], 3U));
+		CHECK(session.commit() && target[0] == 3);
+		CHECK(session.revert() && target[0] == 1);
+	}
+
+	// Overflowed sessions write nothing at all.
+	{
+		resetBackend();
+		PatchSession session;
+		for (size_t i = 0; i <= PatchSession::MaxWrites; i++)
+			target[i] = 0;
+		bool added = true;
+		for (size_t i = 0; i <= PatchSession::MaxWrites; i++)
+			added = session.add(&target[i], 1U) && added;
+		CHECK(!added && session.overflowed());
+		CHECK(!session.commit());
+		CHECK(writeEnables == 0 && writeDisables == 0);
+		for (size_t i = 0; i <= PatchSession::MaxWrites; i++)
+			CHECK(target[i] == 0);
+	}
+
+	// Byte storage overflow behaves the same way.
+	{
+		resetBackend();
+		PatchSession session;
+		uint8_t big[PatchSession::MaxBytes + 1] {}, src[PatchSession::MaxBytes + 1] {1};
+		CHECK(!session.add(big, src, sizeof(big)));
+		CHECK(!session.commit() && big[0] == 0 && writeEnables == 0);
+	}
+
+	// Failing to disable protection leaves the session uncommitted.
+	{
+		resetBackend();
+		writeFails = true;
+		PatchSession session;
+		target[0] = 7;
+		CHECK(session.add(&target[0], 8U));
+		CHECK(!session.commit() && target[0] == 7);
+		CHECK(!session.revert());
+		writeFails = false;
+		CHECK(session.commit() && target[0] == 8);
+		CHECK(writeEnables == 1 && writeDisables == 1);
+	}
+
+	// Empty sessions do not touch protection.
+	{
+		resetBackend();
+		PatchSession session;
+		CHECK(session.commit() && writeEnables == 0);
+	}
+
+	return finishChecks();
+}
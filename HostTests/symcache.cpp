@@ -0,0 +1,363 @@
+//
+//  symcache.cpp
+//  HostTests
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// SymbolCache checks and symbol solving benchmark over fake NVRAM, e.g.:
+//   HostTests/build.tool AMDRadeonX4000 AMDFramebuffer AppleGraphicsDevicePolicy
+// Without arguments a synthetic image is used, arguments must be thin 64-bit kext binaries.
+
+#define WEG_TRACE_SCOPE(phase, ...)
+#define WEG_TRACE_CALL(phase, ...) (__VA_ARGS__)
+
+#include "check.hpp"
+#include "../WhateverGreen/kern_opts.cpp"
+#include "../WhateverGreen/kern_route.cpp"
+#include "../WhateverGreen/kern_session.cpp"
+#include "../WhateverGreen/kern_symcache.cpp"
+
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+kern_return_t MachInfo::setKernelWriting(bool, IOSimpleLock *) {
+	return KERN_SUCCESS;
+}
+
+/**
+ *  Image the resolver walks the symbol table of
+ */
+static const uint8_t *symImage;
+static size_t symImageSize;
+static const symtab_command *symTable;
+
+/**
+ *  Linear symbol table walk, same as KernelPatcher::solveSymbol does on a miss
+ */
+static mach_vm_address_t resolveSymbol(const char *symbol) {
+	auto symbols = reinterpret_cast<const nlist_64 *>(symImage + symTable->symoff);
+	auto strings = reinterpret_cast<const char *>(symImage + symTable->stroff);
+	for (uint32_t i = 0; i < symTable->nsyms; i++) {
+		if (symbols[i].n_strx < symTable->strsize && !strcmp(strings + symbols[i].n_strx, symbol))
+			return reinterpret_cast<mach_vm_address_t>(symImage) + symbols[i].n_value;
+	}
+	return 0;
+}
+
+/**
+ *  Select the image used by the resolver
+ *
+ *  @return true if the image has a symbol table
+ */
+static bool selectImage(const std::vector<uint8_t> &image) {
+	symImage = image.data();
+	symImageSize = image.size();
+	symTable = nullptr;
+
+	auto header = reinterpret_cast<const mach_header_64 *>(symImage);
+	if (symImageSize < sizeof(mach_header_64) || header->magic != MH_MAGIC_64)
+		return false;
+
+	auto cmd = symImage + sizeof(mach_header_64);
+	for (uint32_t i = 0; i < header->ncmds && cmd + sizeof(load_command) <= symImage + symImageSize; i++) {
+		auto lc = reinterpret_cast<const load_command *>(cmd);
+		if (lc->cmd == LC_SYMTAB) {
+			auto table = reinterpret_cast<const symtab_command *>(lc);
+			if (table->symoff + static_cast<uint64_t>(table->nsyms) * sizeof(nlist_64) <= symImageSize &&
+				table->stroff + static_cast<uint64_t>(table->strsize) <= symImageSize)
+				symTable = table;
+			break;
+		}
+		if (lc->cmdsize == 0)
+			break;
+		cmd += lc->cmdsize;
+	}
+
+	return symTable != nullptr;
+}
+
+/**
+ *  Pick defined symbols spread over the symbol table with enough image bytes to check
+ */
+static std::vector<const char *> pickSymbols(size_t num) {
+	std::vector<const char *> names;
+	auto symbols = reinterpret_cast<const nlist_64 *>(symImage + symTable->symoff);
+	auto strings = reinterpret_cast<const char *>(symImage + symTable->stroff);
+	size_t step = symTable->nsyms / num > 0 ? symTable->nsyms / num : 1;
+	for (size_t i = 0; i < symTable->nsyms && names.size() < num; i += step) {
+		// Walk from the end, which is the slowest case for the linear lookup.
+		auto &sym = symbols[symTable->nsyms - 1 - i];
+		if (sym.n_strx == 0 || sym.n_strx >= symTable->strsize || sym.n_value == 0 || sym.n_value + CheckBytes > symImageSize)
+			continue;
+		auto name = strings + sym.n_strx;
+		if (resolveSymbol(name) == reinterpret_cast<mach_vm_address_t>(symImage) + sym.n_value)
+			names.push_back(name);
+	}
+	return names;
+}
+
+/**
+ *  Create a kext sized image with a symbol table
+ *
+ *  @param uuidByte  distinguishes image uuids
+ *  @param nsyms     amount of symbols
+ */
+static std::vector<uint8_t> makeImage(uint8_t uuidByte, uint32_t nsyms) {
+	constexpr uint32_t textOff = 0x1000;
+	constexpr uint32_t funcSize = 32;
+	std::vector<char> strings(1, '\0');
+	std::vector<nlist_64> symbols(nsyms);
+	for (uint32_t i = 0; i < nsyms; i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "__ZN22AMDRadeonX4000_AMDHWChannel%uE%uv", i % 97, i);
+		symbols[i] = {};
+		symbols[i].n_strx = static_cast<uint32_t>(strings.size());
+		symbols[i].n_type = 0xF;
+		symbols[i].n_sect = 1;
+		symbols[i].n_value = textOff + i * funcSize;
+		strings.insert(strings.end(), name, name + strlen(name) + 1);
+	}
+
+	uint32_t symOff = textOff + nsyms * funcSize;
+	uint32_t strOff = symOff + nsyms * static_cast<uint32_t>(sizeof(nlist_64));
+	std::vector<uint8_t> image(strOff + strings.size());
+	std::mt19937 rng(uuidByte);
+	for (size_t i = textOff; i < symOff; i++)
+		image[i] = static_cast<uint8_t>(rng());
+
+	mach_header_64 header {};
+	header.magic = MH_MAGIC_64;
+	header.ncmds = 2;
+	header.sizeofcmds = sizeof(uuid_command) + sizeof(symtab_command);
+	uuid_command uuid {LC_UUID, sizeof(uuid_command), {}};
+	memset(uuid.uuid, uuidByte, sizeof(uuid.uuid));
+	symtab_command symtab {LC_SYMTAB, sizeof(symtab_command), symOff, nsyms, strOff, static_cast<uint32_t>(strings.size())};
+	memcpy(&image[0], &header, sizeof(header));
+	memcpy(&image[sizeof(header)], &uuid, sizeof(uuid));
+	memcpy(&image[sizeof(header) + sizeof(uuid)], &symtab, sizeof(symtab));
+	memcpy(&image[symOff], symbols.data(), nsyms * sizeof(nlist_64));
+	memcpy(&image[strOff], strings.data(), strings.size());
+	return image;
+}
+
+/**
+ *  Forget the in-memory cache as if the system rebooted, NVRAM contents are kept
+ */
+static void reboot() {
+	SymbolCache::deinit();
+	memset(&cache, 0, sizeof(cache));
+	loaded = dirty = false;
+	usedKexts = 0;
+	lastAddress = 0;
+	lastSize = 0;
+	lastKext = -1;
+	SymbolCache::init();
+}
+
+/**
+ *  Route the symbols through a plan the way modules do
+ *
+ *  @return true if all the routes were applied
+ */
+static bool routeSymbols(KernelPatcher &patcher, const std::vector<uint8_t> &image, const std::vector<const char *> &names,
+						 std::vector<mach_vm_address_t> &orgs) {
+	RoutePlan plan(0, reinterpret_cast<mach_vm_address_t>(image.data()), image.size());
+	orgs.assign(names.size(), 0);
+	for (size_t i = 0; i < names.size(); i++)
+		plan.add(names[i], &routeSymbols, orgs[i]);
+	return plan.apply(patcher);
+}
+
+static void checkCache() {
+	auto &nvram = IORegistryEntry::options();
+	auto image = makeImage(1, 2000);
+	CHECK(selectImage(image));
+	auto names = pickSymbols(RoutePlan::MaxRequests);
+	CHECK(names.size() == RoutePlan::MaxRequests);
+
+	nvram.removeProperty(NvramKey);
+	nvram.writes = 0;
+	reboot();
+	CHECK(SymbolCache::enabled());
+
+	// The first boot solves every symbol and still routes them in one batch.
+	std::vector<mach_vm_address_t> first, second;
+	KernelPatcher patcher;
+	patcher.resolver = resolveSymbol;
+	CHECK(routeSymbols(patcher, image, names, first));
+	CHECK(patcher.solveCalls == names.size());
+	CHECK(patcher.routeMultipleCalls == 1 && patcher.routeFunctionCalls == 0);
+	CHECK(nvram.writes == 0);
+
+	// Pending writes are coalesced into one.
+	for (size_t i = 0; i < 3; i++)
+		SymbolCache::scheduleFlush();
+	CHECK(flushCall->entered == 3);
+	CHECK(thread_call_fire(flushCall));
+	CHECK(!thread_call_fire(flushCall));
+	CHECK(nvram.writes == 1);
+	SymbolCache::flush();
+	CHECK(nvram.writes == 1);
+
+	// The next boot hits the cache for every symbol.
+	reboot();
+	patcher = {};
+	patcher.resolver = resolveSymbol;
+	CHECK(routeSymbols(patcher, image, names, second));
+	CHECK(patcher.solveCalls == 0 && patcher.routeMultipleCalls == 1);
+	CHECK(first == second);
+	SymbolCache::scheduleFlush();
+	CHECK(flushCall->entered == 0);
+
+	auto base = reinterpret_cast<mach_vm_address_t>(image.data());
+	auto value = resolveSymbol(names[0]);
+	CHECK(SymbolCache::find(base, image.size(), names[0]) == value);
+
+	// Unknown names never hit, even with the same length.
+	std::string other = names[0];
+	other.back() ^= 1;
+	CHECK(SymbolCache::find(base, image.size(), other.c_str()) == 0);
+
+	// Entries are bound to their name, a colliding or forged name hash is refused.
+	uint8_t length;
+	cache.symbols[0].hash = hashSymbol(other.c_str(), length);
+	size_t count = cache.header.symbolCount;
+	CHECK(SymbolCache::find(base, image.size(), other.c_str()) == 0);
+	CHECK(cache.header.symbolCount == count - 1);
+
+	// Entries pointing to changed image bytes are refused and solved again.
+	reboot();
+	image[value - base] ^= 0xFF;
+	patcher = {};
+	patcher.resolver = resolveSymbol;
+	CHECK(routeSymbols(patcher, image, names, second));
+	CHECK(patcher.solveCalls == 1);
+	CHECK(first == second);
+}
+
+static void checkEviction() {
+	auto &nvram = IORegistryEntry::options();
+	nvram.removeProperty(NvramKey);
+	reboot();
+
+	// Fill the kext table on one boot.
+	std::vector<std::vector<uint8_t>> images;
+	for (size_t i = 0; i <= SymbolCache::MaxKexts; i++)
+		images.push_back(makeImage(static_cast<uint8_t>(i + 10), 64));
+	for (size_t i = 0; i < SymbolCache::MaxKexts; i++) {
+		CHECK(selectImage(images[i]));
+		auto base = reinterpret_cast<mach_vm_address_t>(images[i].data());
+		auto name = pickSymbols(1)[0];
+		SymbolCache::store(base, images[i].size(), name, resolveSymbol(name));
+	}
+	CHECK(cache.header.kextCount == SymbolCache::MaxKexts);
+
+	// Kexts used on this boot are never evicted.
+	auto &extra = images[SymbolCache::MaxKexts];
+	CHECK(selectImage(extra));
+	auto extraBase = reinterpret_cast<mach_vm_address_t>(extra.data());
+	auto extraName = pickSymbols(1)[0];
+	SymbolCache::store(extraBase, extra.size(), extraName, resolveSymbol(extraName));
+	CHECK(SymbolCache::find(extraBase, extra.size(), extraName) == 0);
+	SymbolCache::flush();
+
+	// On the next boot one unused kext makes room and the used ones keep their symbols.
+	reboot();
+	CHECK(selectImage(images[0]));
+	auto name0 = pickSymbols(1)[0];
+	auto base0 = reinterpret_cast<mach_vm_address_t>(images[0].data());
+	CHECK(SymbolCache::find(base0, images[0].size(), name0) == resolveSymbol(name0));
+	CHECK(selectImage(extra));
+	SymbolCache::store(extraBase, extra.size(), extraName, resolveSymbol(extraName));
+	CHECK(SymbolCache::find(extraBase, extra.size(), extraName) == resolveSymbol(extraName));
+	CHECK(cache.header.kextCount == SymbolCache::MaxKexts);
+	CHECK(cache.header.symbolCount == SymbolCache::MaxKexts);
+
+	size_t cached = 0;
+	for (size_t i = 0; i < SymbolCache::MaxKexts; i++) {
+		CHECK(selectImage(images[i]));
+		auto name = pickSymbols(1)[0];
+		cached += SymbolCache::find(reinterpret_cast<mach_vm_address_t>(images[i].data()), images[i].size(), name) != 0;
+	}
+	CHECK(cached == SymbolCache::MaxKexts - 1);
+}
+
+static void benchImage(const char *name, const std::vector<uint8_t> &image) {
+	if (!selectImage(image)) {
+		fprintf(stderr, "%s has no 64-bit symbol table\n", name);
+		return;
+	}
+
+	auto names = pickSymbols(RoutePlan::MaxRequests);
+	printf("%s, %zu bytes, %u symbols, %zu routes\n", name, image.size(), symTable->nsyms, names.size());
+	if (names.empty())
+		return;
+
+	auto &nvram = IORegistryEntry::options();
+	std::vector<mach_vm_address_t> orgs;
+	benchmark("cold routes, symbol table walk and store", 20, [&]() {
+		nvram.removeProperty(NvramKey);
+		reboot();
+		KernelPatcher patcher;
+		patcher.resolver = resolveSymbol;
+		CHECK(routeSymbols(patcher, image, names, orgs));
+	});
+	SymbolCache::flush();
+
+	size_t solves = 0;
+	benchmark("warm routes, cache hits", 20, [&]() {
+		reboot();
+		KernelPatcher patcher;
+		patcher.resolver = resolveSymbol;
+		CHECK(routeSymbols(patcher, image, names, orgs));
+		solves += patcher.solveCalls;
+	});
+	CHECK(solves == 0);
+}
+
+static bool readImage(const char *path, std::vector<uint8_t> &image) {
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	auto file = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+		return false;
+	auto bytes = static_cast<const uint8_t *>(file);
+	image.assign(bytes, bytes + st.st_size);
+	munmap(file, static_cast<size_t>(st.st_size));
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Options::parse("-wegsymcache");
+
+	checkCache();
+	checkEviction();
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++) {
+			std::vector<uint8_t> image;
+			if (readImage(argv[i], image))
+				benchImage(argv[i], image);
+			else
+				fprintf(stderr, "failed to read %s\n", argv[i]);
+		}
+	} else {
+		// Symbol count of a large accelerator kext.
+		benchImage("synthetic image", makeImage(2, 20000));
+	}
+
+	SymbolCache::deinit();
+	return finishChecks();
+}
@@ -0,0 +1,312 @@
+//
+//  main.cpp
+//  RadeonConnectors
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Generates connectors and connector-count properties from VBIOS dumps, e.g.:
+//   RadeonConnectors -raddvi -priority 05,02 vbios.rom roms/
+// Injected connectors bypass autodetection in the kext, so the same autocorrection and
+// prioritisation is applied here. Directories are processed in parallel.
+
+#include "../WhateverGreen/kern_con.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#define SYSLOG(str, ...) fprintf(stderr, "RadeonConnectors: " str "\n", ## __VA_ARGS__)
+
+using namespace RADConnectors;
+
+/**
+ *  Maximum supported VBIOS image size
+ */
+static constexpr size_t MaxRomSize {16 * 1024 * 1024};
+
+/**
+ *  Generation options
+ */
+struct Options {
+	bool dviSingleLink {false};
+	std::vector<uint8_t> senseList;
+};
+
+/**
+ *  Generation result for a single VBIOS image
+ */
+struct Result {
+	std::string path;
+	std::string output;
+	bool success {false};
+};
+
+/**
+ *  Translate atom connector the same way AtiBiosParser2::translateAtomConnectorInfo does (see Manual/reference.cpp)
+ *
+ *  @param parser  atom object table parser
+ *  @param path    display path
+ *  @param object  connector object of the display path
+ *  @param con     resulting connector
+ *
+ *  @return true on success
+ */
+static bool translateConnector(const AtomObjectParser &parser, const AtomDisplayObjectPath &path, const AtomConnectorObject &object, ModernConnector &con) {
+	memset(&con, 0, sizeof(con));
+	if (((path.usConnObjectId & OBJECT_TYPE_MASK) >> OBJECT_TYPE_SHIFT) != GRAPH_OBJECT_TYPE_CONNECTOR || !path.usGraphicObjIds)
+		return false;
+
+	con.sense = parser.getSenseID(object);
+	auto hpd = parser.getRecord<AtomHPDRecord>(object, AtomRecordType::HPD);
+	if (hpd)
+		con.hotplug = hpd->ucHPDIntGPIOID;
+
+	uint8_t encoder = static_cast<uint8_t>(path.usGraphicObjIds);
+	bool one = ((path.usGraphicObjIds & ENUM_ID_MASK) >> ENUM_ID_SHIFT) == 1;
+	switch (encoder) {
+		case ENCODER_OBJECT_ID_NUTMEG:
+			con.flags |= 0x10;
+			break;
+		case ENCODER_OBJECT_ID_INTERNAL_UNIPHY:
+			con.transmitter = one ? 0x10 : 0x20;
+			con.encoder = one ? 0 : 1;
+			break;
+		case ENCODER_OBJECT_ID_INTERNAL_UNIPHY1:
+			con.transmitter = one ? 0x11 : 0x21;
+			con.encoder = one ? 2 : 3;
+			break;
+		case ENCODER_OBJECT_ID_INTERNAL_UNIPHY2:
+			con.transmitter = one ? 0x12 : 0x22;
+			con.encoder = one ? 4 : 5;
+			break;
+		case ENCODER_OBJECT_ID_INTERNAL_UNIPHY3:
+			con.transmitter = one ? 0x13 : 0x23;
+			con.encoder = one ? 6 : 7;
+			break;
+	}
+
+	switch (getConnectorID(path.usConnObjectId)) {
+		case CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_I:
+		case CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_D:
+			con.type = ConnectorDigitalDVI;
+			con.flags |= 0x4;
+			// This is what -raddvi undoes.
+			con.transmitter &= 0xCF;
+			break;
+		case CONNECTOR_OBJECT_ID_SINGLE_LINK_DVI_I:
+		case CONNECTOR_OBJECT_ID_SINGLE_LINK_DVI_D:
+			con.type = ConnectorDigitalDVI;
+			con.flags |= 0x4;
+			break;
+		case CONNECTOR_OBJECT_ID_HDMI_TYPE_A:
+		case CONNECTOR_OBJECT_ID_HDMI_TYPE_B:
+			con.type = ConnectorHDMI;
+			con.flags |= 0x204;
+			break;
+		case CONNECTOR_OBJECT_ID_VGA:
+			con.type = ConnectorVGA;
+			con.flags |= 0x10;
+			break;
+		case CONNECTOR_OBJECT_ID_LVDS:
+			con.type = ConnectorLVDS;
+			con.flags |= 0x40;
+			con.features |= 0x9;
+			con.transmitter &= 0xCF;
+			break;
+		case CONNECTOR_OBJECT_ID_DISPLAYPORT:
+			con.type = ConnectorDP;
+			con.flags |= 0x304;
+			break;
+		case CONNECTOR_OBJECT_ID_eDP:
+			con.type = ConnectorLVDS;
+			con.flags |= 0x100;
+			con.features |= 0x109;
+			break;
+	}
+
+	if (!con.flags)
+		return false;
+
+	if ((con.flags & 0x704) && con.hotplug)
+		con.features |= 0x100;
+
+	return true;
+}
+
+static void appendHex(std::string &out, const void *data, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	auto bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; i++) {
+		out.push_back(digits[bytes[i] >> 4]);
+		out.push_back(digits[bytes[i] & 0xF]);
+	}
+}
+
+template <typename... Args>
+static void appendFormat(std::string &out, const char *format, Args... args) {
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), format, args...);
+	out += tmp;
+}
+
+static bool readRom(const std::string &path, std::vector<uint8_t> &rom) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	rom.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !rom.empty() && rom.size() <= MaxRomSize;
+}
+
+static void generate(const Options &opts, Result &result) {
+	std::vector<uint8_t> rom;
+	AtomObjectParser parser;
+	if (!readRom(result.path, rom) || !parser.initWithRom(rom.data(), rom.size())) {
+		appendFormat(result.output, "%s: not a valid ATOM BIOS image\n", result.path.c_str());
+		return;
+	}
+
+	const AtomDisplayObjectPath *displayPaths[AtomObjectParser::MaxDisplayPaths];
+	const AtomConnectorObject *connectorObjects = nullptr;
+	size_t displayPathNum = parser.getDisplayPaths(displayPaths, AtomObjectParser::MaxDisplayPaths);
+	size_t connectorObjectNum = parser.getObjects(AtomObjectTableType::ConnectorObject, connectorObjects);
+
+	ModernConnector connectors[AtomObjectParser::MaxDisplayPaths];
+	uint8_t num = 0;
+	for (size_t i = 0; i < displayPathNum; i++) {
+		for (size_t j = 0; j < connectorObjectNum; j++) {
+			if (connectorObjects[j].usObjectID == displayPaths[i]->usConnObjectId) {
+				if (translateConnector(parser, *displayPaths[i], connectorObjects[j], connectors[num]))
+					num++;
+				break;
+			}
+		}
+	}
+
+	if (num == 0) {
+		appendFormat(result.output, "%s: no supported connectors found\n", result.path.c_str());
+		return;
+	}
+
+	uint8_t corrected = opts.dviSingleLink ? autocorrectConnectors(parser, connectors, num) : 0;
+	reprioritiseConnectors(opts.senseList.data(), static_cast<uint8_t>(opts.senseList.size()), connectors, num);
+
+	LegacyConnector legacy[AtomObjectParser::MaxDisplayPaths];
+	copy(legacy, num, connectors);
+
+	appendFormat(result.output, "%s: %d connectors, %d autocorrected\n", result.path.c_str(), num, corrected);
+	for (uint8_t i = 0; i < num; i++) {
+		char tmp[192];
+		appendFormat(result.output, "  %d is %s\n", i, printConnector(tmp, connectors[i]));
+	}
+
+	uint32_t count = num;
+	result.output += "  connector-count  ";
+	appendHex(result.output, &count, sizeof(count));
+	result.output += "\n  connectors (modern, 10.12+)  ";
+	appendHex(result.output, connectors, num * sizeof(ModernConnector));
+	result.output += "\n  connectors (legacy)  ";
+	appendHex(result.output, legacy, num * sizeof(LegacyConnector));
+	result.output += "\n";
+	result.success = true;
+}
+
+static void collectRoms(const std::string &path, std::vector<Result> &results) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		SYSLOG("failed to access %s", path.c_str());
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		results.emplace_back();
+		results.back().path = path;
+		return;
+	}
+
+	auto dir = opendir(path.c_str());
+	if (!dir) {
+		SYSLOG("failed to open %s", path.c_str());
+		return;
+	}
+
+	std::vector<std::string> names;
+	while (auto entry = readdir(dir)) {
+		if (entry->d_name[0] != '.')
+			names.emplace_back(entry->d_name);
+	}
+	closedir(dir);
+
+	// Keep the output stable regardless of directory order.
+	std::sort(names.begin(), names.end());
+	for (auto &name : names)
+		collectRoms(path + "/" + name, results);
+}
+
+static bool parseSenseList(const char *str, std::vector<uint8_t> &senseList) {
+	while (*str != '\0') {
+		char *end = nullptr;
+		auto sense = strtoul(str, &end, 16);
+		if (end == str || sense == 0 || sense > 0xFF || (*end != ',' && *end != '\0'))
+			return false;
+		senseList.push_back(static_cast<uint8_t>(sense));
+		str = *end == ',' ? end + 1 : end;
+	}
+
+	return !senseList.empty();
+}
+
+int main(int argc, char *argv[]) {
+	Options opts;
+	std::vector<Result> results;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-raddvi")) {
+			opts.dviSingleLink = true;
+		} else if (!strcmp(argv[i], "-priority") && i + 1 < argc) {
+			if (!parseSenseList(argv[++i], opts.senseList)) {
+				SYSLOG("invalid sense list %s", argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else {
+			collectRoms(argv[i], results);
+		}
+	}
+
+	if (results.empty()) {
+		fprintf(stderr, "Usage: %s [-raddvi] [-priority sense,...] rom|directory...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Images are independent, so they are simply distributed across the workers.
+	std::atomic<size_t> next {0};
+	auto worker = [&]() {
+		for (size_t i = next++; i < results.size(); i = next++)
+			generate(opts, results[i]);
+	};
+
+	size_t threadNum = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()), results.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadNum; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (auto &thread : threads)
+		thread.join();
+
+	bool success = true;
+	for (auto &result : results) {
+		fputs(result.output.c_str(), stdout);
+		success = success && result.success;
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
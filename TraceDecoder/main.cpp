@@ -0,0 +1,217 @@
+//
+//  main.cpp
+//  TraceDecoder
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+// Decodes weg-boot-trace property into a per-phase report and folded stacks suitable for flamegraph.pl.
+// The property could be passed either as a raw binary dump or as ioreg output, e.g.:
+//   ioreg -l -w0 -p IOService -n WhateverGreen | TraceDecoder
+
+#include "../WhateverGreen/kern_trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#define SYSLOG(str, ...) fprintf(stderr, "TraceDecoder: " str "\n", ## __VA_ARGS__)
+
+static bool readInput(const char *path, std::string &data) {
+	if (path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	} else {
+		data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+	}
+
+	return true;
+}
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool decodeText(const std::string &text, std::string &data) {
+	// Prefer the property value from ioreg output, otherwise treat the whole input as hex.
+	size_t start = 0, end = text.size();
+	auto prop = text.find("weg-boot-trace");
+	if (prop != std::string::npos) {
+		start = text.find('<', prop);
+		end = start != std::string::npos ? text.find('>', start) : std::string::npos;
+		if (end == std::string::npos)
+			return false;
+		start++;
+	}
+
+	data.clear();
+	int high = -1;
+	for (size_t i = start; i < end; i++) {
+		int v = hexValue(text[i]);
+		if (v < 0) {
+			if (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r' || text[i] == '<' || text[i] == '>')
+				continue;
+			return false;
+		}
+
+		if (high < 0) {
+			high = v;
+		} else {
+			data.push_back(static_cast<char>(high << 4 | v));
+			high = -1;
+		}
+	}
+
+	return high < 0;
+}
+
+static bool parseTrace(const std::string &data, std::vector<BootTrace::Record> &records, BootTrace::Header &header) {
+	if (data.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != BootTrace::Magic || header.version != BootTrace::Version) {
+		SYSLOG("unsupported trace magic %08X version %u", header.magic, header.version);
+		return false;
+	}
+
+	size_t avail = (data.size() - sizeof(header)) / sizeof(BootTrace::Record);
+	if (header.count > avail || header.count > BootTrace::MaxRecords) {
+		SYSLOG("trace is truncated, %u records declared, %zu available", header.count, avail);
+		return false;
+	}
+
+	records.resize(header.count);
+	if (header.count > 0)
+		memcpy(records.data(), data.data() + sizeof(header), header.count * sizeof(BootTrace::Record));
+
+	// Slots reserved but not yet written at publish time are left empty.
+	records.erase(std::remove_if(records.begin(), records.end(), [](const BootTrace::Record &r) {
+		return r.start == 0 && r.duration == 0;
+	}), records.end());
+
+	return true;
+}
+
+struct PhaseStats {
+	uint64_t count {0};
+	uint64_t total {0};
+	uint64_t self {0};
+};
+
+static void analyse(std::vector<BootTrace::Record> &records) {
+	// Parents start no later and last no shorter than their children.
+	std::sort(records.begin(), records.end(), [](const BootTrace::Record &a, const BootTrace::Record &b) {
+		if (a.start != b.start)
+			return a.start < b.start;
+		return a.duration > b.duration;
+	});
+
+	std::vector<uint64_t> self(records.size());
+	std::vector<size_t> stack;
+	std::map<std::string, uint64_t> folded;
+	std::vector<std::string> paths(records.size());
+
+	for (size_t i = 0; i < records.size(); i++) {
+		auto &r = records[i];
+		uint64_t end = r.start + r.duration;
+		while (!stack.empty()) {
+			auto &p = records[stack.back()];
+			if (r.start >= p.start && end <= p.start + p.duration)
+				break;
+			stack.pop_back();
+		}
+
+		self[i] = r.duration;
+		std::string name = BootTrace::phaseName(r.phase);
+		if (!stack.empty()) {
+			self[stack.back()] -= std::min(self[stack.back()], r.duration);
+			paths[i] = paths[stack.back()] + ";" + name;
+		} else {
+			paths[i] = name;
+		}
+		stack.push_back(i);
+	}
+
+	std::map<uint16_t, PhaseStats> phases;
+	uint64_t total = 0;
+	for (size_t i = 0; i < records.size(); i++) {
+		auto &s = phases[records[i].phase];
+		s.count++;
+		s.total += records[i].duration;
+		s.self += self[i];
+		folded[paths[i]] += self[i];
+		total += self[i];
+	}
+
+	printf("%-16s %8s %14s %14s %7s\n", "phase", "count", "total us", "self us", "self %");
+	for (auto &p : phases) {
+		printf("%-16s %8llu %14.3f %14.3f %6.2f%%\n", BootTrace::phaseName(p.first),
+			   static_cast<unsigned long long>(p.second.count), p.second.total / 1000.0, p.second.self / 1000.0,
+			   total ? p.second.self * 100.0 / total : 0.0);
+	}
+	printf("%-16s %8zu %14s %14.3f\n\n", "all", records.size(), "", total / 1000.0);
+
+	// Each route plan replaces arg separate routeMultiple calls with one.
+	uint64_t plans = 0, routes = 0;
+	for (auto &r : records) {
+		if (r.phase == static_cast<uint16_t>(BootTrace::Phase::RoutePlan)) {
+			plans++;
+			routes += r.arg;
+		}
+	}
+	if (plans > 0)
+		printf("route plans: %llu kexts, %llu routes, %llu routeMultiple calls saved\n\n",
+			   static_cast<unsigned long long>(plans), static_cast<unsigned long long>(routes),
+			   static_cast<unsigned long long>(routes - plans));
+
+	// Folded stacks with self time in nanoseconds.
+	for (auto &f : folded)
+		printf("%s %llu\n", f.first.c_str(), static_cast<unsigned long long>(f.second));
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+		SYSLOG("usage: %s [trace.bin | ioreg.txt]", argv[0]);
+		return 1;
+	}
+
+	std::string input;
+	if (!readInput(argc == 2 ? argv[1] : nullptr, input)) {
+		SYSLOG("failed to read %s", argv[1]);
+		return 1;
+	}
+
+	std::string data;
+	uint32_t magic = 0;
+	if (input.size() >= sizeof(magic))
+		memcpy(&magic, input.data(), sizeof(magic));
+	if (magic == BootTrace::Magic) {
+		data.swap(input);
+	} else if (!decodeText(input, data)) {
+		SYSLOG("input is neither a binary trace nor a hex dump");
+		return 1;
+	}
+
+	BootTrace::Header header;
+	std::vector<BootTrace::Record> records;
+	if (!parseTrace(data, records, header))
+		return 1;
+
+	if (header.dropped > 0)
+		SYSLOG("%u records were dropped due to trace overflow", header.dropped);
+
+	analyse(records);
+	return 0;
+}
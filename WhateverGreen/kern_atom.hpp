@@ -8,7 +8,16 @@
 #ifndef kern_atom_h
 #define kern_atom_h
 
+#ifdef KERNEL
 #include <Headers/kern_util.hpp>
+#else
+// Host tools share the parser, so only standard headers are available.
+#include <stddef.h>
+#include <stdint.h>
+#ifndef DBGLOG
+#define DBGLOG(module, str, ...) do { } while (0)
+#endif
+#endif
 
 enum class AtomObjectTableType : uint8_t {
 	DisplayPath,
@@ -23,6 +32,33 @@ enum class AtomObjectTableType : uint8_t {
 	ProtectionObject
 };
 
+struct AtomCommonTableHeader {
+	uint16_t usStructureSize;
+	uint8_t ucTableFormatRevision;
+	uint8_t ucTableContentRevision;
+};
+
+struct AtomObjectHeader {
+	AtomCommonTableHeader sHeader;
+	uint16_t usDeviceSupport;
+	uint16_t usConnectorObjectTableOffset;
+	uint16_t usRouterObjectTableOffset;
+	uint16_t usEncoderObjectTableOffset;
+	uint16_t usProtectionObjectTableOffset;
+	uint16_t usDisplayPathTableOffset;
+};
+
+struct AtomObjectTableHeader {
+	uint8_t ucNumberOfObjects;
+	uint8_t ucPadding[3];
+};
+
+struct AtomDisplayObjectPathTableHeader {
+	uint8_t ucNumOfDispPath;
+	uint8_t ucVersion;
+	uint8_t ucPadding[2];
+};
+
 struct AtomDisplayObjectPath {
 	uint16_t usDeviceTag;       /* supported device  */
 	uint16_t usSize;            /* the size of ATOM_DISPLAY_OBJECT_PATH */
@@ -41,6 +77,7 @@ struct AtomConnectorObject {
 enum class AtomRecordType : uint8_t {
 	Unknown = 0,
 	I2C = 1,
+	HPD = 2,
 	Max = 0xFF
 };
 
@@ -49,6 +86,21 @@ struct AtomCommonRecordHeader {
 	uint8_t ucRecordSize;
 };
 
+struct AtomI2CRecord {
+	AtomCommonRecordHeader sheader;
+	uint8_t sucI2cId;
+	uint8_t ucI2CAddr;
+};
+
+struct AtomHPDRecord {
+	AtomCommonRecordHeader sheader;
+	uint8_t ucHPDIntGPIOID;
+	uint8_t ucPlugged_PinState;
+};
+
+static_assert(sizeof(AtomObjectHeader) == 16 && sizeof(AtomDisplayObjectPath) == 10 && sizeof(AtomConnectorObject) == 8,
+			  "Invalid atom object layout");
+
 // Definitions taken from asic_reg/ObjectID.h
 enum {
 	/* External Third Party Encoders */
@@ -151,29 +203,54 @@ inline bool isEncoder(uint16_t objid) {
 inline uint8_t getConnectorID(uint16_t objid) {
 	return static_cast<uint8_t>(objid);
 }
+/**
+ *  Maximum size of a connector record list when it is not known
+ */
+static constexpr size_t AtomMaxRecordListSize {0x100};
+
+/**
+ *  Find record of a certain type in a record list
+ *
+ *  @param record  pointer to atom records
+ *  @param size    maximum readable size of the record list
+ *  @param type    record type
+ *
+ *  @return record pointer or nullptr
+ */
+template <typename T>
+inline const T *getAtomRecord(const uint8_t *record, size_t size, AtomRecordType type) {
+	if (!record)
+		return nullptr;
+
+	size_t off = 0;
+	while (size - off >= sizeof(AtomCommonRecordHeader)) {
+		auto h = reinterpret_cast<const AtomCommonRecordHeader *>(record + off);
+		if (h->ucRecordType == AtomRecordType::Max)
+			return nullptr;
+		// Empty records would loop forever, truncated ones are out of bounds.
+		if (h->ucRecordSize < sizeof(AtomCommonRecordHeader) || h->ucRecordSize > size - off)
+			return nullptr;
+		if (h->ucRecordType == type)
+			return h->ucRecordSize >= sizeof(T) ? reinterpret_cast<const T *>(h) : nullptr;
+		off += h->ucRecordSize;
+	}
+
+	return nullptr;
+}
+
 /**
  *  Retrieve sense ID
  *
  *  @param record  pointer to atom records
+ *  @param size    maximum readable size of the record list
  *
  *  @return sense id or 0
  */
-inline uint8_t getSenseID(uint8_t *record) {
+inline uint8_t getSenseID(const uint8_t *record, size_t size=AtomMaxRecordListSize) {
 	// Partially reversed from AtiAtomBiosDceInterface::parseSenseId
-	if (record) {
-		while (true) {
-			auto h = reinterpret_cast<AtomCommonRecordHeader *>(record);
-			if (h->ucRecordType == AtomRecordType::I2C) {
-				if (record[2] > 0)
-					return (record[2] & 0xF) + 1;
-				return 0;
-			} else if (h->ucRecordType == AtomRecordType::Max) {
-				return 0;
-			}
-			record += h->ucRecordSize;
-		}
-	}
-	
+	auto i2c = getAtomRecord<AtomI2CRecord>(record, size, AtomRecordType::I2C);
+	if (i2c && i2c->sucI2cId > 0)
+		return (i2c->sucI2cId & 0xF) + 1;
 	return 0;
 }
 
@@ -209,4 +286,226 @@ inline bool getTxEnc(uint16_t usGraphicObjIds, uint8_t &txmit, uint8_t &enc) {
 	return true;
 }
 
+/**
+ *  Bounded ATOM BIOS object table parser, all the returned pointers point to the original image
+ */
+class AtomObjectParser {
+public:
+	/**
+	 *  ROM offset of the ATOM ROM header pointer
+	 */
+	static constexpr size_t RomHeaderPointer {0x48};
+
+	/**
+	 *  ATOM ROM header offsets of the signature and the master data table pointer
+	 */
+	static constexpr size_t RomHeaderSignature {0x04};
+	static constexpr size_t RomHeaderMasterDataTable {0x20};
+
+	/**
+	 *  Master data table index of the object header
+	 */
+	static constexpr size_t ObjectHeaderIndex {22};
+
+	/**
+	 *  Object header internal offsets are 16-bit
+	 */
+	static constexpr size_t MaxObjectHeaderReach {0x10000};
+
+	/**
+	 *  Maximum amount of display paths returned
+	 */
+	static constexpr size_t MaxDisplayPaths {32};
+
+	/**
+	 *  Initialise from a full VBIOS image
+	 *
+	 *  @param rom      VBIOS image
+	 *  @param romSize  VBIOS image size
+	 *
+	 *  @return true if the object header was found
+	 */
+	bool initWithRom(const uint8_t *rom, size_t romSize) {
+		base = nullptr;
+		size = 0;
+
+		uint16_t romHeader = 0, masterData = 0, objectHeader = 0;
+		if (!rom || !read(rom, romSize, RomHeaderPointer, romHeader) ||
+			romSize < romHeader + RomHeaderSignature + 4u || rom[romHeader + RomHeaderSignature] != 'A' ||
+			rom[romHeader + RomHeaderSignature + 1] != 'T' || rom[romHeader + RomHeaderSignature + 2] != 'O' ||
+			rom[romHeader + RomHeaderSignature + 3] != 'M') {
+			DBGLOG("atom", "invalid atom rom header");
+			return false;
+		}
+
+		if (!read(rom, romSize, romHeader + RomHeaderMasterDataTable, masterData) ||
+			!read(rom, romSize, masterData + sizeof(AtomCommonTableHeader) + ObjectHeaderIndex * sizeof(uint16_t), objectHeader) ||
+			objectHeader == 0 || objectHeader >= romSize) {
+			DBGLOG("atom", "invalid atom master data table");
+			return false;
+		}
+
+		return initWithObjectHeader(rom + objectHeader, romSize - objectHeader);
+	}
+
+	/**
+	 *  Initialise from an object header of unknown image
+	 *
+	 *  @param header      object header
+	 *  @param headerSize  maximum readable size starting at header
+	 *
+	 *  @return true on success
+	 */
+	bool initWithObjectHeader(const uint8_t *header, size_t headerSize=MaxObjectHeaderReach) {
+		base = header;
+		size = headerSize < MaxObjectHeaderReach ? headerSize : MaxObjectHeaderReach;
+		if (!header || !get<AtomObjectHeader>(0)) {
+			base = nullptr;
+			size = 0;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 *  Obtain display paths
+	 *
+	 *  @param paths  display path pointers
+	 *  @param max    maximum amount of paths
+	 *
+	 *  @return amount of paths
+	 */
+	size_t getDisplayPaths(const AtomDisplayObjectPath **paths, size_t max) const {
+		auto header = get<AtomObjectHeader>(0);
+		if (!header)
+			return 0;
+
+		size_t off = header->usDisplayPathTableOffset;
+		auto table = get<AtomDisplayObjectPathTableHeader>(off);
+		if (!table)
+			return 0;
+
+		off += sizeof(AtomDisplayObjectPathTableHeader);
+		size_t num = 0;
+		// Display paths have variable size depending on the amount of graphic objects.
+		for (size_t i = 0; i < table->ucNumOfDispPath && num < max; i++) {
+			auto path = get<AtomDisplayObjectPath>(off);
+			if (!path || path->usSize < sizeof(AtomDisplayObjectPath) || path->usSize > size - off)
+				break;
+			paths[num++] = path;
+			off += path->usSize;
+		}
+
+		return num;
+	}
+
+	/**
+	 *  Obtain object table
+	 *
+	 *  @param type     ConnectorObject, EncoderObject, or RouterObject
+	 *  @param objects  object array
+	 *
+	 *  @return amount of objects
+	 */
+	size_t getObjects(AtomObjectTableType type, const AtomConnectorObject *&objects) const {
+		objects = nullptr;
+		auto header = get<AtomObjectHeader>(0);
+		if (!header)
+			return 0;
+
+		size_t off;
+		if (type == AtomObjectTableType::ConnectorObject)
+			off = header->usConnectorObjectTableOffset;
+		else if (type == AtomObjectTableType::EncoderObject)
+			off = header->usEncoderObjectTableOffset;
+		else if (type == AtomObjectTableType::RouterObject)
+			off = header->usRouterObjectTableOffset;
+		else
+			return 0;
+
+		auto table = get<AtomObjectTableHeader>(off);
+		if (!table)
+			return 0;
+
+		// Truncated tables only return the objects in bounds.
+		off += sizeof(AtomObjectTableHeader);
+		size_t num = table->ucNumberOfObjects;
+		if ((size - off) / sizeof(AtomConnectorObject) < num)
+			num = (size - off) / sizeof(AtomConnectorObject);
+		if (num > 0)
+			objects = reinterpret_cast<const AtomConnectorObject *>(base + off);
+		return num;
+	}
+
+	/**
+	 *  Find object record
+	 *
+	 *  @param object  connector or encoder object
+	 *  @param type    record type
+	 *
+	 *  @return record pointer or nullptr
+	 */
+	template <typename T>
+	const T *getRecord(const AtomConnectorObject &object, AtomRecordType type) const {
+		if (!base || object.usRecordOffset >= size)
+			return nullptr;
+		return getAtomRecord<T>(base + object.usRecordOffset, size - object.usRecordOffset, type);
+	}
+
+	/**
+	 *  Retrieve sense ID of a connector object
+	 *
+	 *  @param object  connector object
+	 *
+	 *  @return sense id or 0
+	 */
+	uint8_t getSenseID(const AtomConnectorObject &object) const {
+		if (!base || object.usRecordOffset >= size)
+			return 0;
+		return ::getSenseID(base + object.usRecordOffset, size - object.usRecordOffset);
+	}
+
+private:
+	/**
+	 *  Object header
+	 */
+	const uint8_t *base {nullptr};
+
+	/**
+	 *  Readable size starting at base
+	 */
+	size_t size {0};
+
+	/**
+	 *  Obtain a bounded structure pointer
+	 *
+	 *  @param off  offset from base
+	 *
+	 *  @return structure pointer or nullptr
+	 */
+	template <typename T>
+	const T *get(size_t off) const {
+		if (!base || off > size || size - off < sizeof(T))
+			return nullptr;
+		return reinterpret_cast<const T *>(base + off);
+	}
+
+	/**
+	 *  Read a little endian 16-bit value from the image
+	 *
+	 *  @param data   image
+	 *  @param size   image size
+	 *  @param off    value offset
+	 *  @param value  read value
+	 *
+	 *  @return true if in bounds
+	 */
+	static bool read(const uint8_t *data, size_t size, size_t off, uint16_t &value) {
+		if (off > size || size - off < sizeof(uint16_t))
+			return false;
+		value = static_cast<uint16_t>(data[off] | (data[off + 1] << 8));
+		return true;
+	}
+};
+
 #endif /* kern_atom_h */
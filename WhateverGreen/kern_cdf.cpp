@@ -6,6 +6,7 @@
 //
 
 #include "kern_cdf.hpp"
+#include "kern_opts.hpp"
 
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_iokit.hpp>
@@ -151,7 +152,7 @@ static UserPatcher::ProcInfo procInfoSieHS { procWindowServerNew, procWindowServ
 CDF *CDF::callbackCDF;
 
 void CDF::init() {
-	disableHDMI20 = checkKernelArgument("-cdfoff");
+	disableHDMI20 = Options::enabled(Options::Id::CdfOff);
 	if (disableHDMI20) {
 		SYSLOG("cdf", "disabling HDMI 2.0 unlock patches by argument");
 		return;
@@ -206,47 +207,41 @@ void CDF::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 	}
 }
 
-bool CDF::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+size_t CDF::getKexts(KernelPatcher::KextInfo **list, size_t max) {
+	size_t num = 0;
+	if (disableHDMI20)
+		return num;
+
+	for (size_t i = 0; i < arrsize(kextList) && num < max; i++)
+		list[num++] = &kextList[i];
+	return num;
+}
+
+bool CDF::processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
 	if (disableHDMI20)
 		return false;
 
 	if (kextList[KextGK100HalSys].loadIndex == index) {
 		KernelPatcher::LookupPatch patch {&kextList[KextGK100HalSys], gk100Find, gk100Repl, sizeof(gk100Find), 1};
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("cdf", "failed to apply gk100 patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "gk100 patch");
 		return true;
 	}
 
 	if (kextList[KextGK100HalWeb].loadIndex == index) {
 		KernelPatcher::LookupPatch patch {&kextList[KextGK100HalWeb], gk100Find, gk100Repl, sizeof(gk100Find), 1};
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("cdf", "failed to apply gk100 web patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "gk100 web patch");
 		return true;
 	}
 
 	if (kextList[KextGM100HalWeb].loadIndex == index) {
 		KernelPatcher::LookupPatch patch {&kextList[KextGM100HalWeb], gmp100Find, gmp100Repl, sizeof(gmp100Find), 1};
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("cdf", "failed to apply gm100 web patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "gm100 web patch");
 		return true;
 	}
 
 	if (kextList[KextGP100HalWeb].loadIndex == index) {
 		KernelPatcher::LookupPatch patch {&kextList[KextGP100HalWeb], gmp100Find, gmp100Repl, sizeof(gmp100Find), 1};
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("cdf", "failed to apply gp100 web patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "gp100 web patch");
 		return true;
 	}
 
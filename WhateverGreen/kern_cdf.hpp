@@ -8,6 +8,8 @@
 #ifndef kern_cdf_hpp
 #define kern_cdf_hpp
 
+#include "kern_route.hpp"
+
 #include <Headers/kern_patcher.hpp>
 #include <Headers/kern_devinfo.hpp>
 #include <Headers/kern_user.hpp>
@@ -29,13 +31,24 @@ public:
 	 *  Patch kext if needed and prepare other patches
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param index   kinfo handle
 	 *  @param address kinfo load address
 	 *  @param size    kinfo memory size
 	 *
 	 *  @return true if patched anything
 	 */
-	bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+	bool processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
+
+	/**
+	 *  Obtain kexts handled by processKext
+	 *
+	 *  @param list  kext list to append to
+	 *  @param max   maximum amount of kexts to append
+	 *
+	 *  @return amount of appended kexts
+	 */
+	size_t getKexts(KernelPatcher::KextInfo **list, size_t max);
 
 private:
 	/**
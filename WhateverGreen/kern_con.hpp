@@ -8,8 +8,16 @@
 #ifndef kern_con_hpp
 #define kern_con_hpp
 
+#ifdef KERNEL
 #include <Headers/kern_util.hpp>
 #include <libkern/libkern.h>
+#else
+// Host tools share connector handling, so only standard headers are available.
+#include <stdio.h>
+#include <string.h>
+#endif
+
+#include "kern_atom.hpp"
 
 namespace RADConnectors {
 
@@ -138,6 +146,7 @@ namespace RADConnectors {
 		return out;
 	}
 	
+#ifdef KERNEL
 	/**
 	 *  Is modern system
 	 *
@@ -148,20 +157,34 @@ namespace RADConnectors {
 	}
 	
 	/**
-	 *  Prints connectors
+	 *  Prints typed connectors
 	 *
-	 *  @param con  pointer to an array of legacy or modern connectors (depends on the kernel version)
+	 *  @param con  pointer to an array of LegacyConnector or ModernConnector
 	 *  @param num  number of connectors in con
 	 */
-	inline void print(Connector *con, uint8_t num) {
+	template <typename T>
+	inline void print(T *con, uint8_t num) {
 #ifdef DEBUG
 		for (uint8_t i = 0; con && i < num; i++) {
 			char tmp[192];
-			DBGLOG("con", "%d is %s", i, modern() ?
-				   printConnector(tmp, (&con->modern)[i]) : printConnector(tmp, (&con->legacy)[i]));
+			DBGLOG("con", "%d is %s", i, printConnector(tmp, con[i]));
 		}
 #endif
 	}
+
+	/**
+	 *  Prints connectors
+	 *
+	 *  @param con  pointer to an array of legacy or modern connectors (depends on the kernel version)
+	 *  @param num  number of connectors in con
+	 */
+	inline void print(Connector *con, uint8_t num) {
+		if (modern())
+			print(&con->modern, num);
+		else
+			print(&con->legacy, num);
+	}
+#endif
 	
 	/**
 	 *  Sanity check connector size
@@ -177,30 +200,173 @@ namespace RADConnectors {
 	}
 
 	/**
-	 *  Copy new connectors
+	 *  Copy typed connectors
 	 *
 	 *  @param out  destination connectors
 	 *  @param num  number of copied connectors
 	 *  @param in   source connectors
+	 */
+	template <typename T, typename Y>
+	inline void copy(T *out, uint8_t num, const Y *in) {
+		for (uint8_t i = 0; i < num; i++)
+			Connector::assign(out[i], in[i]);
+	}
+
+	/**
+	 *  Copy new connectors
+	 *
+	 *  @param out  destination connectors in LegacyConnector or ModernConnector format
+	 *  @param num  number of copied connectors
+	 *  @param in   source connectors
 	 *  @param size size of source connectors
 	 */
-	inline void copy(RADConnectors::Connector *out, uint8_t num, const RADConnectors::Connector *in, uint32_t size) {
-		bool outModern = modern();
-		bool inModern = size % sizeof(ModernConnector) == 0 && size / sizeof(ModernConnector) == num;
-		
-		for (uint8_t i = 0; i < num; i++) {
-			if (outModern) {
-				if (inModern)
-					Connector::assign((&out->modern)[i], (&in->modern)[i]);
-				else
-					Connector::assign((&out->modern)[i], (&in->legacy)[i]);
-			} else {
-				if (inModern)
-					Connector::assign((&out->legacy)[i], (&in->modern)[i]);
-				else
-					Connector::assign((&out->legacy)[i], (&in->legacy)[i]);
+	template <typename T>
+	inline void copy(T *out, uint8_t num, const Connector *in, uint32_t size) {
+		// Source layout is only determined once, the loops themselves do not branch.
+		if (size % sizeof(ModernConnector) == 0 && size / sizeof(ModernConnector) == num)
+			copy(out, num, &in->modern);
+		else
+			copy(out, num, &in->legacy);
+	}
+
+	/**
+	 *  Correct a certain found connector
+	 *
+	 *  @param connector   connector id
+	 *  @param sense       sense id
+	 *  @param txmit       transmitter
+	 *  @param enc         encoder, currently not needed for any correction
+	 *  @param connectors  pointer to an array of LegacyConnector or ModernConnector
+	 *  @param sz          number of connectors
+	 *
+	 *  @return true if the connector was changed
+	 */
+	template <typename T>
+	inline bool autocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, uint8_t /* enc */, T *connectors, uint8_t sz) {
+		// This function attempts to fix the following issues:
+		//
+		// 1. Incompatible DVI transmitter on 290X, 370 and probably some other models
+		// In this case a correct transmitter is detected by AtiAtomBiosDce60::getPropertiesForEncoderObject, however, later
+		// in AtiAtomBiosDce60::getPropertiesForConnectorObject for DVI DL and TITFP513 this value is conjuncted with 0xCF,
+		// which makes it wrong: 0x10 -> 0, 0x11 -> 1. As a result one gets black screen when connecting multiple displays.
+		// getPropertiesForEncoderObject takes usGraphicObjIds and getPropertiesForConnectorObject takes usConnObjectId
+
+		if (connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_I &&
+			connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_D &&
+			connector != CONNECTOR_OBJECT_ID_LVDS) {
+			DBGLOG("con", "autocorrectConnector found unsupported connector type %02X", connector);
+			return false;
+		}
+
+		for (uint8_t j = 0; j < sz; j++) {
+			auto &con = connectors[j];
+			if (con.sense == sense) {
+				if (con.transmitter != txmit && (con.transmitter & 0xCF) == con.transmitter) {
+					DBGLOG("con", "autocorrectConnector replacing txmit %02X with %02X for %d connector sense %02X",
+						   con.transmitter, txmit, j, sense);
+					con.transmitter = txmit;
+					return true;
+				}
+				break;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 *  Correct connectors according to atom display paths
+	 *
+	 *  @param parser      atom object table parser
+	 *  @param connectors  pointer to an array of LegacyConnector or ModernConnector
+	 *  @param sz          number of connectors
+	 *
+	 *  @return number of changed connectors
+	 */
+	template <typename T>
+	inline uint8_t autocorrectConnectors(const AtomObjectParser &parser, T *connectors, uint8_t sz) {
+		const AtomDisplayObjectPath *displayPaths[AtomObjectParser::MaxDisplayPaths];
+		const AtomConnectorObject *connectorObjects = nullptr;
+		size_t displayPathNum = parser.getDisplayPaths(displayPaths, sizeof(displayPaths) / sizeof(displayPaths[0]));
+		size_t connectorObjectNum = parser.getObjects(AtomObjectTableType::ConnectorObject, connectorObjects);
+		if (displayPathNum != connectorObjectNum) {
+			DBGLOG("con", "autocorrectConnectors found different displaypaths %lu and connectors %lu", displayPathNum, connectorObjectNum);
+			return 0;
+		}
+
+		uint8_t changed = 0;
+		for (uint8_t i = 0; i < displayPathNum; i++) {
+			if (!isEncoder(displayPaths[i]->usGraphicObjIds)) {
+				DBGLOG("con", "autocorrectConnectors not encoder %X at %d", displayPaths[i]->usGraphicObjIds, i);
+				continue;
+			}
+
+			uint8_t txmit = 0, enc = 0;
+			if (!getTxEnc(displayPaths[i]->usGraphicObjIds, txmit, enc))
+				continue;
+
+			uint8_t sense = parser.getSenseID(connectorObjects[i]);
+			if (!sense) {
+				DBGLOG("con", "autocorrectConnectors failed to detect sense for %d connector", i);
+				continue;
+			}
+
+			DBGLOG("con", "autocorrectConnectors found txmit %02X enc %02X sense %02X for %d connector", txmit, enc, sense, i);
+
+			if (autocorrectConnector(getConnectorID(displayPaths[i]->usConnObjectId), sense, txmit, enc, connectors, sz))
+				changed++;
+		}
+
+		return changed;
+	}
+
+	/**
+	 *  Changes connector priority according to provided sense id list
+	 *
+	 *  @param senseList   list of sense ids in ascending order
+	 *  @param senseNum    number of sense ids in the list
+	 *  @param connectors  pointer to an array of LegacyConnector or ModernConnector
+	 *  @param sz          number of connectors
+	 */
+	template <typename T>
+	inline void reprioritiseConnectors(const uint8_t *senseList, uint8_t senseNum, T *connectors, uint8_t sz) {
+		static constexpr uint32_t typeList[] {
+			ConnectorLVDS,
+			ConnectorDigitalDVI,
+			ConnectorHDMI,
+			ConnectorDP,
+			ConnectorVGA
+		};
+		static constexpr uint8_t typeNum {static_cast<uint8_t>(sizeof(typeList) / sizeof(typeList[0]))};
+
+		uint16_t priCount = 1;
+		// Automatically detected connectors have equal priority (0), which often results in black screen
+		// This allows to change this firstly by user-defined list, then by type list.
+		//TODO: priority is ignored for 5xxx and 6xxx GPUs, should we manually reorder items?
+		for (uint8_t i = 0; i < senseNum + typeNum + 1; i++) {
+			for (uint8_t j = 0; j < sz; j++) {
+				auto reorder = [&](auto &con) {
+					if (i == senseNum + typeNum) {
+						if (con.priority == 0)
+							con.priority = priCount++;
+					} else if (i < senseNum) {
+						if (con.sense == senseList[i]) {
+							DBGLOG("con", "reprioritiseConnectors setting priority of sense %02X to %d by sense", con.sense, priCount);
+							con.priority = priCount++;
+							return true;
+						}
+					} else {
+						if (con.priority == 0 && con.type == typeList[i-senseNum]) {
+							DBGLOG("con", "reprioritiseConnectors setting priority of sense %02X to %d by type", con.sense, priCount);
+							con.priority = priCount++;
+						}
+					}
+					return false;
+				};
+
+				if (reorder(connectors[j]))
+					break;
 			}
-			
 		}
 	}
 };
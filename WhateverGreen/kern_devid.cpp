@@ -0,0 +1,81 @@
+//
+//  kern_devid.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_devid.hpp"
+
+bool DeviceIdCache::store(IORegistryEntry *entry) {
+	auto data = OSDynamicCast(OSData, entry->getProperty("device-id"));
+	if (!data || data->getLength() != sizeof(uint32_t))
+		return false;
+
+	release();
+
+	// Retain the property object, so that its address stays a valid identity for invalidation.
+	data->retain();
+	deviceId = *static_cast<const uint32_t *>(data->getBytesNoCopy());
+	property = data;
+	service = entry;
+	DBGLOG("weg", "cached IGPU device-id 0x%04X", deviceId);
+	return true;
+}
+
+bool DeviceIdCache::get(IORegistryEntry *entry, uint32_t &device) const {
+	// Fast path for all the other PCI devices, which share the vtable with IGPU.
+	if (entry != service || entry == nullptr)
+		return false;
+
+	// device-id is set before matching and is not expected to change, but in case it does
+	// we must not report a stale value. Fall back to the slow lookup without touching the cache,
+	// as the wrappers may be invoked concurrently.
+	if (entry->getProperty("device-id") == property) {
+		device = deviceId;
+		return true;
+	}
+
+	DBGLOG("weg", "IGPU device-id property changed, using slow lookup");
+	return WIOKit::getOSDataValue(entry, "device-id", device);
+}
+
+void DeviceIdCache::release() {
+	if (property) {
+		property->release();
+		property = nullptr;
+	}
+
+	service = nullptr;
+	deviceId = 0;
+}
+
+uint16_t DeviceIdCache::read16(IORegistryEntry *entry, uint32_t space, uint8_t offset, WIOKit::t_PCIConfigRead16 org) const {
+	auto result = org(entry, space, offset);
+	uint32_t device;
+	if (offset == WIOKit::kIOPCIConfigDeviceID && get(entry, device)) {
+		DBGLOG("weg", "configRead16 IGPU 0x%08X at off 0x%02X, result = 0x%04x", space, offset, result);
+		if (device != result) {
+			DBGLOG("weg", "configRead16 IGPU reported 0x%04x instead of 0x%04x", device, result);
+			return device;
+		}
+	}
+
+	return result;
+}
+
+uint32_t DeviceIdCache::read32(IORegistryEntry *entry, uint32_t space, uint8_t offset, WIOKit::t_PCIConfigRead32 org) const {
+	auto result = org(entry, space, offset);
+	uint32_t device;
+	// According to lvs1974 unaligned reads may actually happen!
+	if ((offset == WIOKit::kIOPCIConfigDeviceID || offset == WIOKit::kIOPCIConfigVendorID) && get(entry, device)) {
+		DBGLOG("weg", "configRead32 IGPU 0x%08X at off 0x%02X, result = 0x%08X", space, offset, result);
+		if (device != (result & 0xFFFF)) {
+			device = (result & 0xFFFF) | (device << 16);
+			DBGLOG("weg", "configRead32 reported 0x%08x instead of 0x%08x", device, result);
+			return device;
+		}
+	}
+
+	return result;
+}
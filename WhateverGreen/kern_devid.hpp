@@ -0,0 +1,76 @@
+//
+//  kern_devid.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_devid_hpp
+#define kern_devid_hpp
+
+#include <Headers/kern_util.hpp>
+#include <Headers/kern_iokit.hpp>
+#include <Library/LegacyIOService.h>
+
+/**
+ *  IGPU device-id cache used by PCI Config read wrappers.
+ *  These wrappers are installed into the shared IOPCIDevice vtable, so they are
+ *  called for every PCI device in the system and must reject foreign services fast.
+ */
+class DeviceIdCache {
+public:
+	/**
+	 *  Fill the cache from the device-id property
+	 *
+	 *  @param service  IGPU service
+	 *
+	 *  @return true if device-id was cached
+	 */
+	bool store(IORegistryEntry *service);
+
+	/**
+	 *  Obtain fake IGPU device-id
+	 *
+	 *  @param service  service the read is performed on
+	 *  @param device   fake device-id
+	 *
+	 *  @return true if service is the IGPU and device was obtained
+	 */
+	bool get(IORegistryEntry *service, uint32_t &device) const;
+
+	/**
+	 *  Drop the cached property
+	 */
+	void release();
+
+	/**
+	 *  PCI Config read with the device-id faked for the cached service
+	 *
+	 *  @param service  service the read is performed on
+	 *  @param space    PCI Config space
+	 *  @param offset   register offset
+	 *  @param org      original reader
+	 *
+	 *  @return register value
+	 */
+	uint16_t read16(IORegistryEntry *service, uint32_t space, uint8_t offset, WIOKit::t_PCIConfigRead16 org) const;
+	uint32_t read32(IORegistryEntry *service, uint32_t space, uint8_t offset, WIOKit::t_PCIConfigRead32 org) const;
+
+private:
+	/**
+	 *  IGPU service the cache belongs to, used as a key
+	 */
+	IORegistryEntry *service {nullptr};
+
+	/**
+	 *  Retained device-id property the value was resolved from, used for invalidation
+	 */
+	OSData *property {nullptr};
+
+	/**
+	 *  Resolved fake device-id
+	 */
+	uint32_t deviceId {0};
+};
+
+#endif /* kern_devid_hpp */
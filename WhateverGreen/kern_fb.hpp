@@ -8,10 +8,26 @@
 #ifndef kern_fb_hpp
 #define kern_fb_hpp
 
+#ifdef KERNEL
 #include <Headers/kern_util.hpp>
+#else
+// Host tools decode framebuffer kexts with the same structures, so only standard headers are available.
+#include <stddef.h>
+#include <stdint.h>
+#ifndef PACKED
+#define PACKED __attribute__((packed))
+#endif
+#endif
 
 static constexpr size_t MaxFramebufferConnectorCount = 4;
 
+/* Sandy Bridge records have no framebuffer ids, AAPL,snb-platform-id values are matched by record position.
+ * 0xFFFFFFFF marks the records that cannot be selected.
+ */
+static constexpr uint32_t SandyPlatformId[] {
+	0x00010000, 0x00020000, 0x00030010, 0x00030030, 0x00040000, 0xFFFFFFFF, 0xFFFFFFFF, 0x00030020, 0x00050000
+};
+
 union FramebufferFlags {
 	struct FramebufferFlagBits {
 		/* Discovered in AppleIntelFBController::LinkTraining. Disables the use of FastLinkTraining.
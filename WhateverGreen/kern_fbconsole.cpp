@@ -0,0 +1,154 @@
+//
+//  kern_fbconsole.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_fbconsole.hpp"
+
+void FramebufferConsole::save(Backup &backup, const vc_info &info) {
+	auto src = reinterpret_cast<const uint8_t *>(info.v_baseaddr);
+
+	// Only keep the visible part of each row, padded strides are common on many modes.
+	backup.visibleRowSize = info.v_rowscanbytes;
+	if (backup.visibleRowSize == 0 || backup.visibleRowSize > info.v_rowbytes)
+		backup.visibleRowSize = info.v_rowbytes;
+	DBGLOG("weg", "console backup uses %lu out of %u bytes per row", backup.visibleRowSize, info.v_rowbytes);
+
+	backup.hasBackground = backup.compressed = false;
+	backup.left = 0;
+	backup.top = 0;
+	backup.rowSize = backup.visibleRowSize;
+	backup.rows = info.v_height;
+
+	// Most of the boot screen is solid background around the logo and the progress bar.
+	// Take the corner pixel as the background and only store the rectangle with the content.
+	uint32_t mask = 0;
+	if (info.v_depth == 32) {
+		mask = 0x00FFFFFF;
+		backup.format = FramebufferCopy::PixelFormat::RGB888;
+	} else if (info.v_depth == 30) {
+		mask = 0x3FFFFFFF;
+		backup.format = FramebufferCopy::PixelFormat::RGB101010;
+	}
+	size_t width = backup.visibleRowSize / sizeof(uint32_t);
+	if (mask != 0 && width > 0 && info.v_width <= width && info.v_height > 0) {
+		width = info.v_width;
+		lilu_os_memcpy(&backup.background, src, sizeof(backup.background));
+		size_t left = 0, top = 0, right = 0, bottom = 0;
+		if (FramebufferCopy::findBounds(src, info.v_rowbytes, width, info.v_height, mask, backup.background, left, top, right, bottom)) {
+			backup.left = left * sizeof(uint32_t);
+			backup.top = top;
+			backup.rowSize = (right - left) * sizeof(uint32_t);
+			backup.rows = bottom - top;
+		} else {
+			backup.rowSize = backup.rows = 0;
+		}
+		backup.hasBackground = true;
+		DBGLOG("weg", "console background %08X content at %lu:%lu %lux%lu", backup.background,
+			   left, top, backup.rowSize / sizeof(uint32_t), backup.rows);
+	}
+
+	// Solid screen needs no storage at all.
+	if (backup.rows == 0) {
+		backup.valid = true;
+		return;
+	}
+
+	src += backup.top * info.v_rowbytes + backup.left;
+
+	// Boot screen content compresses very well, so try it first.
+	uint32_t *compressed = nullptr;
+	size_t compressedSize = 0;
+	if (FramebufferCopy::compressRows(src, info.v_rowbytes, backup.rowSize, backup.rows, compressed, compressedSize)) {
+		DBGLOG("weg", "console backup compressed to %lu bytes from %lu", compressedSize, backup.rowSize * backup.rows);
+		backup.buffer = reinterpret_cast<uint8_t *>(compressed);
+		backup.size = compressedSize;
+		backup.compressed = true;
+		backup.valid = true;
+		return;
+	}
+
+	DBGLOG("weg", "console backup is not compressible, storing raw");
+	backup.buffer = Buffer::create<uint8_t>(backup.rowSize * backup.rows);
+	if (backup.buffer) {
+		backup.size = backup.rowSize * backup.rows;
+		backup.valid = true;
+		FramebufferCopy::copyRows(backup.buffer, backup.rowSize, src, info.v_rowbytes, backup.rowSize, backup.rows);
+	} else {
+		SYSLOG("weg", "console buffer allocation failure");
+	}
+}
+
+void FramebufferConsole::restore(Backup &backup, const vc_info &info, uint8_t *dst) {
+	// Fill everything around the saved rectangle with the background.
+	if (backup.hasBackground) {
+		size_t right = backup.left + backup.rowSize;
+		size_t bottom = backup.top + backup.rows;
+		if (backup.rows == 0) {
+			FramebufferCopy::fillRows(dst, info.v_rowbytes, backup.background, backup.visibleRowSize, info.v_height);
+		} else {
+			FramebufferCopy::fillRows(dst, info.v_rowbytes, backup.background, backup.visibleRowSize, backup.top);
+			if (backup.left > 0)
+				FramebufferCopy::fillRows(dst + backup.top * info.v_rowbytes, info.v_rowbytes, backup.background,
+										  backup.left, backup.rows);
+			if (right < backup.visibleRowSize)
+				FramebufferCopy::fillRows(dst + backup.top * info.v_rowbytes + right, info.v_rowbytes, backup.background,
+										  backup.visibleRowSize - right, backup.rows);
+			FramebufferCopy::fillRows(dst + bottom * info.v_rowbytes, info.v_rowbytes, backup.background,
+									  backup.visibleRowSize, info.v_height - bottom);
+		}
+	}
+
+	auto rect = dst + backup.top * info.v_rowbytes + backup.left;
+	if (backup.compressed) {
+		if (!FramebufferCopy::decompressRows(rect, info.v_rowbytes, reinterpret_cast<const uint32_t *>(backup.buffer),
+											 backup.size, backup.rowSize, backup.rows))
+			SYSLOG("weg", "console buffer decompression failure");
+	} else if (backup.buffer) {
+		FramebufferCopy::copyRows(rect, info.v_rowbytes, backup.buffer, backup.rowSize, backup.rowSize, backup.rows);
+	}
+
+	release(backup);
+}
+
+bool FramebufferConsole::getScaledFormat(const Backup &backup, const IOPixelInformation &pixelInfo, FramebufferCopy::PixelFormat &format) {
+	// Only 32-bit pixels with the content rectangle known are supported.
+	if (!backup.hasBackground || pixelInfo.bitsPerPixel != 32 || pixelInfo.activeWidth == 0 || pixelInfo.activeHeight == 0 ||
+		pixelInfo.bytesPerRow < pixelInfo.activeWidth * sizeof(uint32_t))
+		return false;
+
+	if (pixelInfo.bitsPerComponent == 8)
+		format = FramebufferCopy::PixelFormat::RGB888;
+	else if (pixelInfo.bitsPerComponent == 10)
+		format = FramebufferCopy::PixelFormat::RGB101010;
+	else
+		return false;
+
+	return true;
+}
+
+void FramebufferConsole::restoreScaled(Backup &backup, const vc_info &info, uint8_t *dst, const IOPixelInformation &pixelInfo, FramebufferCopy::PixelFormat format) {
+	FramebufferCopy::SourceImage image {
+		reinterpret_cast<const uint32_t *>(backup.buffer), backup.size, backup.compressed,
+		info.v_width, info.v_height,
+		backup.left / sizeof(uint32_t), backup.top, backup.rowSize / sizeof(uint32_t), backup.rows,
+		backup.background, backup.format
+	};
+
+	if (!FramebufferCopy::scaleRows(dst, pixelInfo.bytesPerRow, pixelInfo.activeWidth, pixelInfo.activeHeight, format, image))
+		SYSLOG("weg", "console buffer scaling failure");
+
+	release(backup);
+}
+
+void FramebufferConsole::release(Backup &backup) {
+	// The image is on the screen now, there is no reason to keep the memory wired.
+	if (backup.buffer) {
+		Buffer::deleter(backup.buffer);
+		backup.buffer = nullptr;
+		backup.size = 0;
+	}
+	backup.valid = false;
+}
@@ -0,0 +1,151 @@
+//
+//  kern_fbconsole.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_fbconsole_hpp
+#define kern_fbconsole_hpp
+
+#include "kern_fbcopy.hpp"
+
+#include <Headers/kern_util.hpp>
+#include <IOKit/graphics/IOGraphicsTypes.h>
+
+// Boot console backcopy, kept apart from WEG so that host checks could run it on synthetic framebuffers.
+namespace FramebufferConsole {
+	/**
+	 *  Console info structure, taken from osfmk/console/video_console.h
+	 *  Last updated from XNU 4570.1.46.
+	 */
+	struct vc_info {
+		unsigned int   v_height;        /* pixels */
+		unsigned int   v_width;         /* pixels */
+		unsigned int   v_depth;
+		unsigned int   v_rowbytes;
+		unsigned long  v_baseaddr;
+		unsigned int   v_type;
+		char           v_name[32];
+		uint64_t       v_physaddr;
+		unsigned int   v_rows;          /* characters */
+		unsigned int   v_columns;       /* characters */
+		unsigned int   v_rowscanbytes;  /* Actualy number of bytes used for display per row*/
+		unsigned int   v_scale;
+		unsigned int   v_rotate;
+		unsigned int   v_reserved[3];
+	};
+
+	/**
+	 *  Console backcopy, only the rectangle different from the background is stored
+	 */
+	struct Backup {
+		/**
+		 *  Saved rectangle, either raw or run-length compressed
+		 */
+		uint8_t *buffer {nullptr};
+
+		/**
+		 *  Saved rectangle size in bytes
+		 */
+		size_t size {0};
+
+		/**
+		 *  Bytes actually displayed per row
+		 */
+		size_t visibleRowSize {0};
+
+		/**
+		 *  Saved rectangle offset in bytes from the row start
+		 */
+		size_t left {0};
+
+		/**
+		 *  First saved row
+		 */
+		size_t top {0};
+
+		/**
+		 *  Saved bytes per row (packed without stride padding)
+		 */
+		size_t rowSize {0};
+
+		/**
+		 *  Amount of saved rows
+		 */
+		size_t rows {0};
+
+		/**
+		 *  Background pixel value used outside of the saved rectangle
+		 */
+		uint32_t background {0};
+
+		/**
+		 *  Saved pixel format, valid when surrounded by background
+		 */
+		FramebufferCopy::PixelFormat format {FramebufferCopy::PixelFormat::RGB888};
+
+		/**
+		 *  Saved rectangle is surrounded by background
+		 */
+		bool hasBackground {false};
+
+		/**
+		 *  Saved rectangle is run-length compressed
+		 */
+		bool compressed {false};
+
+		/**
+		 *  Backcopy is available for restoration
+		 */
+		bool valid {false};
+	};
+
+	/**
+	 *  Save console contents before framebuffer initialisation
+	 *
+	 *  @param backup  console backcopy
+	 *  @param info    console info with the framebuffer mapped at v_baseaddr
+	 */
+	void save(Backup &backup, const vc_info &info);
+
+	/**
+	 *  Restore saved console contents and free the backcopy
+	 *
+	 *  @param backup  console backcopy
+	 *  @param info    console info the backcopy was saved with
+	 *  @param dst     framebuffer memory
+	 */
+	void restore(Backup &backup, const vc_info &info, uint8_t *dst);
+
+	/**
+	 *  Obtain pixel format for scaled console restoration
+	 *
+	 *  @param backup     console backcopy
+	 *  @param pixelInfo  framebuffer pixel information
+	 *  @param format     framebuffer pixel format
+	 *
+	 *  @return true if the saved console can be restored to this framebuffer
+	 */
+	bool getScaledFormat(const Backup &backup, const IOPixelInformation &pixelInfo, FramebufferCopy::PixelFormat &format);
+
+	/**
+	 *  Restore saved console contents to a framebuffer with a different mode and free the backcopy
+	 *
+	 *  @param backup     console backcopy
+	 *  @param info       console info the backcopy was saved with
+	 *  @param dst        framebuffer memory
+	 *  @param pixelInfo  framebuffer pixel information
+	 *  @param format     framebuffer pixel format
+	 */
+	void restoreScaled(Backup &backup, const vc_info &info, uint8_t *dst, const IOPixelInformation &pixelInfo, FramebufferCopy::PixelFormat format);
+
+	/**
+	 *  Free the console backcopy once it is restored
+	 *
+	 *  @param backup  console backcopy
+	 */
+	void release(Backup &backup);
+}
+
+#endif /* kern_fbconsole_hpp */
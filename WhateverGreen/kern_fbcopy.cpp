@@ -0,0 +1,524 @@
+//
+//  kern_fbcopy.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_fbcopy.hpp"
+
+// Kernel code is built without SSE/AVX support and must not touch vector registers
+// without saving the FPU state, so we use movnti, which streams general purpose registers.
+// It is a part of SSE2 and thus is guaranteed to be available on any x86_64 CPU.
+
+namespace {
+	/**
+	 *  Transfers below this size are not worth streaming
+	 */
+	constexpr size_t MinStreamingSize = 256;
+
+	/**
+	 *  Whole copies below this size go through lilu_os_memcpy, which was up to 3 times faster on the host
+	 *  while the destination still fit into the cache. Streaming only won above about 2 MB.
+	 */
+	constexpr size_t MinStreamingCopySize = 2 * 1024 * 1024;
+
+	/**
+	 *  Amount of bytes written per unrolled iteration
+	 */
+	constexpr size_t StreamingBlockSize = 4 * sizeof(uint64_t);
+
+	/**
+	 *  Compressed stream token run flag, the rest of the token is the word count
+	 */
+	constexpr uint32_t TokenRunFlag = 0x80000000;
+
+	/**
+	 *  Shortest run worth a separate token
+	 */
+	constexpr size_t MinRunLength = 3;
+
+	/**
+	 *  Initial compressed stream capacity in words
+	 */
+	constexpr size_t InitialStreamCapacity = 4096;
+
+	inline void streamStore(uint64_t *dst, uint64_t value) {
+		asm volatile ("movnti %1, %0" : "=m" (*dst) : "r" (value));
+	}
+
+	inline uint64_t loadUnaligned(const uint8_t *src) {
+		uint64_t value;
+		lilu_os_memcpy(&value, src, sizeof(value));
+		return value;
+	}
+
+	inline size_t alignmentHead(const void *dst) {
+		return (sizeof(uint64_t) - (reinterpret_cast<uintptr_t>(dst) & (sizeof(uint64_t) - 1))) & (sizeof(uint64_t) - 1);
+	}
+
+	/**
+	 *  Copy without ordering the non-temporal stores, the caller must flush
+	 */
+	void streamCopy(void *dst, const void *src, size_t size) {
+		auto d = static_cast<uint8_t *>(dst);
+		auto s = static_cast<const uint8_t *>(src);
+
+		if (size < MinStreamingSize) {
+			lilu_os_memcpy(d, s, size);
+			return;
+		}
+
+		// Align the destination, unaligned non-temporal stores are split and lose write combining.
+		size_t head = alignmentHead(d);
+		lilu_os_memcpy(d, s, head);
+		d += head;
+		s += head;
+		size -= head;
+
+		auto qd = reinterpret_cast<uint64_t *>(d);
+		size_t blocks = size / StreamingBlockSize;
+		for (size_t i = 0; i < blocks; i++) {
+			streamStore(&qd[0], loadUnaligned(s));
+			streamStore(&qd[1], loadUnaligned(s + 8));
+			streamStore(&qd[2], loadUnaligned(s + 16));
+			streamStore(&qd[3], loadUnaligned(s + 24));
+			qd += 4;
+			s  += StreamingBlockSize;
+		}
+
+		size_t words = (size % StreamingBlockSize) / sizeof(uint64_t);
+		for (size_t i = 0; i < words; i++) {
+			streamStore(qd++, loadUnaligned(s));
+			s += sizeof(uint64_t);
+		}
+
+		lilu_os_memcpy(qd, s, size % sizeof(uint64_t));
+	}
+
+	/**
+	 *  Fill without ordering the non-temporal stores, the caller must flush
+	 */
+	void streamFill(void *dst, uint32_t value, size_t size) {
+		auto d = static_cast<uint8_t *>(dst);
+
+		// The pattern is anchored to the destination start, so small fills are done word by word.
+		if (size < MinStreamingSize) {
+			size_t words = size / sizeof(uint32_t);
+			for (size_t i = 0; i < words; i++)
+				lilu_os_memcpy(&d[i * sizeof(uint32_t)], &value, sizeof(uint32_t));
+			for (size_t i = words * sizeof(uint32_t); i < size; i++)
+				d[i] = static_cast<uint8_t>(value >> ((i % sizeof(uint32_t)) * 8));
+			return;
+		}
+
+		// Rotate the pattern by the alignment head for the aligned part.
+		size_t head = alignmentHead(d);
+		for (size_t i = 0; i < head; i++)
+			d[i] = static_cast<uint8_t>(value >> ((i % sizeof(uint32_t)) * 8));
+
+		uint32_t rotated = value;
+		if (head % sizeof(uint32_t))
+			rotated = (value >> ((head % sizeof(uint32_t)) * 8)) | (value << ((sizeof(uint32_t) - head % sizeof(uint32_t)) * 8));
+		uint64_t pattern = (static_cast<uint64_t>(rotated) << 32) | rotated;
+
+		d += head;
+		size -= head;
+
+		auto qd = reinterpret_cast<uint64_t *>(d);
+		size_t blocks = size / StreamingBlockSize;
+		for (size_t i = 0; i < blocks; i++) {
+			streamStore(&qd[0], pattern);
+			streamStore(&qd[1], pattern);
+			streamStore(&qd[2], pattern);
+			streamStore(&qd[3], pattern);
+			qd += 4;
+		}
+
+		size_t words = (size % StreamingBlockSize) / sizeof(uint64_t);
+		for (size_t i = 0; i < words; i++)
+			streamStore(qd++, pattern);
+
+		auto tail = reinterpret_cast<uint8_t *>(qd);
+		for (size_t i = 0; i < size % sizeof(uint64_t); i++)
+			tail[i] = static_cast<uint8_t>(pattern >> (i * 8));
+	}
+}
+
+void FramebufferCopy::copy(void *dst, const void *src, size_t size) {
+	if (size < MinStreamingCopySize) {
+		lilu_os_memcpy(dst, src, size);
+		return;
+	}
+
+	streamCopy(dst, src, size);
+	flush();
+}
+
+void FramebufferCopy::fill(void *dst, uint32_t value, size_t size) {
+	streamFill(dst, value, size);
+	flush();
+}
+
+void FramebufferCopy::copyRows(void *dst, size_t dstStride, const void *src, size_t srcStride, size_t rowSize, size_t rows) {
+	// Contiguous buffers are copied in one go.
+	if (rowSize == dstStride && rowSize == srcStride) {
+		copy(dst, src, rowSize * rows);
+		return;
+	}
+
+	auto d = static_cast<uint8_t *>(dst);
+	auto s = static_cast<const uint8_t *>(src);
+	bool streaming = rowSize * rows >= MinStreamingCopySize;
+	for (size_t i = 0; i < rows; i++) {
+		if (streaming)
+			streamCopy(d, s, rowSize);
+		else
+			lilu_os_memcpy(d, s, rowSize);
+		d += dstStride;
+		s += srcStride;
+	}
+
+	if (streaming)
+		flush();
+}
+
+void FramebufferCopy::fillRows(void *dst, size_t dstStride, uint32_t value, size_t rowSize, size_t rows) {
+	auto d = static_cast<uint8_t *>(dst);
+	for (size_t i = 0; i < rows; i++) {
+		streamFill(d, value, rowSize);
+		d += dstStride;
+	}
+
+	flush();
+}
+
+void FramebufferCopy::flush() {
+	asm volatile ("sfence" ::: "memory");
+}
+
+namespace {
+	/**
+	 *  Pixel comparator checking two pixels at a time
+	 */
+	struct PixelMatcher {
+		uint32_t mask;
+		uint32_t background;
+		uint64_t mask2;
+		uint64_t background2;
+
+		PixelMatcher(uint32_t mask, uint32_t background) : mask(mask), background(background),
+			mask2((static_cast<uint64_t>(mask) << 32) | mask),
+			background2((static_cast<uint64_t>(background) << 32) | background) {}
+
+		bool differs(uint32_t pixel) const {
+			return ((pixel ^ background) & mask) != 0;
+		}
+
+		/**
+		 *  Index of the first different pixel in [from, to) or to
+		 */
+		size_t first(const uint32_t *row, size_t from, size_t to) const {
+			size_t i = from;
+			for (; i + 2 <= to; i += 2) {
+				uint64_t diff = (loadUnaligned(reinterpret_cast<const uint8_t *>(&row[i])) ^ background2) & mask2;
+				if (diff)
+					return (diff & 0xFFFFFFFF) ? i : i + 1;
+			}
+			if (i < to && differs(row[i]))
+				return i;
+			return to;
+		}
+
+		/**
+		 *  Index past the last different pixel in [from, to) or from
+		 */
+		size_t last(const uint32_t *row, size_t from, size_t to) const {
+			size_t i = to;
+			for (; i >= from + 2; i -= 2) {
+				uint64_t diff = (loadUnaligned(reinterpret_cast<const uint8_t *>(&row[i - 2])) ^ background2) & mask2;
+				if (diff)
+					return (diff >> 32) ? i : i - 1;
+			}
+			if (i > from && differs(row[i - 1]))
+				return i;
+			return from;
+		}
+	};
+
+	/**
+	 *  Growable compressed stream writer
+	 */
+	struct StreamWriter {
+		uint32_t *data {nullptr};
+		size_t size {0};
+		size_t capacity {0};
+		size_t limit {0};
+
+		bool reserve(size_t words) {
+			if (size + words <= capacity)
+				return true;
+			size_t newCapacity = capacity > 0 ? capacity * 2 : InitialStreamCapacity;
+			while (newCapacity < size + words)
+				newCapacity *= 2;
+			if (newCapacity > limit)
+				newCapacity = limit;
+			if (size + words > newCapacity || !Buffer::resize(data, newCapacity))
+				return false;
+			capacity = newCapacity;
+			return true;
+		}
+
+		bool literal(const uint32_t *src, size_t count) {
+			if (count == 0)
+				return true;
+			if (!reserve(count + 1))
+				return false;
+			data[size++] = static_cast<uint32_t>(count);
+			lilu_os_memcpy(&data[size], src, count * sizeof(uint32_t));
+			size += count;
+			return true;
+		}
+
+		bool run(uint32_t value, size_t count) {
+			if (!reserve(2))
+				return false;
+			data[size++] = TokenRunFlag | static_cast<uint32_t>(count);
+			data[size++] = value;
+			return true;
+		}
+	};
+}
+
+bool FramebufferCopy::compressRows(const void *src, size_t srcStride, size_t rowSize, size_t rows, uint32_t *&out, size_t &outSize) {
+	if (rowSize % sizeof(uint32_t) != 0 || rowSize / sizeof(uint32_t) >= TokenRunFlag)
+		return false;
+
+	// Do not bother when the compressed stream is not smaller than the raw data.
+	StreamWriter writer;
+	writer.limit = rowSize / sizeof(uint32_t) * rows;
+
+	auto s = static_cast<const uint8_t *>(src);
+	size_t words = rowSize / sizeof(uint32_t);
+	bool success = true;
+	for (size_t r = 0; r < rows && success; r++, s += srcStride) {
+		auto row = reinterpret_cast<const uint32_t *>(s);
+		size_t literalStart = 0, i = 0;
+		while (i < words && success) {
+			uint32_t value = row[i];
+			size_t j = i + 1;
+			while (j < words && row[j] == value)
+				j++;
+			if (j - i >= MinRunLength) {
+				success = writer.literal(&row[literalStart], i - literalStart) && writer.run(value, j - i);
+				literalStart = j;
+			}
+			i = j;
+		}
+
+		if (success)
+			success = writer.literal(&row[literalStart], words - literalStart);
+	}
+
+	if (!success) {
+		if (writer.data)
+			Buffer::deleter(writer.data);
+		return false;
+	}
+
+	out = writer.data;
+	outSize = writer.size * sizeof(uint32_t);
+	return true;
+}
+
+namespace {
+	/**
+	 *  Decode a single row of the compressed stream
+	 *
+	 *  @param row    destination row
+	 *  @param words  pixels per row
+	 *  @param src    compressed stream
+	 *  @param total  compressed stream size in words
+	 *  @param index  current position in the compressed stream
+	 *
+	 *  @return true if the row was decoded
+	 */
+	template <bool Streaming>
+	bool decodeRow(uint32_t *row, size_t words, const uint32_t *src, size_t total, size_t &index) {
+		size_t pos = 0;
+		while (pos < words) {
+			if (index >= total)
+				return false;
+
+			uint32_t token = src[index++];
+			size_t count = token & ~TokenRunFlag;
+			if (count == 0 || count > words - pos)
+				return false;
+
+			if (token & TokenRunFlag) {
+				if (index >= total)
+					return false;
+				if (Streaming) {
+					streamFill(&row[pos], src[index], count * sizeof(uint32_t));
+				} else {
+					for (size_t i = 0; i < count; i++)
+						row[pos + i] = src[index];
+				}
+				index++;
+			} else {
+				if (count > total - index)
+					return false;
+				if (Streaming)
+					streamCopy(&row[pos], &src[index], count * sizeof(uint32_t));
+				else
+					lilu_os_memcpy(&row[pos], &src[index], count * sizeof(uint32_t));
+				index += count;
+			}
+
+			pos += count;
+		}
+
+		return true;
+	}
+}
+
+bool FramebufferCopy::decompressRows(void *dst, size_t dstStride, const uint32_t *src, size_t srcSize, size_t rowSize, size_t rows) {
+	if (rowSize % sizeof(uint32_t) != 0)
+		return false;
+
+	auto d = static_cast<uint8_t *>(dst);
+	size_t words = rowSize / sizeof(uint32_t);
+	size_t total = srcSize / sizeof(uint32_t), index = 0;
+	bool valid = true;
+	for (size_t r = 0; r < rows && valid; r++, d += dstStride)
+		valid = decodeRow<true>(reinterpret_cast<uint32_t *>(d), words, src, total, index);
+
+	flush();
+	return valid && index == total;
+}
+
+uint32_t FramebufferCopy::convertPixel(uint32_t pixel, PixelFormat from, PixelFormat to) {
+	if (from == to)
+		return pixel;
+
+	if (from == PixelFormat::RGB888) {
+		// Replicate the upper bits into the new low bits to keep white white.
+		uint32_t r = (pixel >> 16) & 0xFF, g = (pixel >> 8) & 0xFF, b = pixel & 0xFF;
+		r = (r << 2) | (r >> 6);
+		g = (g << 2) | (g >> 6);
+		b = (b << 2) | (b >> 6);
+		return (r << 20) | (g << 10) | b;
+	}
+
+	uint32_t r = (pixel >> 22) & 0xFF, g = (pixel >> 12) & 0xFF, b = (pixel >> 2) & 0xFF;
+	return (r << 16) | (g << 8) | b;
+}
+
+bool FramebufferCopy::scaleRows(void *dst, size_t dstStride, size_t dstWidth, size_t dstHeight, PixelFormat dstFormat, const SourceImage &src) {
+	if (src.width == 0 || src.height == 0 || dstWidth == 0 || dstHeight == 0 ||
+		src.left + src.rectWidth > src.width || src.top + src.rectHeight > src.height)
+		return false;
+
+	// Source row (full width) and destination row (converted) scratch buffers.
+	auto srcRow = Buffer::create<uint32_t>(src.width + dstWidth);
+	if (!srcRow)
+		return false;
+	auto dstRow = srcRow + src.width;
+
+	for (size_t x = 0; x < src.width; x++)
+		srcRow[x] = src.background;
+	uint32_t background = convertPixel(src.background, src.format, dstFormat);
+
+	auto d = static_cast<uint8_t *>(dst);
+	size_t total = src.size / sizeof(uint32_t), index = 0;
+	// Amount of rect rows decoded and source row currently converted in dstRow.
+	size_t decodedRow = 0, convertedRow = 0;
+	bool converted = false, valid = true;
+
+	for (size_t y = 0; y < dstHeight && valid; y++, d += dstStride) {
+		// Nearest neighbour source row, it never decreases, so the stream is decoded sequentially.
+		size_t sy = y * src.height / dstHeight;
+		if (sy < src.top || sy >= src.top + src.rectHeight) {
+			streamFill(d, background, dstWidth * sizeof(uint32_t));
+			continue;
+		}
+
+		if (!converted || sy != convertedRow) {
+			size_t ry = sy - src.top;
+			while (valid && decodedRow <= ry) {
+				if (src.compressed)
+					valid = decodeRow<false>(&srcRow[src.left], src.rectWidth, src.data, total, index);
+				else if ((decodedRow + 1) * src.rectWidth <= total)
+					lilu_os_memcpy(&srcRow[src.left], &src.data[decodedRow * src.rectWidth], src.rectWidth * sizeof(uint32_t));
+				else
+					valid = false;
+				decodedRow++;
+			}
+
+			if (!valid)
+				break;
+
+			// Step through source columns as x * width / dstWidth without divisions.
+			size_t sx = 0, remainder = 0;
+			for (size_t x = 0; x < dstWidth; x++) {
+				dstRow[x] = convertPixel(srcRow[sx], src.format, dstFormat);
+				remainder += src.width;
+				while (remainder >= dstWidth) {
+					remainder -= dstWidth;
+					sx++;
+				}
+			}
+			convertedRow = sy;
+			converted = true;
+		}
+
+		streamCopy(d, dstRow, dstWidth * sizeof(uint32_t));
+	}
+
+	flush();
+	Buffer::deleter(srcRow);
+	return valid;
+}
+
+bool FramebufferCopy::findBounds(const void *src, size_t stride, size_t width, size_t height, uint32_t mask, uint32_t background,
+								 size_t &left, size_t &top, size_t &right, size_t &bottom) {
+	PixelMatcher matcher(mask, background);
+	auto s = static_cast<const uint8_t *>(src);
+	auto row = [s, stride](size_t y) {
+		return reinterpret_cast<const uint32_t *>(s + y * stride);
+	};
+
+	// Find the first row with content, it also gives an initial left bound.
+	size_t y = 0;
+	while (y < height) {
+		left = matcher.first(row(y), 0, width);
+		if (left < width)
+			break;
+		y++;
+	}
+
+	if (y == height)
+		return false;
+	top = y;
+
+	// Find the last row with content, it also gives an initial right bound.
+	y = height;
+	while (y > top) {
+		right = matcher.last(row(y - 1), 0, width);
+		if (right > 0)
+			break;
+		y--;
+	}
+	bottom = y;
+
+	// Extend left and right bounds by scanning the outer parts of the remaining rows only.
+	for (y = top; y < bottom; y++) {
+		auto r = row(y);
+		if (left > 0)
+			left = matcher.first(r, 0, left);
+		if (right < width)
+			right = matcher.last(r, right, width);
+	}
+
+	return true;
+}
@@ -0,0 +1,198 @@
+//
+//  kern_fbcopy.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_fbcopy_hpp
+#define kern_fbcopy_hpp
+
+#include <Headers/kern_util.hpp>
+
+namespace FramebufferCopy {
+	/**
+	 *  Supported 32-bit pixel formats
+	 *
+	 *  RGB888     --------RRRRRRRRGGGGGGGGBBBBBBBB
+	 *  RGB101010  --RRRRRRRRRRGGGGGGGGGGBBBBBBBBBB
+	 */
+	enum class PixelFormat {
+		RGB888,
+		RGB101010
+	};
+
+	/**
+	 *  Saved image description used for scaled restoration.
+	 *  Only the content rectangle is stored, the rest is background.
+	 */
+	struct SourceImage {
+		/**
+		 *  Content rectangle pixels, raw or compressed by compressRows
+		 */
+		const uint32_t *data;
+
+		/**
+		 *  Content rectangle data size in bytes
+		 */
+		size_t size;
+
+		/**
+		 *  Content rectangle data is compressed
+		 */
+		bool compressed;
+
+		/**
+		 *  Image size in pixels
+		 */
+		size_t width;
+		size_t height;
+
+		/**
+		 *  Content rectangle in pixels
+		 */
+		size_t left;
+		size_t top;
+		size_t rectWidth;
+		size_t rectHeight;
+
+		/**
+		 *  Background pixel value
+		 */
+		uint32_t background;
+
+		/**
+		 *  Image pixel format
+		 */
+		PixelFormat format;
+	};
+
+	/**
+	 *  Copy data into write-combined video memory.
+	 *  Transfers of at least 2 MB use non-temporal stores, which bypass the cache and do not
+	 *  evict the working set on multi-megabyte framebuffers, smaller ones use lilu_os_memcpy.
+	 *
+	 *  @param dst   destination (usually VRAM)
+	 *  @param src   source
+	 *  @param size  amount of bytes to copy
+	 */
+	void copy(void *dst, const void *src, size_t size);
+
+	/**
+	 *  Fill write-combined video memory with a 32-bit pattern.
+	 *
+	 *  @param dst    destination (usually VRAM)
+	 *  @param value  pixel value to fill with
+	 *  @param size   amount of bytes to fill, the pattern is truncated at the end
+	 */
+	void fill(void *dst, uint32_t value, size_t size);
+
+	/**
+	 *  Copy a rectangle of rows between buffers with different strides.
+	 *  Rectangles of at least 2 MB in total are streamed like in copy.
+	 *
+	 *  @param dst        destination (usually VRAM)
+	 *  @param dstStride  destination bytes per row
+	 *  @param src        source
+	 *  @param srcStride  source bytes per row
+	 *  @param rowSize    amount of bytes to copy per row
+	 *  @param rows       amount of rows
+	 */
+	void copyRows(void *dst, size_t dstStride, const void *src, size_t srcStride, size_t rowSize, size_t rows);
+
+	/**
+	 *  Fill a rectangle of rows with a 32-bit pattern.
+	 *
+	 *  @param dst        destination (usually VRAM)
+	 *  @param dstStride  destination bytes per row
+	 *  @param value      pixel value to fill with
+	 *  @param rowSize    amount of bytes to fill per row
+	 *  @param rows       amount of rows
+	 */
+	void fillRows(void *dst, size_t dstStride, uint32_t value, size_t rowSize, size_t rows);
+
+	/**
+	 *  Find the rectangle of 32-bit pixels different from the background.
+	 *  Only the rows and columns outside of the current rectangle are scanned,
+	 *  so the amount of (slow) video memory reads stays close to the image size.
+	 *
+	 *  @param src         source (usually VRAM)
+	 *  @param stride      source bytes per row
+	 *  @param width       image width in pixels
+	 *  @param height      image height in pixels
+	 *  @param mask        significant pixel bits (e.g. without alpha)
+	 *  @param background  background pixel value
+	 *  @param left        first column with content
+	 *  @param top         first row with content
+	 *  @param right       column past the last column with content
+	 *  @param bottom      row past the last row with content
+	 *
+	 *  @return true if any content was found
+	 */
+	bool findBounds(const void *src, size_t stride, size_t width, size_t height, uint32_t mask, uint32_t background,
+					size_t &left, size_t &top, size_t &right, size_t &bottom);
+
+	/**
+	 *  Compress a rectangle of 32-bit pixel rows with run-length encoding.
+	 *  The stream consists of 32-bit tokens, each holding a word count and a run flag,
+	 *  followed by a single value for runs or by count values for literals.
+	 *  Tokens never cross row boundaries.
+	 *
+	 *  @param src        source (usually VRAM)
+	 *  @param srcStride  source bytes per row
+	 *  @param rowSize    bytes per row to compress, must be a multiple of 4
+	 *  @param rows       amount of rows
+	 *  @param out        allocated compressed stream, must be freed with Buffer::deleter
+	 *  @param outSize    compressed stream size in bytes
+	 *
+	 *  @return true on success, false when allocation failed or the data does not compress
+	 */
+	bool compressRows(const void *src, size_t srcStride, size_t rowSize, size_t rows, uint32_t *&out, size_t &outSize);
+
+	/**
+	 *  Decompress a stream created by compressRows.
+	 *
+	 *  @param dst        destination (usually VRAM)
+	 *  @param dstStride  destination bytes per row
+	 *  @param src        compressed stream
+	 *  @param srcSize    compressed stream size in bytes
+	 *  @param rowSize    bytes per row, must match compression
+	 *  @param rows       amount of rows, must match compression
+	 *
+	 *  @return true if the stream was valid and fully decompressed
+	 */
+	bool decompressRows(void *dst, size_t dstStride, const uint32_t *src, size_t srcSize, size_t rowSize, size_t rows);
+
+	/**
+	 *  Convert a pixel between formats, alpha is not preserved.
+	 *
+	 *  @param pixel  source pixel
+	 *  @param from   source format
+	 *  @param to     destination format
+	 *
+	 *  @return converted pixel
+	 */
+	uint32_t convertPixel(uint32_t pixel, PixelFormat from, PixelFormat to);
+
+	/**
+	 *  Restore a saved image at a different resolution and pixel format with nearest neighbour resampling.
+	 *
+	 *  @param dst        destination (usually VRAM)
+	 *  @param dstStride  destination bytes per row
+	 *  @param dstWidth   destination width in pixels
+	 *  @param dstHeight  destination height in pixels
+	 *  @param dstFormat  destination pixel format
+	 *  @param src        saved image
+	 *
+	 *  @return true if the saved image was valid and fully restored
+	 */
+	bool scaleRows(void *dst, size_t dstStride, size_t dstWidth, size_t dstHeight, PixelFormat dstFormat, const SourceImage &src);
+
+	/**
+	 *  Order previously issued non-temporal stores, must be called once the batch is done.
+	 *  copy and fill call it themselves.
+	 */
+	void flush();
+}
+
+#endif /* kern_fbcopy_hpp */
@@ -0,0 +1,66 @@
+//
+//  kern_fbdiff.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_fbdiff_hpp
+#define kern_fbdiff_hpp
+
+#ifdef KERNEL
+#include <Headers/kern_util.hpp>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+// Compiled framebuffer patches are also decoded by host tools, so this header must stay independent of kernel headers.
+namespace FramebufferDiff {
+	/**
+	 *  Diff magic ('WEGF')
+	 */
+	static constexpr uint32_t Magic {0x46474557};
+
+	/**
+	 *  Diff format version
+	 */
+	static constexpr uint32_t Version {1};
+
+	/**
+	 *  Diff header, followed by count entries
+	 */
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		/* platformInformationList record size, 0 when records are not indexed */
+		uint32_t stride;
+		uint32_t count;
+	};
+
+	/**
+	 *  Diff entry, followed by size original bytes and size patched bytes
+	 */
+	struct Entry {
+		/* Offset from gPlatformInformationList */
+		uint32_t offset;
+		/* Id of the patched framebuffer, 0 when unknown */
+		uint32_t framebufferId;
+		uint32_t size;
+	};
+
+	static_assert(sizeof(Header) == 16 && sizeof(Entry) == 12, "Invalid diff format");
+
+	/**
+	 *  Obtain entry size including its bytes
+	 *
+	 *  @param entry  diff entry
+	 *
+	 *  @return entry size
+	 */
+	inline size_t entrySize(const Entry &entry) {
+		return sizeof(Entry) + 2 * static_cast<size_t>(entry.size);
+	}
+}
+
+#endif /* kern_fbdiff_hpp */
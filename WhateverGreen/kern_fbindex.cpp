@@ -0,0 +1,111 @@
+//
+//  kern_fbindex.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_fbindex.hpp"
+
+bool FramebufferIndex::build(const FramebufferSNB *list, const uint8_t *end) {
+	release();
+
+	size_t num = 0;
+	while (num < arrsize(SandyPlatformId) && reinterpret_cast<const uint8_t *>(&list[num + 1]) <= end && validate(&list[num]))
+		num++;
+
+	if (num == 0 || !allocate(num, sizeof(FramebufferSNB)))
+		return false;
+
+	for (size_t i = 0; i < num; i++) {
+		if (SandyPlatformId[i] != 0xFFFFFFFF)
+			insert(i, SandyPlatformId[i]);
+	}
+
+	return indexed > 0;
+}
+
+bool FramebufferIndex::find(uint32_t framebufferId, size_t &offset) const {
+	if (!table || framebufferId == 0)
+		return false;
+
+	for (size_t i = slot(framebufferId); table[i] != 0; i = (i + 1) & tableMask) {
+		size_t position = table[i] - 1;
+		if (ids[position] == framebufferId) {
+			offset = position * recordStride;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FramebufferIndex::findSandyBridge(uint32_t framebufferId, size_t &offset) {
+	if (framebufferId == 0xFFFFFFFF)
+		return false;
+
+	for (size_t i = 0; i < arrsize(SandyPlatformId); i++) {
+		if (SandyPlatformId[i] == framebufferId) {
+			offset = i * sizeof(FramebufferSNB);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint32_t FramebufferIndex::framebufferIdAt(size_t offset) const {
+	if (recordStride == 0 || offset >= size())
+		return 0;
+	return ids[offset / recordStride];
+}
+
+void FramebufferIndex::release() {
+	if (ids) {
+		Buffer::deleter(ids);
+		ids = nullptr;
+	}
+
+	if (table) {
+		Buffer::deleter(table);
+		table = nullptr;
+	}
+
+	tableMask = 0;
+	recordCount = recordStride = indexed = 0;
+}
+
+bool FramebufferIndex::allocate(size_t records, size_t stride) {
+	// At most half of the slots are used, so probe sequences stay short.
+	size_t tableSize = 8;
+	while (tableSize < records * 2)
+		tableSize *= 2;
+
+	ids = Buffer::create<uint32_t>(records);
+	table = Buffer::create<uint32_t>(tableSize);
+	if (!ids || !table) {
+		SYSLOG("igfx", "failed to allocate index of %lu platformInformationList records", records);
+		release();
+		return false;
+	}
+
+	lilu_os_memset(ids, 0, records * sizeof(uint32_t));
+	lilu_os_memset(table, 0, tableSize * sizeof(uint32_t));
+	tableMask = tableSize - 1;
+	recordCount = records;
+	recordStride = stride;
+	return true;
+}
+
+void FramebufferIndex::insert(size_t position, uint32_t framebufferId) {
+	ids[position] = framebufferId;
+
+	size_t i = slot(framebufferId);
+	for (; table[i] != 0; i = (i + 1) & tableMask) {
+		if (ids[table[i] - 1] == framebufferId)
+			return;
+	}
+
+	table[i] = static_cast<uint32_t>(position + 1);
+	indexed++;
+}
@@ -0,0 +1,197 @@
+//
+//  kern_fbindex.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_fbindex_hpp
+#define kern_fbindex_hpp
+
+#include "kern_fb.hpp"
+
+#include <Headers/kern_util.hpp>
+
+/**
+ *  gPlatformInformationList records indexed by framebuffer id. The list is walked once with the
+ *  record stride of the generation, ids are then looked up in a hash table sized to the list.
+ */
+class FramebufferIndex {
+public:
+	FramebufferIndex() = default;
+	FramebufferIndex(const FramebufferIndex &) = delete;
+	FramebufferIndex &operator=(const FramebufferIndex &) = delete;
+
+	~FramebufferIndex() {
+		release();
+	}
+
+	/**
+	 *  Validate platformInformationList record
+	 *
+	 *  @param frame  record to validate
+	 *
+	 *  @return true if the record looks sane
+	 */
+	template <typename T>
+	static bool validate(const T *frame) {
+		if (frame->fPipeCount > MaxFramebufferConnectorCount || frame->fPortCount > MaxFramebufferConnectorCount ||
+			frame->fFBMemoryCount > MaxFramebufferConnectorCount)
+			return false;
+
+		// Connector indices are only allowed to be 0~3 or -1, see ConnectorInfo.
+		for (size_t i = 0; i < MaxFramebufferConnectorCount; i++) {
+			auto index = frame->connectors[i].index;
+			if (index < -1 || index >= static_cast<int8_t>(MaxFramebufferConnectorCount))
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 *  Index records up to the first invalid one or the terminator
+	 *
+	 *  @param list  platformInformationList pointer
+	 *  @param end   end of the memory the list may occupy
+	 *
+	 *  @return true if any records were indexed
+	 */
+	template <typename T>
+	bool build(const T *list, const uint8_t *end) {
+		release();
+
+		size_t num = 0;
+		while (reinterpret_cast<const uint8_t *>(&list[num + 1]) <= end && list[num].framebufferId != 0 &&
+			   list[num].framebufferId != 0xFFFFFFFF && validate(&list[num]))
+			num++;
+
+		if (num == 0 || !allocate(num, sizeof(T)))
+			return false;
+
+		for (size_t i = 0; i < num; i++)
+			insert(i, list[i].framebufferId);
+		return true;
+	}
+
+	/**
+	 *  Index Sandy Bridge records, which carry no ids and are matched by position
+	 *
+	 *  @param list  platformInformationList pointer
+	 *  @param end   end of the memory the list may occupy
+	 *
+	 *  @return true if any records were indexed
+	 */
+	bool build(const FramebufferSNB *list, const uint8_t *end);
+
+	/**
+	 *  Find the record offset by framebuffer id
+	 *
+	 *  @param framebufferId  framebuffer id
+	 *  @param offset         record offset from the list start
+	 *
+	 *  @return true if found
+	 */
+	bool find(uint32_t framebufferId, size_t &offset) const;
+
+	/**
+	 *  Find the Sandy Bridge record offset by its position in the platform id table, used when no index is built
+	 *
+	 *  @param framebufferId  framebuffer id
+	 *  @param offset         record offset from the list start
+	 *
+	 *  @return true if found
+	 */
+	static bool findSandyBridge(uint32_t framebufferId, size_t &offset);
+
+	/**
+	 *  Obtain the framebuffer id of the record containing an offset
+	 *
+	 *  @param offset  offset from the list start
+	 *
+	 *  @return framebuffer id or 0
+	 */
+	uint32_t framebufferIdAt(size_t offset) const;
+
+	/**
+	 *  Free the index
+	 */
+	void release();
+
+	/**
+	 *  Obtain the amount of indexed framebuffer ids
+	 *
+	 *  @return id count
+	 */
+	size_t count() const {
+		return indexed;
+	}
+
+	/**
+	 *  Obtain the record size, 0 when nothing is indexed
+	 *
+	 *  @return record size
+	 */
+	size_t stride() const {
+		return recordStride;
+	}
+
+	/**
+	 *  Obtain the size of the walked records
+	 *
+	 *  @return size in bytes
+	 */
+	size_t size() const {
+		return recordCount * recordStride;
+	}
+
+private:
+	/**
+	 *  Allocate the index for a list
+	 *
+	 *  @param records  amount of walked records
+	 *  @param stride   record size
+	 *
+	 *  @return true on success
+	 */
+	bool allocate(size_t records, size_t stride);
+
+	/**
+	 *  Index a record, the first record wins for duplicate ids
+	 *
+	 *  @param position       record position
+	 *  @param framebufferId  record framebuffer id
+	 */
+	void insert(size_t position, uint32_t framebufferId);
+
+	/**
+	 *  Hash table slot of a framebuffer id
+	 *
+	 *  @param framebufferId  framebuffer id
+	 *
+	 *  @return first probed slot
+	 */
+	size_t slot(uint32_t framebufferId) const {
+		return ((framebufferId * 0x9E3779B1U) ^ (framebufferId >> 16)) & tableMask;
+	}
+
+	/**
+	 *  Framebuffer id per record position, 0 for Sandy Bridge records without one
+	 */
+	uint32_t *ids {nullptr};
+
+	/**
+	 *  Open addressing hash table of record positions plus one, 0 marks empty slots
+	 */
+	uint32_t *table {nullptr};
+	size_t tableMask {0};
+
+	/**
+	 *  Amount of walked records, their size and the amount of indexed ids
+	 */
+	size_t recordCount {0};
+	size_t recordStride {0};
+	size_t indexed {0};
+};
+
+#endif /* kern_fbindex_hpp */
@@ -0,0 +1,347 @@
+//
+//  kern_fbprops.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_fbprops.hpp"
+
+namespace {
+	using namespace FramebufferProperties;
+
+	const char *framebufferFields[] {
+		"patch-enable", "framebufferid", "mobile", "pipecount", "portcount", "memorycount", "stolenmem", "fbmem", "unifiedmem"
+	};
+
+	const char *connectorFields[] {
+		"enable", "index", "busid", "pipe", "type", "flags"
+	};
+
+	const char *patchFields[] {
+		"enable", "framebufferid", "find", "replace", "findmask", "replacemask", "count"
+	};
+
+	static_assert(arrsize(framebufferFields) == FramebufferFieldTotal &&
+				  arrsize(connectorFields) == ConnectorFieldTotal &&
+				  arrsize(patchFields) == PatchFieldTotal, "Invalid property field lists");
+
+	/**
+	 *  Find property field by name
+	 *
+	 *  @param name    field name
+	 *  @param fields  field names
+	 *  @param num     number of fields
+	 *
+	 *  @return field index or num when not found
+	 */
+	size_t findPropertyField(const char *name, const char **fields, size_t num) {
+		for (size_t i = 0; i < num; i++) {
+			if (!strcmp(name, fields[i]))
+				return i;
+		}
+
+		return num;
+	}
+
+	/**
+	 *  Parse decimal property index followed by a dash, e.g. 12- in framebuffer-patch12-find
+	 *
+	 *  @param str    string to parse
+	 *  @param index  parsed index
+	 *  @param field  the rest of the string after the dash
+	 *
+	 *  @return true on success
+	 */
+	bool parsePropertyIndex(const char *str, uint32_t &index, const char *&field) {
+		// Leading zeroes are not allowed to avoid aliasing different names to the same index.
+		if (str[0] < '0' || str[0] > '9' || (str[0] == '0' && str[1] != '-'))
+			return false;
+
+		uint64_t value = 0;
+		while (*str >= '0' && *str <= '9') {
+			value = value * 10 + (*str - '0');
+			if (value > UINT32_MAX)
+				return false;
+			str++;
+		}
+
+		if (*str != '-')
+			return false;
+
+		index = static_cast<uint32_t>(value);
+		field = str + 1;
+		return true;
+	}
+
+	/**
+	 *  Append a parsed patch property, the storage grows as the amount of patches is not limited
+	 *
+	 *  @param collection  collected properties
+	 *  @param property    parsed property
+	 *
+	 *  @return true on success
+	 */
+	bool addPatchProperty(Collection &collection, const PatchProperty &property) {
+		if (collection.patchCount == collection.patchCapacity) {
+			size_t capacity = collection.patchCapacity > 0 ? collection.patchCapacity * 2 : 16;
+			auto props = Buffer::create<PatchProperty>(capacity);
+			if (!props) {
+				SYSLOG("igfx", "failed to allocate %lu framebuffer patch properties", capacity);
+				return false;
+			}
+
+			if (collection.patches) {
+				lilu_os_memcpy(props, collection.patches, collection.patchCount * sizeof(PatchProperty));
+				Buffer::deleter(collection.patches);
+			}
+
+			collection.patches = props;
+			collection.patchCapacity = capacity;
+		}
+
+		collection.patches[collection.patchCount++] = property;
+		if (property.field == PatchFieldEnable)
+			collection.enableCount++;
+		return true;
+	}
+
+	/**
+	 *  Mark the bytes of a word equal to the broadcasted byte with 0x80
+	 *
+	 *  @param word       data word
+	 *  @param broadcast  byte value repeated in every byte
+	 *
+	 *  @return 0x80 in every matching byte, 0 otherwise
+	 */
+	inline uint64_t matchBytes(uint64_t word, uint64_t broadcast) {
+		uint64_t value = word ^ broadcast;
+		return ~(((value & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | value | 0x7F7F7F7F7F7F7F7FULL);
+	}
+}
+
+bool FramebufferProperties::collect(OSDictionary *dict, Collection &collection) {
+	auto iterator = OSCollectionIterator::withCollection(dict);
+	if (!iterator) {
+		SYSLOG("igfx", "failed to iterate over IGPU properties");
+		return false;
+	}
+
+	static constexpr size_t PrefixLength = sizeof("framebuffer-") - 1;
+
+	OSSymbol *propname;
+	while ((propname = OSDynamicCast(OSSymbol, iterator->getNextObject())) != nullptr) {
+		auto name = propname->getCStringNoCopy();
+		if (!name || strncmp(name, "framebuffer-", PrefixLength))
+			continue;
+
+		name += PrefixLength;
+		uint32_t index = 0;
+		const char *field = nullptr;
+
+		if (!strncmp(name, "con", strlen("con")) && parsePropertyIndex(name + strlen("con"), index, field)) {
+			auto f = findPropertyField(field, connectorFields, ConnectorFieldTotal);
+			if (index < MaxFramebufferConnectorCount && f != ConnectorFieldTotal)
+				collection.connectors[index][f] = dict->getObject(propname);
+		} else if (!strncmp(name, "patch", strlen("patch")) && parsePropertyIndex(name + strlen("patch"), index, field)) {
+			auto f = findPropertyField(field, patchFields, PatchFieldTotal);
+			auto data = OSDynamicCast(OSData, dict->getObject(propname));
+			if (f != PatchFieldTotal && data && !addPatchProperty(collection, {index, static_cast<uint32_t>(f), data}))
+				break;
+		} else {
+			auto f = findPropertyField(name, framebufferFields, FramebufferFieldTotal);
+			if (f != FramebufferFieldTotal)
+				collection.framebuffer[f] = dict->getObject(propname);
+		}
+	}
+
+	iterator->release();
+	return true;
+}
+
+void FramebufferProperties::release(Collection &collection) {
+	if (collection.patches) {
+		Buffer::deleter(collection.patches);
+		collection.patches = nullptr;
+	}
+
+	collection.patchCount = collection.patchCapacity = collection.enableCount = 0;
+}
+
+size_t FramebufferProperties::buildPatches(const Collection &collection, uint32_t currentFramebuffer, uint8_t *&arena) {
+	arena = nullptr;
+	size_t enableCount = collection.enableCount;
+	if (enableCount == 0)
+		return 0;
+
+	// Patches are numbered sequentially, so at most enableCount of them could be used.
+	struct PatchSlot {
+		OSData *fields[PatchFieldTotal];
+	};
+
+	auto slots = Buffer::create<PatchSlot>(enableCount);
+	if (!slots) {
+		SYSLOG("igfx", "failed to allocate %lu framebuffer patch slots", enableCount);
+		return 0;
+	}
+
+	for (size_t i = 0; i < enableCount; i++)
+		slots[i] = {};
+
+	for (size_t i = 0; i < collection.patchCount; i++) {
+		auto &property = collection.patches[i];
+		if (property.index < enableCount)
+			slots[property.index].fields[property.field] = property.data;
+	}
+
+	// Missing status means no more patches, false status means a temporarily disabled patch.
+	size_t slotCount = 0, patchCount = 0, byteCount = 0;
+	for (; slotCount < enableCount; slotCount++) {
+		auto fields = slots[slotCount].fields;
+		uint32_t framebufferPatchEnable = 0;
+		if (!getValue<uint32_t>(fields[PatchFieldEnable], framebufferPatchEnable))
+			break;
+
+		if (!framebufferPatchEnable || !fields[PatchFieldFind] || !fields[PatchFieldReplace]) {
+			fields[PatchFieldEnable] = nullptr;
+			continue;
+		}
+
+		size_t size = fields[PatchFieldFind]->getLength();
+		if (size == 0 || fields[PatchFieldReplace]->getLength() != size ||
+			(fields[PatchFieldFindMask] && fields[PatchFieldFindMask]->getLength() != size) ||
+			(fields[PatchFieldReplaceMask] && fields[PatchFieldReplaceMask]->getLength() != size)) {
+			DBGLOG("igfx", "Patch %lu length mismatch", slotCount);
+			fields[PatchFieldEnable] = nullptr;
+			continue;
+		}
+
+		patchCount++;
+		byteCount += size * (2 + (fields[PatchFieldFindMask] != nullptr) + (fields[PatchFieldReplaceMask] != nullptr));
+	}
+
+	size_t count = 0;
+	if (patchCount > 0) {
+		arena = Buffer::create<uint8_t>(patchCount * sizeof(Patch) + byteCount);
+		if (arena) {
+			auto patches = reinterpret_cast<Patch *>(arena);
+			auto bytes = arena + patchCount * sizeof(Patch);
+			auto copy = [&bytes](OSData *data) -> const uint8_t * {
+				if (!data)
+					return nullptr;
+				auto r = bytes;
+				lilu_os_memcpy(bytes, data->getBytesNoCopy(), data->getLength());
+				bytes += data->getLength();
+				return r;
+			};
+
+			for (size_t i = 0; i < slotCount; i++) {
+				auto fields = slots[i].fields;
+				if (!fields[PatchFieldEnable])
+					continue;
+
+				auto &patch = patches[count++];
+				uint32_t framebufferId = 0;
+				size_t matches = 0;
+				patch.framebufferId = getValue<uint32_t>(fields[PatchFieldFramebufferId], framebufferId) ? framebufferId : currentFramebuffer;
+				patch.size = fields[PatchFieldFind]->getLength();
+				patch.find = copy(fields[PatchFieldFind]);
+				patch.replace = copy(fields[PatchFieldReplace]);
+				patch.findMask = copy(fields[PatchFieldFindMask]);
+				patch.replaceMask = copy(fields[PatchFieldReplaceMask]);
+				if (!getValue<uint32_t>(fields[PatchFieldCount], matches))
+					getValue<uint64_t>(fields[PatchFieldCount], matches);
+				patch.count = matches ? matches : 1;
+			}
+
+			DBGLOG("igfx", "loaded %lu framebuffer patches", count);
+		} else {
+			SYSLOG("igfx", "failed to allocate %lu framebuffer patches", patchCount);
+		}
+	}
+
+	Buffer::deleter(slots);
+	return count;
+}
+
+bool FramebufferProperties::applyPatch(const Patch &patch, uint8_t *startingAddress, size_t maxSize) {
+	auto find = patch.find;
+	auto replace = patch.replace;
+	auto findMask = patch.findMask;
+	auto replaceMask = patch.replaceMask;
+	size_t size = patch.size;
+
+	uint8_t *startAddress = startingAddress;
+	uint8_t *limitAddress = startingAddress + maxSize;
+	if (size == 0 || maxSize < size)
+		return false;
+
+	// Exclusive end for match starting addresses.
+	uint8_t *endAddress = limitAddress - size + 1;
+
+	// Candidates are filtered a word at a time by the first and the last fully compared bytes.
+	// SSE is not available to kernel code without saving FPU state, so plain 64-bit arithmetic is used.
+	size_t first = size, last = size;
+	for (size_t i = 0; i < size; i++) {
+		if (!findMask || findMask[i] == 0xFF) {
+			if (first == size)
+				first = i;
+			last = i;
+		}
+	}
+
+	auto matches = [&](const uint8_t *address) {
+		for (size_t i = 0; i < size; i++) {
+			uint8_t mask = findMask ? findMask[i] : 0xFF;
+			if ((address[i] & mask) != (find[i] & mask))
+				return false;
+		}
+		return true;
+	};
+
+	uint64_t firstByte = first < size ? find[first] * 0x0101010101010101ULL : 0;
+	uint64_t lastByte = last < size ? find[last] * 0x0101010101010101ULL : 0;
+
+	bool r = false;
+	size_t patchCount = 0;
+
+	while (startAddress < endAddress) {
+		uint8_t *match = nullptr;
+		if (first < size && static_cast<size_t>(endAddress - startAddress) >= sizeof(uint64_t)) {
+			auto candidates = matchBytes(*reinterpret_cast<const uint64_t *>(startAddress + first), firstByte) &
+				matchBytes(*reinterpret_cast<const uint64_t *>(startAddress + last), lastByte);
+			while (candidates) {
+				auto address = startAddress + __builtin_ctzll(candidates) / 8;
+				if (matches(address)) {
+					match = address;
+					break;
+				}
+				candidates &= candidates - 1;
+			}
+
+			if (!match) {
+				startAddress += sizeof(uint64_t);
+				continue;
+			}
+		} else if (matches(startAddress)) {
+			match = startAddress;
+		} else {
+			startAddress++;
+			continue;
+		}
+
+		for (size_t i = 0; i < size; i++) {
+			uint8_t mask = replaceMask ? replaceMask[i] : 0xFF;
+			match[i] = (match[i] & ~mask) | (replace[i] & mask);
+		}
+
+		r = true;
+
+		if (++patchCount >= patch.count)
+			break;
+
+		startAddress = match + size;
+	}
+
+	return r;
+}
@@ -0,0 +1,156 @@
+//
+//  kern_fbprops.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_fbprops_hpp
+#define kern_fbprops_hpp
+
+#include "kern_fb.hpp"
+
+#include <Headers/kern_util.hpp>
+#include <Library/LegacyIOService.h>
+
+// framebuffer-* IGPU properties, kept apart from IGFX so that host checks could feed them from fake dictionaries.
+namespace FramebufferProperties {
+	/**
+	 *  Framebuffer properties, prefixed with framebuffer-
+	 */
+	enum FramebufferField : size_t {
+		FramebufferFieldPatchEnable,
+		FramebufferFieldId,
+		FramebufferFieldMobile,
+		FramebufferFieldPipeCount,
+		FramebufferFieldPortCount,
+		FramebufferFieldMemoryCount,
+		FramebufferFieldStolenMem,
+		FramebufferFieldFbMem,
+		FramebufferFieldUnifiedMem,
+		FramebufferFieldTotal
+	};
+
+	/**
+	 *  Connector properties, prefixed with framebuffer-conN-
+	 */
+	enum ConnectorField : size_t {
+		ConnectorFieldEnable,
+		ConnectorFieldIndex,
+		ConnectorFieldBusId,
+		ConnectorFieldPipe,
+		ConnectorFieldType,
+		ConnectorFieldFlags,
+		ConnectorFieldTotal
+	};
+
+	/**
+	 *  Find / replace patch properties, prefixed with framebuffer-patchN-
+	 */
+	enum PatchField : size_t {
+		PatchFieldEnable,
+		PatchFieldFramebufferId,
+		PatchFieldFind,
+		PatchFieldReplace,
+		PatchFieldFindMask,
+		PatchFieldReplaceMask,
+		PatchFieldCount,
+		PatchFieldTotal
+	};
+
+	/**
+	 *  Framebuffer find / replace patch, patch bytes are stored in the same arena right after the patches
+	 */
+	struct Patch {
+		uint32_t framebufferId;
+		const uint8_t *find;
+		const uint8_t *replace;
+		const uint8_t *findMask;
+		const uint8_t *replaceMask;
+		size_t size;
+		size_t count;
+	};
+
+	/**
+	 *  Parsed framebuffer-patchN-* property
+	 */
+	struct PatchProperty {
+		uint32_t index;
+		uint32_t field;
+		OSData *data;
+	};
+
+	/**
+	 *  Collected properties, objects are owned by the collected dictionary
+	 */
+	struct Collection {
+		OSObject *framebuffer[FramebufferFieldTotal] {};
+		OSObject *connectors[MaxFramebufferConnectorCount][ConnectorFieldTotal] {};
+		PatchProperty *patches {nullptr};
+		size_t patchCount {0};
+		size_t patchCapacity {0};
+		size_t enableCount {0};
+	};
+
+	/**
+	 *  Collect all the framebuffer-* properties in a single pass
+	 *
+	 *  @param dict        property dictionary, must not change while it is iterated (e.g. a snapshot)
+	 *  @param collection  collected properties, must be released with release
+	 *
+	 *  @return true on success
+	 */
+	bool collect(OSDictionary *dict, Collection &collection);
+
+	/**
+	 *  Free collected patch properties
+	 *
+	 *  @param collection  collected properties
+	 */
+	void release(Collection &collection);
+
+	/**
+	 *  Build find / replace patches from collected properties
+	 *
+	 *  @param collection          collected properties
+	 *  @param currentFramebuffer  framebuffer id used for patches without one
+	 *  @param arena               allocated patches followed by their bytes, must be freed with Buffer::deleter
+	 *
+	 *  @return number of patches in the arena
+	 */
+	size_t buildPatches(const Collection &collection, uint32_t currentFramebuffer, uint8_t *&arena);
+
+	/**
+	 *  Patch data in place
+	 *
+	 *  Only the bits set in findMask are compared and only the bits set in replaceMask are replaced,
+	 *  missing masks mean all bits.
+	 *
+	 *  @param patch            Framebuffer find / replace patch
+	 *  @param startingAddress  Start address of data to search
+	 *  @param maxSize          Maximum size of data to search
+	 *
+	 *  @return true if patched anything
+	 */
+	bool applyPatch(const Patch &patch, uint8_t *startingAddress, size_t maxSize);
+
+	/**
+	 *  Read integer property value
+	 *
+	 *  @param prop   property value
+	 *  @param value  read value
+	 *
+	 *  @return true if the property is OSData of AS size
+	 */
+	template <typename AS, typename T>
+	bool getValue(OSObject *prop, T &value) {
+		auto data = OSDynamicCast(OSData, prop);
+		if (!data || data->getLength() != sizeof(AS))
+			return false;
+
+		value = static_cast<T>(*static_cast<const AS *>(data->getBytesNoCopy()));
+		return true;
+	}
+}
+
+#endif /* kern_fbprops_hpp */
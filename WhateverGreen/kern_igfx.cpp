@@ -7,10 +7,15 @@
 
 #include "kern_igfx.hpp"
 #include "kern_fb.hpp"
+#include "kern_fbdiff.hpp"
+#include "kern_fbprops.hpp"
+#include "kern_opts.hpp"
+#include "kern_trace.hpp"
 
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_cpu.hpp>
 #include <Headers/kern_file.hpp>
+#include <Library/LegacyIOService.h>
 
 static const char *pathIntelHD3000[]  { "/System/Library/Extensions/AppleIntelHD3000Graphics.kext/Contents/MacOS/AppleIntelHD3000Graphics" };
 static const char *pathIntelSNBFb[]   { "/System/Library/Extensions/AppleIntelSNBGraphicsFB.kext/Contents/MacOS/AppleIntelSNBGraphicsFB" };
@@ -49,9 +54,7 @@ void IGFX::init() {
 	cpuGeneration = CPUInfo::getGeneration(&family, &model);
 	switch (cpuGeneration) {
 		case CPUInfo::CpuGeneration::SandyBridge: {
-			int tmp = 1;
-			PE_parse_boot_argn("igfxsnb", &tmp, sizeof(tmp));
-			moderniseAccelerator = tmp == 1;
+			moderniseAccelerator = Options::integer(Options::Id::IgfxSandyBridge) == 1;
 			currentGraphics = &kextIntelHD3000;
 			currentFramebuffer = &kextIntelSNBFb;
 			break;
@@ -101,7 +104,13 @@ void IGFX::init() {
 }
 
 void IGFX::deinit() {
+	releaseFramebufferPatches();
+	platformIndex.release();
 
+	if (framebufferDiff) {
+		Buffer::deleter(framebufferDiff);
+		framebufferDiff = nullptr;
+	}
 }
 
 void IGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
@@ -113,7 +122,7 @@ void IGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 		applyFramebufferPatch = loadPatchesFromDevice(info->videoBuiltin, info->reportedFramebufferId);
 
 #ifdef DEBUG
-		if (checkKernelArgument("-igfxdump"))
+		if (Options::enabled(Options::Id::IgfxDump))
 			dumpFramebufferToDisk = true;
 #endif
 
@@ -133,12 +142,10 @@ void IGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 		// PAVP patch is only necessary when we have no discrete GPU
 		pavpDisablePatch = !connectorLessFrame && info->firmwareVendor != DeviceInfo::FirmwareVendor::Apple;
 
-		int gl = info->videoBuiltin->getProperty("disable-metal") != nullptr;
-		PE_parse_boot_argn("igfxgl", &gl, sizeof(gl));
-		forceOpenGL = gl == 1;
+		forceOpenGL = Options::integer(Options::Id::IgfxOpenGL, info->videoBuiltin) == 1;
 
 		// Automatically enable HDMI -> DP patches
-		hdmiAutopatch = !applyFramebufferPatch && !connectorLessFrame && getKernelVersion() >= Yosemite && !checkKernelArgument("-igfxnohdmi");
+		hdmiAutopatch = !applyFramebufferPatch && !connectorLessFrame && getKernelVersion() >= Yosemite && !Options::enabled(Options::Id::IgfxNoHdmi);
 
 		// Disable kext patching if we have nothing to do.
 		switchOffFramebuffer = !blackScreenPatch && !applyFramebufferPatch && !dumpFramebufferToDisk && !hdmiAutopatch;
@@ -159,11 +166,22 @@ void IGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 
 	if (moderniseAccelerator) {
 		KernelPatcher::RouteRequest request("__ZN9IOService20copyExistingServicesEP12OSDictionaryjj", wrapCopyExistingServices, orgCopyExistingServices);
-		patcher.routeMultiple(KernelPatcher::KernelID, &request, 1);
+		WEG_TRACE_CALL(RouteRequest, patcher.routeMultiple(KernelPatcher::KernelID, &request, 1));
 	}
 }
 
-bool IGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+size_t IGFX::getKexts(KernelPatcher::KextInfo **list, size_t max) {
+	size_t num = 0;
+	KernelPatcher::KextInfo *kexts[] {currentGraphics, currentFramebuffer, currentFramebufferOpt};
+	for (size_t i = 0; i < arrsize(kexts) && num < max; i++) {
+		if (kexts[i])
+			list[num++] = kexts[i];
+	}
+
+	return num;
+}
+
+bool IGFX::processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
 	if (currentGraphics && currentGraphics->loadIndex == index) {
 		if (pavpDisablePatch) {
 			auto callbackSym = "__ZN16IntelAccelerator19PAVPCommandCallbackE22PAVPSessionCommandID_tjPjb";
@@ -172,8 +190,7 @@ bool IGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t a
 			else if (cpuGeneration == CPUInfo::CpuGeneration::IvyBridge)
 				callbackSym = "__ZN16IntelAccelerator19PAVPCommandCallbackE22PAVPSessionCommandID_t18PAVPSessionAppID_tPjb";
 
-			KernelPatcher::RouteRequest request(callbackSym, wrapPavpSessionCallback, orgPavpSessionCallback);
-			patcher.routeMultiple(index, &request, 1, address, size);
+			plan.add(callbackSym, wrapPavpSessionCallback, orgPavpSessionCallback);
 		}
 
 		if (forceOpenGL || moderniseAccelerator || avoidFirmwareLoading) {
@@ -181,8 +198,7 @@ bool IGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t a
 			if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
 				startSym = "__ZN16IntelAccelerator5startEP9IOService";
 
-			KernelPatcher::RouteRequest request(startSym, wrapAcceleratorStart, orgAcceleratorStart);
-			patcher.routeMultiple(index, &request, 1, address, size);
+			plan.add(startSym, wrapAcceleratorStart, orgAcceleratorStart);
 		}
 
 		return true;
@@ -191,16 +207,23 @@ bool IGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t a
 	if ((currentFramebuffer && currentFramebuffer->loadIndex == index) ||
 		(currentFramebufferOpt && currentFramebufferOpt->loadIndex == index)) {
 		if (blackScreenPatch) {
-			KernelPatcher::RouteRequest request("__ZN31AppleIntelFramebufferController16ComputeLaneCountEPK29IODetailedTimingInformationV2jjPj", wrapComputeLaneCount, orgComputeLaneCount);
-			patcher.routeMultiple(index, &request, 1, address, size);
+			plan.add("__ZN31AppleIntelFramebufferController16ComputeLaneCountEPK29IODetailedTimingInformationV2jjPj", wrapComputeLaneCount, orgComputeLaneCount);
 		}
 
 		if (applyFramebufferPatch || dumpFramebufferToDisk || hdmiAutopatch) {
-			gPlatformInformationList = patcher.solveSymbol<void *>(index, "_gPlatformInformationList", address, size);
+			gPlatformInformationList = plan.solveSymbol<void *>(patcher, "_gPlatformInformationList");
 			if (gPlatformInformationList) {
 				framebufferStart = reinterpret_cast<uint8_t *>(address);
 				framebufferSize = size;
 
+				// Record layouts are only known since 10.10.5.
+				if (getKernelVersion() > KernelVersion::Yosemite ||
+					(getKernelVersion() == KernelVersion::Yosemite && getKernelMinorVersion() >= 5))
+					indexPlatformInformationList();
+
+				if (applyFramebufferPatch || hdmiAutopatch)
+					compileFramebufferPatches();
+
 				auto fbGetOSInformation = "__ZN31AppleIntelFramebufferController16getOSInformationEv";
 				if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
 					fbGetOSInformation = "__ZN23AppleIntelSNBGraphicsFB16getOSInformationEv";
@@ -211,8 +234,7 @@ bool IGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t a
 				else if (cpuGeneration == CPUInfo::CpuGeneration::Broadwell)
 					fbGetOSInformation = "__ZN22AppleIntelFBController16getOSInformationEv";
 
-				KernelPatcher::RouteRequest request(fbGetOSInformation, wrapGetOSInformation, orgGetOSInformation);
-				patcher.routeMultiple(index, &request, 1, address, size);
+				plan.add(fbGetOSInformation, wrapGetOSInformation, orgGetOSInformation);
 			} else {
 				SYSLOG("igfx", "failed to obtain gPlatformInformationList pointer with code %d", patcher.getError());
 				patcher.clearError();
@@ -316,203 +338,190 @@ uint64_t IGFX::wrapGetOSInformation(void *that) {
 	}
 #endif
 
-	if (callbackIGFX->applyFramebufferPatch)
-		callbackIGFX->applyFramebufferPatches();
-	else if (callbackIGFX->hdmiAutopatch)
-		callbackIGFX->applyHdmiAutopatch();
+	callbackIGFX->applyFramebufferDiff();
 
 	return FunctionCast(wrapGetOSInformation, callbackIGFX->orgGetOSInformation)(that);
 }
 
 bool IGFX::loadPatchesFromDevice(IORegistryEntry *igpu, uint32_t currentFramebufferId) {
+	using namespace FramebufferProperties;
+
 	bool hasFramebufferPatch = false;
 
+	// The live property table may change while it is iterated, so a snapshot is used instead.
+	auto dict = igpu->dictionaryWithProperties();
+	if (!dict) {
+		SYSLOG("igfx", "failed to get IGPU properties");
+		return false;
+	}
+
+	// All the properties are collected in a single pass, as the amount of patches is not limited.
+	Collection props;
+	if (!collect(dict, props)) {
+		dict->release();
+		return false;
+	}
+
 	uint32_t framebufferPatchEnable = 0;
-	if (WIOKit::getOSDataValue(igpu, "framebuffer-patch-enable", framebufferPatchEnable) && framebufferPatchEnable) {
+	if (getValue<uint32_t>(props.framebuffer[FramebufferFieldPatchEnable], framebufferPatchEnable) && framebufferPatchEnable) {
 		DBGLOG("igfx", "framebuffer-patch-enable %d", framebufferPatchEnable);
 
 		// Note, the casts to uint32_t here and below are required due to device properties always injecting 32-bit types.
-		framebufferPatchFlags.bits.FPFFramebufferId = WIOKit::getOSDataValue(igpu, "framebuffer-framebufferid", framebufferPatch.framebufferId);
-		framebufferPatchFlags.bits.FPFMobile = WIOKit::getOSDataValue<uint32_t>(igpu, "framebuffer-mobile", framebufferPatch.fMobile);
-		framebufferPatchFlags.bits.FPFPipeCount = WIOKit::getOSDataValue<uint32_t>(igpu, "framebuffer-pipecount", framebufferPatch.fPipeCount);
-		framebufferPatchFlags.bits.FPFPortCount = WIOKit::getOSDataValue<uint32_t>(igpu, "framebuffer-portcount", framebufferPatch.fPortCount);
-		framebufferPatchFlags.bits.FPFFBMemoryCount = WIOKit::getOSDataValue<uint32_t>(igpu, "framebuffer-memorycount", framebufferPatch.fFBMemoryCount);
-		framebufferPatchFlags.bits.FPFStolenMemorySize = WIOKit::getOSDataValue(igpu, "framebuffer-stolenmem", framebufferPatch.fStolenMemorySize);
-		framebufferPatchFlags.bits.FPFFramebufferMemorySize = WIOKit::getOSDataValue(igpu, "framebuffer-fbmem", framebufferPatch.fFramebufferMemorySize);
-		framebufferPatchFlags.bits.FPFUnifiedMemorySize = WIOKit::getOSDataValue(igpu, "framebuffer-unifiedmem", framebufferPatch.fUnifiedMemorySize);
+		framebufferPatchFlags.bits.FPFFramebufferId = getValue<uint32_t>(props.framebuffer[FramebufferFieldId], framebufferPatch.framebufferId);
+		framebufferPatchFlags.bits.FPFMobile = getValue<uint32_t>(props.framebuffer[FramebufferFieldMobile], framebufferPatch.fMobile);
+		framebufferPatchFlags.bits.FPFPipeCount = getValue<uint32_t>(props.framebuffer[FramebufferFieldPipeCount], framebufferPatch.fPipeCount);
+		framebufferPatchFlags.bits.FPFPortCount = getValue<uint32_t>(props.framebuffer[FramebufferFieldPortCount], framebufferPatch.fPortCount);
+		framebufferPatchFlags.bits.FPFFBMemoryCount = getValue<uint32_t>(props.framebuffer[FramebufferFieldMemoryCount], framebufferPatch.fFBMemoryCount);
+		framebufferPatchFlags.bits.FPFStolenMemorySize = getValue<uint32_t>(props.framebuffer[FramebufferFieldStolenMem], framebufferPatch.fStolenMemorySize);
+		framebufferPatchFlags.bits.FPFFramebufferMemorySize = getValue<uint32_t>(props.framebuffer[FramebufferFieldFbMem], framebufferPatch.fFramebufferMemorySize);
+		framebufferPatchFlags.bits.FPFUnifiedMemorySize = getValue<uint32_t>(props.framebuffer[FramebufferFieldUnifiedMem], framebufferPatch.fUnifiedMemorySize);
 
 		if (framebufferPatchFlags.value != 0)
 			hasFramebufferPatch = true;
 
 		for (size_t i = 0; i < MaxFramebufferConnectorCount; i++) {
-			char name[48];
-			snprintf(name, sizeof(name), "framebuffer-con%ld-enable", i);
+			auto fields = props.connectors[i];
 			uint32_t framebufferConnectorPatchEnable = 0;
-			if (!WIOKit::getOSDataValue(igpu, name, framebufferConnectorPatchEnable) || !framebufferConnectorPatchEnable)
+			if (!getValue<uint32_t>(fields[ConnectorFieldEnable], framebufferConnectorPatchEnable) || !framebufferConnectorPatchEnable)
 				continue;
 
 			DBGLOG("igfx", "framebuffer-con%ld-enable %d", i, framebufferConnectorPatchEnable);
 
-			snprintf(name, sizeof(name), "framebuffer-con%ld-index", i);
-			connectorPatchFlags[i].bits.CPFIndex = WIOKit::getOSDataValue<uint32_t>(igpu, name, framebufferPatch.connectors[i].index);
-			snprintf(name, sizeof(name), "framebuffer-con%ld-busid", i);
-			connectorPatchFlags[i].bits.CPFBusId = WIOKit::getOSDataValue<uint32_t>(igpu, name, framebufferPatch.connectors[i].busId);
-			snprintf(name, sizeof(name), "framebuffer-con%ld-pipe", i);
-			connectorPatchFlags[i].bits.CPFPipe = WIOKit::getOSDataValue<uint32_t>(igpu, name, framebufferPatch.connectors[i].pipe);
-			snprintf(name, sizeof(name), "framebuffer-con%ld-type", i);
-			connectorPatchFlags[i].bits.CPFType = WIOKit::getOSDataValue(igpu, name, framebufferPatch.connectors[i].type);
-			snprintf(name, sizeof(name), "framebuffer-con%ld-flags", i);
-			connectorPatchFlags[i].bits.CPFFlags = WIOKit::getOSDataValue(igpu, name, framebufferPatch.connectors[i].flags.value);
+			connectorPatchFlags[i].bits.CPFIndex = getValue<uint32_t>(fields[ConnectorFieldIndex], framebufferPatch.connectors[i].index);
+			connectorPatchFlags[i].bits.CPFBusId = getValue<uint32_t>(fields[ConnectorFieldBusId], framebufferPatch.connectors[i].busId);
+			connectorPatchFlags[i].bits.CPFPipe = getValue<uint32_t>(fields[ConnectorFieldPipe], framebufferPatch.connectors[i].pipe);
+			connectorPatchFlags[i].bits.CPFType = getValue<uint32_t>(fields[ConnectorFieldType], framebufferPatch.connectors[i].type);
+			connectorPatchFlags[i].bits.CPFFlags = getValue<uint32_t>(fields[ConnectorFieldFlags], framebufferPatch.connectors[i].flags.value);
 
 			if (connectorPatchFlags[i].value != 0)
 				hasFramebufferPatch = true;
 		}
 	}
 
-	size_t patchIndex = 0;
-	for (size_t i = 0; i < MaxFramebufferPatchCount; i++) {
-		char name[48];
-		snprintf(name, sizeof(name), "framebuffer-patch%ld-enable", i);
-		// Missing status means no patches at all.
-		uint32_t framebufferPatchEnable = 0;
-		if (!WIOKit::getOSDataValue(igpu, name, framebufferPatchEnable))
-			break;
-
-		// False status means a temporarily disabled patch, skip for next one.
-		if (!framebufferPatchEnable)
-			continue;
-
-		uint32_t framebufferId = 0;
-		size_t framebufferPatchCount = 0;
-
-		snprintf(name, sizeof(name), "framebuffer-patch%ld-framebufferid", i);
-		bool passedFramebufferId = WIOKit::getOSDataValue(igpu, name, framebufferId);
-		snprintf(name, sizeof(name), "framebuffer-patch%ld-find", i);
-		auto framebufferPatchFind = OSDynamicCast(OSData, igpu->getProperty(name));
-		snprintf(name, sizeof(name), "framebuffer-patch%ld-replace", i);
-		auto framebufferPatchReplace = OSDynamicCast(OSData, igpu->getProperty(name));
-		snprintf(name, sizeof(name), "framebuffer-patch%ld-count", i);
-		WIOKit::getOSDataValue(igpu, name, framebufferPatchCount);
-
-		if (!framebufferPatchFind || !framebufferPatchReplace)
-			continue;
-
-		framebufferPatches[patchIndex].framebufferId = (passedFramebufferId ? framebufferId : currentFramebufferId);
-		framebufferPatches[patchIndex].find = framebufferPatchFind;
-		framebufferPatches[patchIndex].replace = framebufferPatchReplace;
-		framebufferPatches[patchIndex].count = (framebufferPatchCount ? framebufferPatchCount : 1);
-
-		framebufferPatchFind->retain();
-		framebufferPatchReplace->retain();
-
+	// Patch bytes are copied, so neither the properties nor the snapshot are needed afterwards.
+	framebufferPatchCount = buildPatches(props, currentFramebufferId, framebufferPatchArena);
+	framebufferPatches = reinterpret_cast<FramebufferPatch *>(framebufferPatchArena);
+	if (framebufferPatchCount > 0)
 		hasFramebufferPatch = true;
 
-		patchIndex++;
-	}
-
+	release(props);
+	dict->release();
 	return hasFramebufferPatch;
 }
 
-uint8_t *IGFX::findFramebufferId(uint32_t framebufferId, uint8_t *startingAddress, size_t maxSize) {
-	uint8_t *startAddress = startingAddress;
-	uint8_t *endAddress = startingAddress + maxSize - sizeof(uint32_t);
-	while (startAddress < endAddress) {
-		if (*(reinterpret_cast<uint32_t *>(startAddress)) == framebufferId)
-			return startAddress;
-		startAddress++;
+void IGFX::releaseFramebufferPatches() {
+	if (framebufferPatchArena) {
+		Buffer::deleter(framebufferPatchArena);
+		framebufferPatchArena = nullptr;
 	}
 
-	return nullptr;
+	framebufferPatches = nullptr;
+	framebufferPatchCount = 0;
 }
 
-bool IGFX::applyPatch(const KernelPatcher::LookupPatch &patch, uint8_t *startingAddress, size_t maxSize) {
-	bool r = false;
-	size_t i = 0, patchCount = 0;
-	uint8_t *startAddress = startingAddress;
-	uint8_t *endAddress = startingAddress + maxSize - patch.size;
-
-	if (startAddress < framebufferStart)
-		startAddress = framebufferStart;
-	if (endAddress > framebufferStart + framebufferSize)
-		endAddress = framebufferStart + framebufferSize;
-
-	while (startAddress < endAddress) {
-		for (i = 0; i < patch.size; i++) {
-			if (startAddress[i] != patch.find[i])
-				break;
-		}
-		if (i == patch.size) {
-			for (i = 0; i < patch.size; i++)
-				startAddress[i] = patch.replace[i];
+void IGFX::indexPlatformInformationList() {
+	platformIndex.release();
 
-			r = true;
+	auto list = static_cast<uint8_t *>(gPlatformInformationList);
+	if (list < framebufferStart || list >= framebufferStart + framebufferSize) {
+		SYSLOG("igfx", "gPlatformInformationList is outside of the framebuffer kext");
+		return;
+	}
+
+	auto end = framebufferStart + framebufferSize;
+	if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
+		platformIndex.build(static_cast<FramebufferSNB *>(gPlatformInformationList), end);
+	else if (cpuGeneration == CPUInfo::CpuGeneration::IvyBridge)
+		platformIndex.build(static_cast<FramebufferIVB *>(gPlatformInformationList), end);
+	else if (cpuGeneration == CPUInfo::CpuGeneration::Haswell)
+		platformIndex.build(static_cast<FramebufferHSW *>(gPlatformInformationList), end);
+	else if (cpuGeneration == CPUInfo::CpuGeneration::Broadwell)
+		platformIndex.build(static_cast<FramebufferBDW *>(gPlatformInformationList), end);
+	else if (cpuGeneration == CPUInfo::CpuGeneration::Skylake || cpuGeneration == CPUInfo::CpuGeneration::KabyLake)
+		platformIndex.build(static_cast<FramebufferSKL *>(gPlatformInformationList), end);
+	else if (cpuGeneration == CPUInfo::CpuGeneration::CoffeeLake)
+		platformIndex.build(static_cast<FramebufferCFL *>(gPlatformInformationList), end);
 
-			if (++patchCount >= patch.count)
-				break;
+	if (platformIndex.count() > 0)
+		DBGLOG("igfx", "indexed %lu platformInformationList records of %lu bytes", platformIndex.count(), platformIndex.stride());
+	else
+		SYSLOG("igfx", "failed to index platformInformationList records");
+}
 
-			startAddress += patch.size;
-			continue;
-		}
+uint8_t *IGFX::findFramebufferId(uint32_t framebufferId, uint8_t *platformInformationList) {
+	size_t offset = 0;
+	if (platformIndex.find(framebufferId, offset))
+		return platformInformationList + offset;
 
-		startAddress++;
+	if (platformIndex.stride() == 0) {
+		// Sandy Bridge records carry no framebuffer ids, so scanning for one would hit unrelated bytes.
+		if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
+			return FramebufferIndex::findSandyBridge(framebufferId, offset) ? platformInformationList + offset : nullptr;
+
+		// Record layouts are unknown prior to 10.10.5, so the list is still scanned byte-wise there.
+		uint8_t *startAddress = platformInformationList;
+		uint8_t *endAddress = startAddress + PAGE_SIZE - sizeof(uint32_t);
+		while (startAddress < endAddress) {
+			if (*(reinterpret_cast<uint32_t *>(startAddress)) == framebufferId)
+				return startAddress;
+			startAddress++;
+		}
 	}
 
-	return r;
+	return nullptr;
 }
 
 template <>
 bool IGFX::applyPlatformInformationListPatch(uint32_t framebufferId, FramebufferSNB *platformInformationList) {
-	uint32_t framebufferPlatformId[] = { 0x00010000, 0x00020000, 0x00030010, 0x00030030, 0x00040000, 0xFFFFFFFF, 0xFFFFFFFF, 0x00030020, 0x00050000 };
-	size_t platformInformationCount = arrsize(framebufferPlatformId);
+	auto frame = reinterpret_cast<FramebufferSNB *>(findFramebufferId(framebufferId, reinterpret_cast<uint8_t *>(platformInformationList)));
+	if (!frame)
+		return false;
+
 	bool framebufferFound = false;
 
-	for (size_t i = 0; i < platformInformationCount; i++) {
-		if (framebufferPlatformId[i] == framebufferId) {
-			if (framebufferPatchFlags.bits.FPFMobile)
-				platformInformationList[i].fMobile = framebufferPatch.fMobile;
+	if (framebufferPatchFlags.bits.FPFMobile)
+		frame->fMobile = framebufferPatch.fMobile;
 
-			if (framebufferPatchFlags.bits.FPFPipeCount)
-				platformInformationList[i].fPipeCount = framebufferPatch.fPipeCount;
+	if (framebufferPatchFlags.bits.FPFPipeCount)
+		frame->fPipeCount = framebufferPatch.fPipeCount;
 
-			if (framebufferPatchFlags.bits.FPFPortCount)
-				platformInformationList[i].fPortCount = framebufferPatch.fPortCount;
+	if (framebufferPatchFlags.bits.FPFPortCount)
+		frame->fPortCount = framebufferPatch.fPortCount;
 
-			if (framebufferPatchFlags.bits.FPFFBMemoryCount)
-				platformInformationList[i].fFBMemoryCount = framebufferPatch.fFBMemoryCount;
+	if (framebufferPatchFlags.bits.FPFFBMemoryCount)
+		frame->fFBMemoryCount = framebufferPatch.fFBMemoryCount;
 
-			for (size_t j = 0; j < MaxFramebufferConnectorCount; j++) {
-				if (connectorPatchFlags[j].bits.CPFIndex)
-					platformInformationList[i].connectors[j].index = framebufferPatch.connectors[j].index;
+	for (size_t j = 0; j < MaxFramebufferConnectorCount; j++) {
+		if (connectorPatchFlags[j].bits.CPFIndex)
+			frame->connectors[j].index = framebufferPatch.connectors[j].index;
 
-				if (connectorPatchFlags[j].bits.CPFBusId)
-					platformInformationList[i].connectors[j].busId = framebufferPatch.connectors[j].busId;
+		if (connectorPatchFlags[j].bits.CPFBusId)
+			frame->connectors[j].busId = framebufferPatch.connectors[j].busId;
 
-				if (connectorPatchFlags[j].bits.CPFPipe)
-					platformInformationList[i].connectors[j].pipe = framebufferPatch.connectors[j].pipe;
+		if (connectorPatchFlags[j].bits.CPFPipe)
+			frame->connectors[j].pipe = framebufferPatch.connectors[j].pipe;
 
-				if (connectorPatchFlags[j].bits.CPFType)
-					platformInformationList[i].connectors[j].type = framebufferPatch.connectors[j].type;
+		if (connectorPatchFlags[j].bits.CPFType)
+			frame->connectors[j].type = framebufferPatch.connectors[j].type;
 
-				if (connectorPatchFlags[j].bits.CPFFlags)
-					platformInformationList[i].connectors[j].flags = framebufferPatch.connectors[j].flags;
+		if (connectorPatchFlags[j].bits.CPFFlags)
+			frame->connectors[j].flags = framebufferPatch.connectors[j].flags;
 
-				if (connectorPatchFlags[j].value) {
-					DBGLOG("igfx", "patching framebufferId 0x%08X connector [%d] busId: 0x%02X, pipe: %d, type: 0x%08X, flags: 0x%08X", framebufferId, platformInformationList[i].connectors[j].index, platformInformationList[i].connectors[j].busId, platformInformationList[i].connectors[j].pipe, platformInformationList[i].connectors[j].type, platformInformationList[i].connectors[j].flags.value);
+		if (connectorPatchFlags[j].value) {
+			DBGLOG("igfx", "patching framebufferId 0x%08X connector [%d] busId: 0x%02X, pipe: %d, type: 0x%08X, flags: 0x%08X", framebufferId, frame->connectors[j].index, frame->connectors[j].busId, frame->connectors[j].pipe, frame->connectors[j].type, frame->connectors[j].flags.value);
 
-					framebufferFound = true;
-				}
-			}
+			framebufferFound = true;
+		}
+	}
 
-			if (framebufferPatchFlags.value) {
-				DBGLOG("igfx", "patching framebufferId 0x%08X", framebufferId);
-				DBGLOG("igfx", "mobile: 0x%08X", platformInformationList[i].fMobile);
-				DBGLOG("igfx", "pipeCount: %d", platformInformationList[i].fPipeCount);
-				DBGLOG("igfx", "portCount: %d", platformInformationList[i].fPortCount);
-				DBGLOG("igfx", "fbMemoryCount: %d", platformInformationList[i].fFBMemoryCount);
+	if (framebufferPatchFlags.value) {
+		DBGLOG("igfx", "patching framebufferId 0x%08X", framebufferId);
+		DBGLOG("igfx", "mobile: 0x%08X", frame->fMobile);
+		DBGLOG("igfx", "pipeCount: %d", frame->fPipeCount);
+		DBGLOG("igfx", "portCount: %d", frame->fPortCount);
+		DBGLOG("igfx", "fbMemoryCount: %d", frame->fFBMemoryCount);
 
-				framebufferFound = true;
-			}
-		}
+		framebufferFound = true;
 	}
 
 	return framebufferFound;
@@ -520,7 +529,7 @@ bool IGFX::applyPlatformInformationListPatch(uint32_t framebufferId, Framebuffer
 
 template <typename T>
 bool IGFX::applyPlatformInformationListPatch(uint32_t framebufferId, T *platformInformationList) {
-	auto frame = reinterpret_cast<T *>(findFramebufferId(framebufferId, reinterpret_cast<uint8_t *>(platformInformationList), PAGE_SIZE));
+	auto frame = reinterpret_cast<T *>(findFramebufferId(framebufferId, reinterpret_cast<uint8_t *>(platformInformationList)));
 	if (!frame)
 		return false;
 
@@ -587,7 +596,7 @@ bool IGFX::applyPlatformInformationListPatch(uint32_t framebufferId, T *platform
 
 template <typename T>
 bool IGFX::applyDPtoHDMIPatch(uint32_t framebufferId, T *platformInformationList) {
-	auto frame = reinterpret_cast<T *>(findFramebufferId(framebufferId, reinterpret_cast<uint8_t *>(platformInformationList), PAGE_SIZE));
+	auto frame = reinterpret_cast<T *>(findFramebufferId(framebufferId, reinterpret_cast<uint8_t *>(platformInformationList)));
 	if (!frame)
 		return false;
 
@@ -603,24 +612,24 @@ bool IGFX::applyDPtoHDMIPatch(uint32_t framebufferId, T *platformInformationList
 	return true;
 }
 
-void IGFX::applyFramebufferPatches() {
+void IGFX::applyFramebufferPatches(uint8_t *platformInformationList, size_t size) {
 	uint32_t framebufferId = framebufferPatch.framebufferId;
 
 	// Not tested prior to 10.10.5, and definitely different on 10.9.5 at least.
 	if (getKernelVersion() >= KernelVersion::Yosemite) {
 		bool success = false;
 		if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferSNB *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferSNB *>(platformInformationList));
 		else if (cpuGeneration == CPUInfo::CpuGeneration::IvyBridge)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferIVB *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferIVB *>(platformInformationList));
 		else if (cpuGeneration == CPUInfo::CpuGeneration::Haswell)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferHSW *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferHSW *>(platformInformationList));
 		else if (cpuGeneration == CPUInfo::CpuGeneration::Broadwell)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferBDW *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferBDW *>(platformInformationList));
 		else if (cpuGeneration == CPUInfo::CpuGeneration::Skylake || cpuGeneration == CPUInfo::CpuGeneration::KabyLake)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferSKL *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferSKL *>(platformInformationList));
 		else if (cpuGeneration == CPUInfo::CpuGeneration::CoffeeLake)
-			success = applyPlatformInformationListPatch(framebufferId, static_cast<FramebufferCFL *>(gPlatformInformationList));
+			success = applyPlatformInformationListPatch(framebufferId, reinterpret_cast<FramebufferCFL *>(platformInformationList));
 
 		if (success)
 			DBGLOG("igfx", "Patching framebufferId 0x%08X successful", framebufferId);
@@ -628,15 +637,12 @@ void IGFX::applyFramebufferPatches() {
 			DBGLOG("igfx", "Patching framebufferId 0x%08X failed", framebufferId);
 	}
 
-	uint8_t *platformInformationAddress = findFramebufferId(framebufferId, static_cast<uint8_t *>(gPlatformInformationList), PAGE_SIZE);
+	uint8_t *platformInformationAddress = findFramebufferId(framebufferId, platformInformationList);
 	if (platformInformationAddress) {
-		for (size_t i = 0; i < MaxFramebufferPatchCount; i++) {
-			if (!framebufferPatches[i].find || !framebufferPatches[i].replace)
-				continue;
-
+		for (size_t i = 0; i < framebufferPatchCount; i++) {
 			if (framebufferPatches[i].framebufferId != framebufferId)    {
 				framebufferId = framebufferPatches[i].framebufferId;
-				platformInformationAddress = findFramebufferId(framebufferId, static_cast<uint8_t *>(gPlatformInformationList), PAGE_SIZE);
+				platformInformationAddress = findFramebufferId(framebufferId, platformInformationList);
 			}
 
 			if (!platformInformationAddress) {
@@ -644,50 +650,171 @@ void IGFX::applyFramebufferPatches() {
 				continue;
 			}
 
-			if (framebufferPatches[i].find->getLength() != framebufferPatches[i].replace->getLength()) {
-				DBGLOG("igfx", "Patch %lu framebufferId 0x%08X length mistmatch", i, framebufferId);
-				continue;
-			}
+			size_t maxSize = platformIndex.stride() ? platformIndex.stride() : PAGE_SIZE;
+			size_t available = platformInformationList + size - platformInformationAddress;
+			if (maxSize > available)
+				maxSize = available;
 
-			KernelPatcher::LookupPatch patch {};
-			patch.kext = currentFramebuffer;
-			patch.find = static_cast<const uint8_t *>(framebufferPatches[i].find->getBytesNoCopy());
-			patch.replace = static_cast<const uint8_t *>(framebufferPatches[i].replace->getBytesNoCopy());
-			patch.size = framebufferPatches[i].find->getLength();
-			patch.count = framebufferPatches[i].count;
-
-			if (applyPatch(patch, platformInformationAddress, PAGE_SIZE))
+			if (FramebufferProperties::applyPatch(framebufferPatches[i], platformInformationAddress, maxSize))
 				DBGLOG("igfx", "Patch %lu framebufferId 0x%08X successful", i, framebufferId);
 			else
 				DBGLOG("igfx", "Patch %lu framebufferId 0x%08X failed", i, framebufferId);
-
-			framebufferPatches[i].find->release();
-			framebufferPatches[i].find = nullptr;
-			framebufferPatches[i].replace->release();
-			framebufferPatches[i].replace = nullptr;
 		}
 	}
 }
 
-void IGFX::applyHdmiAutopatch() {
+void IGFX::applyHdmiAutopatch(uint8_t *platformInformationList) {
 	uint32_t framebufferId = framebufferPatch.framebufferId;
 
 	bool success = false;
 	if (cpuGeneration == CPUInfo::CpuGeneration::SandyBridge)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferSNB *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferSNB *>(platformInformationList));
 	else if (cpuGeneration == CPUInfo::CpuGeneration::IvyBridge)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferIVB *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferIVB *>(platformInformationList));
 	else if (cpuGeneration == CPUInfo::CpuGeneration::Haswell)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferHSW *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferHSW *>(platformInformationList));
 	else if (cpuGeneration == CPUInfo::CpuGeneration::Broadwell)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferBDW *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferBDW *>(platformInformationList));
 	else if (cpuGeneration == CPUInfo::CpuGeneration::Skylake || cpuGeneration == CPUInfo::CpuGeneration::KabyLake)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferSKL *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferSKL *>(platformInformationList));
 	else if (cpuGeneration == CPUInfo::CpuGeneration::CoffeeLake)
-		success = applyDPtoHDMIPatch(framebufferId, static_cast<FramebufferCFL *>(gPlatformInformationList));
+		success = applyDPtoHDMIPatch(framebufferId, reinterpret_cast<FramebufferCFL *>(platformInformationList));
 
 	if (success)
 		DBGLOG("igfx", "Patching framebufferId 0x%08X successful", framebufferId);
 	else
 		DBGLOG("igfx", "Patching framebufferId 0x%08X failed", framebufferId);
 }
+
+/**
+ *  Find the next run of changed bytes, runs do not cross record boundaries
+ *
+ *  @param original  original data
+ *  @param patched   patched data
+ *  @param size      data size
+ *  @param stride    record size or 0
+ *  @param offset    search start, updated to run start
+ *
+ *  @return run size or 0 when there are no more changes
+ */
+static size_t findChangedRun(const uint8_t *original, const uint8_t *patched, size_t size, size_t stride, size_t &offset) {
+	while (offset < size && original[offset] == patched[offset])
+		offset++;
+
+	size_t limit = size;
+	if (stride > 0 && offset < size && (offset / stride + 1) * stride < size)
+		limit = (offset / stride + 1) * stride;
+
+	size_t end = offset;
+	while (end < limit && original[end] != patched[end])
+		end++;
+
+	return end - offset;
+}
+
+void IGFX::compileFramebufferPatches() {
+	auto list = static_cast<uint8_t *>(gPlatformInformationList);
+
+	// Indexed patches never leave the indexed records. Otherwise the records are looked up within
+	// the first page and find / replace patches may span one more page.
+	size_t size = platformIndex.stride() > 0 ? platformIndex.size() : 2 * PAGE_SIZE;
+
+	if (list < framebufferStart || list >= framebufferStart + framebufferSize)
+		size = 0;
+	else if (size > static_cast<size_t>(framebufferStart + framebufferSize - list))
+		size = framebufferStart + framebufferSize - list;
+
+	auto patched = size > 0 ? Buffer::create<uint8_t>(size) : nullptr;
+	if (!patched) {
+		SYSLOG("igfx", "failed to allocate %lu bytes for framebuffer patches", size);
+		releaseFramebufferPatches();
+		return;
+	}
+
+	lilu_os_memcpy(patched, list, size);
+
+	if (applyFramebufferPatch)
+		applyFramebufferPatches(patched, size);
+	else if (hdmiAutopatch)
+		applyHdmiAutopatch(patched);
+
+	releaseFramebufferPatches();
+
+	size_t count = 0, diffSize = sizeof(FramebufferDiff::Header);
+	for (size_t offset = 0, len; (len = findChangedRun(list, patched, size, platformIndex.stride(), offset)) > 0; offset += len) {
+		count++;
+		diffSize += sizeof(FramebufferDiff::Entry) + 2 * len;
+	}
+
+	if (count > 0) {
+		framebufferDiff = Buffer::create<uint8_t>(diffSize);
+		if (framebufferDiff) {
+			FramebufferDiff::Header header {FramebufferDiff::Magic, FramebufferDiff::Version, static_cast<uint32_t>(platformIndex.stride()), static_cast<uint32_t>(count)};
+			lilu_os_memcpy(framebufferDiff, &header, sizeof(header));
+
+			auto out = framebufferDiff + sizeof(header);
+			for (size_t offset = 0, len; (len = findChangedRun(list, patched, size, platformIndex.stride(), offset)) > 0; offset += len) {
+				FramebufferDiff::Entry entry {static_cast<uint32_t>(offset), 0, static_cast<uint32_t>(len)};
+				entry.framebufferId = platformIndex.framebufferIdAt(offset);
+
+				lilu_os_memcpy(out, &entry, sizeof(entry));
+				out += sizeof(entry);
+				lilu_os_memcpy(out, list + offset, len);
+				out += len;
+				lilu_os_memcpy(out, patched + offset, len);
+				out += len;
+			}
+
+			framebufferDiffSize = diffSize;
+			DBGLOG("igfx", "compiled framebuffer patches into %lu changes", count);
+		} else {
+			SYSLOG("igfx", "failed to allocate %lu bytes for framebuffer diff", diffSize);
+		}
+	} else {
+		DBGLOG("igfx", "framebuffer patches change nothing");
+	}
+
+	Buffer::deleter(patched);
+}
+
+void IGFX::applyFramebufferDiff() {
+	// getOSInformation is called more than once, while the list only needs to be patched once.
+	if (framebufferDiffApplied)
+		return;
+
+	framebufferDiffApplied = true;
+	if (!framebufferDiff)
+		return;
+
+	auto list = static_cast<uint8_t *>(gPlatformInformationList);
+	auto header = reinterpret_cast<const FramebufferDiff::Header *>(framebufferDiff);
+	auto data = framebufferDiff + sizeof(FramebufferDiff::Header);
+	for (uint32_t i = 0; i < header->count; i++) {
+		auto entry = reinterpret_cast<const FramebufferDiff::Entry *>(data);
+		auto original = data + sizeof(FramebufferDiff::Entry);
+		// Nothing else is supposed to modify the list, but do not overwrite foreign changes.
+		if (!memcmp(list + entry->offset, original, entry->size))
+			lilu_os_memcpy(list + entry->offset, original + entry->size, entry->size);
+		else
+			SYSLOG("igfx", "framebuffer diff at 0x%X no longer matches", entry->offset);
+		data += FramebufferDiff::entrySize(*entry);
+	}
+
+	DBGLOG("igfx", "applied %u framebuffer changes", header->count);
+
+	// The plugin service is matched on IOResources and is only available after its start.
+	auto service = IORegistryEntry::fromPath("IOService:/IOResources/" xStringify(PRODUCT_NAME));
+	if (service) {
+		auto diff = OSData::withBytes(framebufferDiff, static_cast<unsigned>(framebufferDiffSize));
+		if (diff) {
+			service->setProperty("weg-framebuffer-diff", diff);
+			diff->release();
+		}
+		service->release();
+	} else {
+		DBGLOG("igfx", "plugin service is not available for framebuffer diff");
+	}
+
+	Buffer::deleter(framebufferDiff);
+	framebufferDiff = nullptr;
+}
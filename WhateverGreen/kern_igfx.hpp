@@ -9,6 +9,9 @@
 #define kern_igfx_hpp
 
 #include "kern_fb.hpp"
+#include "kern_fbindex.hpp"
+#include "kern_fbprops.hpp"
+#include "kern_route.hpp"
 
 #include <Headers/kern_patcher.hpp>
 #include <Headers/kern_devinfo.hpp>
@@ -32,13 +35,24 @@ public:
 	 *  Patch kext if needed and prepare other patches
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param index   kinfo handle
 	 *  @param address kinfo load address
 	 *  @param size    kinfo memory size
 	 *
 	 *  @return true if patched anything
 	 */
-	bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+	bool processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
+
+	/**
+	 *  Obtain kexts handled by processKext
+	 *
+	 *  @param list  kext list to append to
+	 *  @param max   maximum amount of kexts to append
+	 *
+	 *  @return amount of appended kexts
+	 */
+	size_t getKexts(KernelPatcher::KextInfo **list, size_t max);
 
 private:
 
@@ -87,14 +101,9 @@ private:
 	};
 
 	/**
-	 *  Framebuffer find / replace patch struct
+	 *  Framebuffer find / replace patch struct, patch bytes are stored in framebufferPatchArena
 	 */
-	struct FramebufferPatch {
-		uint32_t framebufferId;
-		OSData *find;
-		OSData *replace;
-		size_t count;
-	};
+	using FramebufferPatch = FramebufferProperties::Patch;
 
 	/**
 	 *  Framebuffer patching flags
@@ -112,20 +121,30 @@ private:
 	FramebufferCFL framebufferPatch {};
 
 	/**
-	 *  Maximum find / replace patches
+	 *  Framebuffer find / replace patches, points to the beginning of framebufferPatchArena
+	 */
+	FramebufferPatch *framebufferPatches {nullptr};
+
+	/**
+	 *  Number of framebuffer find / replace patches
 	 */
-	static constexpr size_t MaxFramebufferPatchCount = 10;
+	size_t framebufferPatchCount {0};
 
 	/**
-	 *  Framebuffer find / replace patches
+	 *  Single allocation holding framebuffer find / replace patches followed by their bytes
 	 */
-	FramebufferPatch framebufferPatches[MaxFramebufferPatchCount] {};
+	uint8_t *framebufferPatchArena {nullptr};
 
 	/**
 	 *  External global variables
 	 */
 	void *gPlatformInformationList {nullptr};
 
+	/**
+	 *  platformInformationList records indexed by framebuffer id
+	 */
+	FramebufferIndex platformIndex;
+
 	/**
 	 *  Private self instance for callbacks
 	 */
@@ -216,6 +235,21 @@ private:
 	 */
 	bool hdmiAutopatch {false};
 
+	/**
+	 *  Compiled framebuffer patches in FramebufferDiff format
+	 */
+	uint8_t *framebufferDiff {nullptr};
+
+	/**
+	 *  Compiled framebuffer patches size
+	 */
+	size_t framebufferDiffSize {0};
+
+	/**
+	 *  Compiled framebuffer patches were applied
+	 */
+	bool framebufferDiffApplied {false};
+
 	/**
 	 *  Framebuffer address space start
 	 */
@@ -262,32 +296,30 @@ private:
 	bool loadPatchesFromDevice(IORegistryEntry *igpu, uint32_t currentFramebuffer);
 
 	/**
-	 *  Find the framebuffer id in data
-	 *
-	 *  @param framebufferId    Framebuffer id to search
-	 *  @param startingAddress  Start address of data to search
-	 *  @param maxSize          Maximum size of data to search
-	 *
-	 *  @return pointer to address in data or nullptr
+	 *  Free framebuffer find / replace patches
 	 */
-	uint8_t *findFramebufferId(uint32_t framebufferId, uint8_t *startingAddress, size_t maxSize);
+	void releaseFramebufferPatches();
 
 	/**
-	 *  Patch data without changing kernel protection
+	 *  Index platformInformationList for the current generation
+	 */
+	void indexPlatformInformationList();
+
+	/**
+	 *  Find the framebuffer record by its id
 	 *
-	 *  @param patch            KernelPatcher instance
-	 *  @param startingAddress  Start address of data to search
-	 *  @param maxSize          Maximum size of data to search
+	 *  @param framebufferId            Framebuffer id to search
+	 *  @param platformInformationList  PlatformInformationList copy to return the record from
 	 *
-	 *  @return true if patched anything
+	 *  @return pointer to the record in platformInformationList or nullptr
 	 */
-	bool applyPatch(const KernelPatcher::LookupPatch &patch, uint8_t *startingAddress, size_t maxSize);
+	uint8_t *findFramebufferId(uint32_t framebufferId, uint8_t *platformInformationList);
 
 	/**
 	 *  Patch platformInformationList
 	 *
 	 *  @param framebufferId               Framebuffer id
-	 *  @param platformInformationList     PlatformInformationList pointer
+	 *  @param platformInformationList     PlatformInformationList copy to patch
 	 *
 	 *  @return true if patched anything
 	 */
@@ -296,14 +328,17 @@ private:
 
 	/**
 	 *  Apply framebuffer patches
+	 *
+	 *  @param platformInformationList     PlatformInformationList copy to patch
+	 *  @param size                        PlatformInformationList copy size
 	 */
-	void applyFramebufferPatches();
+	void applyFramebufferPatches(uint8_t *platformInformationList, size_t size);
 
 	/**
 	 *  Patch platformInformationList with DP to HDMI connector type replacements
 	 *
 	 *  @param framebufferId               Framebuffer id
-	 *  @param platformInformationList     PlatformInformationList pointer
+	 *  @param platformInformationList     PlatformInformationList copy to patch
 	 *
 	 *  @return true if patched anything
 	 */
@@ -312,8 +347,21 @@ private:
 
 	/**
 	 *  Apply DP to HDMI automatic connector type changes
+	 *
+	 *  @param platformInformationList     PlatformInformationList copy to patch
+	 */
+	void applyHdmiAutopatch(uint8_t *platformInformationList);
+
+	/**
+	 *  Compile all the framebuffer patches into a sorted list of byte differences
+	 *  by applying them to a copy of platformInformationList
+	 */
+	void compileFramebufferPatches();
+
+	/**
+	 *  Apply compiled framebuffer patches once and publish them as weg-framebuffer-diff
 	 */
-	void applyHdmiAutopatch();
+	void applyFramebufferDiff();
 };
 
 #endif /* kern_igfx_hpp */
@@ -6,6 +6,9 @@
 //
 
 #include "kern_ngfx.hpp"
+#include "kern_opts.hpp"
+#include "kern_session.hpp"
+#include "kern_trace.hpp"
 
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_iokit.hpp>
@@ -44,8 +47,10 @@ NGFX *NGFX::callbackNGFX;
 void NGFX::init() {
 	callbackNGFX = this;
 
-	PE_parse_boot_argn("ngfxcompat", &forceDriverCompatibility, sizeof(forceDriverCompatibility));
-	disableTeamUnrestrict = checkKernelArgument("-ngfxlibvalfix");
+	// force-compat device property is checked at probe time when the boot-arg is missing or negative.
+	if (Options::has(Options::Id::NgfxCompat))
+		forceDriverCompatibility = Options::integer(Options::Id::NgfxCompat);
+	disableTeamUnrestrict = Options::enabled(Options::Id::NgfxLibValFix);
 
 	lilu.onKextLoadForce(kextList, arrsize(kextList));
 }
@@ -66,11 +71,11 @@ void NGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 	if (hasNVIDIA) {
 		if (getKernelVersion() > KernelVersion::Mavericks && getKernelVersion() < KernelVersion::HighSierra) {
 			if (!disableTeamUnrestrict) {
-				orgCsfgGetTeamId = reinterpret_cast<decltype(orgCsfgGetTeamId)>(patcher.solveSymbol(KernelPatcher::KernelID, "_csfg_get_teamid"));
+				orgCsfgGetTeamId = reinterpret_cast<decltype(orgCsfgGetTeamId)>(WEG_TRACE_CALL(SolveSymbol, patcher.solveSymbol(KernelPatcher::KernelID, "_csfg_get_teamid")));
 				if (orgCsfgGetTeamId) {
 					DBGLOG("ngfx", "obtained csfg_get_teamid");
 					KernelPatcher::RouteRequest request("_csfg_get_platform_binary", wrapCsfgGetPlatformBinary, orgCsfgGetPlatformBinary);
-					patcher.routeMultiple(KernelPatcher::KernelID, &request, 1);
+					WEG_TRACE_CALL(RouteRequest, patcher.routeMultiple(KernelPatcher::KernelID, &request, 1));
 				} else {
 					SYSLOG("ngfx", "failed to resolve csfg_get_teamid");
 					patcher.clearError();
@@ -83,37 +88,40 @@ void NGFX::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 	}
 }
 
-bool NGFX::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+size_t NGFX::getKexts(KernelPatcher::KextInfo **list, size_t max) {
+	size_t num = 0;
+	for (size_t i = 0; i < arrsize(kextList) && num < max; i++)
+		list[num++] = &kextList[i];
+	return num;
+}
+
+bool NGFX::processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
 	if (kextList[IndexGeForce].loadIndex == index) {
-		KernelPatcher::RouteRequest request("__ZN13nvAccelerator18SetAccelPropertiesEv", wrapSetAccelProperties, orgSetAccelProperties);
-		patcher.routeMultiple(index, &request, 1, address, size);
-		restoreLegacyOptimisations(patcher, index, address, size);
+		plan.add("__ZN13nvAccelerator18SetAccelPropertiesEv", wrapSetAccelProperties, orgSetAccelProperties);
+		restoreLegacyOptimisations(patcher, plan, index, address, size);
 		return true;
 	}
 
 	if (kextList[IndexGeForceWeb].loadIndex == index) {
-		KernelPatcher::RouteRequest request("__ZN19nvAcceleratorParent18SetAccelPropertiesEv", wrapSetAccelProperties, orgSetAccelProperties);
-		patcher.routeMultiple(index, &request, 1, address, size);
+		plan.add("__ZN19nvAcceleratorParent18SetAccelPropertiesEv", wrapSetAccelProperties, orgSetAccelProperties);
 		return true;
 	}
 
 	if (kextList[IndexNVDAStartupWeb].loadIndex == index) {
-		KernelPatcher::RouteRequest request("__ZN14NVDAStartupWeb5probeEP9IOServicePi", wrapStartupWebProbe, orgStartupWebProbe);
-		patcher.routeMultiple(index, &request, 1, address, size);
+		plan.add("__ZN14NVDAStartupWeb5probeEP9IOServicePi", wrapStartupWebProbe, orgStartupWebProbe);
 		return true;
 	}
 
 	return false;
 }
 
-void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
 	if (getKernelVersion() < KernelVersion::HighSierra) {
 		DBGLOG("ngfx", "not bothering vaddr presubmit performance fix on pre-10.13");
 		return;
 	}
 
-	int fifoSubmit = 1;
-	PE_parse_boot_argn("ngfxsubmit", &fifoSubmit, sizeof(fifoSubmit));
+	int fifoSubmit = Options::integer(Options::Id::NgfxSubmit);
 	DBGLOG("ngfx", "read legacy fifo submit as %d", fifoSubmit);
 
 	if (!fifoSubmit) {
@@ -121,7 +129,7 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 		return;
 	}
 
-	orgFifoPrepare = patcher.solveSymbol<decltype(orgFifoPrepare)>(index, "__ZN15nvGpFifoChannel7PrepareEv", address, size);
+	orgFifoPrepare = plan.solveSymbol<decltype(orgFifoPrepare)>(patcher, "__ZN15nvGpFifoChannel7PrepareEv");
 	if (orgFifoPrepare) {
 		DBGLOG("ngfx", "obtained nvGpFifoChannel::Prepare");
 	} else {
@@ -129,7 +137,7 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 		patcher.clearError();
 	}
 
-	orgFifoComplete = patcher.solveSymbol<decltype(orgFifoComplete)>(index, "__ZN15nvGpFifoChannel8CompleteEv", address, size);
+	orgFifoComplete = plan.solveSymbol<decltype(orgFifoComplete)>(patcher, "__ZN15nvGpFifoChannel8CompleteEv");
 	if (orgFifoComplete) {
 		DBGLOG("ngfx", "obtained nvGpFifoChannel::Complete");
 	} else {
@@ -141,7 +149,7 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 		mach_vm_address_t presubmitBase = 0;
 
 		// Firstly we need to recover the PreSubmit function, which was badly broken.
-		auto presubmit = patcher.solveSymbol(index, "__ZN21nvVirtualAddressSpace9PreSubmitEv", address, size);
+		auto presubmit = plan.solveSymbol(patcher, "__ZN21nvVirtualAddressSpace9PreSubmitEv");
 		if (presubmit) {
 			DBGLOG("ngfx", "obtained nvVirtualAddressSpace::PreSubmit");
 			// Here we patch the prologue to signal that this call to PreSubmit is not coming from patched areas.
@@ -201,8 +209,9 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 				{seqR12, repR12, sizeof(seqR12)}
 			};
 
+			PatchSession session;
 			for (auto &sym : symbols) {
-				auto addr = patcher.solveSymbol(index, sym, address, size);
+				auto addr = plan.solveSymbol(patcher, sym);
 				if (addr) {
 					DBGLOG("ngfx", "obtained %s", sym);
 
@@ -213,13 +222,11 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 								auto disp = static_cast<int32_t>(presubmitBase - (addr+off+dispOff + 5));
 								DBGLOG("ngfx", "found pattern of %lu bytes at %lu offset, disp %X", patch.sz, off, disp);
 								*reinterpret_cast<int32_t *>(patch.code + dispOff) = disp;
-								patcher.routeBlock(addr+off, patch.code, patch.sz);
-								if (patcher.getError() == KernelPatcher::Error::NoError) {
-									DBGLOG("ngfx", "successfully patched %s", sym);
-								} else {
-									SYSLOG("ngfx", "failed to patch %s", sym);
-									patcher.clearError();
-								}
+								// The session copies the code, so the displacement may be reused for the next symbol.
+								if (session.add(reinterpret_cast<void *>(addr+off), patch.code, patch.sz))
+									DBGLOG("ngfx", "scheduled patch of %s", sym);
+								else
+									SYSLOG("ngfx", "failed to schedule patch of %s", sym);
 								off = maxLookup;
 								break;
 							}
@@ -231,6 +238,11 @@ void NGFX::restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach
 					patcher.clearError();
 				}
 			}
+
+			if (session.commit())
+				DBGLOG("ngfx", "successfully patched %lu PreSubmit calls", session.count());
+			else
+				SYSLOG("ngfx", "failed to patch PreSubmit calls");
 		}
 	}
 }
@@ -249,8 +261,7 @@ void NGFX::applyAcceleratorProperties(IOService *that) {
 	}
 
 	auto gfx = that->getParentEntry(gIOServicePlane);
-	int gl = gfx && gfx->getProperty("disable-metal");
-	PE_parse_boot_argn("ngfxgl", &gl, sizeof(gl));
+	int gl = Options::integer(Options::Id::NgfxOpenGL, gfx);
 
 	if (gl) {
 		DBGLOG("ngfx", "disabling metal support");
@@ -315,6 +326,7 @@ IOService *NGFX::wrapStartupWebProbe(IOService *that, IOService *provider, SInt3
 	DBGLOG("ngfx", "NVDAStartupWeb::probe is called");
 
 	int comp = callbackNGFX->forceDriverCompatibility;
+	// Negative boot-arg values, including the default, leave the decision to the GPU property.
 	if (comp < 0)
 		comp = provider && provider->getProperty("force-compat");
 
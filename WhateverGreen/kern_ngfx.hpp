@@ -13,6 +13,7 @@
 #include <Headers/kern_patcher.hpp>
 #include <Headers/kern_devinfo.hpp>
 #include <Library/LegacyIOService.h>
+#include "kern_route.hpp"
 
 // Assembly exports for restoreLegacyOptimisations
 extern "C" bool wrapVaddrPreSubmitTrampoline(void *that);
@@ -36,13 +37,24 @@ public:
 	 *  Patch kext if needed and prepare other patches
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param index   kinfo handle
 	 *  @param address kinfo load address
 	 *  @param size    kinfo memory size
 	 *
 	 *  @return true if patched anything
 	 */
-	bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+	bool processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
+
+	/**
+	 *  Obtain kexts handled by processKext
+	 *
+	 *  @param list  kext list to append to
+	 *  @param max   maximum amount of kexts to append
+	 *
+	 *  @return amount of appended kexts
+	 */
+	size_t getKexts(KernelPatcher::KextInfo **list, size_t max);
 
 private:
 	/**
@@ -106,11 +118,12 @@ private:
 	 *  For Web drivers it is very experimental, since they have a lot of additional different (broken) code.
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param index   kinfo handle
 	 *  @param address kinfo load address
 	 *  @param size    kinfo memory size
 	 */
-	void restoreLegacyOptimisations(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+	void restoreLegacyOptimisations(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
 
 	/**
 	 *  Add IOVARenderer properties to fix hardware video decoding
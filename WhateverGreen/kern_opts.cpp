@@ -0,0 +1,187 @@
+//
+//  kern_opts.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_opts.hpp"
+
+#include <Library/LegacyIOService.h>
+#include <pexpert/pexpert.h>
+
+const Options::Info Options::table[static_cast<size_t>(Id::Total)] {
+	{"gfxrst",         Type::Integer, 0,  nullptr},
+	{"agdpmod",        Type::String,  0,  nullptr},
+	{"igfxsnb",        Type::Integer, 1,  nullptr},
+	{"igfxgl",         Type::Integer, 0,  "disable-metal"},
+	{"-igfxnohdmi",    Type::Flag,    0,  nullptr},
+	{"-igfxdump",      Type::Flag,    0,  nullptr},
+	{"ngfxcompat",     Type::Integer, -1, "force-compat"},
+	{"ngfxsubmit",     Type::Integer, 1,  nullptr},
+	{"ngfxgl",         Type::Integer, 0,  "disable-metal"},
+	{"-ngfxlibvalfix", Type::Flag,    0,  nullptr},
+	{"-rad24",         Type::Flag,    0,  nullptr},
+	{"-raddvi",        Type::Flag,    0,  nullptr},
+	{"-radgl",         Type::Flag,    0,  nullptr},
+	{"-radcfg",        Type::Flag,    0,  nullptr},
+	{"-radvesa",       Type::Flag,    0,  nullptr},
+	{"radpg",          Type::Integer, 0,  nullptr},
+	{"shikigva",       Type::Integer, 0,  nullptr},
+	{"-shikigva",      Type::Flag,    0,  nullptr},
+	{"-shikifps",      Type::Flag,    0,  nullptr},
+	{"shiki-id",       Type::String,  0,  nullptr},
+	{"-cdfoff",        Type::Flag,    0,  nullptr},
+	{"-wegsymcache",   Type::Flag,    0,  nullptr},
+	{"-wegtrace",      Type::Flag,    0,  nullptr}
+};
+
+Options::Value Options::values[static_cast<size_t>(Id::Total)];
+
+void Options::load() {
+	auto bootArgs = PE_boot_args();
+	parse(bootArgs ? bootArgs : "");
+
+	for (size_t i = 0; i < static_cast<size_t>(Id::Total); i++) {
+		if (values[i].present)
+			DBGLOG("opts", "%s = %d %s", table[i].name, values[i].number, values[i].string);
+	}
+}
+
+void Options::parse(const char *bootArgs) {
+	for (auto &value : values) {
+		value.present = false;
+		value.number = 0;
+		value.string[0] = '\0';
+	}
+
+	const char *curr = bootArgs;
+	while (*curr != '\0') {
+		// Skip separators.
+		if (*curr == ' ' || *curr == '\t') {
+			curr++;
+			continue;
+		}
+
+		// Split the argument into name and value.
+		const char *name = curr;
+		while (*curr != '\0' && *curr != ' ' && *curr != '\t' && *curr != '=')
+			curr++;
+		size_t nameLen = curr - name;
+
+		const char *value = nullptr;
+		size_t valueLen = 0;
+		if (*curr == '=') {
+			value = ++curr;
+			while (*curr != '\0' && *curr != ' ' && *curr != '\t')
+				curr++;
+			valueLen = curr - value;
+		}
+
+		for (size_t i = 0; i < static_cast<size_t>(Id::Total); i++) {
+			auto &opt = table[i];
+			auto &val = values[i];
+			// The first occurrence wins, same as PE_parse_boot_argn.
+			if (val.present || strncmp(opt.name, name, nameLen) != 0 || opt.name[nameLen] != '\0')
+				continue;
+
+			switch (opt.type) {
+				case Type::Flag:
+					val.present = true;
+					val.number = 1;
+					break;
+				case Type::Integer:
+					// Arguments without a value are treated as enabled.
+					if (!value) {
+						val.present = true;
+						val.number = 1;
+					} else if (parseInteger(value, valueLen, val.number)) {
+						val.present = true;
+					} else {
+						SYSLOG("opts", "invalid %s value", opt.name);
+					}
+					break;
+				case Type::String: {
+					// Same as integers, arguments without a value read as 1.
+					if (!value) {
+						value = "1";
+						valueLen = 1;
+					}
+					size_t len = valueLen < MaxStringSize - 1 ? valueLen : MaxStringSize - 1;
+					if (len > 0)
+						lilu_os_memcpy(val.string, value, len);
+					val.string[len] = '\0';
+					val.present = true;
+					break;
+				}
+			}
+
+			break;
+		}
+	}
+}
+
+bool Options::has(Id id) {
+	return values[static_cast<size_t>(id)].present;
+}
+
+int32_t Options::integer(Id id, IORegistryEntry *device) {
+	auto &val = values[static_cast<size_t>(id)];
+	if (val.present)
+		return val.number;
+
+	auto &opt = table[static_cast<size_t>(id)];
+	if (device && opt.property && device->getProperty(opt.property))
+		return 1;
+
+	return opt.defaultValue;
+}
+
+const char *Options::string(Id id) {
+	auto &val = values[static_cast<size_t>(id)];
+	return val.present ? val.string : nullptr;
+}
+
+bool Options::parseInteger(const char *str, size_t len, int32_t &out) {
+	bool negative = false;
+	if (len > 0 && *str == '-') {
+		negative = true;
+		str++;
+		len--;
+	}
+
+	uint32_t base = 10;
+	if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+		base = 16;
+		str += 2;
+		len -= 2;
+	}
+
+	if (len == 0)
+		return false;
+
+	uint32_t result = 0;
+	for (size_t i = 0; i < len; i++) {
+		uint32_t digit;
+		char c = str[i];
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (base == 16 && c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (base == 16 && c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+		// Values not fitting into 32 bits are rejected instead of silently wrapping.
+		if (result > (UINT32_MAX - digit) / base)
+			return false;
+		result = result * base + digit;
+	}
+
+	// Negative values must fit into int32_t, positive ones are kept as 32-bit masks (e.g. radpg=0xFFFFFFFF).
+	if (negative && result > static_cast<uint32_t>(INT32_MAX) + 1)
+		return false;
+
+	out = negative ? static_cast<int32_t>(0U - result) : static_cast<int32_t>(result);
+	return true;
+}
@@ -0,0 +1,175 @@
+//
+//  kern_opts.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_opts_hpp
+#define kern_opts_hpp
+
+#include <Headers/kern_util.hpp>
+
+class IORegistryEntry;
+
+class Options {
+public:
+	/**
+	 *  Option identifiers, must match the option table order
+	 */
+	enum class Id {
+		GfxReset,
+		GraphicsPolicyMod,
+		IgfxSandyBridge,
+		IgfxOpenGL,
+		IgfxNoHdmi,
+		IgfxDump,
+		NgfxCompat,
+		NgfxSubmit,
+		NgfxOpenGL,
+		NgfxLibValFix,
+		Rad24Bit,
+		RadDviSingleLink,
+		RadOpenGL,
+		RadConfigName,
+		RadVesa,
+		RadPowerGating,
+		ShikiGva,
+		ShikiGvaLegacy,
+		ShikiFps,
+		ShikiBoardId,
+		CdfOff,
+		SymbolCache,
+		BootTrace,
+		Total
+	};
+
+	/**
+	 *  Option value types
+	 *
+	 *  Flag     -name boot-arg presence
+	 *  Integer  name=value boot-arg with decimal or 0x-prefixed hexadecimal value, 1 without a value
+	 *  String   name=value boot-arg, "1" without a value
+	 */
+	enum class Type {
+		Flag,
+		Integer,
+		String
+	};
+
+	/**
+	 *  Option description
+	 */
+	struct Info {
+		/**
+		 *  Boot-arg name
+		 */
+		const char *name;
+
+		/**
+		 *  Value type
+		 */
+		Type type;
+
+		/**
+		 *  Default value for flags and integers
+		 */
+		int32_t defaultValue;
+
+		/**
+		 *  Device property enabling the option when no boot-arg is passed or nullptr
+		 */
+		const char *property;
+	};
+
+	/**
+	 *  Maximum string option length including the null terminator
+	 */
+	static constexpr size_t MaxStringSize {128};
+
+	/**
+	 *  Parse kernel boot-args into the option snapshot, must be called once before any access
+	 */
+	static void load();
+
+	/**
+	 *  Parse a boot-args string into the option snapshot, the first occurrence of an option wins
+	 *
+	 *  @param bootArgs  boot-args string
+	 */
+	static void parse(const char *bootArgs);
+
+	/**
+	 *  Check whether the option was passed via boot-args
+	 *
+	 *  @param id  option identifier
+	 *
+	 *  @return true if present
+	 */
+	static bool has(Id id);
+
+	/**
+	 *  Obtain flag or integer option value
+	 *
+	 *  @param id      option identifier
+	 *  @param device  device to check the matching property at when no boot-arg is passed
+	 *
+	 *  @return boot-arg value, 1 if device property is present, or the default value
+	 */
+	static int32_t integer(Id id, IORegistryEntry *device=nullptr);
+
+	/**
+	 *  Check whether flag or integer option is enabled
+	 *
+	 *  @param id      option identifier
+	 *  @param device  device to check the matching property at when no boot-arg is passed
+	 *
+	 *  @return true if integer returns a non-zero value
+	 */
+	static bool enabled(Id id, IORegistryEntry *device=nullptr) {
+		return integer(id, device) != 0;
+	}
+
+	/**
+	 *  Obtain string option value
+	 *
+	 *  @param id  option identifier
+	 *
+	 *  @return boot-arg value or nullptr
+	 */
+	static const char *string(Id id);
+
+private:
+	/**
+	 *  Parsed option value
+	 */
+	struct Value {
+		bool present;
+		int32_t number;
+		char string[MaxStringSize];
+	};
+
+	/**
+	 *  Option table
+	 */
+	static const Info table[static_cast<size_t>(Id::Total)];
+
+	/**
+	 *  Option snapshot
+	 */
+	static Value values[static_cast<size_t>(Id::Total)];
+
+	/**
+	 *  Parse integer value in boot-args notation
+	 *  Positive values up to 0xFFFFFFFF are stored as 32-bit patterns, out of range values are rejected
+	 *
+	 *  @param str  value start
+	 *  @param len  value length
+	 *  @param out  parsed value
+	 *
+	 *  @return true on success
+	 */
+	static bool parseInteger(const char *str, size_t len, int32_t &out);
+};
+
+#endif /* kern_opts_hpp */
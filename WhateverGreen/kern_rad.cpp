@@ -14,6 +14,16 @@
 #include <IOKit/IOPlatformExpert.h>
 
 #include "kern_rad.hpp"
+#include "kern_opts.hpp"
+#include "kern_session.hpp"
+#include "kern_trace.hpp"
+
+// This is a hack to let us access protected properties.
+struct CollectionViewer : public OSCollection {
+	static unsigned int getUpdateStamp(OSCollection *collection) {
+		return static_cast<CollectionViewer *>(collection)->updateStamp;
+	}
+};
 
 static const char *pathFramebuffer[]		{ "/System/Library/Extensions/AMDFramebuffer.kext/Contents/MacOS/AMDFramebuffer" };
 static const char *pathLegacyFramebuffer[]	{ "/System/Library/Extensions/AMDLegacyFramebuffer.kext/Contents/MacOS/AMDLegacyFramebuffer" };
@@ -77,7 +87,7 @@ void RAD::init() {
 	callbackRAD = this;
 
 	// Certain displays do not support 32-bit colour output, so we have to force 24-bit.
-	if (getKernelVersion() >= KernelVersion::Sierra && checkKernelArgument("-rad24")) {
+	if (getKernelVersion() >= KernelVersion::Sierra && Options::enabled(Options::Id::Rad24Bit)) {
 		lilu.onKextLoadForce(&kextRadeonFramebuffer);
 		// Mojave dropped legacy GPU support (5xxx and 6xxx).
 		if (getKernelVersion() < KernelVersion::Mojave)
@@ -85,16 +95,16 @@ void RAD::init() {
 	}
 
 	// Certain GPUs cannot output to DVI at full resolution.
-	dviSingleLink = checkKernelArgument("-raddvi");
+	dviSingleLink = Options::enabled(Options::Id::RadDviSingleLink);
 
 	// Disabling Metal may be useful for testing
-	forceOpenGL = checkKernelArgument("-radgl");
+	forceOpenGL = Options::enabled(Options::Id::RadOpenGL);
 
 	// Fix accelerator name if requested
-	fixConfigName = checkKernelArgument("-radcfg");
+	fixConfigName = Options::enabled(Options::Id::RadConfigName);
 
 	// Broken drivers can still let us boot in vesa mode
-	forceVesaMode = checkKernelArgument("-radvesa");
+	forceVesaMode = Options::enabled(Options::Id::RadVesa);
 
 	// To support overriding connectors and -radvesa mode we need to patch AMDSupport.
 	lilu.onKextLoadForce(&kextRadeonSupport);
@@ -105,8 +115,7 @@ void RAD::init() {
 	initHardwareKextMods();
 
 	//FIXME: autodetect?
-	uint32_t powerGatingMask = 0;
-	PE_parse_boot_argn("radpg", &powerGatingMask, sizeof(powerGatingMask));
+	uint32_t powerGatingMask = static_cast<uint32_t>(Options::integer(Options::Id::RadPowerGating));
 	for (size_t i = 0; i < arrsize(powerGatingFlags); i++) {
 		if (!(powerGatingMask & (1 << i))) {
 			DBGLOG("rad", "not enabling %s", powerGatingFlags[i]);
@@ -118,24 +127,46 @@ void RAD::init() {
 }
 
 void RAD::deinit() {
+	propertyHooks.deinit();
+
+	for (auto &index : propertyIndex)
+		releasePropertyIndex(index);
 
+	for (auto &cached : mergedCache) {
+		if (cached.merged) {
+			cached.merged->release();
+			cached = {};
+		}
+	}
+
+	if (mergedCacheLock) {
+		IOLockFree(mergedCacheLock);
+		mergedCacheLock = nullptr;
+	}
 }
 
 void RAD::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
-	bool hasAMD = false;
+	const void *amdProviders[PropertyHookTracker::MaxControllers + 1];
+	size_t amdNum = 0;
 	for (size_t i = 0; i < info->videoExternal.size(); i++) {
-		if (info->videoExternal[i].vendor == WIOKit::VendorID::ATIAMD) {
-			hasAMD = true;
-			break;
-		}
+		if (info->videoExternal[i].vendor == WIOKit::VendorID::ATIAMD && amdNum < arrsize(amdProviders))
+			amdProviders[amdNum++] = info->videoExternal[i].video;
 	}
 
-	if (hasAMD) {
+	if (amdNum > 0) {
+		// Property merges are only needed until every controller has started and got its cail_properties.
+		// One extra provider lets the tracker tell that there are too many controllers to track.
+		propertyHooks.init(amdProviders, amdNum);
+
+		mergedCacheLock = IOLockAlloc();
+		if (!mergedCacheLock)
+			SYSLOG("rad", "failed to allocate merged property cache lock");
+
 		KernelPatcher::RouteRequest requests[] {
 			KernelPatcher::RouteRequest("__ZN15IORegistryEntry11setPropertyEPKcPvj", wrapSetProperty, orgSetProperty),
 			KernelPatcher::RouteRequest("__ZNK15IORegistryEntry11getPropertyEPKc", wrapGetProperty, orgGetProperty),
 		};
-		patcher.routeMultiple(KernelPatcher::KernelID, requests);
+		WEG_TRACE_CALL(RouteRequest, patcher.routeMultiple(KernelPatcher::KernelID, requests));
 	} else {
 		kextRadeonFramebuffer.switchOff();
 		kextRadeonLegacyFramebuffer.switchOff();
@@ -147,30 +178,40 @@ void RAD::processKernel(KernelPatcher &patcher, DeviceInfo *info) {
 	}
 }
 
-bool RAD::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+size_t RAD::getKexts(KernelPatcher::KextInfo **list, size_t max) {
+	size_t num = 0;
+	KernelPatcher::KextInfo *kexts[] {&kextRadeonFramebuffer, &kextRadeonLegacyFramebuffer, &kextRadeonSupport, &kextRadeonLegacySupport};
+	for (size_t i = 0; i < arrsize(kexts) && num < max; i++)
+		list[num++] = kexts[i];
+	for (size_t i = 0; i < maxHardwareKexts && num < max; i++)
+		list[num++] = &kextRadeonHardware[i];
+	return num;
+}
+
+bool RAD::processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
 	if (kextRadeonFramebuffer.loadIndex == index) {
-		process24BitOutput(patcher, kextRadeonFramebuffer, address, size);
+		process24BitOutput(patcher, plan, kextRadeonFramebuffer, address, size);
 		return true;
 	}
 
 	if (kextRadeonLegacyFramebuffer.loadIndex == index) {
-		process24BitOutput(patcher, kextRadeonLegacyFramebuffer, address, size);
+		process24BitOutput(patcher, plan, kextRadeonLegacyFramebuffer, address, size);
 		return true;
 	}
 
 	if (kextRadeonSupport.loadIndex == index) {
-		processConnectorOverrides(patcher, address, size, true);
+		processConnectorOverrides(patcher, plan, address, size, true);
 		return true;
 	}
 
 	if (kextRadeonLegacySupport.loadIndex == index) {
-		processConnectorOverrides(patcher, address, size, false);
+		processConnectorOverrides(patcher, plan, address, size, false);
 		return true;
 	}
 
 	for (size_t i = 0; i < maxHardwareKexts; i++) {
 		if (kextRadeonHardware[i].loadIndex == index) {
-			processHardwareKext(patcher, i, address, size);
+			processHardwareKext(patcher, plan, i, address, size);
 			return true;
 		}
 	}
@@ -225,22 +266,23 @@ void RAD::initHardwareKextMods() {
 	lilu.onKextLoadForce(kextRadeonHardware, maxHardwareKexts);
 }
 
-void RAD::process24BitOutput(KernelPatcher &patcher, KernelPatcher::KextInfo &info, mach_vm_address_t address, size_t size) {
-	auto bitsPerComponent = patcher.solveSymbol<int *>(info.loadIndex, "__ZL18BITS_PER_COMPONENT", address, size);
+void RAD::process24BitOutput(KernelPatcher &patcher, RoutePlan &plan, KernelPatcher::KextInfo &info, mach_vm_address_t address, size_t size) {
+	auto bitsPerComponent = plan.solveSymbol<int *>(patcher, "__ZL18BITS_PER_COMPONENT");
 	if (bitsPerComponent) {
-		while (bitsPerComponent && *bitsPerComponent) {
+		PatchSession session;
+		bool scheduled = true;
+		while (scheduled && bitsPerComponent && *bitsPerComponent) {
 			if (*bitsPerComponent == 10) {
-				auto ret = MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock);
-				if (ret == KERN_SUCCESS) {
-					DBGLOG("rad", "fixing BITS_PER_COMPONENT");
-					*bitsPerComponent = 8;
-					MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
-				} else {
-					SYSLOG("rad", "failed to disable write protection for BITS_PER_COMPONENT");
-				}
+				DBGLOG("rad", "fixing BITS_PER_COMPONENT");
+				scheduled = session.add(bitsPerComponent, 8);
 			}
 			bitsPerComponent++;
 		}
+
+		if (!scheduled)
+			SYSLOG("rad", "failed to schedule all BITS_PER_COMPONENT fixes");
+		else if (!session.commit())
+			SYSLOG("rad", "failed to disable write protection for BITS_PER_COMPONENT");
 	} else {
 		SYSLOG("rad", "failed to find BITS_PER_COMPONENT");
 	}
@@ -254,14 +296,12 @@ void RAD::process24BitOutput(KernelPatcher &patcher, KernelPatcher::KextInfo &in
 		32, 2
 	};
 
-	patcher.applyLookupPatch(&pixelPatch);
-	if (patcher.getError() != KernelPatcher::Error::NoError) {
-		SYSLOG("rad", "failed to patch RGB mask for 24-bit output");
-		patcher.clearError();
-	}
+	plan.add(pixelPatch, "RGB mask for 24-bit output");
 }
 
-void RAD::processConnectorOverrides(KernelPatcher &patcher, mach_vm_address_t address, size_t size, bool modern) {
+void RAD::processConnectorOverrides(KernelPatcher &patcher, RoutePlan &plan, mach_vm_address_t address, size_t size, bool modern) {
+	modernConnectors = RADConnectors::modern();
+
 	if (modern) {
 		if (getKernelVersion() >= KernelVersion::HighSierra) {
 			KernelPatcher::RouteRequest requests[] {
@@ -273,16 +313,15 @@ void RAD::processConnectorOverrides(KernelPatcher &patcher, mach_vm_address_t ad
 											wrapTranslateAtomConnectorInfoV2, orgTranslateAtomConnectorInfoV2),
 				KernelPatcher::RouteRequest("__ZN13ATIController5startEP9IOService", wrapATIControllerStart, orgATIControllerStart),
 			};
-			patcher.routeMultiple(kextRadeonSupport.loadIndex, requests, address, size);
+			plan.add(requests);
 		} else {
 			KernelPatcher::RouteRequest requests[] {
 				KernelPatcher::RouteRequest("__ZN23AtiAtomBiosDceInterface17getConnectorsInfoEP13ConnectorInfoRh", wrapGetConnectorsInfoV1, orgGetConnectorsInfoV1),
 				KernelPatcher::RouteRequest("__ZN13ATIController5startEP9IOService", wrapATIControllerStart, orgATIControllerStart),
 			};
-			patcher.routeMultiple(kextRadeonSupport.loadIndex, requests, address, size);
+			plan.add(requests);
 
-			orgGetAtomObjectTableForType = reinterpret_cast<t_getAtomObjectTableForType>(patcher.solveSymbol(kextRadeonSupport.loadIndex,
-																											 "__ZN20AtiAtomBiosUtilities25getAtomObjectTableForTypeEhRh", address, size));
+			orgGetAtomObjectTableForType = plan.solveSymbol<t_getAtomObjectTableForType>(patcher, "__ZN20AtiAtomBiosUtilities25getAtomObjectTableForTypeEhRh");
 			if (!orgGetAtomObjectTableForType) {
 				SYSLOG("rad", "failed to find AtiAtomBiosUtilities::getAtomObjectTableForType");
 				patcher.clearError();
@@ -293,10 +332,9 @@ void RAD::processConnectorOverrides(KernelPatcher &patcher, mach_vm_address_t ad
 			KernelPatcher::RouteRequest("__ZN23AtiAtomBiosDceInterface17getConnectorsInfoEP13ConnectorInfoRh", wrapLegacyGetConnectorsInfo, orgLegacyGetConnectorsInfo),
 			KernelPatcher::RouteRequest("__ZN19AMDLegacyController5startEP9IOService", wrapLegacyATIControllerStart, orgLegacyATIControllerStart),
 		};
-		patcher.routeMultiple(kextRadeonLegacySupport.loadIndex, requests, address, size);
+		plan.add(requests);
 
-		orgLegacyGetAtomObjectTableForType = patcher.solveSymbol<t_getAtomObjectTableForType>(kextRadeonLegacySupport.loadIndex,
-																							  "__ZN20AtiAtomBiosUtilities25getAtomObjectTableForTypeEhRh", address, size);
+		orgLegacyGetAtomObjectTableForType = plan.solveSymbol<t_getAtomObjectTableForType>(patcher, "__ZN20AtiAtomBiosUtilities25getAtomObjectTableForTypeEhRh");
 		if (!orgLegacyGetAtomObjectTableForType) {
 			SYSLOG("rad", "failed to find AtiAtomBiosUtilities::getAtomObjectTableForType");
 			patcher.clearError();
@@ -304,13 +342,14 @@ void RAD::processConnectorOverrides(KernelPatcher &patcher, mach_vm_address_t ad
 	}
 }
 
-void RAD::processHardwareKext(KernelPatcher &patcher, size_t hwIndex, mach_vm_address_t address, size_t size) {
+void RAD::processHardwareKext(KernelPatcher &patcher, RoutePlan &plan, size_t hwIndex, mach_vm_address_t address, size_t size) {
 	auto getFrame = getFrameBufferProcNames[hwIndex];
 	auto &hardware = kextRadeonHardware[hwIndex];
 
 	// Fix boot and wake to black screen
+	PatchSession session;
 	for (size_t j = 0; j < MaxGetFrameBufferProcs && getFrame[j] != nullptr; j++) {
-		auto getFB = patcher.solveSymbol(hardware.loadIndex, getFrame[j], address, size);
+		auto getFB = plan.solveSymbol(patcher, getFrame[j]);
 		if (getFB) {
 			// Initially it was discovered that the only problematic register is PRIMARY_SURFACE_ADDRESS_HIGH (0x1A07).
 			// This register must be nulled to solve most of the issues.
@@ -321,23 +360,24 @@ void RAD::processHardwareKext(KernelPatcher &patcher, size_t hwIndex, mach_vm_ad
 			// xor rax, rax
 			// ret
 			uint8_t ret[] {0x48, 0x31, 0xC0, 0xC3};
-			patcher.routeBlock(getFB, ret, sizeof(ret));
-			if (patcher.getError() == KernelPatcher::Error::NoError) {
-				DBGLOG("rad", "patched %s", getFrame[j]);
-			} else {
-				SYSLOG("rad", "failed to patch %s code %d", getFrame[j], patcher.getError());
-				patcher.clearError();
-			}
+			if (session.add(reinterpret_cast<void *>(getFB), ret, sizeof(ret)))
+				DBGLOG("rad", "scheduled %s patch", getFrame[j]);
+			else
+				SYSLOG("rad", "failed to schedule %s patch", getFrame[j]);
 		} else {
 			SYSLOG("rad", "failed to find %s code %d", getFrame[j], patcher.getError());
 			patcher.clearError();
 		}
 	}
 
+	if (session.commit())
+		DBGLOG("rad", "patched %lu framebuffer base procs", session.count());
+	else
+		SYSLOG("rad", "failed to patch framebuffer base procs");
+
 	// Fix reported Accelerator name to support WhateverName.app
 	if (fixConfigName) {
-		KernelPatcher::RouteRequest request(populateAccelConfigProcNames[hwIndex], wrapPopulateAccelConfig[hwIndex], orgPopulateAccelConfig[hwIndex]);
-		patcher.routeMultiple(hardware.loadIndex, &request, 1, address, size);
+		plan.add(populateAccelConfigProcNames[hwIndex], wrapPopulateAccelConfig[hwIndex], orgPopulateAccelConfig[hwIndex]);
 	}
 
 	// Enforce OpenGL support if requested
@@ -353,61 +393,76 @@ void RAD::processHardwareKext(KernelPatcher &patcher, size_t hwIndex, mach_vm_ad
 			{&hardware, find2, repl2, sizeof(find1), 2}
 		};
 
-		for (auto &p : antimetal) {
-			patcher.applyLookupPatch(&p);
-			patcher.clearError();
-		}
+		// Not every accelerator has both strings, missing ones were never reported.
+		for (auto &p : antimetal)
+			plan.add(p, "Metal support", true);
 	}
 }
 
-void RAD::mergeProperties(OSDictionary *props, const char *prefix, IOService *provider) {
+void RAD::buildPropertyIndex(PropertyIndex &index, IOService *provider) {
+	// Providers are retained, so that their addresses cannot be reused while indexed.
+	provider->retain();
+	index.provider = provider;
+	index.stamp = getPropertyStamp(provider);
+
 	// Should be ok, but in case there are issues switch to dictionaryWithProperties();
 	auto dict = provider->getPropertyTable();
-	if (dict) {
-		auto iterator = OSCollectionIterator::withCollection(dict);
-		if (iterator) {
-			OSSymbol *propname;
-			size_t prefixlen = strlen(prefix);
-			while ((propname = OSDynamicCast(OSSymbol, iterator->getNextObject())) != nullptr) {
-				auto name = propname->getCStringNoCopy();
-				if (name && propname->getLength() > prefixlen && !strncmp(name, prefix, prefixlen)) {
-					auto prop = dict->getObject(propname);
-					if (prop) {
-						// It is hard to make a boolean from ACPI, so we make a hack here:
-						// 1-byte OSData with 0x01 / 0x00 values becomes boolean.
-						auto data = OSDynamicCast(OSData, prop);
-						if (data && data->getLength() == 1) {
-							auto val = static_cast<const uint8_t *>(data->getBytesNoCopy());
-							if (val && val[0] == 1) {
-								props->setObject(name+prefixlen, kOSBooleanTrue);
-								DBGLOG("rad", "prop %s was merged as kOSBooleanTrue", name);
-								continue;
-							} else if (val && val[0] == 0) {
-								props->setObject(name+prefixlen, kOSBooleanFalse);
-								DBGLOG("rad", "prop %s was merged as kOSBooleanFalse", name);
-								continue;
-							}
-						}
-						
-						props->setObject(name+prefixlen, prop);
-						DBGLOG("rad", "prop %s was merged", name);
-					} else {
-						DBGLOG("rad", "prop %s was not merged due to no value", name);
-					}
-				} else {
-					//DBGLOG("rad", "prop %s does not match %s prefix", safeString(name), prefix);
-				}
-			}
+	if (dict)
+		index.props.build(dict);
+	else
+		SYSLOG("rad", "prop index failed to get properties");
+}
 
-			iterator->release();
-		} else {
-			SYSLOG("rad", "prop merge failed to iterate over properties");
+void RAD::releasePropertyIndex(PropertyIndex &index) {
+	index.props.release();
+
+	if (index.provider) {
+		index.provider->release();
+		index.provider = nullptr;
+	}
+}
+
+RAD::PropertyIndex *RAD::getPropertyIndex(IOService *provider) {
+	PropertyIndex *slot = nullptr;
+	for (auto &index : propertyIndex) {
+		if (index.provider == provider) {
+			slot = &index;
+			break;
 		}
+	}
+
+	// Rebuild the index whenever the provider properties change.
+	if (slot && slot->stamp == getPropertyStamp(provider))
+		return slot;
+
+	if (!slot) {
+		slot = &propertyIndex[propertyIndexNext];
+		propertyIndexNext = (propertyIndexNext + 1) % MaxPropertyIndex;
+	}
+
+	releasePropertyIndex(*slot);
+	buildPropertyIndex(*slot, provider);
+	return slot;
+}
+
+void RAD::mergeProperties(OSDictionary *props, MergedKey key, IOService *provider) {
+	// Every provider property table is only walked once, merges copy the prefix bucket.
+	if (mergedCacheLock) {
+		IOLockLock(mergedCacheLock);
+		auto bucket = getPropertyIndex(provider)->props.get(key);
+		if (bucket && !props->merge(bucket))
+			SYSLOG("rad", "prop merge failed for %s", MergedPropertyIndex::prefix(key));
+		IOLockUnlock(mergedCacheLock);
 	} else {
-		SYSLOG("rad", "prop merge failed to get properties");
+		PropertyIndex index {};
+		buildPropertyIndex(index, provider);
+		auto bucket = index.props.get(key);
+		if (bucket && !props->merge(bucket))
+			SYSLOG("rad", "prop merge failed for %s", MergedPropertyIndex::prefix(key));
+		releasePropertyIndex(index);
 	}
-	
-	if (!strcmp(prefix, "CAIL,")) {
+
+	if (key == MergedKey::Cail) {
 		for (size_t i = 0; i < arrsize(powerGatingFlags); i++) {
 			if (powerGatingFlags[i] && props->getObject(powerGatingFlags[i])) {
 				DBGLOG("rad", "cail prop merge found %s, replacing", powerGatingFlags[i]);
@@ -417,6 +472,55 @@ void RAD::mergeProperties(OSDictionary *props, const char *prefix, IOService *pr
 	}
 }
 
+unsigned int RAD::getPropertyStamp(IOService *provider) {
+	auto dict = provider->getPropertyTable();
+	return dict ? CollectionViewer::getUpdateStamp(dict) : 0;
+}
+
+bool RAD::isMergedCached(IORegistryEntry *entry, IOService *provider, MergedKey key, OSObject *obj) {
+	if (!mergedCacheLock)
+		return false;
+
+	bool found = false;
+	IOLockLock(mergedCacheLock);
+	for (auto &cached : mergedCache) {
+		// The merged object is retained by the cache, so its address cannot be reused by another dictionary.
+		if (cached.merged == obj && cached.entry == entry && cached.provider == provider && cached.key == key) {
+			found = cached.stamp == getPropertyStamp(provider);
+			break;
+		}
+	}
+	IOLockUnlock(mergedCacheLock);
+
+	return found;
+}
+
+void RAD::cacheMerged(IORegistryEntry *entry, IOService *provider, MergedKey key, OSObject *merged) {
+	if (!mergedCacheLock)
+		return;
+
+	IOLockLock(mergedCacheLock);
+	// Replace the previous merge of the same property or evict the oldest one.
+	MergedCacheEntry *slot = nullptr;
+	for (auto &cached : mergedCache) {
+		if (cached.entry == entry && cached.provider == provider && cached.key == key) {
+			slot = &cached;
+			break;
+		}
+	}
+
+	if (!slot) {
+		slot = &mergedCache[mergedCacheNext];
+		mergedCacheNext = (mergedCacheNext + 1) % MaxMergedCache;
+	}
+
+	if (slot->merged)
+		slot->merged->release();
+	merged->retain();
+	*slot = {entry, provider, merged, getPropertyStamp(provider), key};
+	IOLockUnlock(mergedCacheLock);
+}
+
 void RAD::applyPropertyFixes(IOService *service, uint32_t connectorNum) {
 	if (service && getKernelVersion() >= KernelVersion::HighSierra) {
 		// Starting with 10.13.2 this is important to fix sleep issues due to enforced 6 screens
@@ -431,6 +535,15 @@ void RAD::applyPropertyFixes(IOService *service, uint32_t connectorNum) {
 }
 
 void RAD::updateConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gettable, IOService *ctrl, RADConnectors::Connector *connectors, uint8_t *sz) {
+	// Connector layout is selected once here, the rest of the pipeline is specialised for it.
+	if (modernConnectors)
+		updateTypedConnectorsInfo(atomutils, gettable, ctrl, &connectors->modern, sz);
+	else
+		updateTypedConnectorsInfo(atomutils, gettable, ctrl, &connectors->legacy, sz);
+}
+
+template <typename T>
+void RAD::updateTypedConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gettable, IOService *ctrl, T *connectors, uint8_t *sz) {
 	if (atomutils) {
 		DBGLOG("rad", "getConnectorsInfo found %d connectors", *sz);
 		RADConnectors::print(connectors, *sz);
@@ -463,14 +576,14 @@ void RAD::updateConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gett
 	} else {
 		if (atomutils) {
 			DBGLOG("rad", "getConnectorsInfo attempting to autofix connectors");
-			uint8_t sHeader = 0, displayPathNum = 0, connectorObjectNum = 0;
-			auto baseAddr = static_cast<uint8_t *>(gettable(atomutils, AtomObjectTableType::Common, &sHeader)) - sizeof(uint32_t);
-			auto displayPaths = static_cast<AtomDisplayObjectPath *>(gettable(atomutils, AtomObjectTableType::DisplayPath, &displayPathNum));
-			auto connectorObjects = static_cast<AtomConnectorObject *>(gettable(atomutils, AtomObjectTableType::ConnectorObject, &connectorObjectNum));
-			if (displayPathNum == connectorObjectNum)
-				autocorrectConnectors(baseAddr, displayPaths, displayPathNum, connectorObjects, connectorObjectNum, connectors, *sz);
+			uint8_t sHeader = 0;
+			auto common = static_cast<uint8_t *>(gettable(atomutils, AtomObjectTableType::Common, &sHeader));
+			// The image size is unknown here, so the parser is only bounded by 16-bit object header offsets.
+			AtomObjectParser parser;
+			if (common && parser.initWithObjectHeader(common - sizeof(uint32_t)))
+				autocorrectConnectors(parser, connectors, *sz);
 			else
-				DBGLOG("rad", "getConnectorsInfo found different displaypaths %d and connectors %d", displayPathNum, connectorObjectNum);
+				DBGLOG("rad", "getConnectorsInfo failed to find atom object header");
 		}
 
 		applyPropertyFixes(ctrl, *sz);
@@ -483,7 +596,7 @@ void RAD::updateConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gett
 			senseList = static_cast<const uint8_t *>(priData->getBytesNoCopy());
 			senseNum = static_cast<uint8_t>(priData->getLength());
 			DBGLOG("rad", "getConnectorInfo found %d senses in connector-priority", senseNum);
-			reprioritiseConnectors(senseList, senseNum, connectors, *sz);
+			RADConnectors::reprioritiseConnectors(senseList, senseNum, connectors, *sz);
 		} else {
 			DBGLOG("rad", "getConnectorInfo leaving unchaged priority");
 		}
@@ -493,117 +606,20 @@ void RAD::updateConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gett
 	RADConnectors::print(connectors, *sz);
 }
 
-void RAD::autocorrectConnectors(uint8_t *baseAddr, AtomDisplayObjectPath *displayPaths, uint8_t displayPathNum, AtomConnectorObject *connectorObjects,
-								uint8_t connectorObjectNum, RADConnectors::Connector *connectors, uint8_t sz) {
-	for (uint8_t i = 0; i < displayPathNum; i++) {
-		if (!isEncoder(displayPaths[i].usGraphicObjIds)) {
-			DBGLOG("rad", "autocorrectConnectors not encoder %X at %d", displayPaths[i].usGraphicObjIds, i);
-			continue;
-		}
-		
-		uint8_t txmit = 0, enc = 0;
-		if (!getTxEnc(displayPaths[i].usGraphicObjIds, txmit, enc))
-			continue;
-		
-		uint8_t sense = getSenseID(baseAddr + connectorObjects[i].usRecordOffset);
-		if (!sense) {
-			DBGLOG("rad", "autocorrectConnectors failed to detect sense for %d connector", i);
-			continue;
-		}
-		
-		DBGLOG("rad", "autocorrectConnectors found txmit %02X enc %02X sense %02X for %d connector", txmit, enc, sense, i);
-
-		autocorrectConnector(getConnectorID(displayPaths[i].usConnObjectId), sense, txmit, enc, connectors, sz);
-	}
+template <typename T>
+void RAD::autocorrectConnectors(const AtomObjectParser &parser, T *connectors, uint8_t sz) {
+	if (dviSingleLink)
+		RADConnectors::autocorrectConnectors(parser, connectors, sz);
+	else
+		DBGLOG("rad", "autocorrectConnectors use -raddvi to enable dvi autocorrection");
 }
 
-void RAD::autocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, uint8_t enc, RADConnectors::Connector *connectors, uint8_t sz) {
-	// This function attempts to fix the following issues:
-	//
-	// 1. Incompatible DVI transmitter on 290X, 370 and probably some other models
-	// In this case a correct transmitter is detected by AtiAtomBiosDce60::getPropertiesForEncoderObject, however, later
-	// in AtiAtomBiosDce60::getPropertiesForConnectorObject for DVI DL and TITFP513 this value is conjuncted with 0xCF,
-	// which makes it wrong: 0x10 -> 0, 0x11 -> 1. As a result one gets black screen when connecting multiple displays.
-	// getPropertiesForEncoderObject takes usGraphicObjIds and getPropertiesForConnectorObject takes usConnObjectId
-	
-	if (callbackRAD->dviSingleLink) {
-		if (connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_I &&
-			connector != CONNECTOR_OBJECT_ID_DUAL_LINK_DVI_D &&
-			connector != CONNECTOR_OBJECT_ID_LVDS) {
-			DBGLOG("rad", "autocorrectConnector found unsupported connector type %02X", connector);
-			return;
-		}
-		
-		auto fixTransmit = [](auto &con, uint8_t idx, uint8_t sense, uint8_t txmit) {
-			if (con.sense == sense) {
-				if (con.transmitter != txmit && (con.transmitter & 0xCF) == con.transmitter) {
-					DBGLOG("rad", "autocorrectConnector replacing txmit %02X with %02X for %d connector sense %02X",
-						   con.transmitter, txmit, idx, sense);
-					con.transmitter = txmit;
-				}
-				return true;
-			}
-			return false;
-		};
-		
-		bool isModern = RADConnectors::modern();
-		for (uint8_t j = 0; j < sz; j++) {
-			if (isModern) {
-				auto &con = (&connectors->modern)[j];
-				if (fixTransmit(con, j, sense, txmit))
-					break;
-			} else {
-				auto &con = (&connectors->legacy)[j];
-				if (fixTransmit(con, j, sense, txmit))
-					break;
-			}
-		}
-	} else {
+template <typename T>
+void RAD::autocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, uint8_t enc, T *connectors, uint8_t sz) {
+	if (dviSingleLink)
+		RADConnectors::autocorrectConnector(connector, sense, txmit, enc, connectors, sz);
+	else
 		DBGLOG("rad", "autocorrectConnector use -raddvi to enable dvi autocorrection");
-	}
-}
-
-void RAD::reprioritiseConnectors(const uint8_t *senseList, uint8_t senseNum, RADConnectors::Connector *connectors, uint8_t sz) {
-	static constexpr uint32_t typeList[] {
-		RADConnectors::ConnectorLVDS,
-		RADConnectors::ConnectorDigitalDVI,
-		RADConnectors::ConnectorHDMI,
-		RADConnectors::ConnectorDP,
-		RADConnectors::ConnectorVGA
-	};
-	static constexpr uint8_t typeNum {static_cast<uint8_t>(arrsize(typeList))};
-	
-	bool isModern = RADConnectors::modern();
-	uint16_t priCount = 1;
-	// Automatically detected connectors have equal priority (0), which often results in black screen
-	// This allows to change this firstly by user-defined list, then by type list.
-	//TODO: priority is ignored for 5xxx and 6xxx GPUs, should we manually reorder items?
-	for (uint8_t i = 0; i < senseNum + typeNum + 1; i++) {
-		for (uint8_t j = 0; j < sz; j++) {
-			auto reorder = [&](auto &con) {
-				if (i == senseNum + typeNum) {
-					if (con.priority == 0)
-						con.priority = priCount++;
-				} else if (i < senseNum) {
-					if (con.sense == senseList[i]) {
-						DBGLOG("rad", "reprioritiseConnectors setting priority of sense %02X to %d by sense", con.sense, priCount);
-						con.priority = priCount++;
-						return true;
-					}
-				} else {
-					if (con.priority == 0 && con.type == typeList[i-senseNum]) {
-						DBGLOG("rad", "reprioritiseConnectors setting priority of sense %02X to %d by type", con.sense, priCount);
-						con.priority = priCount++;
-					}
-				}
-				return false;
-			};
-			
-			if ((isModern && reorder((&connectors->modern)[j])) ||
-				(!isModern && reorder((&connectors->legacy)[j])))
-				break;
-		}
-	}
 }
 
 void RAD::updateAccelConfig(IOService *accelService, const char **accelConfig) {
@@ -637,6 +653,7 @@ void RAD::updateAccelConfig(IOService *accelService, const char **accelConfig) {
 
 
 bool RAD::wrapSetProperty(IORegistryEntry *that, const char *aKey, void *bytes, unsigned length) {
+	// The model guard is never retired, drivers may set the model at any time.
 	if (length > 10 && aKey && reinterpret_cast<const uint32_t *>(aKey)[0] == 'edom' && reinterpret_cast<const uint16_t *>(aKey)[2] == 'l') {
 		DBGLOG("rad", "SetProperty caught model %d (%.*s)", length, length, static_cast<char *>(bytes));
 		if (*static_cast<uint32_t *>(bytes) == ' DMA' || *static_cast<uint32_t *>(bytes) == ' ITA') {
@@ -653,33 +670,54 @@ bool RAD::wrapSetProperty(IORegistryEntry *that, const char *aKey, void *bytes,
 
 OSObject *RAD::wrapGetProperty(IORegistryEntry *that, const char *aKey) {
 	auto obj = FunctionCast(wrapGetProperty, callbackRAD->orgGetProperty)(that, aKey);
-	auto props = OSDynamicCast(OSDictionary, obj);
+	if (callbackRAD->propertyHooks.isRetired())
+		return obj;
 
-	if (props && aKey) {
-		const char *prefix {nullptr};
+	// This is called for every property read in the system, so reject unrelated keys before any casts.
+	auto key = callbackRAD->mergedKeyFilter.check(aKey);
+	if (key == MergedKey::None)
+		return obj;
+
+	auto props = OSDynamicCast(OSDictionary, obj);
+	if (props) {
+		bool merge = false;
 		auto provider = callbackRAD->currentLegacyPropProvider;
 		if (!provider)
 			provider = callbackRAD->currentPropProvider;
 		if (provider) {
-			if (aKey[0] == 'a') {
-				if (!strcmp(aKey, "aty_config"))
-					prefix = "CFG,";
-				else if (!strcmp(aKey, "aty_properties"))
-					prefix = "PP,";
-			}
-		} else if (aKey[0] == 'c' && !strcmp(aKey, "cail_properties")) {
+			merge = key == MergedKey::Config || key == MergedKey::Properties;
+		} else if (key == MergedKey::Cail) {
 			provider = OSDynamicCast(IOService, that->getParentEntry(gIOServicePlane));
 			DBGLOG("rad", "GetProperty got cail_properties %d, merging from %s", provider != nullptr,
 				   provider ? safeString(provider->getName()) : "(null provider)");
-			if (provider) prefix = "CAIL,";
+			merge = provider != nullptr;
 		}
 
-		if (prefix) {
+		if (merge && callbackRAD->isMergedCached(that, provider, key, obj)) {
+			DBGLOG("rad", "GetProperty reused merged %s", aKey);
+		} else if (merge) {
 			DBGLOG("rad", "GetProperty discovered property merge request for %s", aKey);
 			auto newProps = OSDynamicCast(OSDictionary, props->copyCollection());
-			callbackRAD->mergeProperties(newProps, prefix, provider);
-			that->setProperty(aKey, newProps);
+			if (!newProps) {
+				SYSLOG("rad", "GetProperty failed to copy %s", aKey);
+				return obj;
+			}
+
+			callbackRAD->mergeProperties(newProps, key, provider);
+			if (!that->setProperty(aKey, newProps)) {
+				SYSLOG("rad", "GetProperty failed to store merged %s", aKey);
+				newProps->release();
+				return obj;
+			}
+
+			callbackRAD->cacheMerged(that, provider, key, newProps);
+			// The registry entry holds the merged dictionary now, like any other returned property.
 			obj = newProps;
+			newProps->release();
+
+			// Merged properties are stored back, so later reads need no hook.
+			if (key == MergedKey::Cail)
+				callbackRAD->propertyHooks.cailMerged(provider);
 		}
 	}
 
@@ -727,7 +765,7 @@ uint32_t RAD::wrapTranslateAtomConnectorInfoV1(void *that, RADConnectors::AtomCo
 	uint32_t code = FunctionCast(wrapTranslateAtomConnectorInfoV1, callbackRAD->orgTranslateAtomConnectorInfoV1)(that, info, connector);
 	
 	if (code == 0 && info && connector) {
-		RADConnectors::print(connector, 1);
+		RADConnectors::print(&connector->modern, 1);
 		
 		uint8_t sense = getSenseID(info->i2cRecord);
 		if (sense) {
@@ -749,7 +787,7 @@ uint32_t RAD::wrapTranslateAtomConnectorInfoV1(void *that, RADConnectors::AtomCo
 				if (((usSrcObjectID & OBJECT_TYPE_MASK) >> OBJECT_TYPE_SHIFT) == GRAPH_OBJECT_TYPE_ENCODER) {
 					uint8_t txmit = 0, enc = 0;
 					if (getTxEnc(usSrcObjectID, txmit, enc))
-						callbackRAD->autocorrectConnector(getConnectorID(info->usConnObjectId), getSenseID(info->i2cRecord), txmit, enc, connector, 1);
+						callbackRAD->autocorrectConnector(getConnectorID(info->usConnObjectId), getSenseID(info->i2cRecord), txmit, enc, &connector->modern, 1);
 					break;
 				}
 			}
@@ -767,14 +805,14 @@ uint32_t RAD::wrapTranslateAtomConnectorInfoV2(void *that, RADConnectors::AtomCo
 	uint32_t code = FunctionCast(wrapTranslateAtomConnectorInfoV2, callbackRAD->orgTranslateAtomConnectorInfoV2)(that, info, connector);
 	
 	if (code == 0 && info && connector) {
-		RADConnectors::print(connector, 1);
+		RADConnectors::print(&connector->modern, 1);
 		
 		uint8_t sense = getSenseID(info->i2cRecord);
 		if (sense) {
 			DBGLOG("rad", "translateAtomConnectorInfoV2 got sense id %02X", sense);
 			uint8_t txmit = 0, enc = 0;
 			if (getTxEnc(info->usGraphicObjIds, txmit, enc))
-				callbackRAD->autocorrectConnector(getConnectorID(info->usConnObjectId), getSenseID(info->i2cRecord), txmit, enc, connector, 1);
+				callbackRAD->autocorrectConnector(getConnectorID(info->usConnObjectId), getSenseID(info->i2cRecord), txmit, enc, &connector->modern, 1);
 		} else {
 			DBGLOG("rad", "translateAtomConnectorInfoV2 failed to detect sense for translated connector");
 		}
@@ -787,13 +825,19 @@ bool RAD::wrapATIControllerStart(IOService *ctrl, IOService *provider) {
 	DBGLOG("rad", "starting controller");
 	if (callbackRAD->forceVesaMode) {
 		DBGLOG("rad", "disabling video acceleration on request");
+		callbackRAD->propertyHooks.controllerStarted(provider, false);
 		return false;
 	}
 	
+	// Track the controller before starting it, so that no cail_properties merge is missed.
+	callbackRAD->propertyHooks.controllerStarting(provider);
 	callbackRAD->currentPropProvider = provider;
 	bool r = FunctionCast(wrapATIControllerStart, callbackRAD->orgATIControllerStart)(ctrl, provider);
 	callbackRAD->currentPropProvider = nullptr;
 	DBGLOG("rad", "starting controller done %d", r);
+
+	// Only started controllers get an accelerator reading cail_properties.
+	callbackRAD->propertyHooks.controllerStarted(provider, r);
 	return r;
 }
 
@@ -801,12 +845,17 @@ bool RAD::wrapLegacyATIControllerStart(IOService *ctrl, IOService *provider) {
 	DBGLOG("rad", "starting legacy controller");
 	if (callbackRAD->forceVesaMode) {
 		DBGLOG("rad", "disabling legacy video acceleration on request");
+		callbackRAD->propertyHooks.controllerStarted(provider, false);
 		return false;
 	}
 	
+	// Track the controller before starting it, so that no cail_properties merge is missed.
+	callbackRAD->propertyHooks.controllerStarting(provider);
 	callbackRAD->currentLegacyPropProvider = provider;
 	bool r = FunctionCast(wrapLegacyATIControllerStart, callbackRAD->orgLegacyATIControllerStart)(ctrl, provider);
 	callbackRAD->currentLegacyPropProvider = nullptr;
 	DBGLOG("rad", "starting legacy controller done %d", r);
+
+	callbackRAD->propertyHooks.controllerStarted(provider, r);
 	return r;
 }
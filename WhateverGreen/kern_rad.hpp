@@ -11,8 +11,13 @@
 #include <Headers/kern_patcher.hpp>
 #include <Headers/kern_devinfo.hpp>
 #include <Library/LegacyIOService.h>
+#include <IOKit/IOLocks.h>
 #include "kern_atom.hpp"
 #include "kern_con.hpp"
+#include "kern_radhooks.hpp"
+#include "kern_radindex.hpp"
+#include "kern_radkeys.hpp"
+#include "kern_route.hpp"
 
 class RAD {
 public:
@@ -47,13 +52,24 @@ public:
 	 *  Patch kext if needed and prepare other patches
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param index   kinfo handle
 	 *  @param address kinfo load address
 	 *  @param size    kinfo memory size
 	 *
 	 *  @return true if patched anything
 	 */
-	bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+	bool processKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
+
+	/**
+	 *  Obtain kexts handled by processKext
+	 *
+	 *  @param list  kext list to append to
+	 *  @param max   maximum amount of kexts to append
+	 *
+	 *  @return amount of appended kexts
+	 */
+	size_t getKexts(KernelPatcher::KextInfo **list, size_t max);
 
 private:
 	/**
@@ -107,6 +123,11 @@ private:
 	IOService *currentPropProvider {nullptr};
 	IOService *currentLegacyPropProvider {nullptr};
 
+	/**
+	 *  getProperty key filter
+	 */
+	MergedKeyFilter mergedKeyFilter;
+
 	/**
 	 *  Original populateAccelConfig functions
 	 */
@@ -194,24 +215,25 @@ private:
 	 */
 	bool forceVesaMode {false};
 
+	/**
+	 *  Connectors are in ModernConnector format, decided once AMD support kext is loaded
+	 */
+	bool modernConnectors {false};
+
 	/**
 	 *  Current max used hardware kexts
 	 */
 	size_t maxHardwareKexts {MaxRadeonHardware};
 
 	/**
-	 *  Configure available kexts for different OS
+	 *  AMD controllers still needing property merges
 	 */
-	void initHardwareKextMods();
+	PropertyHookTracker propertyHooks;
 
 	/**
-	 *  Merge configuration properties from ioreg
-	 *
-	 *  @param props     target dictionary with original properties
-	 *  @param prefix    property name prefix in provider
-	 *  @param provider  property provider for merging
+	 *  Configure available kexts for different OS
 	 */
-	void mergeProperties(OSDictionary *props, const char *prefix, IOService *provider);
+	void initHardwareKextMods();
 
 	/**
 	 *  Automatically add properties to fix various bugs
@@ -233,39 +255,39 @@ private:
 	void updateConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gettable, IOService *ctrl, RADConnectors::Connector *connectors, uint8_t *sz);
 
 	/**
-	 *  Apply various fixes to automatically detected connectors
+	 *  Refresh connectors of the used layout, see updateConnectorsInfo
 	 *
-	 *  @param baseAddr            atom object offset base address
-	 *  @param displayPaths        pointer to atom display object path table
-	 *  @param connectorObjects    pointer to connector objects table
-	 *  @param connectorObjectNum  number of elements in connectorObjects
-	 *  @param connectors          pointer to autodetected connectors
-	 *  @param sz                  number of autodetected connectors
+	 *  @param atomutils  AtiAtomBiosUtilities instance
+	 *  @param gettable   relevant atom object table getting function
+	 *  @param ctrl       ATIController service
+	 *  @param connectors autodetected controllers in LegacyConnector or ModernConnector format
+	 *  @param sz         number of autodetected controllers
 	 */
-	void autocorrectConnectors(uint8_t *baseAddr, AtomDisplayObjectPath *displayPaths, uint8_t displayPathNum, AtomConnectorObject *connectorObjects,
-							   uint8_t connectorObjectNum, RADConnectors::Connector *connectors, uint8_t sz);
+	template <typename T>
+	void updateTypedConnectorsInfo(void *atomutils, t_getAtomObjectTableForType gettable, IOService *ctrl, T *connectors, uint8_t *sz);
 
 	/**
-	 *  Actually correct a certain found connector
+	 *  Apply various fixes to automatically detected connectors if enabled
 	 *
-	 *  @param connector   connector id
-	 *  @param sense       sense id
-	 *  @param txmit       transmitter
-	 *  @param enc         encoder
+	 *  @param parser      atom object table parser
 	 *  @param connectors  pointer to autodetected connectors
 	 *  @param sz          number of autodetected connectors
 	 */
-	void autocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, uint8_t enc, RADConnectors::Connector *connectors, uint8_t sz);
+	template <typename T>
+	void autocorrectConnectors(const AtomObjectParser &parser, T *connectors, uint8_t sz);
 
 	/**
-	 *  Changes connector priority according to provided sense id list
+	 *  Correct a certain found connector if enabled
 	 *
-	 *  @param senseList   list of sense ids in ascending order
-	 *  @param senseNum    number of sense ids in the list
+	 *  @param connector   connector id
+	 *  @param sense       sense id
+	 *  @param txmit       transmitter
+	 *  @param enc         encoder
 	 *  @param connectors  pointer to autodetected connectors
 	 *  @param sz          number of autodetected connectors
 	 */
-	void reprioritiseConnectors(const uint8_t *senseList, uint8_t senseNum, RADConnectors::Connector *connectors, uint8_t sz);
+	template <typename T>
+	void autocorrectConnector(uint8_t connector, uint8_t sense, uint8_t txmit, uint8_t enc, T *connectors, uint8_t sz);
 
 	/**
 	 *  populateAccelConfig wrapping functions used for accelerator name correction
@@ -284,31 +306,34 @@ private:
 	 *  Enable forced 24-bit output
 	 *
 	 *  @param patcher  kernel patcher instance
+	 *  @param plan     route plan of the loaded kext
 	 *  @param info     loaded kinfo of the right framebuffer
 	 *  @param address  kinfo load address
 	 *  @param size     kinfo memory size
 	 */
-	void process24BitOutput(KernelPatcher &patcher, KernelPatcher::KextInfo &info, mach_vm_address_t address, size_t size);
+	void process24BitOutput(KernelPatcher &patcher, RoutePlan &plan, KernelPatcher::KextInfo &info, mach_vm_address_t address, size_t size);
 
 	/**
 	 *  Apply connector modifications (for support kexts)
 	 *
 	 *  @param patcher  kernel patcher instance
+	 *  @param plan     route plan of the kext
 	 *  @param address  kinfo load address
 	 *  @param size     kinfo memory size
 	 *  @param modern   legacy or normal kext
 	 */
-	void processConnectorOverrides(KernelPatcher &patcher, mach_vm_address_t address, size_t size, bool modern);
+	void processConnectorOverrides(KernelPatcher &patcher, RoutePlan &plan, mach_vm_address_t address, size_t size, bool modern);
 
 	/**
 	 *  Apply hardware kext modifications (X3000~X5000)
 	 *
 	 *  @param patcher  kernel patcher instance
+	 *  @param plan     route plan of the kext
 	 *  @param hwIndex  hardware kext index
 	 *  @param address  kinfo load address
 	 *  @param size     kinfo memory size
 	 */
-	void processHardwareKext(KernelPatcher &patcher, size_t hwIndex, mach_vm_address_t address, size_t size);
+	void processHardwareKext(KernelPatcher &patcher, RoutePlan &plan, size_t hwIndex, mach_vm_address_t address, size_t size);
 
 	/**
 	 *  Update IOAccelConfig with a real GPU model name
@@ -323,6 +348,125 @@ private:
 	 */
 	static bool wrapSetProperty(IORegistryEntry *that, const char *aKey, void *bytes, unsigned length);
 	
+	/**
+	 *  Merged property dictionary stored back to the registry entry
+	 */
+	struct MergedCacheEntry {
+		IORegistryEntry *entry;
+		IOService *provider;
+		OSObject *merged;
+		unsigned int stamp;
+		MergedKey key;
+	};
+
+	/**
+	 *  Maximum amount of cached merged dictionaries
+	 */
+	static constexpr size_t MaxMergedCache {8};
+
+	/**
+	 *  Cached merged dictionaries, merged objects are retained
+	 */
+	MergedCacheEntry mergedCache[MaxMergedCache] {};
+
+	/**
+	 *  Next cache entry to evict
+	 */
+	size_t mergedCacheNext {0};
+
+	/**
+	 *  Merged dictionary cache and property index lock, neither is used when it is missing
+	 */
+	IOLock *mergedCacheLock {nullptr};
+
+	/**
+	 *  Obtain provider property table generation
+	 *
+	 *  @param provider  property provider
+	 *
+	 *  @return update stamp of the property table
+	 */
+	static unsigned int getPropertyStamp(IOService *provider);
+
+	/**
+	 *  Check whether the property object is an up to date merged dictionary
+	 *
+	 *  @param entry     registry entry the property was read from
+	 *  @param provider  property provider for merging
+	 *  @param key       merged property
+	 *  @param obj       current property value
+	 *
+	 *  @return true if obj needs no merging
+	 */
+	bool isMergedCached(IORegistryEntry *entry, IOService *provider, MergedKey key, OSObject *obj);
+
+	/**
+	 *  Remember a merged dictionary
+	 *
+	 *  @param entry     registry entry the property was stored to
+	 *  @param provider  property provider for merging
+	 *  @param key       merged property
+	 *  @param merged    merged dictionary
+	 */
+	void cacheMerged(IORegistryEntry *entry, IOService *provider, MergedKey key, OSObject *merged);
+
+	/**
+	 *  Provider properties bucketed by merged property prefix
+	 */
+	struct PropertyIndex {
+		IOService *provider;
+		unsigned int stamp;
+		MergedPropertyIndex props;
+	};
+
+	/**
+	 *  Maximum amount of indexed providers
+	 */
+	static constexpr size_t MaxPropertyIndex {4};
+
+	/**
+	 *  Indexed providers, protected by mergedCacheLock
+	 */
+	PropertyIndex propertyIndex[MaxPropertyIndex] {};
+
+	/**
+	 *  Next property index to evict
+	 */
+	size_t propertyIndexNext {0};
+
+	/**
+	 *  Retain the provider and index its property table
+	 *
+	 *  @param index     index to fill
+	 *  @param provider  property provider
+	 */
+	static void buildPropertyIndex(PropertyIndex &index, IOService *provider);
+
+	/**
+	 *  Free property index buckets and release the provider
+	 *
+	 *  @param index  index to free
+	 */
+	static void releasePropertyIndex(PropertyIndex &index);
+
+	/**
+	 *  Obtain an up to date property index, mergedCacheLock must be held
+	 *
+	 *  @param provider  property provider
+	 *
+	 *  @return property index
+	 */
+	PropertyIndex *getPropertyIndex(IOService *provider);
+
+	/**
+	 *  Merge configuration properties from ioreg
+	 *
+	 *  @param props     target dictionary with original properties
+	 *  @param key       merged property
+	 *  @param provider  property provider for merging
+	 */
+	void mergeProperties(OSDictionary *props, MergedKey key, IOService *provider);
+
 	/**
 	 *  Wrapped get property function
 	 */
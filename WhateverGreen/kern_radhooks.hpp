@@ -0,0 +1,206 @@
+//
+//  kern_radhooks.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_radhooks_hpp
+#define kern_radhooks_hpp
+
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLocks.h>
+
+/**
+ *  Tracks AMD controllers still needing RAD property merges, kept apart from RAD so that host checks could drive it.
+ *  Merges retire once every controller counted at boot has started and got its cail_properties merged.
+ *  Controllers that were not counted, e.g. Thunderbolt eGPUs attached later, re-arm them when they start.
+ */
+class PropertyHookTracker {
+public:
+	/**
+	 *  Maximum amount of tracked controllers
+	 */
+	static constexpr size_t MaxControllers {8};
+
+	/**
+	 *  Start tracking the controllers expected at boot
+	 *
+	 *  @param providers  controller providers, e.g. AMD GPUs from DeviceInfo
+	 *  @param num        provider count
+	 */
+	void init(const void * const *providers, size_t num) {
+		lock = IOLockAlloc();
+		if (!lock) {
+			SYSLOG("rad", "failed to allocate property hook lock, property merges stay active");
+			pinned = true;
+			return;
+		}
+
+		if (num > MaxControllers) {
+			SYSLOG("rad", "too many controllers to track, property merges stay active");
+			pinned = true;
+			num = MaxControllers;
+		}
+
+		for (size_t i = 0; i < num; i++)
+			controllers[i] = {providers[i], true, false, false};
+		controllerNum = num;
+	}
+
+	/**
+	 *  Free the lock
+	 */
+	void deinit() {
+		if (lock) {
+			IOLockFree(lock);
+			lock = nullptr;
+		}
+	}
+
+	/**
+	 *  Account for a controller about to start, before any of its merges may happen
+	 *
+	 *  @param provider  controller provider
+	 */
+	void controllerStarting(const void *provider) {
+		if (!lock)
+			return;
+
+		IOLockLock(lock);
+		auto controller = find(provider);
+		if (controller) {
+			controller->pendingCail = true;
+			// Controllers not counted at boot, as well as restarted ones, need merges again.
+			if (retired) {
+				DBGLOG("rad", "re-arming property merges for a %s controller", controller->counted ? "restarted" : "new");
+				retired = false;
+			}
+		}
+		IOLockUnlock(lock);
+	}
+
+	/**
+	 *  Account for a finished controller start
+	 *
+	 *  @param provider  controller provider
+	 *  @param started   controller started and is going to have its cail_properties merged
+	 */
+	void controllerStarted(const void *provider, bool started) {
+		if (!lock)
+			return;
+
+		IOLockLock(lock);
+		auto controller = find(provider);
+		if (controller) {
+			controller->started = true;
+			if (!started)
+				controller->pendingCail = false;
+		}
+		update();
+		IOLockUnlock(lock);
+	}
+
+	/**
+	 *  Account for a cail_properties merge, repeated merges for the same controller change nothing
+	 *
+	 *  @param provider  controller provider
+	 */
+	void cailMerged(const void *provider) {
+		if (!lock)
+			return;
+
+		IOLockLock(lock);
+		for (size_t i = 0; i < controllerNum; i++) {
+			if (controllers[i].provider == provider)
+				controllers[i].pendingCail = false;
+		}
+		update();
+		IOLockUnlock(lock);
+	}
+
+	/**
+	 *  Check whether merges are no longer needed, called for every property read without locking
+	 *
+	 *  @return true if getProperty may only call the original function
+	 */
+	bool isRetired() const {
+		return retired;
+	}
+
+private:
+	/**
+	 *  Tracked controller
+	 */
+	struct Controller {
+		const void *provider;
+		bool counted;
+		bool started;
+		bool pendingCail;
+	};
+
+	/**
+	 *  Find or add a controller, lock must be held
+	 *
+	 *  @param provider  controller provider
+	 *
+	 *  @return controller or nullptr when there is no room left
+	 */
+	Controller *find(const void *provider) {
+		for (size_t i = 0; i < controllerNum; i++) {
+			if (controllers[i].provider == provider)
+				return &controllers[i];
+		}
+
+		if (controllerNum < MaxControllers) {
+			controllers[controllerNum] = {provider, false, false, false};
+			return &controllers[controllerNum++];
+		}
+
+		SYSLOG("rad", "too many controllers to track, property merges stay active");
+		pinned = true;
+		retired = false;
+		return nullptr;
+	}
+
+	/**
+	 *  Retire merges once every counted controller started and no merge is pending, lock must be held
+	 */
+	void update() {
+		if (pinned)
+			return;
+
+		for (size_t i = 0; i < controllerNum; i++) {
+			if ((controllers[i].counted && !controllers[i].started) || controllers[i].pendingCail)
+				return;
+		}
+
+		// Lilu cannot unroute functions, so the hook just turns into a plain forwarder.
+		if (!retired)
+			DBGLOG("rad", "retiring property merges, all controllers started");
+		retired = true;
+	}
+
+	/**
+	 *  Tracked controllers, the ones counted at boot go first
+	 */
+	Controller controllers[MaxControllers] {};
+	size_t controllerNum {0};
+
+	/**
+	 *  Some controller could not be tracked, so merges must stay active
+	 */
+	bool pinned {false};
+
+	/**
+	 *  getProperty merges are not needed at the moment
+	 */
+	volatile bool retired {false};
+
+	/**
+	 *  Tracker state lock, nothing is tracked and merges stay active without it
+	 */
+	IOLock *lock {nullptr};
+};
+
+#endif /* kern_radhooks_hpp */
@@ -0,0 +1,141 @@
+//
+//  kern_radindex.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_radindex_hpp
+#define kern_radindex_hpp
+
+#include <Headers/kern_util.hpp>
+#include <Library/LegacyIOService.h>
+#include "kern_radkeys.hpp"
+
+/**
+ *  Provider properties bucketed by merged property prefix, kept apart from RAD so that host checks could build it.
+ *  The property table is walked once, merges then copy a single bucket.
+ */
+class MergedPropertyIndex {
+public:
+	/**
+	 *  Obtain provider property prefix of a merged property
+	 *
+	 *  @param key  merged property
+	 *
+	 *  @return prefix or nullptr for MergedKey::None
+	 */
+	static const char *prefix(MergedKey key) {
+		static const char *prefixes[] {
+			nullptr,
+			"CFG,",
+			"PP,",
+			"CAIL,"
+		};
+		return prefixes[static_cast<size_t>(key)];
+	}
+
+	/**
+	 *  Find the merged property a provider property belongs to
+	 *
+	 *  @param name       provider property name
+	 *  @param length     provider property name length
+	 *  @param prefixlen  prefix length on success
+	 *
+	 *  @return merged property or MergedKey::None
+	 */
+	static MergedKey classify(const char *name, size_t length, size_t &prefixlen) {
+		// Most of the properties have no prefix at all.
+		for (auto key : {MergedKey::Config, MergedKey::Properties, MergedKey::Cail}) {
+			auto p = prefix(key);
+			prefixlen = strlen(p);
+			if (length > prefixlen && !strncmp(name, p, prefixlen))
+				return key;
+		}
+		prefixlen = 0;
+		return MergedKey::None;
+	}
+
+	/**
+	 *  Bucket prefixed properties with prefixes stripped, the index must be empty
+	 *
+	 *  @param dict  provider property table
+	 */
+	void build(const OSDictionary *dict) {
+		auto iterator = OSCollectionIterator::withCollection(dict);
+		if (!iterator) {
+			SYSLOG("rad", "prop index failed to iterate over properties");
+			return;
+		}
+
+		OSSymbol *propname;
+		while ((propname = OSDynamicCast(OSSymbol, iterator->getNextObject())) != nullptr) {
+			auto name = propname->getCStringNoCopy();
+			if (!name)
+				continue;
+
+			size_t prefixlen;
+			auto key = classify(name, propname->getLength(), prefixlen);
+			if (key == MergedKey::None)
+				continue;
+
+			auto prop = dict->getObject(propname);
+			if (!prop) {
+				DBGLOG("rad", "prop %s was not indexed due to no value", name);
+				continue;
+			}
+
+			// It is hard to make a boolean from ACPI, so we make a hack here:
+			// 1-byte OSData with 0x01 / 0x00 values becomes boolean.
+			auto data = OSDynamicCast(OSData, prop);
+			if (data && data->getLength() == 1) {
+				auto val = static_cast<const uint8_t *>(data->getBytesNoCopy());
+				if (val && val[0] == 1)
+					prop = kOSBooleanTrue;
+				else if (val && val[0] == 0)
+					prop = kOSBooleanFalse;
+			}
+
+			auto &props = buckets[static_cast<size_t>(key) - 1];
+			if (!props)
+				props = OSDictionary::withCapacity(8);
+			if (props && props->setObject(name + prefixlen, prop))
+				DBGLOG("rad", "prop %s was indexed", name);
+			else
+				SYSLOG("rad", "prop %s failed to be indexed", name);
+		}
+
+		iterator->release();
+	}
+
+	/**
+	 *  Obtain indexed properties of a merged property
+	 *
+	 *  @param key  merged property
+	 *
+	 *  @return properties with prefixes stripped or nullptr
+	 */
+	OSDictionary *get(MergedKey key) const {
+		return key != MergedKey::None ? buckets[static_cast<size_t>(key) - 1] : nullptr;
+	}
+
+	/**
+	 *  Free the buckets
+	 */
+	void release() {
+		for (auto &bucket : buckets) {
+			if (bucket) {
+				bucket->release();
+				bucket = nullptr;
+			}
+		}
+	}
+
+private:
+	/**
+	 *  Buckets indexed by MergedKey without MergedKey::None
+	 */
+	OSDictionary *buckets[3] {};
+};
+
+#endif /* kern_radindex_hpp */
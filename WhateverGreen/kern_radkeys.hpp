@@ -0,0 +1,84 @@
+//
+//  kern_radkeys.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_radkeys_hpp
+#define kern_radkeys_hpp
+
+#include <Headers/kern_util.hpp>
+
+/**
+ *  Properties merged from the controller
+ */
+enum class MergedKey {
+	None,
+	Config,
+	Properties,
+	Cail
+};
+
+/**
+ *  getProperty key filter of RAD property merges, kept apart from RAD so that host checks could replay registry reads.
+ *  The filter is called for every property read in the system, so unrelated keys must be rejected fast.
+ */
+class MergedKeyFilter {
+public:
+	/**
+	 *  Classify getProperty key without touching the returned object
+	 *
+	 *  @param key  property name
+	 *
+	 *  @return merged property or MergedKey::None
+	 */
+	static MergedKey classify(const char *key) {
+		// The comparisons stop at the terminator, so short keys are never overread.
+		// Nearly all the keys are rejected by the first one or two characters.
+		if (!key)
+			return MergedKey::None;
+		if (key[0] == 'a') {
+			if (key[1] != 't' || key[2] != 'y' || key[3] != '_')
+				return MergedKey::None;
+			if (!strcmp(key + 4, "config"))
+				return MergedKey::Config;
+			if (!strcmp(key + 4, "properties"))
+				return MergedKey::Properties;
+		} else if (key[0] == 'c') {
+			if (key[1] == 'a' && key[2] == 'i' && key[3] == 'l' && !strcmp(key + 4, "_properties"))
+				return MergedKey::Cail;
+		}
+		return MergedKey::None;
+	}
+
+	/**
+	 *  Classify getProperty key and account for it
+	 *
+	 *  @param key  property name
+	 *
+	 *  @return merged property or MergedKey::None
+	 */
+	MergedKey check(const char *key) {
+		auto merged = classify(key);
+#ifdef DEBUG
+		if (merged == MergedKey::None) {
+			misses++;
+		} else {
+			hits++;
+			DBGLOG("rad", "GetProperty %s, %lu merged key hits %lu misses", key, hits, misses);
+		}
+#endif
+		return merged;
+	}
+
+#ifdef DEBUG
+	/**
+	 *  Amount of getProperty calls with merged and unrelated keys, not synchronised
+	 */
+	size_t hits {0};
+	size_t misses {0};
+#endif
+};
+
+#endif /* kern_radkeys_hpp */
@@ -0,0 +1,238 @@
+//
+//  kern_route.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_route.hpp"
+#include "kern_session.hpp"
+#include "kern_symcache.hpp"
+#include "kern_trace.hpp"
+
+#include <Headers/kern_util.hpp>
+
+void RoutePlan::add(const KernelPatcher::RouteRequest &request) {
+	if (num < MaxRequests)
+		slots[num++].request = request;
+	else
+		SYSLOG("route", "route plan overflow on %s", request.symbol);
+}
+
+void RoutePlan::add(const KernelPatcher::LookupPatch &patch, const char *name, bool optional) {
+	if (patchNum >= MaxPatches || patch.size == 0 || patch.size > (MaxPatchBytes - patchBytesUsed) / 2) {
+		SYSLOG("route", "lookup patch plan overflow on %s", name);
+		patchesDropped = true;
+		return;
+	}
+
+	// Every match of every patch must fit into the session, so that the kext is never left partly patched.
+	if (patch.count == 0 || patch.count > PatchSession::MaxWrites - patchWrites ||
+		patch.count > (PatchSession::MaxBytes - patchWriteBytes) / patch.size) {
+		SYSLOG("route", "lookup patch %s with %lu matches does not fit into a patch session", name, patch.count);
+		patchesDropped = true;
+		return;
+	}
+
+	auto &p = patches[patchNum++];
+	p.name = name;
+	p.count = patch.count;
+	p.off = static_cast<uint16_t>(patchBytesUsed);
+	p.size = static_cast<uint16_t>(patch.size);
+	p.optional = optional;
+	lilu_os_memcpy(&patchBytes[p.off], patch.find, patch.size);
+	lilu_os_memcpy(&patchBytes[p.off + p.size], patch.replace, patch.size);
+	patchBytesUsed += patch.size * 2;
+	patchWrites += patch.count;
+	patchWriteBytes += patch.count * patch.size;
+}
+
+/**
+ *  Check whether a match of one pattern may overlap bytes equal to another pattern
+ *
+ *  @param a      first pattern
+ *  @param aSize  first pattern size
+ *  @param b      second pattern
+ *  @param bSize  second pattern size
+ *
+ *  @return true if some placement of the patterns agrees on all the shared bytes
+ */
+static bool patternsOverlap(const uint8_t *a, size_t aSize, const uint8_t *b, size_t bSize) {
+	// b starts at a + shift, the placements share at least one byte.
+	for (ssize_t shift = 1 - static_cast<ssize_t>(bSize); shift < static_cast<ssize_t>(aSize); shift++) {
+		size_t aStart = shift > 0 ? shift : 0;
+		size_t bStart = shift > 0 ? 0 : -shift;
+		size_t len = aSize - aStart < bSize - bStart ? aSize - aStart : bSize - bStart;
+		if (!memcmp(&a[aStart], &b[bStart], len))
+			return true;
+	}
+
+	return false;
+}
+
+bool RoutePlan::patchesChained() const {
+	// Sequential lookups let a later patch match the replacement of an earlier one, and drop the later
+	// patch matches overlapping earlier writes. Neither can happen when no placements agree.
+	for (size_t i = 1; i < patchNum; i++) {
+		auto &later = patches[i];
+		for (size_t j = 0; j < i; j++) {
+			auto &earlier = patches[j];
+			if (patternsOverlap(&patchBytes[earlier.off + earlier.size], earlier.size, &patchBytes[later.off], later.size) ||
+				patternsOverlap(&patchBytes[earlier.off], earlier.size, &patchBytes[later.off], later.size))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void RoutePlan::scanPatches(PatchSession &session, size_t first, size_t last, size_t *found) {
+	static_assert(MaxPatches <= 32, "Candidate masks must fit all patches");
+	uint32_t candidates[256] {};
+	size_t pending = 0;
+	for (size_t i = first; i < last; i++) {
+		candidates[patchBytes[patches[i].off]] |= 1U << i;
+		pending++;
+	}
+
+	auto data = reinterpret_cast<uint8_t *>(address);
+	// Matches never overlap, overlapping candidates of different patches are only possible for chained plans.
+	size_t busy = 0;
+	for (size_t off = 0; off < size && pending > 0; off++) {
+		auto mask = off >= busy ? candidates[data[off]] : 0;
+		while (mask) {
+			size_t i = __builtin_ctz(mask);
+			mask &= mask - 1;
+
+			auto &p = patches[i];
+			auto find = &patchBytes[p.off];
+			if (p.size > size - off || memcmp(&data[off + 1], &find[1], p.size - 1) != 0)
+				continue;
+
+			// Cannot happen as plans are sized to the session, but never commit a partial scan.
+			if (!session.add(&data[off], &find[p.size], p.size)) {
+				pending = 0;
+				break;
+			}
+
+			busy = off + p.size;
+			if (++found[i] == p.count) {
+				candidates[find[0]] &= ~(1U << i);
+				pending--;
+			}
+			break;
+		}
+	}
+}
+
+bool RoutePlan::applyPatches() {
+	// Every pattern is looked up within the same pass, candidates are prefiltered by their first byte.
+	WEG_TRACE_SCOPE(LookupPatch, static_cast<uint32_t>(patchNum));
+
+	size_t found[MaxPatches] {};
+	bool committed = true;
+	if (patchesChained()) {
+		// Later patches must see the output of the earlier ones, so each of them gets its own pass and session.
+		DBGLOG("route", "lookup patches of kext %lu may overlap, applying them sequentially", index);
+		for (size_t i = 0; i < patchNum; i++) {
+			PatchSession session;
+			scanPatches(session, i, i + 1, found);
+			committed = session.commit() && committed;
+		}
+	} else {
+		PatchSession session;
+		scanPatches(session, 0, patchNum, found);
+		committed = session.commit();
+	}
+
+	bool result = true;
+	for (size_t i = 0; i < patchNum; i++) {
+		if (found[i] == 0 && !patches[i].optional) {
+			SYSLOG("route", "failed to find lookup patch %s in kext %lu", patches[i].name, index);
+			result = false;
+		} else {
+			DBGLOG("route", "found lookup patch %s %lu times in kext %lu", patches[i].name, found[i], index);
+		}
+	}
+
+	if (!committed) {
+		SYSLOG("route", "failed to apply %lu lookup patches to kext %lu", patchNum, index);
+		result = false;
+	}
+
+	patchNum = 0;
+	patchBytesUsed = 0;
+	patchWrites = 0;
+	patchWriteBytes = 0;
+	return result;
+}
+
+mach_vm_address_t RoutePlan::solveSymbol(KernelPatcher &patcher, const char *symbol) {
+	auto value = SymbolCache::find(address, size, symbol);
+	if (value)
+		return value;
+
+	value = WEG_TRACE_CALL(SolveSymbol, patcher.solveSymbol(index, symbol, address, size));
+	if (value)
+		SymbolCache::store(address, size, symbol, value);
+	return value;
+}
+
+bool RoutePlan::routeSeparately(KernelPatcher &patcher, const mach_vm_address_t *previous) {
+	bool result = true;
+	for (size_t i = 0; i < num; i++) {
+		auto &request = slots[i].request;
+		// Requests without an original cannot be told routed, so they are only retried when never solved.
+		if (request.org ? *request.org != previous[i] : request.from != 0)
+			continue;
+
+		if (patcher.routeMultiple(index, &request, 1, address, size)) {
+			DBGLOG("route", "applied route %s to kext %lu separately", request.symbol, index);
+		} else {
+			SYSLOG("route", "failed to apply route %s to kext %lu code %d", request.symbol, index, patcher.getError());
+			result = false;
+		}
+		patcher.clearError();
+	}
+
+	return result;
+}
+
+bool RoutePlan::apply(KernelPatcher &patcher) {
+	// Cached symbols are verified against the image, so they are solved before any lookup patch touches it.
+	if (num > 0 && SymbolCache::enabled()) {
+		for (size_t i = 0; i < num; i++) {
+			auto &request = slots[i].request;
+			if (!request.from)
+				request.from = solveSymbol(patcher, request.symbol);
+		}
+		patcher.clearError();
+	}
+
+	bool result = (patchNum == 0 || applyPatches()) && !patchesDropped;
+	patchesDropped = false;
+
+	if (num > 0) {
+		// The whole batch shares one symbol solving pass and trampoline allocation.
+		// The argument lets the trace tell how many separate routeMultiple calls were saved.
+		// Requests solved through the symbol cache are passed with their addresses, the rest are solved here.
+		WEG_TRACE_SCOPE(RoutePlan, static_cast<uint32_t>(num));
+
+		// Originals are only written for routed requests, which tells them apart should the batch fail.
+		// They are not cleared, as the same storage may already serve a route of another kext.
+		mach_vm_address_t previous[MaxRequests];
+		for (size_t i = 0; i < num; i++)
+			previous[i] = slots[i].request.org ? *slots[i].request.org : 0;
+
+		if (patcher.routeMultiple(index, &slots[0].request, num, address, size)) {
+			DBGLOG("route", "applied %lu routes to kext %lu", num, index);
+		} else {
+			SYSLOG("route", "failed to apply some of %lu routes to kext %lu code %d, retrying separately", num, index, patcher.getError());
+			patcher.clearError();
+			result = routeSeparately(patcher, previous) && result;
+		}
+	}
+
+	num = 0;
+	return result;
+}
@@ -0,0 +1,235 @@
+//
+//  kern_route.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_route_hpp
+#define kern_route_hpp
+
+#include <Headers/kern_patcher.hpp>
+
+class PatchSession;
+
+/**
+ *  Per-kext route plan, collects the routes all the modules want for a kext
+ *  and resolves them with a single routeMultiple call. Should the call fail,
+ *  the requests left unrouted are retried one by one, so that a missing symbol
+ *  does not disable unrelated routes. Lookup patches for the
+ *  same kext are collected as well and applied in a single pass over the kext.
+ *  Patches that might match or overlap the output of an earlier patch are applied
+ *  in sequential passes instead, so they keep the meaning of separate lookups.
+ *  With the symbol cache enabled route symbols are looked up in the cache first.
+ */
+class RoutePlan {
+public:
+	/**
+	 *  Maximum amount of routes per kext
+	 */
+	static constexpr size_t MaxRequests {16};
+
+	/**
+	 *  Maximum amount of lookup patches per kext
+	 */
+	static constexpr size_t MaxPatches {16};
+
+	/**
+	 *  Maximum total size of lookup patch find and replace bytes per kext
+	 */
+	static constexpr size_t MaxPatchBytes {256};
+
+	/**
+	 *  Create an empty plan for a loaded kext
+	 *
+	 *  @param index    kinfo handle
+	 *  @param address  kinfo load address
+	 *  @param size     kinfo memory size
+	 */
+	RoutePlan(size_t index, mach_vm_address_t address, size_t size) : index(index), address(address), size(size) {}
+
+	RoutePlan(const RoutePlan &) = delete;
+	RoutePlan &operator=(const RoutePlan &) = delete;
+
+	/**
+	 *  Schedule a route
+	 *
+	 *  @param symbol   symbol to route
+	 *  @param wrapper  wrapper function
+	 *  @param org      original function storage, only written once the plan is applied
+	 */
+	template <typename T, typename O>
+	void add(const char *symbol, T wrapper, O &org) {
+		add(KernelPatcher::RouteRequest(symbol, wrapper, org));
+	}
+
+	/**
+	 *  Schedule a list of routes
+	 *
+	 *  @param requests  route requests
+	 */
+	template <size_t N>
+	void add(KernelPatcher::RouteRequest (&requests)[N]) {
+		for (size_t i = 0; i < N; i++)
+			add(requests[i]);
+	}
+
+	/**
+	 *  Schedule a route request
+	 *
+	 *  @param request  route request
+	 */
+	void add(const KernelPatcher::RouteRequest &request);
+
+	/**
+	 *  Schedule a lookup patch, find and replace bytes are copied
+	 *
+	 *  @param patch     lookup patch, kext field is ignored, count must fit into one patch session with the other patches
+	 *  @param name      patch name for diagnostics
+	 *  @param optional  missing patch is expected on some systems and is not reported
+	 */
+	void add(const KernelPatcher::LookupPatch &patch, const char *name, bool optional=false);
+
+	/**
+	 *  Solve a kext symbol, consulting the symbol cache first
+	 *
+	 *  @param patcher  KernelPatcher instance
+	 *  @param symbol   symbol to solve
+	 *
+	 *  @return symbol address or 0
+	 */
+	mach_vm_address_t solveSymbol(KernelPatcher &patcher, const char *symbol);
+
+	/**
+	 *  Solve a kext symbol, consulting the symbol cache first
+	 *
+	 *  @param patcher  KernelPatcher instance
+	 *  @param symbol   symbol to solve
+	 *
+	 *  @return typed symbol address or nullptr
+	 */
+	template <typename T>
+	T solveSymbol(KernelPatcher &patcher, const char *symbol) {
+		return reinterpret_cast<T>(solveSymbol(patcher, symbol));
+	}
+
+	/**
+	 *  Apply all the scheduled lookup patches and then route all the scheduled requests at once
+	 *
+	 *  @param patcher  KernelPatcher instance
+	 *
+	 *  @return true if all the patches and routes were applied
+	 */
+	bool apply(KernelPatcher &patcher);
+
+	/**
+	 *  Obtain the amount of scheduled routes
+	 *
+	 *  @return route count
+	 */
+	size_t count() const {
+		return num;
+	}
+
+private:
+	/**
+	 *  RouteRequest has no default constructor, so the storage is left uninitialised
+	 */
+	union Slot {
+		Slot() {}
+		KernelPatcher::RouteRequest request;
+	};
+
+	static_assert(sizeof(Slot) == sizeof(KernelPatcher::RouteRequest), "Slots must form a request array");
+
+	/**
+	 *  Scheduled routes
+	 */
+	Slot slots[MaxRequests];
+
+	/**
+	 *  Amount of scheduled routes
+	 */
+	size_t num {0};
+
+	/**
+	 *  Scheduled lookup patch, find and replace bytes follow each other in patchBytes
+	 */
+	struct Patch {
+		const char *name;
+		size_t count;
+		uint16_t off;
+		uint16_t size;
+		bool optional;
+	};
+
+	/**
+	 *  Scheduled lookup patches
+	 */
+	Patch patches[MaxPatches] {};
+
+	/**
+	 *  Lookup patch find and replace bytes
+	 */
+	uint8_t patchBytes[MaxPatchBytes] {};
+
+	/**
+	 *  Amount of scheduled lookup patches and used patch bytes
+	 */
+	size_t patchNum {0};
+	size_t patchBytesUsed {0};
+
+	/**
+	 *  Maximum amount of writes and written bytes of the scheduled lookup patches
+	 */
+	size_t patchWrites {0};
+	size_t patchWriteBytes {0};
+
+	/**
+	 *  Some lookup patch could not be scheduled
+	 */
+	bool patchesDropped {false};
+
+	/**
+	 *  Check whether a scheduled lookup patch may depend on the output of an earlier one
+	 *
+	 *  @return true if the patches must be applied sequentially
+	 */
+	bool patchesChained() const;
+
+	/**
+	 *  Look up a range of the scheduled lookup patches in a single pass
+	 *
+	 *  @param session  session to schedule the writes in
+	 *  @param first    first patch
+	 *  @param last     patch after the last one
+	 *  @param found    per-patch match counters
+	 */
+	void scanPatches(PatchSession &session, size_t first, size_t last, size_t *found);
+
+	/**
+	 *  Apply all the scheduled lookup patches in a single pass, or in sequential passes for chained patches
+	 *
+	 *  @return true if all the patches were found and applied
+	 */
+	bool applyPatches();
+
+	/**
+	 *  Route the scheduled requests left unrouted by a failed batch one by one
+	 *
+	 *  @param patcher   KernelPatcher instance
+	 *  @param previous  original function storage values prior to the batch
+	 *
+	 *  @return true if all the retried requests were routed
+	 */
+	bool routeSeparately(KernelPatcher &patcher, const mach_vm_address_t *previous);
+
+	/**
+	 *  Planned kext
+	 */
+	size_t index;
+	mach_vm_address_t address;
+	size_t size;
+};
+
+#endif /* kern_route_hpp */
@@ -0,0 +1,92 @@
+//
+//  kern_session.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_session.hpp"
+
+#include <Headers/kern_mach.hpp>
+#include <Headers/kern_patcher.hpp>
+
+bool PatchSession::add(void *dst, const void *src, size_t size) {
+	if (committed) {
+		SYSLOG("session", "cannot add writes to a committed session");
+		return false;
+	}
+
+	if (!dst || !src || size == 0) {
+		SYSLOG("session", "invalid write to %p of %lu bytes", dst, size);
+		return false;
+	}
+
+	if (num >= MaxWrites || size > MaxBytes - used) {
+		SYSLOG("session", "session overflow on write to %p of %lu bytes", dst, size);
+		overflow = true;
+		return false;
+	}
+
+	auto &w = writes[num++];
+	w.dst = static_cast<uint8_t *>(dst);
+	w.off = static_cast<uint16_t>(used);
+	w.size = static_cast<uint16_t>(size);
+	lilu_os_memcpy(&replacement[used], src, size);
+	used += size;
+	return true;
+}
+
+bool PatchSession::commit() {
+	// A partially scheduled batch would leave the kext half patched, so nothing is written.
+	if (overflow) {
+		SYSLOG("session", "refusing to commit an overflowed session of %lu writes", num);
+		return false;
+	}
+
+	if (committed || num == 0)
+		return true;
+
+	// Overlapping writes are applied in order, so the undo log is snapshotted as each write goes.
+	if (!write(false))
+		return false;
+
+	DBGLOG("session", "committed %lu writes of %lu bytes", num, used);
+	committed = true;
+	return true;
+}
+
+bool PatchSession::revert() {
+	if (!committed)
+		return false;
+
+	if (!write(true))
+		return false;
+
+	DBGLOG("session", "reverted %lu writes of %lu bytes", num, used);
+	committed = false;
+	return true;
+}
+
+bool PatchSession::write(bool restore) {
+	// One window for the whole batch, instead of toggling protection on every write.
+	if (MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS) {
+		SYSLOG("session", "failed to enable kernel writing for %lu writes", num);
+		return false;
+	}
+
+	if (restore) {
+		for (size_t i = num; i > 0; i--) {
+			auto &w = writes[i - 1];
+			lilu_os_memcpy(w.dst, &original[w.off], w.size);
+		}
+	} else {
+		for (size_t i = 0; i < num; i++) {
+			auto &w = writes[i];
+			lilu_os_memcpy(&original[w.off], w.dst, w.size);
+			lilu_os_memcpy(w.dst, &replacement[w.off], w.size);
+		}
+	}
+
+	MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
+	return true;
+}
@@ -0,0 +1,141 @@
+//
+//  kern_session.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_session_hpp
+#define kern_session_hpp
+
+#include <Headers/kern_util.hpp>
+
+/**
+ *  Per-kext patch session, queues in-place writes to write-protected kext memory
+ *  and commits them within a single kernel writing window. Original bytes are kept,
+ *  so that the committed writes could be reverted.
+ */
+class PatchSession {
+public:
+	/**
+	 *  Maximum amount of writes per session
+	 */
+	static constexpr size_t MaxWrites {16};
+
+	/**
+	 *  Maximum total size of written bytes per session
+	 */
+	static constexpr size_t MaxBytes {128};
+
+	PatchSession() = default;
+	PatchSession(const PatchSession &) = delete;
+	PatchSession &operator=(const PatchSession &) = delete;
+
+	/**
+	 *  Schedule a write, the bytes are copied, so the source may be reused right away
+	 *
+	 *  @param dst   destination address
+	 *  @param src   source bytes
+	 *  @param size  write size
+	 *
+	 *  @return true if the write was scheduled
+	 */
+	bool add(void *dst, const void *src, size_t size);
+
+	/**
+	 *  Schedule a write of a typed value
+	 *
+	 *  @param dst    destination
+	 *  @param value  value to write
+	 *
+	 *  @return true if the write was scheduled
+	 */
+	template <typename T>
+	bool add(T *dst, const T &value) {
+		return add(static_cast<void *>(dst), &value, sizeof(T));
+	}
+
+	/**
+	 *  Apply all the scheduled writes at once, nothing is written if some write could not be scheduled
+	 *
+	 *  @return true if all the writes were applied
+	 */
+	bool commit();
+
+	/**
+	 *  Restore the original bytes of the committed writes
+	 *
+	 *  @return true if the writes were reverted
+	 */
+	bool revert();
+
+	/**
+	 *  Obtain the amount of scheduled or committed writes
+	 *
+	 *  @return write count
+	 */
+	size_t count() const {
+		return num;
+	}
+
+	/**
+	 *  Check whether some write did not fit into the session
+	 *
+	 *  @return true on overflow
+	 */
+	bool overflowed() const {
+		return overflow;
+	}
+
+private:
+	/**
+	 *  Scheduled write, data offsets point to replacement and original storage
+	 */
+	struct Write {
+		uint8_t *dst;
+		uint16_t off;
+		uint16_t size;
+	};
+
+	/**
+	 *  Copy the data within a single kernel writing window
+	 *
+	 *  @param restore  write original bytes in reverse order instead of replacements
+	 *
+	 *  @return true on success
+	 */
+	bool write(bool restore);
+
+	/**
+	 *  Scheduled writes
+	 */
+	Write writes[MaxWrites] {};
+
+	/**
+	 *  Replacement bytes
+	 */
+	uint8_t replacement[MaxBytes] {};
+
+	/**
+	 *  Original bytes (undo log), valid once committed
+	 */
+	uint8_t original[MaxBytes] {};
+
+	/**
+	 *  Amount of scheduled writes and used bytes
+	 */
+	size_t num {0};
+	size_t used {0};
+
+	/**
+	 *  Writes were committed and not reverted
+	 */
+	bool committed {false};
+
+	/**
+	 *  Some write could not be scheduled
+	 */
+	bool overflow {false};
+};
+
+#endif /* kern_session_hpp */
@@ -6,6 +6,7 @@
 //
 
 #include "kern_shiki.hpp"
+#include "kern_opts.hpp"
 
 #include <Library/LegacyIOService.h>
 #include <Headers/plugin_start.hpp>
@@ -30,8 +31,8 @@ void SHIKI::init() {
 
 	cpuGeneration = CPUInfo::getGeneration();
 
-	int bootarg {0};
-	if (PE_parse_boot_argn("shikigva", &bootarg, sizeof(bootarg))) {
+	if (Options::has(Options::Id::ShikiGva)) {
+		int bootarg = Options::integer(Options::Id::ShikiGva);
 		forceOnlineRenderer     = bootarg & ForceOnlineRenderer;
 		allowNonBGRA            = bootarg & AllowNonBGRA;
 		forceCompatibleRenderer = bootarg & ForceCompatibleRenderer;
@@ -39,7 +40,7 @@ void SHIKI::init() {
 		replaceBoardID          = bootarg & ReplaceBoardID;
 		unlockFP10Streaming     = bootarg & UnlockFP10Streaming;
 	} else {
-		if (PE_parse_boot_argn("-shikigva", &bootarg, sizeof(bootarg))) {
+		if (Options::enabled(Options::Id::ShikiGvaLegacy)) {
 			SYSLOG("shiki", "-shikigva is deprecated use shikigva %d bit instead", ForceOnlineRenderer);
 			forceOnlineRenderer = true;
 		}
@@ -62,7 +63,7 @@ void SHIKI::init() {
 		DBGLOG("shiki", "will autodetect autodetect GPU %d whitelist %d", autodetectGFX, addExecutableWhitelist);
 	}
 
-	if (PE_parse_boot_argn("-shikifps", &bootarg, sizeof(bootarg))) {
+	if (Options::enabled(Options::Id::ShikiFps)) {
 		SYSLOG("shiki", "-shikifps is deprecated use shikigva %d bit instead", UnlockFP10Streaming);
 		unlockFP10Streaming = true;
 	}
@@ -87,7 +88,10 @@ void SHIKI::init() {
 
 	// Custom board-id may be overridden by a boot-arg
 	if (replaceBoardID) {
-		if (!PE_parse_boot_argn("shiki-id", customBoardID, sizeof(customBoardID)))
+		auto boardId = Options::string(Options::Id::ShikiBoardId);
+		if (boardId)
+			snprintf(customBoardID, sizeof(customBoardID), "%s", boardId);
+		else
 			snprintf(customBoardID, sizeof(customBoardID), "Mac-27ADBB7B4CEE8E61"); // iMac14,2
 		DBGLOG("shiki", "requesting %s board-id for gva", customBoardID);
 	} else {
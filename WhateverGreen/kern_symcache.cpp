@@ -0,0 +1,442 @@
+//
+//  kern_symcache.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_symcache.hpp"
+#include "kern_opts.hpp"
+
+#include <Library/LegacyIOService.h>
+#include <IOKit/IODeviceTreeSupport.h>
+#include <IOKit/IOLocks.h>
+#include <kern/clock.h>
+#include <kern/thread_call.h>
+#include <mach-o/loader.h>
+
+namespace {
+	/**
+	 *  NVRAM variable name
+	 */
+	const char *NvramKey = "weg-symbol-cache";
+
+	/**
+	 *  Amount of image bytes at the symbol covered by the check
+	 */
+	constexpr size_t CheckBytes {16};
+
+	/**
+	 *  Delay in milliseconds between the last processed kext and the cache write
+	 */
+	constexpr uint32_t FlushDelay {5000};
+
+	static_assert(SymbolCache::MaxKexts <= 32, "Used kext mask must fit all kexts");
+
+	/**
+	 *  Cache contents
+	 */
+	struct {
+		SymbolCache::Header header;
+		SymbolCache::Kext kexts[SymbolCache::MaxKexts];
+		SymbolCache::Symbol symbols[SymbolCache::MaxSymbols];
+	} cache;
+
+	/**
+	 *  Cache state
+	 */
+	bool loaded, dirty;
+
+	/**
+	 *  Kexts looked up during this boot, they are never evicted
+	 */
+	uint32_t usedKexts;
+
+	/**
+	 *  Cache lock, the cache is disabled when it is missing
+	 */
+	IOLock *cacheLock;
+
+	/**
+	 *  Deferred cache write
+	 */
+	thread_call_t flushCall;
+
+	/**
+	 *  Last looked up image and its kext slot, -1 if it is not cached
+	 */
+	mach_vm_address_t lastAddress;
+	size_t lastSize;
+	int lastKext {-1};
+
+	/**
+	 *  Continue FNV-1a 64-bit hash over some bytes
+	 *
+	 *  @param hash  current hash
+	 *  @param data  hashed bytes
+	 *  @param size  amount of bytes
+	 *
+	 *  @return updated hash
+	 */
+	uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+		auto bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+		return hash;
+	}
+
+	/**
+	 *  FNV-1a 64-bit hash offset basis
+	 */
+	constexpr uint64_t HashBasis {0xCBF29CE484222325ULL};
+
+	/**
+	 *  Symbol name hash
+	 *
+	 *  @param symbol  symbol name
+	 *  @param length  symbol name length, saturated at 255
+	 *
+	 *  @return hash
+	 */
+	uint64_t hashSymbol(const char *symbol, uint8_t &length) {
+		size_t len = strlen(symbol);
+		length = static_cast<uint8_t>(len < UINT8_MAX ? len : UINT8_MAX);
+		return hashBytes(HashBasis, symbol, len);
+	}
+
+	/**
+	 *  Compute symbol check, which only matches for the same kext, symbol and offset
+	 *
+	 *  @param address  kext load address
+	 *  @param size     kext memory size
+	 *  @param kext     kext slot
+	 *  @param hash     symbol name hash
+	 *  @param offset   symbol offset
+	 *  @param check    computed check
+	 *
+	 *  @return true if the checked bytes are within the image
+	 */
+	bool computeCheck(mach_vm_address_t address, size_t size, int kext, uint64_t hash, uint32_t offset, uint64_t &check) {
+		if (size < CheckBytes || offset > size - CheckBytes)
+			return false;
+		check = hashBytes(HashBasis, cache.kexts[kext].uuid, sizeof(cache.kexts[kext].uuid));
+		check = hashBytes(check, &hash, sizeof(hash));
+		check = hashBytes(check, &offset, sizeof(offset));
+		check = hashBytes(check, reinterpret_cast<const void *>(address + offset), CheckBytes);
+		return true;
+	}
+
+	/**
+	 *  Obtain image LC_UUID
+	 *
+	 *  @param address  kext load address
+	 *  @param size     kext memory size
+	 *  @param uuid     image uuid
+	 *
+	 *  @return true on success
+	 */
+	bool getImageUUID(mach_vm_address_t address, size_t size, uint8_t (&uuid)[16]) {
+		auto header = reinterpret_cast<const mach_header_64 *>(address);
+		if (size < sizeof(mach_header_64) || header->magic != MH_MAGIC_64 || header->sizeofcmds > size - sizeof(mach_header_64))
+			return false;
+
+		auto cmd = reinterpret_cast<const uint8_t *>(header + 1);
+		auto end = cmd + header->sizeofcmds;
+		for (uint32_t i = 0; i < header->ncmds && end - cmd >= static_cast<ptrdiff_t>(sizeof(load_command)); i++) {
+			auto lc = reinterpret_cast<const load_command *>(cmd);
+			if (lc->cmdsize < sizeof(load_command) || lc->cmdsize > static_cast<size_t>(end - cmd))
+				return false;
+			if (lc->cmd == LC_UUID && lc->cmdsize >= sizeof(uuid_command)) {
+				lilu_os_memcpy(uuid, reinterpret_cast<const uuid_command *>(lc)->uuid, sizeof(uuid));
+				return true;
+			}
+			cmd += lc->cmdsize;
+		}
+
+		return false;
+	}
+
+	/**
+	 *  Load the cache from NVRAM once, invalid contents are dropped
+	 */
+	void load() {
+		loaded = true;
+		cache.header.magic = SymbolCache::Magic;
+		cache.header.version = SymbolCache::Version;
+
+		auto options = IORegistryEntry::fromPath("/options", gIODTPlane);
+		if (!options) {
+			DBGLOG("symcache", "nvram is not available");
+			return;
+		}
+
+		auto data = OSDynamicCast(OSData, options->getProperty(NvramKey));
+		if (data && data->getLength() >= sizeof(SymbolCache::Header)) {
+			auto header = static_cast<const SymbolCache::Header *>(data->getBytesNoCopy());
+			size_t length = sizeof(SymbolCache::Header) + header->kextCount * sizeof(SymbolCache::Kext) + header->symbolCount * sizeof(SymbolCache::Symbol);
+			if (header->magic == SymbolCache::Magic && header->version == SymbolCache::Version && header->kextCount <= SymbolCache::MaxKexts &&
+				header->symbolCount <= SymbolCache::MaxSymbols && data->getLength() == length) {
+				auto kexts = reinterpret_cast<const SymbolCache::Kext *>(header + 1);
+				auto symbols = reinterpret_cast<const SymbolCache::Symbol *>(kexts + header->kextCount);
+				cache.header = *header;
+				lilu_os_memcpy(cache.kexts, kexts, header->kextCount * sizeof(SymbolCache::Kext));
+				lilu_os_memcpy(cache.symbols, symbols, header->symbolCount * sizeof(SymbolCache::Symbol));
+				// Kext references are validated once, so that lookups could trust them.
+				for (size_t i = 0; i < cache.header.symbolCount; i++) {
+					if (cache.symbols[i].kext >= cache.header.kextCount) {
+						cache.header.kextCount = cache.header.symbolCount = 0;
+						break;
+					}
+				}
+				DBGLOG("symcache", "loaded %u kexts and %u symbols", cache.header.kextCount, cache.header.symbolCount);
+			} else {
+				SYSLOG("symcache", "dropping invalid cache of %u bytes", data->getLength());
+				dirty = true;
+			}
+		}
+
+		options->release();
+	}
+
+	/**
+	 *  Remove a cached symbol
+	 *
+	 *  @param index  symbol slot
+	 */
+	void removeSymbol(size_t index) {
+		cache.symbols[index] = cache.symbols[--cache.header.symbolCount];
+		dirty = true;
+	}
+
+	/**
+	 *  Remove a cached kext with its symbols, the last kext takes its slot
+	 *
+	 *  @param index  kext slot
+	 */
+	void removeKext(size_t index) {
+		for (size_t i = cache.header.symbolCount; i > 0; i--) {
+			if (cache.symbols[i - 1].kext == index)
+				removeSymbol(i - 1);
+		}
+
+		size_t last = --cache.header.kextCount;
+		if (index != last) {
+			cache.kexts[index] = cache.kexts[last];
+			for (size_t i = 0; i < cache.header.symbolCount; i++) {
+				if (cache.symbols[i].kext == last)
+					cache.symbols[i].kext = static_cast<uint8_t>(index);
+			}
+			if (usedKexts & (1U << last))
+				usedKexts |= 1U << index;
+		}
+
+		usedKexts &= ~(1U << last);
+		lastAddress = 0;
+		lastSize = 0;
+		lastKext = -1;
+		dirty = true;
+	}
+
+	/**
+	 *  Find the cache slot of a kext image, cacheLock must be held
+	 *
+	 *  @param address  kext load address
+	 *  @param size     kext memory size
+	 *  @param create   allocate a slot if none exists
+	 *
+	 *  @return kext slot or -1
+	 */
+	int findKext(mach_vm_address_t address, size_t size, bool create) {
+		if (!loaded)
+			load();
+
+		if (address == lastAddress && size == lastSize && (lastKext >= 0 || !create))
+			return lastKext;
+
+		lastAddress = address;
+		lastSize = size;
+		lastKext = -1;
+
+		SymbolCache::Kext kext {};
+		kext.size = static_cast<uint32_t>(size);
+		if (!getImageUUID(address, size, kext.uuid)) {
+			DBGLOG("symcache", "no uuid in image of %lu bytes", size);
+			return -1;
+		}
+
+		for (size_t i = 0; i < cache.header.kextCount; i++) {
+			if (cache.kexts[i].size == kext.size && !memcmp(cache.kexts[i].uuid, kext.uuid, sizeof(kext.uuid))) {
+				usedKexts |= 1U << i;
+				lastKext = static_cast<int>(i);
+				return lastKext;
+			}
+		}
+
+		if (!create)
+			return -1;
+
+		// Kexts from older builds or not loaded on this boot make room one at a time.
+		if (cache.header.kextCount >= SymbolCache::MaxKexts) {
+			size_t victim = 0;
+			while (victim < cache.header.kextCount && (usedKexts & (1U << victim)))
+				victim++;
+			if (victim == cache.header.kextCount) {
+				DBGLOG("symcache", "kext table is full of kexts used on this boot");
+				return -1;
+			}
+
+			DBGLOG("symcache", "evicting kext %lu", victim);
+			removeKext(victim);
+			lastAddress = address;
+			lastSize = size;
+		}
+
+		lastKext = cache.header.kextCount++;
+		cache.kexts[lastKext] = kext;
+		usedKexts |= 1U << lastKext;
+		dirty = true;
+		return lastKext;
+	}
+}
+
+void SymbolCache::init() {
+	if (!Options::enabled(Options::Id::SymbolCache))
+		return;
+
+	cacheLock = IOLockAlloc();
+	flushCall = thread_call_allocate([](thread_call_param_t, thread_call_param_t) {
+		flush();
+	}, nullptr);
+
+	if (!cacheLock || !flushCall) {
+		SYSLOG("symcache", "failed to allocate cache resources, the cache is disabled");
+		deinit();
+	}
+}
+
+void SymbolCache::deinit() {
+	if (flushCall) {
+		thread_call_cancel(flushCall);
+		thread_call_free(flushCall);
+		flushCall = nullptr;
+	}
+
+	if (cacheLock) {
+		IOLockFree(cacheLock);
+		cacheLock = nullptr;
+	}
+}
+
+bool SymbolCache::enabled() {
+	return cacheLock != nullptr;
+}
+
+mach_vm_address_t SymbolCache::find(mach_vm_address_t address, size_t size, const char *symbol) {
+	if (!enabled())
+		return 0;
+
+	mach_vm_address_t result = 0;
+	IOLockLock(cacheLock);
+	int kext = findKext(address, size, false);
+	if (kext >= 0) {
+		uint8_t length;
+		uint64_t hash = hashSymbol(symbol, length);
+		for (size_t i = 0; i < cache.header.symbolCount; i++) {
+			auto &sym = cache.symbols[i];
+			if (sym.kext != kext || sym.hash != hash || sym.length != length)
+				continue;
+
+			uint64_t check;
+			if (computeCheck(address, size, kext, hash, sym.offset, check) && check == sym.check) {
+				DBGLOG("symcache", "found %s at %X", symbol, sym.offset);
+				result = address + sym.offset;
+			} else {
+				SYSLOG("symcache", "dropping stale %s at %X", symbol, sym.offset);
+				removeSymbol(i);
+			}
+			break;
+		}
+	}
+	IOLockUnlock(cacheLock);
+
+	return result;
+}
+
+void SymbolCache::store(mach_vm_address_t address, size_t size, const char *symbol, mach_vm_address_t value) {
+	if (!enabled() || value < address)
+		return;
+
+	uint32_t offset = static_cast<uint32_t>(value - address);
+	if (value - address != offset)
+		return;
+
+	IOLockLock(cacheLock);
+	int kext = findKext(address, size, true);
+	uint8_t length;
+	uint64_t hash = hashSymbol(symbol, length);
+	uint64_t check;
+	if (kext >= 0 && computeCheck(address, size, kext, hash, offset, check)) {
+		for (size_t i = 0; i < cache.header.symbolCount; i++) {
+			if (cache.symbols[i].kext == kext && cache.symbols[i].hash == hash && cache.symbols[i].length == length) {
+				removeSymbol(i);
+				break;
+			}
+		}
+
+		if (cache.header.symbolCount < MaxSymbols) {
+			auto &sym = cache.symbols[cache.header.symbolCount++];
+			sym = {};
+			sym.hash = hash;
+			sym.check = check;
+			sym.offset = offset;
+			sym.kext = static_cast<uint8_t>(kext);
+			sym.length = length;
+			dirty = true;
+		} else {
+			DBGLOG("symcache", "symbol table is full, not caching %s", symbol);
+		}
+	}
+	IOLockUnlock(cacheLock);
+}
+
+void SymbolCache::flush() {
+	if (!enabled())
+		return;
+
+	IOLockLock(cacheLock);
+	auto options = dirty ? IORegistryEntry::fromPath("/options", gIODTPlane) : nullptr;
+	if (options) {
+		// Only used prefixes of the tables are stored to save NVRAM space.
+		unsigned kextSize = static_cast<unsigned>(cache.header.kextCount * sizeof(Kext));
+		unsigned symbolSize = static_cast<unsigned>(cache.header.symbolCount * sizeof(Symbol));
+		auto data = OSData::withCapacity(sizeof(Header) + kextSize + symbolSize);
+		if (data) {
+			data->appendBytes(&cache.header, sizeof(Header));
+			data->appendBytes(cache.kexts, kextSize);
+			data->appendBytes(cache.symbols, symbolSize);
+
+			if (options->setProperty(NvramKey, data)) {
+				DBGLOG("symcache", "stored %u kexts and %u symbols", cache.header.kextCount, cache.header.symbolCount);
+				dirty = false;
+			} else {
+				SYSLOG("symcache", "failed to store the cache in nvram");
+			}
+			data->release();
+		}
+
+		options->release();
+	} else if (dirty) {
+		DBGLOG("symcache", "nvram is not available for flushing");
+	}
+	IOLockUnlock(cacheLock);
+}
+
+void SymbolCache::scheduleFlush() {
+	if (!flushCall || !dirty)
+		return;
+
+	// Every processed kext pushes the write further, so it happens once kext loading settles.
+	uint64_t deadline;
+	clock_interval_to_deadline(FlushDelay, kMillisecondScale, &deadline);
+	thread_call_enter_delayed(flushCall, deadline);
+}
@@ -0,0 +1,117 @@
+//
+//  kern_symcache.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_symcache_hpp
+#define kern_symcache_hpp
+
+#include <Headers/kern_util.hpp>
+#include <mach/vm_types.h>
+
+// Resolved kext symbol offsets persisted in NVRAM across boots.
+// Kexts are identified by their LC_UUID and image size, every hit is verified against the loaded image.
+// The cache is written once kext loading is over rather than after every kext.
+namespace SymbolCache {
+	/**
+	 *  Cache magic ('WEGS')
+	 */
+	static constexpr uint32_t Magic {0x53474557};
+
+	/**
+	 *  Cache format version
+	 */
+	static constexpr uint16_t Version {2};
+
+	/**
+	 *  Maximum amount of cached kexts and symbols, a Radeon system alone solves symbols in up to 13 kexts
+	 */
+	static constexpr size_t MaxKexts {24};
+	static constexpr size_t MaxSymbols {64};
+
+	/**
+	 *  Cache header, followed by kextCount kexts and symbolCount symbols
+	 */
+	struct Header {
+		uint32_t magic;
+		uint16_t version;
+		uint8_t kextCount;
+		uint8_t symbolCount;
+	};
+
+	/**
+	 *  Cached kext identity
+	 */
+	struct Kext {
+		uint8_t uuid[16];
+		uint32_t size;
+		uint32_t reserved;
+	};
+
+	/**
+	 *  Cached symbol, check binds the entry to its kext, name hash, offset and
+	 *  the image bytes at the symbol prior to any patching
+	 */
+	struct Symbol {
+		uint64_t hash;
+		uint64_t check;
+		uint32_t offset;
+		uint8_t kext;
+		uint8_t length;
+		uint8_t reserved[2];
+	};
+
+	static_assert(sizeof(Header) == 8 && sizeof(Kext) == 24 && sizeof(Symbol) == 24, "Invalid symbol cache format");
+
+	/**
+	 *  Allocate cache resources when the cache is enabled (-wegsymcache)
+	 */
+	void init();
+
+	/**
+	 *  Free cache resources
+	 */
+	void deinit();
+
+	/**
+	 *  Check whether the cache is enabled (-wegsymcache)
+	 *
+	 *  @return true if enabled
+	 */
+	bool enabled();
+
+	/**
+	 *  Find a cached symbol
+	 *
+	 *  @param address  kext load address
+	 *  @param size     kext memory size
+	 *  @param symbol   symbol name
+	 *
+	 *  @return symbol address or 0
+	 */
+	mach_vm_address_t find(mach_vm_address_t address, size_t size, const char *symbol);
+
+	/**
+	 *  Cache a resolved symbol, must be called before the symbol memory is patched
+	 *
+	 *  @param address  kext load address
+	 *  @param size     kext memory size
+	 *  @param symbol   symbol name
+	 *  @param value    symbol address
+	 */
+	void store(mach_vm_address_t address, size_t size, const char *symbol, mach_vm_address_t value);
+
+	/**
+	 *  Persist the cache in NVRAM if it changed
+	 */
+	void flush();
+
+	/**
+	 *  Persist the cache once no more kexts were processed for a while
+	 */
+	void scheduleFlush();
+}
+
+#endif /* kern_symcache_hpp */
@@ -0,0 +1,137 @@
+//
+//  kern_trace.cpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#include "kern_trace.hpp"
+#include "kern_opts.hpp"
+
+#include <Headers/kern_util.hpp>
+#include <Library/LegacyIOService.h>
+#include <libkern/OSAtomic.h>
+#include <kern/thread_call.h>
+
+namespace {
+	/**
+	 *  Trace buffer, the header is only filled at publishing
+	 */
+	struct {
+		BootTrace::Header header;
+		BootTrace::Record records[BootTrace::MaxRecords];
+	} traceBuffer;
+
+	/**
+	 *  Amount of reserved records, may exceed MaxRecords
+	 */
+	volatile SInt32 traceReserved;
+
+	/**
+	 *  Delay in milliseconds between the last top-level phase and publishing
+	 */
+	constexpr uint32_t PublishDelay {10000};
+
+	/**
+	 *  Maximum amount of publishing attempts while the plugin service is not available
+	 */
+	constexpr size_t MaxPublishAttempts {6};
+
+	/**
+	 *  Deferred trace publishing
+	 */
+	thread_call_t publishCall;
+	size_t publishAttempts;
+
+	/**
+	 *  Publish the trace as weg-boot-trace property of the plugin service
+	 *
+	 *  @return true on success
+	 */
+	bool publish() {
+		// The plugin service is matched on IOResources and is only available after its start.
+		auto service = IORegistryEntry::fromPath("IOService:/IOResources/" xStringify(PRODUCT_NAME));
+		if (!service) {
+			DBGLOG("trace", "plugin service is not available yet");
+			return false;
+		}
+
+		// Records being written concurrently may still be empty, decoders skip them.
+		size_t reserved = static_cast<size_t>(traceReserved);
+		size_t count = reserved < BootTrace::MaxRecords ? reserved : BootTrace::MaxRecords;
+		traceBuffer.header.magic = BootTrace::Magic;
+		traceBuffer.header.version = BootTrace::Version;
+		traceBuffer.header.count = static_cast<uint32_t>(count);
+		traceBuffer.header.dropped = static_cast<uint32_t>(reserved > BootTrace::MaxRecords ? reserved - BootTrace::MaxRecords : 0);
+
+		bool result = false;
+		auto data = OSData::withBytes(&traceBuffer, static_cast<unsigned>(sizeof(BootTrace::Header) + count * sizeof(BootTrace::Record)));
+		if (data) {
+			result = service->setProperty("weg-boot-trace", data);
+			data->release();
+		}
+
+		service->release();
+		return result;
+	}
+}
+
+bool BootTrace::active;
+
+void BootTrace::init() {
+#ifdef DEBUG
+	active = true;
+#else
+	active = Options::enabled(Options::Id::BootTrace);
+#endif
+	if (!active)
+		return;
+
+	publishCall = thread_call_allocate([](thread_call_param_t, thread_call_param_t) {
+		// The trace is published once, later phases are no longer recorded.
+		if (publish() || ++publishAttempts >= MaxPublishAttempts)
+			active = false;
+		else
+			schedulePublish();
+	}, nullptr);
+
+	if (!publishCall) {
+		SYSLOG("trace", "failed to allocate publishing call, tracing is disabled");
+		active = false;
+	}
+}
+
+void BootTrace::deinit() {
+	if (publishCall) {
+		thread_call_cancel(publishCall);
+		thread_call_free(publishCall);
+		publishCall = nullptr;
+	}
+	active = false;
+}
+
+void BootTrace::record(Phase phase, uint32_t arg, uint64_t start) {
+	uint64_t end = mach_absolute_time();
+
+	// Slots are reserved atomically, as kext loads and framebuffer init may happen concurrently.
+	SInt32 slot = OSIncrementAtomic(&traceReserved);
+	if (slot < 0 || static_cast<size_t>(slot) >= MaxRecords)
+		return;
+
+	auto &rec = traceBuffer.records[slot];
+	absolutetime_to_nanoseconds(start, &rec.start);
+	absolutetime_to_nanoseconds(end - start, &rec.duration);
+	rec.phase = static_cast<uint16_t>(phase);
+	rec.reserved = 0;
+	rec.arg = arg;
+}
+
+void BootTrace::schedulePublish() {
+	if (!publishCall || !active)
+		return;
+
+	// Every top-level phase pushes publishing further, so the trace is published once boot settles.
+	uint64_t deadline;
+	clock_interval_to_deadline(PublishDelay, kMillisecondScale, &deadline);
+	thread_call_enter_delayed(publishCall, deadline);
+}
@@ -0,0 +1,190 @@
+//
+//  kern_trace.hpp
+//  WhateverGreen
+//
+//  Copyright © 2018 vit9696. All rights reserved.
+//
+
+#ifndef kern_trace_hpp
+#define kern_trace_hpp
+
+#ifdef KERNEL
+#include <Headers/kern_util.hpp>
+#include <kern/clock.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+// Boot trace is also decoded by host tools, so the format part must stay independent of kernel headers.
+namespace BootTrace {
+	/**
+	 *  Traced boot phases
+	 */
+	enum class Phase : uint16_t {
+		Init,
+		ProcessKernel,
+		KernelIGFX,
+		KernelNGFX,
+		KernelRAD,
+		KernelSHIKI,
+		KernelCDF,
+		ProcessKext,
+		KextWEG,
+		KextIGFX,
+		KextNGFX,
+		KextRAD,
+		KextCDF,
+		RouteRequest,
+		LookupPatch,
+		SolveSymbol,
+		FramebufferInit,
+		RoutePlan,
+		Total
+	};
+
+	/**
+	 *  Obtain printable phase name
+	 *
+	 *  @param phase  phase identifier
+	 *
+	 *  @return phase name
+	 */
+	inline const char *phaseName(uint16_t phase) {
+		static const char *names[] {
+			"Init",
+			"ProcessKernel",
+			"KernelIGFX",
+			"KernelNGFX",
+			"KernelRAD",
+			"KernelSHIKI",
+			"KernelCDF",
+			"ProcessKext",
+			"KextWEG",
+			"KextIGFX",
+			"KextNGFX",
+			"KextRAD",
+			"KextCDF",
+			"RouteRequest",
+			"LookupPatch",
+			"SolveSymbol",
+			"FramebufferInit",
+			"RoutePlan"
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Phase::Total), "Invalid phase name list");
+		return phase < static_cast<uint16_t>(Phase::Total) ? names[phase] : "Unknown";
+	}
+
+	/**
+	 *  Trace magic ('WEGT')
+	 */
+	static constexpr uint32_t Magic {0x54474557};
+
+	/**
+	 *  Trace format version
+	 */
+	static constexpr uint32_t Version {1};
+
+	/**
+	 *  Maximum amount of trace records
+	 */
+	static constexpr size_t MaxRecords {512};
+
+	/**
+	 *  Trace header, followed by count records
+	 */
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;
+		uint32_t dropped;
+	};
+
+	/**
+	 *  Trace record, times are in nanoseconds since boot
+	 */
+	struct Record {
+		uint64_t start;
+		uint64_t duration;
+		uint16_t phase;
+		uint16_t reserved;
+		uint32_t arg;
+	};
+
+	static_assert(sizeof(Header) == 16 && sizeof(Record) == 24, "Invalid trace format");
+
+#ifdef KERNEL
+	/**
+	 *  Tracing is enabled, only changed by init
+	 */
+	extern bool active;
+
+	/**
+	 *  Enable tracing in debug builds or with -wegtrace boot-arg, must be called after Options::load
+	 */
+	void init();
+
+	/**
+	 *  Cancel pending trace publishing
+	 */
+	void deinit();
+
+	/**
+	 *  Append a finished phase to the trace
+	 *
+	 *  @param phase  phase identifier
+	 *  @param arg    phase argument (e.g. kext load index)
+	 *  @param start  mach_absolute_time at phase start
+	 */
+	void record(Phase phase, uint32_t arg, uint64_t start);
+
+	/**
+	 *  Publish the trace as weg-boot-trace property of the plugin service once no top-level phase ran for a while
+	 */
+	void schedulePublish();
+
+	/**
+	 *  Phase tracing scope
+	 */
+	class Scope {
+		Phase phase;
+		uint32_t arg;
+		bool update;
+		uint64_t start;
+	public:
+		/**
+		 *  Start phase tracing
+		 *
+		 *  @param phase   phase identifier
+		 *  @param arg     phase argument
+		 *  @param update  schedule trace publishing once the phase is over (for top-level phases)
+		 */
+		Scope(Phase phase, uint32_t arg=0, bool update=false) : phase(phase), arg(arg), update(update), start(active ? mach_absolute_time() : 0) {}
+
+		~Scope() {
+			if (start) {
+				record(phase, arg, start);
+				if (update)
+					schedulePublish();
+			}
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+	};
+#endif
+}
+
+#ifdef KERNEL
+/**
+ *  Trace the rest of the current scope
+ */
+#define WEG_TRACE_SCOPE(phase, ...) BootTrace::Scope bootTraceScope(BootTrace::Phase::phase, ##__VA_ARGS__)
+
+/**
+ *  Trace a single call expression, the scope temporary lives till the end of the full expression
+ */
+#define WEG_TRACE_CALL(phase, ...) (BootTrace::Scope(BootTrace::Phase::phase), __VA_ARGS__)
+#endif
+
+#endif /* kern_trace_hpp */
@@ -10,6 +10,10 @@
 #include <Headers/kern_iokit.hpp>
 #include <Headers/kern_cpu.hpp>
 #include "kern_weg.hpp"
+#include "kern_fbcopy.hpp"
+#include "kern_opts.hpp"
+#include "kern_symcache.hpp"
+#include "kern_trace.hpp"
 
 #include <IOKit/graphics/IOFramebuffer.h>
 
@@ -36,10 +40,18 @@ WEG *WEG::callbackWEG;
 void WEG::init() {
 	callbackWEG = this;
 
+	// Parse all the boot-args at once, modules only read the resulting snapshot.
+	Options::load();
+	BootTrace::init();
+
+	WEG_TRACE_SCOPE(Init);
+	SymbolCache::init();
+
 	// Background init fix is only necessary on 10.10 and newer.
 	// Former boot-arg name is igfxrst.
 	if (getKernelVersion() >= KernelVersion::Yosemite) {
-		PE_parse_boot_argn("gfxrst", &resetFramebuffer, sizeof(resetFramebuffer));
+		if (Options::has(Options::Id::GfxReset))
+			resetFramebuffer = static_cast<uint32_t>(Options::integer(Options::Id::GfxReset));
 		if (resetFramebuffer >= FB_TOTAL) {
 			SYSLOG("weg", "invalid igfxrset value %d, falling back to autodetect", resetFramebuffer);
 			resetFramebuffer = FB_DETECT;
@@ -50,8 +62,8 @@ void WEG::init() {
 
 	// Black screen fix is needed everywhere, but the form depends on the boot-arg.
 	// Former boot-arg name is ngfxpatch.
-	char agdp[128];
-	if (PE_parse_boot_argn("agdpmod", agdp, sizeof(agdp))) {
+	auto agdp = Options::string(Options::Id::GraphicsPolicyMod);
+	if (agdp) {
 		if (strstr(agdp, "detect")) {
 			graphicsDisplayPolicyMod = AGDP_DETECT;
 		} else {
@@ -96,9 +108,13 @@ void WEG::deinit() {
 	rad.deinit();
 	shiki.deinit();
 	cdf.deinit();
+	SymbolCache::deinit();
+	BootTrace::deinit();
 }
 
 void WEG::processKernel(KernelPatcher &patcher) {
+	WEG_TRACE_SCOPE(ProcessKernel, 0, true);
+
 	// Correct GPU properties
 	auto devInfo = DeviceInfo::create();
 	if (devInfo) {
@@ -129,11 +145,11 @@ void WEG::processKernel(KernelPatcher &patcher) {
 				processManagementEngineProperties(devInfo->managementEngine);
 		}
 
-		igfx.processKernel(patcher, devInfo);
-		ngfx.processKernel(patcher, devInfo);
-		rad.processKernel(patcher, devInfo);
-		shiki.processKernel(patcher, devInfo);
-		cdf.processKernel(patcher, devInfo);
+		WEG_TRACE_CALL(KernelIGFX, igfx.processKernel(patcher, devInfo));
+		WEG_TRACE_CALL(KernelNGFX, ngfx.processKernel(patcher, devInfo));
+		WEG_TRACE_CALL(KernelRAD, rad.processKernel(patcher, devInfo));
+		WEG_TRACE_CALL(KernelSHIKI, shiki.processKernel(patcher, devInfo));
+		WEG_TRACE_CALL(KernelCDF, cdf.processKernel(patcher, devInfo));
 
 		DeviceInfo::deleter(devInfo);
 	}
@@ -151,7 +167,7 @@ void WEG::processKernel(KernelPatcher &patcher) {
 
 	// We need to load vinfo for cleanup and copy.
 	if (resetFramebuffer == FB_COPY || resetFramebuffer == FB_ZEROFILL) {
-		auto info = reinterpret_cast<vc_info *>(patcher.solveSymbol(KernelPatcher::KernelID, "_vinfo"));
+		auto info = reinterpret_cast<FramebufferConsole::vc_info *>(WEG_TRACE_CALL(SolveSymbol, patcher.solveSymbol(KernelPatcher::KernelID, "_vinfo")));
 		if (info) {
 			consoleVinfo = *info;
 			DBGLOG("weg", "vinfo 1: %d:%d %d:%d:%d",
@@ -164,38 +180,106 @@ void WEG::processKernel(KernelPatcher &patcher) {
 			patcher.clearError();
 		}
 	}
+
+	// All the modules have decided on the kexts they need by now.
+	buildKextHandlers();
+}
+
+void WEG::buildKextHandlers() {
+	KernelPatcher::KextInfo *list[MaxKextHandlers];
+	kextHandlerNum = 0;
+
+	list[0] = &kextIOGraphics;
+	list[1] = &kextAGDPolicy;
+	addKextHandlers(list, 2, KextOwner::WEG);
+	addKextHandlers(list, igfx.getKexts(list, MaxKextHandlers), KextOwner::IGFX);
+	addKextHandlers(list, ngfx.getKexts(list, MaxKextHandlers), KextOwner::NGFX);
+	addKextHandlers(list, rad.getKexts(list, MaxKextHandlers), KextOwner::RAD);
+	addKextHandlers(list, cdf.getKexts(list, MaxKextHandlers), KextOwner::CDF);
+
+	DBGLOG("weg", "kext dispatch table has %lu entries", kextHandlerNum);
+}
+
+void WEG::addKextHandlers(KernelPatcher::KextInfo **list, size_t num, KextOwner owner) {
+	for (size_t i = 0; i < num; i++) {
+		// Switched off kexts are never loaded, do not waste time on them.
+		if (list[i]->sys[KernelPatcher::KextInfo::Disabled])
+			continue;
+
+		if (kextHandlerNum < MaxKextHandlers)
+			kextHandlers[kextHandlerNum++] = {list[i], owner};
+		else
+			SYSLOG("weg", "kext dispatch table overflow on %s", list[i]->id);
+	}
 }
 
 void WEG::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-	if (kextIOGraphics.loadIndex == index) {
-		gIOFBVerboseBootPtr = patcher.solveSymbol<uint8_t *>(index, "__ZL16gIOFBVerboseBoot", address, size);
-		if (gIOFBVerboseBootPtr) {
-			KernelPatcher::RouteRequest request("__ZN13IOFramebuffer6initFBEv", wrapFramebufferInit, orgFramebufferInit);
-			patcher.routeMultiple(index, &request, 1, address, size);
-		} else {
-			SYSLOG("rad", "failed to resolve gIOFBVerboseBoot");
-			patcher.clearError();
+	// Load indices are only assigned by Lilu once the kext is loaded, so they cannot be used
+	// as table keys at registration time. Instead we probe a compact table of enabled kexts.
+	KextHandler *handler = nullptr;
+	for (size_t i = 0; i < kextHandlerNum; i++) {
+		if (kextHandlers[i].info->loadIndex == index) {
+			handler = &kextHandlers[i];
+			break;
 		}
+	}
 
+	if (!handler) {
+		kextLoadsIgnored++;
 		return;
 	}
 
-	if (kextAGDPolicy.loadIndex == index) {
-		processGraphicsPolicyMods(patcher, address, size);
-		return;
+	kextLoadsDispatched++;
+	DBGLOG("weg", "dispatching %s, %lu dispatched %lu ignored", handler->info->id, kextLoadsDispatched, kextLoadsIgnored);
+
+	// Only dispatched loads are traced, ignored ones are too cheap to matter.
+	WEG_TRACE_SCOPE(ProcessKext, static_cast<uint32_t>(index), true);
+
+	// Handlers only schedule their routes, which are then applied in one pass.
+	RoutePlan plan(index, address, size);
+
+	switch (handler->owner) {
+		case KextOwner::WEG:
+			WEG_TRACE_CALL(KextWEG, processOwnKext(patcher, plan, index, address, size));
+			break;
+		case KextOwner::IGFX:
+			WEG_TRACE_CALL(KextIGFX, igfx.processKext(patcher, plan, index, address, size));
+			break;
+		case KextOwner::NGFX:
+			WEG_TRACE_CALL(KextNGFX, ngfx.processKext(patcher, plan, index, address, size));
+			break;
+		case KextOwner::RAD:
+			WEG_TRACE_CALL(KextRAD, rad.processKext(patcher, plan, index, address, size));
+			break;
+		case KextOwner::CDF:
+			WEG_TRACE_CALL(KextCDF, cdf.processKext(patcher, plan, index, address, size));
+			break;
 	}
 
-	if (igfx.processKext(patcher, index, address, size))
-		return;
+	plan.apply(patcher);
 
-	if (ngfx.processKext(patcher, index, address, size))
-		return;
+	// The cache is written once, right after the last enabled kext or once kext loading settles otherwise.
+	if (kextLoadsDispatched >= kextHandlerNum)
+		SymbolCache::flush();
+	else
+		SymbolCache::scheduleFlush();
+}
 
-	if (rad.processKext(patcher, index, address, size))
-		return;
+void WEG::processOwnKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size) {
+	if (kextIOGraphics.loadIndex == index) {
+		gIOFBVerboseBootPtr = plan.solveSymbol<uint8_t *>(patcher, "__ZL16gIOFBVerboseBoot");
+		if (gIOFBVerboseBootPtr) {
+			plan.add("__ZN13IOFramebuffer6initFBEv", wrapFramebufferInit, orgFramebufferInit);
+		} else {
+			SYSLOG("rad", "failed to resolve gIOFBVerboseBoot");
+			patcher.clearError();
+		}
 
-	if (cdf.processKext(patcher, index, address, size))
 		return;
+	}
+
+	if (kextAGDPolicy.loadIndex == index)
+		processGraphicsPolicyMods(patcher, plan, address, size);
 }
 
 void WEG::processBuiltinProperties(IORegistryEntry *device, DeviceInfo *info) {
@@ -239,6 +323,8 @@ void WEG::processBuiltinProperties(IORegistryEntry *device, DeviceInfo *info) {
 					   bus, dev, fun, acpiDevice, fakeDevice);
 			}
 			if (fakeDevice != realDevice) {
+				if (!igpuDeviceIdCache.store(obj))
+					SYSLOG("weg", "failed to cache IGPU device-id");
 				if (KernelPatcher::routeVirtual(obj, WIOKit::PCIConfigOffset::ConfigRead16, wrapConfigRead16, &orgConfigRead16) &&
 					KernelPatcher::routeVirtual(obj, WIOKit::PCIConfigOffset::ConfigRead32, wrapConfigRead32, &orgConfigRead32))
 					DBGLOG("weg", "hooked configRead read methods!");
@@ -341,7 +427,7 @@ void WEG::processManagementEngineProperties(IORegistryEntry *imei) {
 	}
 }
 
-void WEG::processGraphicsPolicyMods(KernelPatcher &patcher, mach_vm_address_t address, size_t size) {
+void WEG::processGraphicsPolicyMods(KernelPatcher &patcher, RoutePlan &plan, mach_vm_address_t address, size_t size) {
 	if (graphicsDisplayPolicyMod & AGDP_VIT9696) {
 		uint8_t find[]    = {0xBA, 0x05, 0x00, 0x00, 0x00};
 		uint8_t replace[] = {0xBA, 0x00, 0x00, 0x00, 0x00};
@@ -349,11 +435,7 @@ void WEG::processGraphicsPolicyMods(KernelPatcher &patcher, mach_vm_address_t ad
 			&kextAGDPolicy, find, replace, sizeof(find), 1
 		};
 
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("weg", "failed to apply agdp vit9696's patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "agdp vit9696's patch");
 	}
 
 	if (graphicsDisplayPolicyMod & AGDP_PIKERA) {
@@ -364,16 +446,11 @@ void WEG::processGraphicsPolicyMods(KernelPatcher &patcher, mach_vm_address_t ad
 			sizeof("board-id"), 1
 		};
 
-		patcher.applyLookupPatch(&patch);
-		if (patcher.getError() != KernelPatcher::Error::NoError) {
-			SYSLOG("weg", "failed to apply agdp Piker-Alpha's patch %d", patcher.getError());
-			patcher.clearError();
-		}
+		plan.add(patch, "agdp Piker-Alpha's patch");
 	}
 
 	if (graphicsDisplayPolicyMod & AGDP_CFGMAP) {
-		KernelPatcher::RouteRequest request("__ZN25AppleGraphicsDevicePolicy5startEP9IOService", wrapGraphicsPolicyStart, orgGraphicsPolicyStart);
-		patcher.routeMultiple(kextAGDPolicy.loadIndex, &request, 1, address, size);
+		plan.add("__ZN25AppleGraphicsDevicePolicy5startEP9IOService", wrapGraphicsPolicyStart, orgGraphicsPolicyStart);
 	}
 }
 
@@ -415,33 +492,34 @@ bool WEG::isGraphicsPolicyModRequired(DeviceInfo *info) {
 }
 
 void WEG::wrapFramebufferInit(IOFramebuffer *fb) {
+	WEG_TRACE_SCOPE(FramebufferInit, 0, true);
+
 	bool backCopy = callbackWEG->gotConsoleVinfo && callbackWEG->resetFramebuffer == FB_COPY;
 	bool zeroFill  = callbackWEG->gotConsoleVinfo && callbackWEG->resetFramebuffer == FB_ZEROFILL;
 	auto &info = callbackWEG->consoleVinfo;
+	auto &backup = callbackWEG->consoleBackup;
 
 	// Copy back usually happens in a separate call to frameBufferInit
 	// Furthermore, v_baseaddr may not be available on subsequent calls, so we have to copy
 	if (backCopy && info.v_baseaddr) {
-		// Note, this buffer is left allocated and never freed, yet there actually is no way to free it.
-		callbackWEG->consoleBuffer = Buffer::create<uint8_t>(info.v_rowbytes * info.v_height);
-		if (callbackWEG->consoleBuffer)
-			lilu_os_memcpy(callbackWEG->consoleBuffer, reinterpret_cast<uint8_t *>(info.v_baseaddr), info.v_rowbytes * info.v_height);
-		else
-			SYSLOG("weg", "console buffer allocation failure");
+		FramebufferConsole::save(backup, info);
 		// Even if we may succeed next time, it will be unreasonably dangerous
 		info.v_baseaddr = 0;
 	}
 
 	uint8_t verboseBoot = *callbackWEG->gIOFBVerboseBootPtr;
 	// For back copy we need a console buffer and no verbose
-	backCopy = backCopy && callbackWEG->consoleBuffer && !verboseBoot;
+	backCopy = backCopy && backup.valid && !verboseBoot;
+	// A freed backcopy only stays on the framebuffer and mode it was restored to, everything else is reset as usual.
+	bool restoredHere = callbackWEG->restoredFramebuffer == fb && !verboseBoot;
 
 	// Now check if the resolution and parameters match
-	if (backCopy || zeroFill) {
-		IODisplayModeID mode;
-		IOIndex depth;
-		IOPixelInformation pixelInfo;
-
+	IODisplayModeID mode {};
+	IOIndex depth {};
+	IOPixelInformation pixelInfo {};
+	FramebufferCopy::PixelFormat scaledFormat {};
+	bool scaledCopy = false;
+	if (backCopy || zeroFill || restoredHere) {
 		if (fb->getCurrentDisplayMode(&mode, &depth) == kIOReturnSuccess &&
 			fb->getPixelInformation(mode, depth, kIOFBSystemAperture, &pixelInfo) == kIOReturnSuccess) {
 			DBGLOG("weg", "fb info 1: %d:%d %d:%d:%d",
@@ -449,73 +527,56 @@ void WEG::wrapFramebufferInit(IOFramebuffer *fb) {
 			DBGLOG("weg", "fb info 2: %d:%d %s %d:%d:%d",
 				   pixelInfo.componentCount, pixelInfo.bitsPerComponent, pixelInfo.pixelFormat, pixelInfo.flags, pixelInfo.activeWidth, pixelInfo.activeHeight);
 
+			restoredHere = restoredHere && mode == callbackWEG->restoredMode && depth == callbackWEG->restoredDepth;
+
 			if (info.v_rowbytes != pixelInfo.bytesPerRow || info.v_width != pixelInfo.activeWidth ||
 				info.v_height != pixelInfo.activeHeight || info.v_depth != pixelInfo.bitsPerPixel) {
-				backCopy = zeroFill = false;
-				DBGLOG("weg", "this display has different mode");
+				// The saved image can still be resampled and converted to the new mode.
+				scaledCopy = backCopy && FramebufferConsole::getScaledFormat(backup, pixelInfo, scaledFormat);
+				backCopy = scaledCopy;
+				zeroFill = false;
+				DBGLOG("weg", "this display has different mode, scaled copy %d", scaledCopy);
 			}
 		} else {
 			DBGLOG("weg", "failed to obtain display mode");
-			backCopy = zeroFill = false;
+			backCopy = zeroFill = restoredHere = false;
 		}
 	}
 
 	// For whatever reason not resetting Intel framebuffer (back copy mode) twice works better.
-	if (!backCopy) *callbackWEG->gIOFBVerboseBootPtr = 1;
+	bool keepScreen = backCopy || restoredHere;
+	if (!keepScreen) *callbackWEG->gIOFBVerboseBootPtr = 1;
 	FunctionCast(wrapFramebufferInit, callbackWEG->orgFramebufferInit)(fb);
-	if (!backCopy) *callbackWEG->gIOFBVerboseBootPtr = verboseBoot;
+	if (!keepScreen) *callbackWEG->gIOFBVerboseBootPtr = verboseBoot;
 
 	// Finish the framebuffer initialisation by filling with black or copying the image back.
 	if (FramebufferViewer::getVramMap(fb)) {
-		auto src = reinterpret_cast<uint8_t *>(callbackWEG->consoleBuffer);
 		auto dst = reinterpret_cast<uint8_t *>(FramebufferViewer::getVramMap(fb)->getVirtualAddress());
 		if (backCopy) {
 			DBGLOG("weg", "attempting to copy...");
 			// Here you can actually draw at your will, but looks like only on Intel.
 			// On AMD you technically can draw too, but it happens for a very short while, and is not worth it.
-			lilu_os_memcpy(dst, src, info.v_rowbytes * info.v_height);
+			if (scaledCopy)
+				FramebufferConsole::restoreScaled(backup, info, dst, pixelInfo, scaledFormat);
+			else
+				FramebufferConsole::restore(backup, info, dst);
+			callbackWEG->restoredFramebuffer = fb;
+			callbackWEG->restoredMode = mode;
+			callbackWEG->restoredDepth = depth;
 		} else if (zeroFill) {
 			// On AMD we do a zero-fill to ensure no visual glitches.
 			DBGLOG("weg", "doing zero-fill...");
-			memset(dst, 0, info.v_rowbytes * info.v_height);
+			FramebufferCopy::fill(dst, 0, info.v_rowbytes * info.v_height);
 		}
 	}
 }
 
 uint16_t WEG::wrapConfigRead16(IORegistryEntry *service, uint32_t space, uint8_t offset) {
-	auto result = callbackWEG->orgConfigRead16(service, space, offset);
-	if (offset == WIOKit::kIOPCIConfigDeviceID && service != nullptr) {
-		auto name = service->getName();
-		if (name && name[0] == 'I' && name[1] == 'G' && name[2] == 'P' && name[3] == 'U') {
-			DBGLOG("weg", "configRead16 IGPU 0x%08X at off 0x%02X, result = 0x%04x", space, offset, result);
-			uint32_t device;
-			if (WIOKit::getOSDataValue(service, "device-id", device) && device != result) {
-				DBGLOG("weg", "configRead16 IGPU reported 0x%04x instead of 0x%04x", device, result);
-				return device;
-			}
-		}
-	}
-
-	return result;
+	return callbackWEG->igpuDeviceIdCache.read16(service, space, offset, callbackWEG->orgConfigRead16);
 }
 
 uint32_t WEG::wrapConfigRead32(IORegistryEntry *service, uint32_t space, uint8_t offset) {
-	auto result = callbackWEG->orgConfigRead32(service, space, offset);
-	// According to lvs1974 unaligned reads may actually happen!
-	if ((offset == WIOKit::kIOPCIConfigDeviceID || offset == WIOKit::kIOPCIConfigVendorID) && service != nullptr) {
-		auto name = service->getName();
-		if (name && name[0] == 'I' && name[1] == 'G' && name[2] == 'P' && name[3] == 'U') {
-			DBGLOG("weg", "configRead32 IGPU 0x%08X at off 0x%02X, result = 0x%08X", space, offset, result);
-			uint32_t device;
-			if (WIOKit::getOSDataValue(service, "device-id", device) && device != (result & 0xFFFF)) {
-				device = (result & 0xFFFF) | (device << 16);
-				DBGLOG("weg", "configRead32 reported 0x%08x instead of 0x%08x", device, result);
-				return device;
-			}
-		}
-	}
-
-	return result;
+	return callbackWEG->igpuDeviceIdCache.read32(service, space, offset, callbackWEG->orgConfigRead32);
 }
 
 bool WEG::wrapGraphicsPolicyStart(IOService *that, IOService *provider) {
@@ -10,8 +10,11 @@
 
 #include <Headers/kern_iokit.hpp>
 #include <Headers/kern_devinfo.hpp>
+#include <IOKit/graphics/IOGraphicsTypes.h>
 
 #include "kern_cdf.hpp"
+#include "kern_devid.hpp"
+#include "kern_fbconsole.hpp"
 #include "kern_igfx.hpp"
 #include "kern_ngfx.hpp"
 #include "kern_rad.hpp"
@@ -55,6 +58,57 @@ private:
 	 */
 	SHIKI shiki;
 
+	/**
+	 *  Kext handler owners
+	 */
+	enum class KextOwner {
+		WEG,
+		IGFX,
+		NGFX,
+		RAD,
+		CDF
+	};
+
+	/**
+	 *  Kext dispatch table entry
+	 */
+	struct KextHandler {
+		/**
+		 *  Handled kext
+		 */
+		KernelPatcher::KextInfo *info;
+
+		/**
+		 *  Module handling the kext
+		 */
+		KextOwner owner;
+	};
+
+	/**
+	 *  Maximum amount of handled kexts
+	 */
+	static constexpr size_t MaxKextHandlers {32};
+
+	/**
+	 *  Kext dispatch table, only contains enabled kexts
+	 */
+	KextHandler kextHandlers[MaxKextHandlers] {};
+
+	/**
+	 *  Amount of kext dispatch table entries
+	 */
+	size_t kextHandlerNum {0};
+
+	/**
+	 *  Amount of kext loads dispatched to the modules
+	 */
+	size_t kextLoadsDispatched {0};
+
+	/**
+	 *  Amount of kext loads not handled by any module
+	 */
+	size_t kextLoadsIgnored {0};
+
 	/**
 	 *  FB_DETECT   autodetects based on the installed GPU.
 	 *  FB_RESET    enforces -v like usual patch.
@@ -77,35 +131,21 @@ private:
 	uint32_t resetFramebuffer {FB_DETECT};
 
 	/**
-	 *  Console info structure, taken from osfmk/console/video_console.h
-	 *  Last updated from XNU 4570.1.46.
-	 */
-	struct vc_info {
-		unsigned int   v_height;        /* pixels */
-		unsigned int   v_width;         /* pixels */
-		unsigned int   v_depth;
-		unsigned int   v_rowbytes;
-		unsigned long  v_baseaddr;
-		unsigned int   v_type;
-		char           v_name[32];
-		uint64_t       v_physaddr;
-		unsigned int   v_rows;          /* characters */
-		unsigned int   v_columns;       /* characters */
-		unsigned int   v_rowscanbytes;  /* Actualy number of bytes used for display per row*/
-		unsigned int   v_scale;
-		unsigned int   v_rotate;
-		unsigned int   v_reserved[3];
-	};
+	 *  Loaded vinfo
+	 */
+	FramebufferConsole::vc_info consoleVinfo {};
 
 	/**
-	 *  Loaded vinfo
+	 *  Console backcopy
 	 */
-	vc_info consoleVinfo {};
+	FramebufferConsole::Backup consoleBackup {};
 
 	/**
-	 *  Console buffer backcopy
+	 *  Framebuffer and mode the backcopy was restored to before it was freed
 	 */
-	uint8_t *consoleBuffer {nullptr};
+	IOFramebuffer *restoredFramebuffer {nullptr};
+	IODisplayModeID restoredMode {0};
+	IOIndex restoredDepth {0};
 
 	/**
 	 *  Original IOGraphics framebuffer init handler
@@ -123,6 +163,11 @@ private:
 	WIOKit::t_PCIConfigRead16 orgConfigRead16 {nullptr};
 	WIOKit::t_PCIConfigRead32 orgConfigRead32 {nullptr};
 
+	/**
+	 *  Current IGPU device-id cache
+	 */
+	DeviceIdCache igpuDeviceIdCache {};
+
 	/**
 	 *  Original AppleGraphicsDevicePolicy start handler
 	 */
@@ -197,6 +242,31 @@ private:
 	 */
 	void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
+	/**
+	 *  Patch kexts handled by WEG itself
+	 *
+	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
+	 *  @param index   kinfo handle
+	 *  @param address kinfo load address
+	 *  @param size    kinfo memory size
+	 */
+	void processOwnKext(KernelPatcher &patcher, RoutePlan &plan, size_t index, mach_vm_address_t address, size_t size);
+
+	/**
+	 *  Build kext dispatch table once all the modules decided on their kexts
+	 */
+	void buildKextHandlers();
+
+	/**
+	 *  Append kexts owned by a module to the kext dispatch table
+	 *
+	 *  @param list   kext list
+	 *  @param num    amount of kexts in the list
+	 *  @param owner  owning module
+	 */
+	void addKextHandlers(KernelPatcher::KextInfo **list, size_t num, KextOwner owner);
+
 	/**
 	 *  Apply builtin GPU properties and renamings
 	 *
@@ -225,10 +295,11 @@ private:
 	 *  Apply AppleGraphicsDevicePolicy (AGDP) patches if any
 	 *
 	 *  @param patcher KernelPatcher instance
+	 *  @param plan    route plan of the kext
 	 *  @param address agdp load address
 	 *  @param size    agdp memory size
 	 */
-	void processGraphicsPolicyMods(KernelPatcher &patcher, mach_vm_address_t address, size_t size);
+	void processGraphicsPolicyMods(KernelPatcher &patcher, RoutePlan &plan, mach_vm_address_t address, size_t size);
 
 	/**
 	 *  Check whether the graphics policy modification patches are required